@@ -0,0 +1,85 @@
+#include "qc_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Thread scaling of the gate kernels: for each register size, time a layer of H gates on every
+// qubit and a layer of CNOTs chaining all the qubits, for 1, 2, 4, ... threads.
+// Usage: bench_scaling.elf [min_qubits] [max_qubits] [max_threads]
+// The default sizes (16 to 22 qubits, 64 MiB state vectors at most) fit any machine, larger ones are
+// given on the command line (or with make bench BENCH_ARGS="...")
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Build "G_0|G_1|...|G_n-1" for single qubit gates, or "CNOT_0_1|CNOT_1_2|..." for CNOTs
+static char *build_layer(int num_qubits, int cnot_chain) {
+    size_t capacity = (size_t)num_qubits * 16 + 1;
+    char *layer = malloc(capacity);
+    if (layer == NULL) {
+        return NULL;
+    }
+    size_t len = 0;
+    layer[0] = '\0';
+    int num_gates = cnot_chain ? num_qubits - 1 : num_qubits;
+    for (int q = 0; q < num_gates; q++) {
+        if (cnot_chain) {
+            len += snprintf(layer + len, capacity - len, "%sCNOT_%d_%d", q ? "|" : "", q, q + 1);
+        } else {
+            len += snprintf(layer + len, capacity - len, "%sH_%d", q ? "|" : "", q);
+        }
+    }
+    return layer;
+}
+
+static double time_layer(qreg *qr, const char *layer) {
+    double start = now_seconds();
+    circuit_layer(qr, layer);
+    return now_seconds() - start;
+}
+
+int main(int argc, char **argv) {
+    int min_qubits = (argc > 1) ? atoi(argv[1]) : 16;
+    int max_qubits = (argc > 2) ? atoi(argv[2]) : 22;
+    int max_threads = (argc > 3) ? atoi(argv[3]) : qc_get_num_threads();
+
+    printf("%8s %8s %12s %14s %14s %10s\n", "qubits", "threads", "seconds", "gates/s", "amplitudes/s", "speedup");
+    for (int n = min_qubits; n <= max_qubits; n++) {
+        qreg *qr = new_qreg(n);
+        if (qr == NULL) {
+            printf("%8d skipped: %s (%llu bytes)\n", n, qc_status_string(qc_last_status()), (unsigned long long)qc_qreg_bytes(n));
+            continue;
+        }
+        char *h_layer = build_layer(n, 0);
+        char *cnot_layer = build_layer(n, 1);
+        if (h_layer == NULL || cnot_layer == NULL) {
+            fprintf(stderr, "Error allocating benchmark layers\n");
+            return 1;
+        }
+
+        double serial_seconds = 0.0;
+        for (int threads = 1; ; threads = (threads * 2 > max_threads && threads < max_threads) ? max_threads : threads * 2) {
+            qc_set_num_threads(threads);
+            double seconds = time_layer(qr, h_layer) + time_layer(qr, cnot_layer);
+            int num_gates = 2 * n - 1;
+            if (threads == 1) {
+                serial_seconds = seconds;
+            }
+            printf("%8d %8d %12.4f %14.0f %14.3e %10.2f\n", n, threads, seconds, num_gates / seconds,
+                   (double)num_gates * (double)(1ULL << n) / seconds, serial_seconds / seconds);
+            if (threads >= max_threads) {
+                break;
+            }
+        }
+
+        free(h_layer);
+        free(cnot_layer);
+        free_qreg(qr);
+    }
+    qc_set_num_threads(0);
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include "qc_lib.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Standard circuits (GHZ, QFT, Grover, random layers) compiled once and run for every register size
+// and thread count, reported as CSV so results can be stored & compared across library versions.
+// Usage: bench_suite.elf [min_qubits] [max_qubits] [max_threads] [repetitions]
+//
+// gates counts the gates of the layer strings, passes the sweeps over the state vector the compiled
+// circuit needs (after merging diagonal gates); GB/s assumes every pass reads & writes the whole vector.
+
+#define RANDOM_DEPTH 10
+#define GROVER_ITERATIONS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // ru_maxrss is in KiB on Linux
+}
+
+// Growing list of layer strings, each one built gate by gate
+typedef struct layer_list {
+    char **layers;
+    int count, capacity;
+    int num_gates;
+} layer_list;
+
+static void new_layer(layer_list *list) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 64;
+        list->layers = realloc(list->layers, list->capacity * sizeof(char *));
+        if (list->layers == NULL) {
+            fprintf(stderr, "Error allocating benchmark layers\n");
+            exit(1);
+        }
+    }
+    list->layers[list->count++] = NULL;
+}
+
+static void add_gate(layer_list *list, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void add_gate(layer_list *list, const char *format, ...) {
+    char gate[64 + 4 * QUBIT_REGISTER_LIMIT];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(gate, sizeof(gate), format, args);
+    va_end(args);
+
+    char **layer = &list->layers[list->count - 1];
+    size_t old_len = (*layer != NULL) ? strlen(*layer) : 0;
+    char *grown = realloc(*layer, old_len + strlen(gate) + 2);
+    if (grown == NULL) {
+        fprintf(stderr, "Error allocating benchmark layers\n");
+        exit(1);
+    }
+    sprintf(grown + old_len, "%s%s", old_len ? "|" : "", gate);
+    *layer = grown;
+    list->num_gates++;
+}
+
+static void free_layers(layer_list *list) {
+    for (int l = 0; l < list->count; l++) {
+        free(list->layers[l]);
+    }
+    free(list->layers);
+}
+
+static void build_ghz(layer_list *list, int n) {
+    new_layer(list);
+    add_gate(list, "H_0");
+    for (int q = 0; q + 1 < n; q++) {
+        new_layer(list);
+        add_gate(list, "CNOT_%d_%d", q, q + 1);
+    }
+}
+
+static void build_qft(layer_list *list, int n) {
+    for (int j = n - 1; j >= 0; j--) {
+        new_layer(list);
+        add_gate(list, "H_%d", j);
+        for (int k = j - 1; k >= 0; k--) {
+            new_layer(list);
+            add_gate(list, "MCP_%d_%d_%.17g", k, j, M_PI / (double)(1ULL << (j - k)));
+        }
+    }
+    new_layer(list);
+    for (int q = 0; q < n / 2; q++) {
+        add_gate(list, "SWP_%d_%d", q, n - 1 - q);
+    }
+}
+
+// Multi-controlled Z over all the qubits, as an MCZ with the last qubit as target
+static void add_mcz_all(layer_list *list, int n) {
+    char gate[64 + 4 * QUBIT_REGISTER_LIMIT];
+    int len = snprintf(gate, sizeof(gate), "MCZ");
+    for (int q = 0; q < n; q++) {
+        len += snprintf(gate + len, sizeof(gate) - len, "_%d", q);
+    }
+    add_gate(list, "%s", gate);
+}
+
+static void add_all(layer_list *list, int n, const char *gate) {
+    new_layer(list);
+    for (int q = 0; q < n; q++) {
+        add_gate(list, "%s_%d", gate, q);
+    }
+}
+
+// Grover iterations searching for |11...1>
+static void build_grover(layer_list *list, int n) {
+    add_all(list, n, "H");
+    for (int it = 0; it < GROVER_ITERATIONS; it++) {
+        new_layer(list);
+        add_mcz_all(list, n);
+        add_all(list, n, "H");
+        add_all(list, n, "X");
+        new_layer(list);
+        add_mcz_all(list, n);
+        add_all(list, n, "X");
+        add_all(list, n, "H");
+    }
+}
+
+// Layers of random rotations on every qubit followed by CNOTs between random disjoint pairs
+static void build_random(layer_list *list, int n) {
+    static const char *rotations[] = {"RX", "RY", "RZ"};
+    unsigned seed = 12345;
+    int order[QUBIT_REGISTER_LIMIT];
+
+    for (int d = 0; d < RANDOM_DEPTH; d++) {
+        new_layer(list);
+        for (int q = 0; q < n; q++) {
+            add_gate(list, "%s_%d_%.6f", rotations[rand_r(&seed) % 3], q, 2 * M_PI * rand_r(&seed) / RAND_MAX);
+        }
+        for (int q = 0; q < n; q++) {
+            order[q] = q;
+        }
+        for (int q = n - 1; q > 0; q--) {
+            int r = rand_r(&seed) % (q + 1);
+            int tmp = order[q];
+            order[q] = order[r];
+            order[r] = tmp;
+        }
+        new_layer(list);
+        for (int q = 0; q + 1 < n; q += 2) {
+            add_gate(list, "CNOT_%d_%d", order[q], order[q + 1]);
+        }
+    }
+}
+
+typedef struct benchmark {
+    const char *name;
+    void (*build)(layer_list *list, int n);
+} benchmark;
+
+static const benchmark benchmarks[] = {
+    {"ghz", build_ghz},
+    {"qft", build_qft},
+    {"grover", build_grover},
+    {"random", build_random},
+};
+
+int main(int argc, char **argv) {
+    int min_qubits = (argc > 1) ? atoi(argv[1]) : 16;
+    int max_qubits = (argc > 2) ? atoi(argv[2]) : 22;
+    int max_threads = (argc > 3) ? atoi(argv[3]) : qc_get_num_threads();
+    int repetitions = (argc > 4) ? atoi(argv[4]) : 3;
+    if (min_qubits < 2 || max_qubits > QUBIT_REGISTER_LIMIT || max_threads < 1 || repetitions < 1) {
+        fprintf(stderr, "Usage: %s [min_qubits >= 2] [max_qubits <= %d] [max_threads] [repetitions]\n", argv[0], QUBIT_REGISTER_LIMIT);
+        return 1;
+    }
+
+    printf("circuit,qubits,threads,gates,passes,seconds,gates_per_s,amplitudes_per_s,gb_per_s,peak_rss_mb\n");
+    for (int n = min_qubits; n <= max_qubits; n++) {
+        qreg *qr = new_qreg(n);
+        if (qr == NULL) {
+            fprintf(stderr, "%d qubits skipped: %s (%llu bytes)\n", n, qc_status_string(qc_last_status()), (unsigned long long)qc_qreg_bytes(n));
+            continue;
+        }
+        double state_bytes = (double)qc_qreg_bytes(n);
+
+        for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+            layer_list list = {0};
+            benchmarks[b].build(&list, n);
+            qcircuit *circuit = qc_compile((const char **)list.layers, list.count);
+            if (circuit == NULL) {
+                fprintf(stderr, "Error compiling the %s circuit: %s\n", benchmarks[b].name, qc_status_string(qc_last_status()));
+                return 1;
+            }
+            int passes = qc_circuit_num_gates(circuit);
+
+            for (int threads = 1; ; threads = (threads * 2 > max_threads && threads < max_threads) ? max_threads : threads * 2) {
+                qc_set_num_threads(threads);
+
+                // Best of the repetitions, the state keeps evolving but that doesn't change the work done
+                double best = INFINITY;
+                for (int r = 0; r < repetitions; r++) {
+                    double start = now_seconds();
+                    qc_run(circuit, qr);
+                    double seconds = now_seconds() - start;
+                    best = (seconds < best) ? seconds : best;
+                }
+                printf("%s,%d,%d,%d,%d,%.6f,%.0f,%.4e,%.3f,%.1f\n", benchmarks[b].name, n, threads, list.num_gates, passes, best,
+                       list.num_gates / best, (double)list.num_gates * (double)(1ULL << n) / best,
+                       2.0 * passes * state_bytes / best / 1e9, peak_rss_mb());
+                fflush(stdout);
+                if (threads >= max_threads) {
+                    break;
+                }
+            }
+
+            qc_free_circuit(circuit);
+            free_layers(&list);
+        }
+        free_qreg(qr);
+    }
+    qc_set_num_threads(0);
+    return 0;
+}
@@ -1,11 +1,34 @@
 #ifndef QC_LIB_H // Include guard 
 #define QC_LIB_H
 
+#include <stdint.h>
+
 // Public API
-#define QUBIT_REGISTER_LIMIT 12
+#define QUBIT_REGISTER_LIMIT 34
+
+// Status codes reported by the library, see qc_last_status()
+typedef enum qc_status {
+    QC_OK = 0,
+    QC_ERR_INVALID_ARGUMENT,   // NULL pointer, negative size, out of range qubit, ...
+    QC_ERR_TOO_MANY_QUBITS,    // Register larger than QUBIT_REGISTER_LIMIT (or than the dense engine supports)
+    QC_ERR_OUT_OF_MEMORY,      // The state vector does not fit in this machine's memory, or an allocation failed
+    QC_ERR_IO,                 // A file could not be read or written, or is not a valid checkpoint
+} qc_status;
+
+// Amplitude precision, chosen at build time: compiling with QC_SINGLE_PRECISION ("make PRECISION=single")
+// stores amplitudes as 2 floats, halving the memory & bandwidth of every state vector (one more qubit
+// for the same memory). QC_AMPLITUDE_TOLERANCE is the accuracy to expect from amplitudes computed
+// at that precision.
+#ifdef QC_SINGLE_PRECISION
+typedef float qc_real;
+#define QC_AMPLITUDE_TOLERANCE 1e-4
+#else
+typedef double qc_real;
+#define QC_AMPLITUDE_TOLERANCE 1e-9
+#endif
 
 typedef struct complex_number {
-    double re, im; 
+    qc_real re, im;
 } cnum;
 
 typedef struct quantum_register {
@@ -14,11 +37,257 @@ typedef struct quantum_register {
     // State vector
     cnum *amp; /* 2^size number of amplitudes, dynamically allocated & freed,
      corresponding to the probability of the register being in a particular state */
+
+    uint64_t mapped_bytes; // Set by the library: non-zero when amp is memory mapped from a checkpoint file
+    struct sparse_state *sparse; // Set by the library: non-NULL (and amp NULL) while the register is stored sparsely
+    struct stabilizer_tableau *tableau; // Set by the library: non-NULL (and amp NULL) while the register is a stabilizer tableau
+    struct mps_state *mps; // Set by the library: non-NULL (and amp NULL) while the register is a matrix product state
+    cnum *back_buffer; // Set by the library: the dense engine's second state vector, kept between layers (NULL until used)
 } qreg;
 
+// Number of bytes needed by the state vector of a register of `size` qubits (0 if size is out of range)
+uint64_t qc_qreg_bytes(int size);
+
+// Returns NULL when the register cannot be created, qc_last_status() tells why
 qreg *new_qreg(int size);
 void free_qreg(qreg *qr);
-void circuit_layer(qreg *qr, const char *operations);
+void circuit_layer(qreg *qr, const char *operations); // qc_last_status() tells whether the layer was applied
 void view_state_vector(qreg *qr);
 
+// Sparse storage
+// A sparse register only stores its non-zero amplitudes (a hash map from basis state index to amplitude),
+// so circuits keeping few basis states in superposition (reversible logic, basis state oracles, ...) can
+// run on up to SPARSE_QUBIT_LIMIT qubits, at a cost per gate proportional to the number of stored
+// amplitudes. A sparse register within QUBIT_REGISTER_LIMIT is converted to dense storage automatically
+// once more than 1/8 of its amplitudes are non-zero. amp is NULL while a register is sparse:
+// qc_get_amplitude() reads amplitudes from either storage.
+//
+// A stabilizer register stores a stabilizer tableau instead of amplitudes: O(size^2) bits, with Clifford
+// gates (H, S, X, Y, Z, CNOT, CZ, SWP, and any gate or merged layer equivalent to them) and measurements
+// in polynomial time, so error correction style circuits can use up to STABILIZER_QUBIT_LIMIT qubits.
+// The first other gate turns it into a sparse register, holding exactly the state a dense register
+// would (only possible up to SPARSE_QUBIT_LIMIT qubits; larger registers reject such gates). After very
+// long Clifford circuits (about 10^4 gates) the state is rebuilt from the stabilizers instead of
+// replaying the gates, and only matches a dense run up to a global phase.
+// qc_pauli_expectations & qc_measure_qubit work on the tableau, and view_state_vector prints its
+// stabilizer generators; amplitudes are only available after qc_to_dense().
+// The tableau is opt-in, as registers created by new_qreg keep their state vector: QC_STORAGE_AUTO
+// picks the cheapest storage as the gates come, starting as a stabilizer register, which becomes a sparse
+// register at the first non-Clifford gate, then a dense one once it fills up (up to SPARSE_QUBIT_LIMIT
+// qubits). It suits circuits that aren't known in advance (qc_run_qasm takes it too);
+// qc_circuit_is_clifford tells whether a whole compiled circuit can stay on a tableau.
+//
+// A matrix product state (MPS) register stores one tensor per qubit, linked in a chain by bonds whose
+// dimension grows with the entanglement between the two sides: shallow or 1D-local circuits over
+// hundreds of qubits fit in little memory, with gates costing O(bond^3). Gates on qubits that aren't
+// neighbours in the chain are routed with internal swaps, transparently. After every multi-qubit gate
+// the bonds are truncated: the smallest singular values are dropped while their total weight (relative
+// to the state's norm) stays within truncation_threshold, and at most max_bond_dimension are kept;
+// qc_set_mps_limits changes both for the following gates. The state is exact as long as
+// qc_get_mps_info reports no discarded weight. Amplitudes, samples, measurements & Pauli expectation
+// values are computed from the tensors; qc_get_amplitude_bits & qc_sample_bits cover registers of
+// more than 64 qubits.
+#define SPARSE_QUBIT_LIMIT 63
+#define STABILIZER_QUBIT_LIMIT 16384
+#define MPS_QUBIT_LIMIT 4096
+#define MPS_DEFAULT_MAX_BOND_DIMENSION 64
+#define MPS_DEFAULT_TRUNCATION_THRESHOLD 1e-12
+
+typedef enum qc_storage {
+    QC_STORAGE_DENSE = 0, // Full 2^size state vector, as created by new_qreg()
+    QC_STORAGE_SPARSE,
+    QC_STORAGE_STABILIZER,
+    QC_STORAGE_MPS,
+    QC_STORAGE_AUTO,      // Only for creating registers: stabilizer, then sparse, then dense storage as needed
+} qc_storage;
+
+qreg *new_qreg_with_storage(int size, qc_storage storage); // NULL on error, see qc_last_status()
+qc_storage qc_get_storage(const qreg *qr);
+uint64_t qc_num_stored_amplitudes(const qreg *qr); // 2^size for dense registers, tensor entries for MPS ones, 0 for stabilizer ones
+cnum qc_get_amplitude(const qreg *qr, uint64_t index); // 0 for stabilizer registers (qubits past 63 are 0 in index)
+cnum qc_get_amplitude_bits(const qreg *qr, const uint8_t *bits); // Basis state given by one 0/1 value per qubit
+qc_status qc_to_dense(qreg *qr); // No-op for dense registers
+qc_status qc_set_mps_limits(qreg *qr, int max_bond_dimension, double truncation_threshold);
+qc_status qc_get_mps_info(const qreg *qr, int *bond_dimension, double *discarded_weight); // Largest bond, total weight truncated so far
+
+// Compiled circuits
+// A circuit is compiled once from its layer strings (same syntax as circuit_layer), and can then be run
+// any number of times on any register with enough qubits, without parsing or allocating anything.
+typedef struct quantum_circuit qcircuit;
+
+qcircuit *qc_compile(const char *layers[], int num_layers); // NULL on error, see qc_last_status()
+qc_status qc_run(const qcircuit *circuit, qreg *qr);
+void qc_free_circuit(qcircuit *circuit);
+int qc_circuit_num_gates(const qcircuit *circuit);
+int qc_circuit_is_clifford(const qcircuit *circuit); // 1 if every gate is a Clifford (no parameters), 0 otherwise
+
+// Gate fusion: returns a new circuit where consecutive gates acting on at most max_qubits qubits (2 to 5)
+// are merged into single dense gates, so each block costs one pass over the state vector instead of one
+// per gate. passes_saved (if not NULL) receives how many state vector passes were removed.
+qcircuit *qc_fuse(const qcircuit *circuit, int max_qubits, int *passes_saved);
+
+// Parameter sweeps
+// The angle of an RX, RY, RZ or P gate can be a placeholder: "$" followed by letters and a parameter
+// index, like "RX_0_$theta3" (parameter 3). Circuits with placeholders are compiled once and only run
+// on batch registers; circuit_layer, qc_run, qc_run_noisy & qc_fuse reject them.
+// A batch register holds batch_size independent states of `size` qubits, stored interleaved
+// (amplitude i of every state next to each other), so each gate is a single sweep updating all of
+// them: index arithmetic & parsing are shared by the whole batch, and the SIMD lanes stay full even
+// for small registers. The batch is padded to a power of two, and size + log2(padded batch) must be
+// at most QUBIT_REGISTER_LIMIT. qc_run_batch runs a circuit on every state, state b binding parameter
+// p to params[b * num_params + p] (params can be NULL without parameters); noise channels are ignored.
+typedef struct batch_register qbatch;
+
+qbatch *new_qbatch(int size, int batch_size); // Every state |0...0>, NULL on error, see qc_last_status()
+void free_qbatch(qbatch *qb);
+qc_status qc_batch_reset(qbatch *qb); // Back to |0...0>
+int qc_circuit_num_params(const qcircuit *circuit);
+qc_status qc_run_batch(const qcircuit *circuit, qbatch *qb, const double *params);
+cnum qc_batch_get_amplitude(const qbatch *qb, int b, uint64_t index);
+// Copy state b into a dense register of the same size, for measurements & expectation values
+qc_status qc_batch_get_state(const qbatch *qb, int b, qreg *qr);
+
+// Gradients
+// qc_adjoint_gradient runs a (parametric) circuit from |0...0> on num_qubits qubits with one row of
+// parameters, and computes the energy <psi|H|psi> of H = sum_t coeffs[t] P_t (Pauli strings as in
+// qc_pauli_expectations) with its derivative with respect to every parameter in gradient[p] (summed
+// over the gates sharing parameter p). Adjoint differentiation: one forward pass, then one backward
+// pass undoing the gates on psi and on H psi, with one extra sweep per parametric gate: three state
+// vectors in all, whatever the number of parameters. energy can be NULL; noise channels are ignored.
+qc_status qc_adjoint_gradient(const qcircuit *circuit, int num_qubits, const double *params, const char *const paulis[],
+                              const double *coeffs, int num_terms, double *energy, double *gradient);
+
+// OpenQASM 2.0
+// qc_run_qasm runs an OpenQASM 2.0 file on a new register holding all its qregs (concatenated in
+// declaration order, qubit 0 being the first qubit of the first qreg). The file is memory mapped and
+// every statement is applied as soon as it is read, without building a circuit, so files of any
+// length run in constant memory. Supported: qreg & creg, include "qelib1.inc", the qelib1 gates (id,
+// x, y, z, h, s, sdg, t, tdg, sx, rx, ry, rz, p, u1, u2, u3, u, U, cx, CX, cy, cz, ch, crx, cry, crz,
+// cu1, cp, cu3, swap, rzz, ccx, cswap) with whole registers broadcast, barrier, which ends a layer
+// (diagonal gates are merged within a layer), and measure, each measurement drawing its own result
+// from rng_seed. Results go to clbits (one byte per bit, cregs concatenated like the qregs, can be
+// NULL), which must hold max_clbits. gate, opaque, if & reset are rejected.
+qreg *qc_run_qasm(const char *path, qc_storage storage, uint64_t rng_seed, uint8_t *clbits, int max_clbits); // NULL on error
+
+// Multi-controlled gates, equivalent to the "MCX_c1_..._t", "MCZ_c1_..._t" and "MCP_c1_..._t_angle"
+// layer operations: the gate is applied to the target only where all the control qubits are 1
+void qc_mcx(qreg *qr, const int *controls, int num_controls, int target);
+void qc_mcz(qreg *qr, const int *controls, int num_controls, int target);
+void qc_mcp(qreg *qr, const int *controls, int num_controls, int target, double angle);
+
+// Measurement
+// qc_measure_all draws `shots` samples of the whole register (each one a basis state index, qubit q
+// being bit q) into out, without changing the state. The same seed always gives the same samples.
+// qc_measure_qubit measures a single qubit: the state collapses onto the result, which is returned
+// (0 or 1, -1 on error), and is renormalized. qc_sample_bits draws the same samples with one byte per
+// qubit (qubit q of shot s in out[s * size + q]), for registers too large for 64 bit indices.
+qc_status qc_measure_all(const qreg *qr, uint64_t shots, uint64_t rng_seed, uint64_t *out);
+qc_status qc_sample_bits(const qreg *qr, uint64_t shots, uint64_t rng_seed, uint8_t *out);
+
+// Noise
+// Channels are attached to the gates of a compiled circuit (gate indices as counted by
+// qc_circuit_num_gates, or QC_ALL_GATES) and act on every qubit of the gate, right after it:
+//  - QC_CHANNEL_DEPOLARIZING: X, Y or Z, each with probability p / 3
+//  - QC_CHANNEL_AMPLITUDE_DAMPING: decay of |1> towards |0>, with probability p
+// Noise is simulated with Monte-Carlo trajectories instead of a density matrix (which would need 4^size
+// entries): qc_run_noisy runs one trajectory on a state vector register, picking one Kraus operator
+// of each channel with its probability on the current state, and averages over many trajectories
+// converge to the density matrix results. qc_run ignores the channels, and qc_fuse drops them (attach
+// them to the fused circuit instead).
+// qc_run_trajectories runs `trajectories` trajectories from |0...0> in parallel (each thread reusing
+// one register), draws shots_per_trajectory samples from each, flips every sampled bit with probability
+// readout_error, and counts the outcomes in counts (2^num_qubits entries, overwritten). Results only
+// depend on the seed, not on the number of threads.
+#define QC_ALL_GATES -1
+
+typedef enum qc_channel {
+    QC_CHANNEL_DEPOLARIZING,
+    QC_CHANNEL_AMPLITUDE_DAMPING,
+} qc_channel;
+
+qc_status qc_add_noise(qcircuit *circuit, int gate, qc_channel channel, double probability);
+qc_status qc_run_noisy(const qcircuit *circuit, qreg *qr, uint64_t rng_seed);
+qc_status qc_run_trajectories(const qcircuit *circuit, int num_qubits, uint64_t trajectories, uint64_t shots_per_trajectory,
+                              double readout_error, uint64_t rng_seed, uint64_t *counts);
+int qc_measure_qubit(qreg *qr, int qubit, uint64_t rng_seed);
+
+// Expectation values
+// Pauli strings are written as space separated factors like "X0 Z3 Y5" (qubit indices as in layers,
+// identity factors "I2" allowed, "" being the identity). qc_pauli_expectations writes <psi|P|psi> of
+// every string to values; qc_hamiltonian_expectation writes sum_t coeffs[t] <psi|P_t|psi> to energy.
+// Terms flipping the same qubits (same X/Y positions) are evaluated together in one read-only pass.
+qc_status qc_pauli_expectations(const qreg *qr, const char *const paulis[], int num_terms, double *values);
+qc_status qc_hamiltonian_expectation(const qreg *qr, const char *const paulis[], const double *coeffs, int num_terms, double *energy);
+
+// Checkpoints
+// qc_save_state writes a register to a binary file (versioned header + raw amplitudes), replacing it
+// atomically once complete. qc_load_state maps such a file back as a new register: the amplitudes are
+// only read from disk when touched, and changes to the register never reach the file, so one prepared
+// state can seed many runs. Files are specific to the amplitude precision they were saved with.
+qc_status qc_save_state(const qreg *qr, const char *path);
+qreg *qc_load_state(const char *path); // NULL on error, see qc_last_status()
+
+// Status of the last library call that can fail on the calling thread
+qc_status qc_last_status(void);
+const char *qc_status_string(qc_status status);
+
+// Threading
+// Number of threads the gate kernels split the state vector across. Defaults to the QC_NUM_THREADS
+// environment variable, or to OpenMP's default (one per core); a value <= 0 restores the default.
+// Small registers are always simulated serially.
+void qc_set_num_threads(int num_threads);
+int qc_get_num_threads(void);
+
+// SIMD
+// Instruction sets the gate kernels can use. The widest one supported by the CPU is picked on first
+// use; qc_set_simd() can force a narrower one (returns -1 if the CPU doesn't support it).
+typedef enum qc_simd {
+    QC_SIMD_SCALAR = 0, // Portable C (SSE2 on x86-64)
+    QC_SIMD_AVX2,
+    QC_SIMD_AVX512,
+} qc_simd;
+
+qc_simd qc_get_simd(void);
+int qc_set_simd(qc_simd simd);
+
+// Instrumentation
+// Only recorded when the library is built with QC_STATS ("make STATS=1"); otherwise the hooks compile
+// to nothing and qc_get_stats() reports enabled = 0 with all counters at 0.
+typedef enum qc_phase {
+    QC_PHASE_PARSE,          // Parsing layer strings
+    QC_PHASE_LOWER,          // Turning parsed gates into instructions (qc_compile, qc_fuse)
+    QC_PHASE_KERNELS,        // In-place gate application
+    QC_PHASE_DENSE_EXPAND,   // Dense engine: expand_gate_matrix
+    QC_PHASE_DENSE_MULTIPLY, // Dense engine: multiply_matrices
+    QC_PHASE_DENSE_APPLY,    // Dense engine: apply_operator_to_state
+    QC_PHASE_OBSERVE,        // Measurement, sampling & expectation values
+    QC_PHASE_IO,             // Checkpoint save & load
+    QC_NUM_PHASES,
+} qc_phase;
+
+#define QC_STATS_MAX_GATE_TYPES 24
+
+typedef struct qc_stats {
+    int enabled;
+    double phase_seconds[QC_NUM_PHASES];   // Wall time spent in each phase
+    uint64_t phase_calls[QC_NUM_PHASES];
+    uint64_t bytes_allocated;              // State vectors, matrices, circuit pools & parsed gate lists
+    uint64_t allocations;                  // Heap blocks behind bytes_allocated
+    uint64_t state_sweeps;                 // Passes over a state vector
+    int num_gate_types;                    // Gates parsed, per type ("H", "CNOT", ...)
+    char gate_types[QC_STATS_MAX_GATE_TYPES][10];
+    uint64_t gate_counts[QC_STATS_MAX_GATE_TYPES];
+} qc_stats;
+
+void qc_get_stats(qc_stats *stats);
+void qc_reset_stats(void);
+const char *qc_phase_name(qc_phase phase);
+// Write every recorded phase as Chrome trace-event JSON (viewable in chrome://tracing or Perfetto)
+qc_status qc_write_trace(const char *path);
+
+// Debug API
+// Evaluate layers by building the full 2^n x 2^n operator (slow, only meant for cross-checking
+// the in-place engine on small registers). Disabled by default.
+void qc_use_dense_engine(int enabled);
+
 #endif // End of include guard
@@ -0,0 +1,98 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+// Layer scratch memory
+//
+// Everything a layer needs only while it is parsed & applied (gate nodes, qubit lists) is bumped out of
+// a per-thread chain of blocks. Releasing a mark rewinds the current block, so a whole layer is freed in
+// O(1) whatever its number of gates, and the blocks are kept for the next layer: once the arena has grown
+// to the largest layer seen, layers don't call malloc at all. Blocks past the first are given back when
+// the arena is released to empty while holding more than ARENA_RETAIN_BYTES (after compiling a long
+// circuit, say).
+
+#define ARENA_FIRST_BLOCK_BYTES (16 * 1024)
+#define ARENA_RETAIN_BYTES (1024 * 1024)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t capacity;  // Bytes of data
+    size_t used;
+    max_align_t data[];
+} arena_block;
+
+static _Thread_local arena_block *arena_first = NULL;
+static _Thread_local arena_block *arena_current = NULL;
+static _Thread_local size_t arena_bytes = 0;  // Capacity of all the blocks
+
+static arena_block *arena_new_block(size_t capacity) {
+    arena_block *block = malloc(sizeof(arena_block) + capacity);
+    if (block == NULL) {
+        return NULL;
+    }
+    STATS_ALLOC(sizeof(arena_block) + capacity);
+    arena_bytes += capacity;
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+void *arena_alloc(size_t bytes) {
+    const size_t alignment = sizeof(max_align_t);
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+    if (arena_current == NULL) {
+        size_t capacity = (bytes > ARENA_FIRST_BLOCK_BYTES) ? bytes : ARENA_FIRST_BLOCK_BYTES;
+        arena_first = arena_current = arena_new_block(capacity);
+        if (arena_current == NULL) {
+            fprintf(stderr, "Error allocating layer scratch memory\n");
+            return NULL;
+        }
+    }
+
+    // Move on to the next block (reusing the blocks kept from earlier layers) until one has room
+    while (arena_current->capacity - arena_current->used < bytes) {
+        if (arena_current->next == NULL) {
+            size_t capacity = 2 * arena_current->capacity;
+            arena_current->next = arena_new_block((bytes > capacity) ? bytes : capacity);
+            if (arena_current->next == NULL) {
+                fprintf(stderr, "Error allocating layer scratch memory\n");
+                return NULL;
+            }
+        }
+        arena_current = arena_current->next;
+        arena_current->used = 0;
+    }
+    void *p = (char *)arena_current->data + arena_current->used;
+    arena_current->used += bytes;
+    return p;
+}
+
+arena_mark arena_get_mark(void) {
+    return (arena_mark){arena_current, (arena_current != NULL) ? arena_current->used : 0};
+}
+
+void arena_release(arena_mark mark) {
+    if (arena_first == NULL) {
+        return;
+    }
+    if (mark.block != NULL && (mark.block != arena_first || mark.used != 0)) {
+        arena_current = mark.block;
+        arena_current->used = mark.used;
+        return;
+    }
+    // Back to empty
+    if (arena_bytes > ARENA_RETAIN_BYTES) {
+        arena_block *block = arena_first->next;
+        while (block != NULL) {
+            arena_block *next = block->next;
+            free(block);
+            block = next;
+        }
+        arena_first->next = NULL;
+        arena_bytes = arena_first->capacity;
+    }
+    arena_current = arena_first;
+    arena_current->used = 0;
+}
@@ -0,0 +1,175 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Batch registers & parameter sweeps
+//
+// The states of a batch are interleaved: amplitude i of state b is at i * lanes + b, lanes being the
+// batch size rounded up to a power of two. That is the layout of a single state vector over
+// size + lane_bits qubits whose low lane_bits index bits are the state, so a gate with a fixed angle
+// runs through the ordinary dense kernels (threads, SIMD & all) with its qubits shifted up by
+// lane_bits, updating every state in one sweep. Only the gates with a parameter need their own kernel,
+// applying a different matrix to each lane. Padding lanes hold zero amplitudes and stay zero.
+
+struct batch_register {
+    int size;        // Qubits of every state
+    int batch_size;
+    int lane_bits;   // log2 of the padded batch size
+    qreg *lanes;     // Dense register of size + lane_bits qubits holding the interleaved states
+};
+
+qbatch *new_qbatch(int size, int batch_size) {
+    if (size < 1 || batch_size < 1) {
+        fprintf(stderr, "Error: a batch register needs at least 1 qubit & 1 state, attempted %d x %d\n", size, batch_size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+    int lane_bits = 0;
+    while ((1LL << lane_bits) < batch_size) {
+        lane_bits++;
+    }
+    if (size + lane_bits > QUBIT_REGISTER_LIMIT) {
+        fprintf(stderr, "Error: a batch of %d states of %d qubits needs a %d qubit state vector, more than %d\n",
+                batch_size, size, size + lane_bits, QUBIT_REGISTER_LIMIT);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return NULL;
+    }
+
+    qbatch *qb = malloc(sizeof(qbatch));
+    if (qb == NULL) {
+        fprintf(stderr, "Error allocating memory for batch register\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    qb->size = size;
+    qb->batch_size = batch_size;
+    qb->lane_bits = lane_bits;
+    qb->lanes = new_qreg(size + lane_bits);
+    if (qb->lanes == NULL) {
+        free(qb);
+        return NULL;
+    }
+    return (qc_batch_reset(qb) == QC_OK) ? qb : NULL;
+}
+
+void free_qbatch(qbatch *qb) {
+    if (qb != NULL) {
+        free_qreg(qb->lanes);
+        free(qb);
+    }
+}
+
+qc_status qc_batch_reset(qbatch *qb) {
+    if (qb == NULL) {
+        fprintf(stderr, "Error trying to reset a NULL batch register\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    memset(qb->lanes->amp, 0, (1ULL << qb->lanes->size) * sizeof(cnum));
+    for (int b = 0; b < qb->batch_size; b++) {
+        qb->lanes->amp[b].re = 1.0;
+    }
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+// Apply one 2x2 matrix per state (state b's at matrices[4 * b]) to a qubit of every state of the batch
+static void apply_batched_rotation(qbatch *qb, int qubit, const cnum *matrices, int diagonal) {
+    uint64_t lanes = 1ULL << qb->lane_bits;
+    uint64_t num_pairs = (1ULL << qb->size) >> 1;
+    uint64_t stride = lanes << qubit;
+    cnum *amp = qb->lanes->amp;
+    int batch_size = qb->batch_size;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((lanes << qb->size) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_pairs; k++) {
+        cnum *a0 = &amp[insert_zero_bit(k, qubit) * lanes];
+        cnum *a1 = a0 + stride;
+        if (diagonal) {
+            for (int b = 0; b < batch_size; b++) {
+                a0[b] = cnum_mul(matrices[4 * b], a0[b]);
+                a1[b] = cnum_mul(matrices[4 * b + 3], a1[b]);
+            }
+        } else {
+            for (int b = 0; b < batch_size; b++) {
+                const cnum *m = &matrices[4 * b];
+                cnum x0 = a0[b], x1 = a1[b];
+                a0[b] = cnum_add(cnum_mul(m[0], x0), cnum_mul(m[1], x1));
+                a1[b] = cnum_add(cnum_mul(m[2], x0), cnum_mul(m[3], x1));
+            }
+        }
+    }
+}
+
+qc_status qc_run_batch(const qcircuit *circuit, qbatch *qb, const double *params) {
+    if (circuit == NULL || qb == NULL || (params == NULL && circuit->num_params > 0)) {
+        fprintf(stderr, "Error trying to run a batch with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qb->size < circuit->min_qubits) {
+        fprintf(stderr, "Error: circuit needs %d qubits, batch states have %d\n", circuit->min_qubits, qb->size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    cnum *matrices = malloc(4 * (size_t)qb->batch_size * sizeof(cnum));
+    if (matrices == NULL) {
+        fprintf(stderr, "Error allocating memory for the batch's gate matrices\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    STATS_BEGIN(stats_start);
+    qc_status status = QC_OK;
+    int next = 0;
+    for (int i = 0; i < circuit->num_instructions && status == QC_OK; i++) {
+        const instruction *ins = &circuit->instructions[i];
+        STATS_SWEEPS(1);
+        if (next < circuit->num_parametric && circuit->parametric[next].instruction == i) {
+            const parametric_gate *gate = &circuit->parametric[next++];
+            for (int b = 0; b < qb->batch_size; b++) {
+                rotation_matrix(gate->gate, params[(size_t)b * circuit->num_params + gate->param], &matrices[4 * b]);
+            }
+            apply_batched_rotation(qb, ins->qubits[0], matrices, gate->gate == ROTATION_RZ || gate->gate == ROTATION_P);
+            continue;
+        }
+        int qubits[ins->num_qubits];
+        for (int q = 0; q < ins->num_qubits; q++) {
+            qubits[q] = ins->qubits[q] + qb->lane_bits;
+        }
+        instruction shifted = *ins;
+        shifted.qubits = qubits;
+        status = apply_dense_instruction(qb->lanes, &shifted);
+    }
+    STATS_END(QC_PHASE_KERNELS, stats_start);
+    free(matrices);
+
+    set_status(status);
+    return status;
+}
+
+cnum qc_batch_get_amplitude(const qbatch *qb, int b, uint64_t index) {
+    if (qb == NULL || b < 0 || b >= qb->batch_size || (index >> qb->size) != 0) {
+        return (cnum){0.0, 0.0};
+    }
+    return qb->lanes->amp[(index << qb->lane_bits) | (uint64_t)b];
+}
+
+qc_status qc_batch_get_state(const qbatch *qb, int b, qreg *qr) {
+    if (qb == NULL || qr == NULL || b < 0 || b >= qb->batch_size || qr->amp == NULL || qr->size != qb->size) {
+        fprintf(stderr, "Error: a batch state can only be copied into a dense register of the same size\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    uint64_t num_states = 1ULL << qb->size;
+    const cnum *amp = qb->lanes->amp;
+    int lane_bits = qb->lane_bits;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t i = 0; i < num_states; i++) {
+        qr->amp[i] = amp[(i << lane_bits) | (uint64_t)b];
+    }
+    set_status(QC_OK);
+    return QC_OK;
+}
@@ -0,0 +1,189 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Checkpoint files
+//
+// Layout: a CHECKPOINT_HEADER_BYTES header (checkpoint_header, zero padded) followed by the raw 2^n
+// amplitudes, exactly as they are laid out in memory. The header is 64 KiB, the largest page size of
+// common systems (arm64 & ppc64le kernels can use 16 or 64 KiB pages), so the amplitudes start on a
+// page boundary wherever the file is loaded. Loading maps the whole file privately and points the
+// register into it: nothing is copied, pages are read on first touch, and writes go to private copies
+// instead of the file.
+// Saving writes a temporary file with large sequential writes, syncs it, then renames it over the
+// destination, so a preemption in the middle of a save never leaves a truncated checkpoint behind.
+
+#define CHECKPOINT_MAGIC "QCSTATE"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+#define CHECKPOINT_HEADER_BYTES (64 * 1024)
+#define CHECKPOINT_WRITE_CHUNK (64ULL << 20)
+
+typedef struct checkpoint_header {
+    char magic[8];            // "QCSTATE\0"
+    uint32_t version;
+    uint32_t byte_order;      // CHECKPOINT_BYTE_ORDER as stored by the machine that saved the file
+    uint32_t real_bytes;      // sizeof(qc_real): 8 for double precision builds, 4 for single precision ones
+    uint32_t num_qubits;
+    uint64_t amplitude_bytes; // 2^num_qubits * sizeof(cnum)
+    uint64_t header_bytes;    // Offset of the amplitudes in the file, CHECKPOINT_HEADER_BYTES
+} checkpoint_header;
+
+// Write a whole buffer, retrying partial & interrupted writes
+static int write_fully(int fd, const void *buffer, uint64_t bytes) {
+    const char *p = buffer;
+    while (bytes > 0) {
+        size_t chunk = (bytes < CHECKPOINT_WRITE_CHUNK) ? (size_t)bytes : (size_t)CHECKPOINT_WRITE_CHUNK;
+        ssize_t written = write(fd, p, chunk);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        p += written;
+        bytes -= (uint64_t)written;
+    }
+    return 0;
+}
+
+qc_status qc_save_state(const qreg *qr, const char *path) {
+    if (qr == NULL || path == NULL) {
+        fprintf(stderr, "Error trying to save a state with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->sparse != NULL || qr->tableau != NULL || qr->mps != NULL) {
+        fprintf(stderr, "Error: only dense registers can be saved, convert this one with qc_to_dense() first\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    size_t tmp_length = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_length);
+    char *page = calloc(1, CHECKPOINT_HEADER_BYTES);
+    if (tmp_path == NULL || page == NULL) {
+        fprintf(stderr, "Error allocating memory to save a state\n");
+        free(tmp_path);
+        free(page);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    snprintf(tmp_path, tmp_length, "%s.tmp", path);
+
+    checkpoint_header header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, CHECKPOINT_BYTE_ORDER, sizeof(qc_real),
+                                (uint32_t)qr->size, qc_qreg_bytes(qr->size), CHECKPOINT_HEADER_BYTES};
+    memcpy(page, &header, sizeof(header));
+
+    STATS_BEGIN(stats_start);
+    qc_status status = QC_OK;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s for writing: %s\n", tmp_path, strerror(errno));
+        status = QC_ERR_IO;
+    } else {
+        if (write_fully(fd, page, CHECKPOINT_HEADER_BYTES) != 0 || write_fully(fd, qr->amp, header.amplitude_bytes) != 0 || fsync(fd) != 0) {
+            fprintf(stderr, "Error writing state to %s: %s\n", tmp_path, strerror(errno));
+            status = QC_ERR_IO;
+        }
+        if (close(fd) != 0 && status == QC_OK) {
+            status = QC_ERR_IO;
+        }
+        if (status == QC_OK && rename(tmp_path, path) != 0) {
+            fprintf(stderr, "Error renaming %s to %s: %s\n", tmp_path, path, strerror(errno));
+            status = QC_ERR_IO;
+        }
+        if (status != QC_OK) {
+            unlink(tmp_path);
+        }
+    }
+
+    free(tmp_path);
+    free(page);
+    STATS_END(QC_PHASE_IO, stats_start);
+    set_status(status);
+    return status;
+}
+
+qreg *qc_load_state(const char *path) {
+    if (path == NULL) {
+        fprintf(stderr, "Error trying to load a state from a NULL path\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    STATS_BEGIN(stats_start);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+
+    // Validate the header against this build before mapping anything
+    checkpoint_header header;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Error: %s is not a state checkpoint\n", path);
+        close(fd);
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+    if (header.version != CHECKPOINT_VERSION || header.byte_order != CHECKPOINT_BYTE_ORDER || header.real_bytes != sizeof(qc_real) ||
+        header.num_qubits < 1 || header.num_qubits > QUBIT_REGISTER_LIMIT || header.amplitude_bytes != qc_qreg_bytes(header.num_qubits) ||
+        header.header_bytes != CHECKPOINT_HEADER_BYTES) {
+        fprintf(stderr, "Error: %s is a version %u checkpoint of %u qubits with %u byte reals, which this build cannot load\n",
+                path, header.version, header.num_qubits, header.real_bytes);
+        close(fd);
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+    uint64_t file_bytes = CHECKPOINT_HEADER_BYTES + header.amplitude_bytes;
+    if ((uint64_t)st.st_size < file_bytes) {
+        fprintf(stderr, "Error: %s is truncated, %llu bytes instead of %llu\n", path, (unsigned long long)st.st_size, (unsigned long long)file_bytes);
+        close(fd);
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+
+    // Private mapping: the register can be modified freely without touching the file
+    void *base = mmap(NULL, file_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error mapping %s: %s\n", path, strerror(errno));
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+
+    qreg *qr = malloc(sizeof(qreg));
+    if (qr == NULL) {
+        fprintf(stderr, "Error allocating memory for quantum register.\n");
+        munmap(base, file_bytes);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    qr->size = (int)header.num_qubits;
+    qr->amp = (cnum *)((char *)base + CHECKPOINT_HEADER_BYTES);
+    qr->mapped_bytes = file_bytes;
+    qr->back_buffer = NULL;
+    qr->sparse = NULL;
+    qr->tableau = NULL;
+    qr->mps = NULL;
+    STATS_END(QC_PHASE_IO, stats_start);
+
+    set_status(QC_OK);
+    return qr;
+}
+
+void unmap_state_vector(qreg *qr) {
+    munmap((char *)qr->amp - CHECKPOINT_HEADER_BYTES, qr->mapped_bytes);
+    qr->amp = NULL;
+    qr->mapped_bytes = 0;
+}
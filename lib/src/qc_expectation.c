@@ -0,0 +1,247 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Pauli expectation values
+//
+// A Pauli string P maps |i> to i^num_y (-1)^popcount(i & phase_mask) |i ^ flip_mask>, where flip_mask
+// holds its X & Y qubits and phase_mask its Z & Y qubits. So
+//   <psi|P|psi> = i^num_y sum_i (-1)^popcount(i & phase_mask) conj(amp[i ^ flip_mask]) amp[i]
+// and all the strings sharing a flip mask only differ by the sign applied to the same products:
+// each group of such terms costs one read-only sweep over the state vector, whatever its size.
+// Sparse registers sweep their stored entries instead, looking up amp[i ^ flip_mask] in the map,
+// stabilizer registers read the value of each term from their tableau, and MPS registers contract
+// each term along their chain.
+
+typedef struct pauli_term {
+    uint64_t flip_mask;
+    uint64_t phase_mask;
+    int num_y;
+    int index; // Position in the caller's arrays
+} pauli_term;
+
+int next_pauli_factor(const char *paulis, const char **p, int num_qubits, char *op, int *qubit) {
+    while (isspace((unsigned char)**p)) {
+        (*p)++;
+    }
+    if (**p == '\0') {
+        return 0;
+    }
+    *op = *(*p)++;
+    char *end;
+    long index = strtol(*p, &end, 10);
+    if (end == *p || !isdigit((unsigned char)**p) || index >= num_qubits || (*op != 'I' && *op != 'X' && *op != 'Y' && *op != 'Z')) {
+        fprintf(stderr, "Error: invalid Pauli factor in \"%s\"\n", paulis);
+        return -1;
+    }
+    *p = end;
+    *qubit = (int)index;
+    return 1;
+}
+
+// Parse a string like "X0 Z3 Y5", returns 0 on success
+static int parse_pauli_string(const char *paulis, int num_qubits, pauli_term *term) {
+    uint64_t seen = 0;
+    const char *p = paulis;
+    char op;
+    int qubit, ret;
+
+    term->flip_mask = term->phase_mask = 0;
+    term->num_y = 0;
+    while ((ret = next_pauli_factor(paulis, &p, num_qubits, &op, &qubit)) > 0) {
+        uint64_t bit = 1ULL << qubit;
+        if (seen & bit) {
+            fprintf(stderr, "Error: qubit %d appears twice in Pauli string \"%s\"\n", qubit, paulis);
+            return -1;
+        }
+        seen |= bit;
+        if (op == 'X' || op == 'Y') {
+            term->flip_mask |= bit;
+        }
+        if (op == 'Z' || op == 'Y') {
+            term->phase_mask |= bit;
+        }
+        term->num_y += (op == 'Y');
+    }
+    return ret;
+}
+
+static int compare_flip_masks(const void *a, const void *b) {
+    uint64_t fa = ((const pauli_term *)a)->flip_mask;
+    uint64_t fb = ((const pauli_term *)b)->flip_mask;
+    return (fa > fb) - (fa < fb);
+}
+
+// Add conj(b) * a, with the sign of every term at index i, to the sums of a group
+static inline void accumulate_products(uint64_t i, cnum a, cnum b, const pauli_term *group, int count, double *sum_re, double *sum_im) {
+    double re = (double)b.re * a.re + (double)b.im * a.im;
+    double im = (double)b.re * a.im - (double)b.im * a.re;
+    for (int t = 0; t < count; t++) {
+        if (__builtin_parityll(i & group[t].phase_mask)) {
+            sum_re[t] -= re;
+            sum_im[t] -= im;
+        } else {
+            sum_re[t] += re;
+            sum_im[t] += im;
+        }
+    }
+}
+
+// Evaluate a group of terms sharing the same flip mask in a single sweep
+static void evaluate_group(const qreg *qr, const pauli_term *group, int count, double *values) {
+    uint64_t num_states = 1ULL << qr->size;
+    uint64_t flip = group[0].flip_mask;
+    double *sum_re = calloc(2 * count, sizeof(double));
+    if (sum_re == NULL) {
+        // Fall back to one sweep per term
+        for (int t = 0; t < count; t++) {
+            evaluate_group(qr, &group[t], 1, values);
+        }
+        return;
+    }
+    double *sum_im = sum_re + count;
+    STATS_SWEEPS(1);
+
+    if (qr->sparse != NULL) {
+        const sparse_state *s = qr->sparse;
+        for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+            if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+                uint64_t i = s->keys[slot];
+                accumulate_products(i, s->values[slot], sparse_get(s, i ^ flip), group, count, sum_re, sum_im);
+            }
+        }
+        num_states = 0; // Nothing to sweep below
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD) reduction(+:sum_re[:count], sum_im[:count])
+    for (uint64_t i = 0; i < num_states; i++) {
+        accumulate_products(i, qr->amp[i], qr->amp[i ^ flip], group, count, sum_re, sum_im);
+    }
+
+    // Multiply by i^num_y, the imaginary part left is only rounding for a Hermitian P
+    for (int t = 0; t < count; t++) {
+        double value;
+        switch (group[t].num_y % 4) {
+            case 0: value = sum_re[t]; break;
+            case 1: value = -sum_im[t]; break;
+            case 2: value = -sum_re[t]; break;
+            default: value = sum_im[t]; break;
+        }
+        values[group[t].index] = value;
+    }
+    free(sum_re);
+}
+
+qc_status qc_pauli_expectations(const qreg *qr, const char *const paulis[], int num_terms, double *values) {
+    if (qr == NULL || num_terms < 0 || (num_terms > 0 && (paulis == NULL || values == NULL))) {
+        fprintf(stderr, "Error trying to compute expectation values with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    if (qr->tableau != NULL || qr->mps != NULL) {
+        // Each term is +-1 or 0, read from the tableau in O(size^2), or contracted along the MPS chain
+        STATS_BEGIN(tableau_start);
+        for (int t = 0; t < num_terms; t++) {
+            qc_status status = QC_ERR_INVALID_ARGUMENT;
+            if (paulis[t] != NULL) {
+                status = (qr->tableau != NULL) ? tableau_pauli_expectation(qr->tableau, paulis[t], &values[t])
+                                               : mps_pauli_expectation(qr->mps, paulis[t], &values[t]);
+            }
+            if (status != QC_OK) {
+                set_status(status);
+                return status;
+            }
+        }
+        STATS_END(QC_PHASE_OBSERVE, tableau_start);
+        set_status(QC_OK);
+        return QC_OK;
+    }
+
+    pauli_term *terms = malloc((num_terms + 1) * sizeof(pauli_term));
+    if (terms == NULL) {
+        fprintf(stderr, "Error allocating memory for Pauli terms\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    for (int t = 0; t < num_terms; t++) {
+        if (paulis[t] == NULL || parse_pauli_string(paulis[t], qr->size, &terms[t]) != 0) {
+            free(terms);
+            set_status(QC_ERR_INVALID_ARGUMENT);
+            return QC_ERR_INVALID_ARGUMENT;
+        }
+        terms[t].index = t;
+    }
+
+    // Group the terms by flip mask, one sweep per group
+    STATS_BEGIN(stats_start);
+    qsort(terms, num_terms, sizeof(pauli_term), compare_flip_masks);
+    for (int start = 0; start < num_terms;) {
+        int end = start + 1;
+        while (end < num_terms && terms[end].flip_mask == terms[start].flip_mask) {
+            end++;
+        }
+        evaluate_group(qr, &terms[start], end - start, values);
+        start = end;
+    }
+
+    free(terms);
+    STATS_END(QC_PHASE_OBSERVE, stats_start);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+qc_status qc_hamiltonian_expectation(const qreg *qr, const char *const paulis[], const double *coeffs, int num_terms, double *energy) {
+    if (energy == NULL || num_terms < 0 || (num_terms > 0 && coeffs == NULL)) {
+        fprintf(stderr, "Error trying to compute a Hamiltonian expectation with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    double *values = malloc((num_terms + 1) * sizeof(double));
+    if (values == NULL) {
+        fprintf(stderr, "Error allocating memory for expectation values\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    qc_status status = qc_pauli_expectations(qr, paulis, num_terms, values);
+    if (status == QC_OK) {
+        *energy = 0.0;
+        for (int t = 0; t < num_terms; t++) {
+            *energy += coeffs[t] * values[t];
+        }
+    }
+    free(values);
+    return status;
+}
+
+// Every term adds c i^num_y (-1)^popcount(i & phase_mask) amp[i] to out[i ^ flip_mask], one sweep per term
+int hamiltonian_product(const qreg *qr, const char *const paulis[], const double *coeffs, int num_terms, cnum *out) {
+    uint64_t num_states = 1ULL << qr->size;
+    memset(out, 0, num_states * sizeof(cnum));
+    for (int t = 0; t < num_terms; t++) {
+        pauli_term term;
+        if (paulis[t] == NULL || parse_pauli_string(paulis[t], qr->size, &term) != 0) {
+            return -1;
+        }
+        qc_real c = (qc_real)coeffs[t];
+        cnum scale;
+        switch (term.num_y % 4) {
+            case 0: scale = (cnum){c, 0.0}; break;
+            case 1: scale = (cnum){0.0, c}; break;
+            case 2: scale = (cnum){-c, 0.0}; break;
+            default: scale = (cnum){0.0, -c}; break;
+        }
+        cnum negated = {-scale.re, -scale.im};
+        STATS_SWEEPS(1);
+
+        #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+        for (uint64_t j = 0; j < num_states; j++) {
+            uint64_t i = j ^ term.flip_mask;
+            out[j] = cnum_add(out[j], cnum_mul(__builtin_parityll(i & term.phase_mask) ? negated : scale, qr->amp[i]));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Gate fusion
+//
+// Every instruction of a circuit is a full sweep over the state vector, which is memory bound for
+// small gates. This pass walks the instructions in order and greedily merges consecutive gates into
+// a block as long as the block acts on at most max_qubits qubits; each block of two or more gates
+// becomes a single dense matrix instruction, i.e. one compute-dense sweep instead of several
+// memory-bound ones. Blocks holding a single gate keep their original (specialized) instruction.
+
+#define FUSION_MIN_QUBITS 2
+#define FUSION_MAX_QUBITS 5
+#define FUSION_MAX_DIM (1 << FUSION_MAX_QUBITS)
+
+typedef struct fusion_block {
+    int num_gates;
+    int first_gate;                 // Index of the first instruction in the block
+    int num_qubits;
+    int qubits[FUSION_MAX_QUBITS];  // qubits[0] is the most significant bit of the block's sub-index
+    cnum matrix[FUSION_MAX_DIM * FUSION_MAX_DIM];
+} fusion_block;
+
+// Growable copy of a circuit, the instruction pointers are fixed up once all the pools are final
+typedef struct circuit_builder {
+    qcircuit *circuit;
+    int capacity, qubit_capacity, matrix_capacity;
+    int num_qubit_entries, num_matrix_entries;
+    int *qubit_offsets, *matrix_offsets;
+} circuit_builder;
+
+// Position of a qubit inside the block, or -1
+static int block_position(const fusion_block *block, int qubit) {
+    for (int p = 0; p < block->num_qubits; p++) {
+        if (block->qubits[p] == qubit) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Number of qubits the block would act on after absorbing the instruction
+static int merged_width(const fusion_block *block, const instruction *ins) {
+    int width = block->num_qubits;
+    for (int q = 0; q < ins->num_qubits; q++) {
+        if (block_position(block, ins->qubits[q]) < 0) {
+            width++;
+        }
+    }
+    return width;
+}
+
+// Add a qubit to the block as its new least significant bit: matrix <- matrix (x) I
+static void block_add_qubit(fusion_block *block, int qubit) {
+    int dim = 1 << block->num_qubits;
+    int new_dim = dim * 2;
+    cnum expanded[FUSION_MAX_DIM * FUSION_MAX_DIM];
+
+    for (int r = 0; r < new_dim; r++) {
+        for (int c = 0; c < new_dim; c++) {
+            expanded[r * new_dim + c] = ((r & 1) == (c & 1)) ? block->matrix[(r >> 1) * dim + (c >> 1)] : (cnum){0.0, 0.0};
+        }
+    }
+    memcpy(block->matrix, expanded, new_dim * new_dim * sizeof(cnum));
+    block->qubits[block->num_qubits++] = qubit;
+}
+
+// Expand an instruction into a dense matrix over the block's qubits (which include all of its qubits)
+static void embed_instruction(const fusion_block *block, const instruction *ins, cnum *out) {
+    int k = block->num_qubits;
+    int dim = 1 << k;
+    int num_targets = ins->num_qubits - ins->num_controls;
+    int control_mask = 0, target_mask = 0;
+    int target_bits[FUSION_MAX_QUBITS];
+
+    for (int q = 0; q < ins->num_qubits; q++) {
+        int bit = k - 1 - block_position(block, ins->qubits[q]);
+        if (q < ins->num_controls) {
+            control_mask |= 1 << bit;
+        } else {
+            target_bits[q - ins->num_controls] = bit;
+            target_mask |= 1 << bit;
+        }
+    }
+
+    memset(out, 0, dim * dim * sizeof(cnum));
+    if (ins->op == GATE_OP_DIAGONAL) {
+        for (int col = 0; col < dim; col++) {
+            int key = 0;
+            for (int q = 0; q < ins->num_qubits; q++) {
+                key = (key << 1) | ((col >> target_bits[q]) & 1);
+            }
+            out[col * dim + col] = ins->matrix[key];
+        }
+        return;
+    }
+    for (int col = 0; col < dim; col++) {
+        if ((col & control_mask) != control_mask) {
+            out[col * dim + col] = (cnum){1.0, 0.0};
+            continue;
+        }
+        int sub_col = 0;
+        for (int t = 0; t < num_targets; t++) {
+            sub_col = (sub_col << 1) | ((col >> target_bits[t]) & 1);
+        }
+        for (int sub_row = 0; sub_row < (1 << num_targets); sub_row++) {
+            int row = col & ~target_mask;
+            for (int t = 0; t < num_targets; t++) {
+                if ((sub_row >> (num_targets - 1 - t)) & 1) {
+                    row |= 1 << target_bits[t];
+                }
+            }
+            out[row * dim + col] = ins->matrix[sub_row * (1 << num_targets) + sub_col];
+        }
+    }
+}
+
+// block <- instruction * block
+static void block_absorb(fusion_block *block, const instruction *ins) {
+    for (int q = 0; q < ins->num_qubits; q++) {
+        if (block_position(block, ins->qubits[q]) < 0) {
+            block_add_qubit(block, ins->qubits[q]);
+        }
+    }
+
+    int dim = 1 << block->num_qubits;
+    cnum gate[FUSION_MAX_DIM * FUSION_MAX_DIM];
+    cnum product[FUSION_MAX_DIM * FUSION_MAX_DIM];
+    embed_instruction(block, ins, gate);
+    for (int r = 0; r < dim; r++) {
+        for (int c = 0; c < dim; c++) {
+            cnum sum = {0.0, 0.0};
+            for (int j = 0; j < dim; j++) {
+                sum = cnum_add(sum, cnum_mul(gate[r * dim + j], block->matrix[j * dim + c]));
+            }
+            product[r * dim + c] = sum;
+        }
+    }
+    memcpy(block->matrix, product, dim * dim * sizeof(cnum));
+    block->num_gates++;
+}
+
+static void block_start(fusion_block *block, int first_gate) {
+    block->num_gates = 0;
+    block->first_gate = first_gate;
+    block->num_qubits = 0;
+    block->matrix[0] = (cnum){1.0, 0.0};
+}
+
+static int builder_reserve(circuit_builder *b, int qubits, int entries) {
+    qcircuit *c = b->circuit;
+    if (c->num_instructions == b->capacity) {
+        b->capacity = b->capacity ? 2 * b->capacity : 16;
+        void *ins = realloc(c->instructions, b->capacity * sizeof(instruction));
+        void *qo = realloc(b->qubit_offsets, b->capacity * sizeof(int));
+        void *mo = realloc(b->matrix_offsets, b->capacity * sizeof(int));
+        if (ins) c->instructions = ins;
+        if (qo) b->qubit_offsets = qo;
+        if (mo) b->matrix_offsets = mo;
+        if (!ins || !qo || !mo) {
+            return -1;
+        }
+    }
+    while (b->num_qubit_entries + qubits > b->qubit_capacity) {
+        b->qubit_capacity = b->qubit_capacity ? 2 * b->qubit_capacity : 64;
+        void *pool = realloc(c->qubit_pool, b->qubit_capacity * sizeof(int));
+        if (pool == NULL) {
+            return -1;
+        }
+        c->qubit_pool = pool;
+    }
+    while (b->num_matrix_entries + entries > b->matrix_capacity) {
+        b->matrix_capacity = b->matrix_capacity ? 2 * b->matrix_capacity : 256;
+        void *pool = realloc(c->matrix_pool, b->matrix_capacity * sizeof(cnum));
+        if (pool == NULL) {
+            return -1;
+        }
+        c->matrix_pool = pool;
+    }
+    return 0;
+}
+
+// Append an instruction, copying its qubits & matrix into the new circuit's pools
+static int builder_append(circuit_builder *b, gate_op op, int num_qubits, int num_controls, const int *qubits, const cnum *matrix) {
+    int entries = instruction_matrix_entries(op, num_qubits, num_controls);
+    if (builder_reserve(b, num_qubits, entries) != 0) {
+        return -1;
+    }
+
+    qcircuit *c = b->circuit;
+    int i = c->num_instructions++;
+    c->instructions[i] = (instruction){op, num_qubits, num_controls, NULL, NULL};
+    b->qubit_offsets[i] = b->num_qubit_entries;
+    b->matrix_offsets[i] = b->num_matrix_entries;
+    memcpy(&c->qubit_pool[b->num_qubit_entries], qubits, num_qubits * sizeof(int));
+    memcpy(&c->matrix_pool[b->num_matrix_entries], matrix, entries * sizeof(cnum));
+    b->num_qubit_entries += num_qubits;
+    b->num_matrix_entries += entries;
+    return 0;
+}
+
+// Emit a finished block: its original instruction if it holds a single gate, a fused matrix otherwise
+static int block_flush(circuit_builder *b, const fusion_block *block, const qcircuit *source) {
+    if (block->num_gates == 0) {
+        return 0;
+    }
+    if (block->num_gates == 1) {
+        const instruction *ins = &source->instructions[block->first_gate];
+        return builder_append(b, ins->op, ins->num_qubits, ins->num_controls, ins->qubits, ins->matrix);
+    }
+    return builder_append(b, GATE_OP_MATRIX, block->num_qubits, 0, block->qubits, block->matrix);
+}
+
+qcircuit *qc_fuse(const qcircuit *circuit, int max_qubits, int *passes_saved) {
+    if (circuit == NULL || max_qubits < FUSION_MIN_QUBITS || max_qubits > FUSION_MAX_QUBITS) {
+        fprintf(stderr, "Error: gate fusion needs a circuit and a block size between %d and %d qubits\n", FUSION_MIN_QUBITS, FUSION_MAX_QUBITS);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+    // Fused matrices would bake in the placeholder angles
+    if (reject_parametric(circuit) != 0) {
+        return NULL;
+    }
+
+    circuit_builder b = {0};
+    b.circuit = calloc(1, sizeof(qcircuit));
+    fusion_block *block = malloc(sizeof(fusion_block));
+    if (b.circuit == NULL || block == NULL) {
+        fprintf(stderr, "Error allocating memory for gate fusion\n");
+        free(b.circuit);
+        free(block);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    b.circuit->num_layers = circuit->num_layers;
+    b.circuit->min_qubits = circuit->min_qubits;
+
+    STATS_BEGIN(stats_start);
+    int ret = 0;
+    block_start(block, 0);
+    for (int i = 0; i < circuit->num_instructions && ret == 0; i++) {
+        const instruction *ins = &circuit->instructions[i];
+
+        if (merged_width(block, ins) > max_qubits) {
+            ret = block_flush(&b, block, circuit);
+            block_start(block, i);
+        }
+        if (ins->num_qubits > max_qubits) {
+            // Too wide to ever be fused (e.g. a many-controlled MCX), keep it as it is
+            if (ret == 0) {
+                ret = builder_append(&b, ins->op, ins->num_qubits, ins->num_controls, ins->qubits, ins->matrix);
+            }
+            block_start(block, i + 1);
+            continue;
+        }
+        block_absorb(block, ins);
+    }
+    if (ret == 0) {
+        ret = block_flush(&b, block, circuit);
+    }
+    free(block);
+
+    qcircuit *fused = b.circuit;
+    for (int i = 0; i < fused->num_instructions; i++) {
+        fused->instructions[i].qubits = &fused->qubit_pool[b.qubit_offsets[i]];
+        fused->instructions[i].matrix = &fused->matrix_pool[b.matrix_offsets[i]];
+    }
+    free(b.qubit_offsets);
+    free(b.matrix_offsets);
+
+    if (ret != 0) {
+        fprintf(stderr, "Error allocating memory for the fused circuit\n");
+        qc_free_circuit(fused);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    STATS_END(QC_PHASE_LOWER, stats_start);
+    if (passes_saved != NULL) {
+        *passes_saved = circuit->num_instructions - fused->num_instructions;
+    }
+    set_status(QC_OK);
+    return fused;
+}
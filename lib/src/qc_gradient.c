@@ -0,0 +1,167 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Adjoint differentiation
+//
+// With psi = U_N ... U_1 |0> and E = <psi|H|psi>, the derivative with respect to the angle of gate k is
+//   dE/dtheta_k = 2 Re <lambda_k| dU_k/dtheta |psi_{k-1}>,  lambda_k = U_{k+1}^dagger ... U_N^dagger H |psi>
+// so after one forward pass, a single backward pass undoing the gates one by one on both psi and
+// lambda = H psi yields every derivative, each costing one extra sweep on a copy of psi (mu). That is
+// three state vectors and O(gates) sweeps, instead of two full simulations per parameter.
+
+// Derivative of a rotation's matrix with respect to its angle
+static void rotation_derivative(rotation_gate gate, double angle, cnum m[4]) {
+    if (gate == ROTATION_P) {
+        // d/dtheta diag(1, e^(i theta)) = diag(0, i e^(i theta))
+        m[0] = m[1] = m[2] = (cnum){0.0, 0.0};
+        m[3] = (cnum){-sin(angle), cos(angle)};
+        return;
+    }
+    // The entries are linear in cos(theta / 2) & sin(theta / 2), whose derivatives are
+    // cos((theta + pi) / 2) / 2 & sin((theta + pi) / 2) / 2
+    rotation_matrix(gate, angle + M_PI, m);
+    for (int j = 0; j < 4; j++) {
+        m[j].re *= 0.5;
+        m[j].im *= 0.5;
+    }
+}
+
+// Turn an instruction into its inverse, writing the conjugate transpose of its matrix to `adjoint`
+// (room for 2^(2 * MATRIX_GATE_MAX_QUBITS) entries). Returns 0 on success
+static int adjoint_instruction(instruction *ins, cnum *adjoint) {
+    int entries = instruction_matrix_entries(ins->op, ins->num_qubits, ins->num_controls);
+    switch (ins->op) {
+        case GATE_OP_CONTROLLED_X:
+        case GATE_OP_SWAP:
+            return 0; // Self-inverse
+        case GATE_OP_CONTROLLED_PHASE:
+        case GATE_OP_DIAGONAL:
+            if (ins->op == GATE_OP_DIAGONAL && ins->num_qubits > DIAGONAL_GATE_MAX_QUBITS) {
+                return -1;
+            }
+            for (int j = 0; j < entries; j++) {
+                adjoint[j] = (cnum){ins->matrix[j].re, -ins->matrix[j].im};
+            }
+            break;
+        case GATE_OP_MATRIX: {
+            if (ins->num_qubits > MATRIX_GATE_MAX_QUBITS) {
+                return -1;
+            }
+            int dim = 1 << (ins->num_qubits - ins->num_controls);
+            for (int r = 0; r < dim; r++) {
+                for (int c = 0; c < dim; c++) {
+                    cnum m = ins->matrix[c * dim + r];
+                    adjoint[r * dim + c] = (cnum){m.re, -m.im};
+                }
+            }
+            break;
+        }
+    }
+    ins->matrix = adjoint;
+    return 0;
+}
+
+// Re <a|b>
+static double real_inner_product(const cnum *a, const cnum *b, uint64_t num_states) {
+    double sum = 0.0;
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD) reduction(+:sum)
+    for (uint64_t i = 0; i < num_states; i++) {
+        sum += (double)a[i].re * b[i].re + (double)a[i].im * b[i].im;
+    }
+    return sum;
+}
+
+qc_status qc_adjoint_gradient(const qcircuit *circuit, int num_qubits, const double *params, const char *const paulis[],
+                              const double *coeffs, int num_terms, double *energy, double *gradient) {
+    if (circuit == NULL || num_qubits < circuit->min_qubits || num_qubits < 1 || num_qubits > QUBIT_REGISTER_LIMIT || num_terms < 0 ||
+        (num_terms > 0 && (paulis == NULL || coeffs == NULL)) || (circuit->num_params > 0 && (params == NULL || gradient == NULL))) {
+        fprintf(stderr, "Error trying to compute gradients with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    qreg *psi = new_qreg(num_qubits);
+    qreg *lambda = new_qreg(num_qubits);
+    qreg *mu = new_qreg(num_qubits);
+    cnum *adjoint = malloc((1 << (2 * MATRIX_GATE_MAX_QUBITS)) * sizeof(cnum));
+    if (psi == NULL || lambda == NULL || mu == NULL || adjoint == NULL) {
+        fprintf(stderr, "Error allocating the state vectors of an adjoint gradient\n");
+        free_qreg(psi);
+        free_qreg(lambda);
+        free_qreg(mu);
+        free(adjoint);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    uint64_t num_states = 1ULL << num_qubits;
+    qc_status status = QC_OK;
+    STATS_BEGIN(stats_start);
+
+    // Forward pass, binding the angles
+    for (int i = 0, next = 0; i < circuit->num_instructions && status == QC_OK; i++) {
+        instruction ins = circuit->instructions[i];
+        cnum bound[4];
+        if (next < circuit->num_parametric && circuit->parametric[next].instruction == i) {
+            const parametric_gate *gate = &circuit->parametric[next++];
+            rotation_matrix(gate->gate, params[gate->param], bound);
+            ins.matrix = bound;
+        }
+        STATS_SWEEPS(1);
+        status = apply_dense_instruction(psi, &ins);
+    }
+    if (status == QC_OK && hamiltonian_product(psi, paulis, coeffs, num_terms, lambda->amp) != 0) {
+        status = QC_ERR_INVALID_ARGUMENT;
+    }
+    if (status == QC_OK && energy != NULL) {
+        *energy = real_inner_product(psi->amp, lambda->amp, num_states);
+    }
+    for (int p = 0; p < circuit->num_params; p++) {
+        gradient[p] = 0.0;
+    }
+
+    // Backward pass: undo each gate on psi & lambda, differentiating the parametric ones in between
+    for (int i = circuit->num_instructions - 1, next = circuit->num_parametric - 1; i >= 0 && status == QC_OK; i--) {
+        instruction ins = circuit->instructions[i];
+        const parametric_gate *gate = NULL;
+        cnum bound[4];
+        if (next >= 0 && circuit->parametric[next].instruction == i) {
+            gate = &circuit->parametric[next--];
+            rotation_matrix(gate->gate, params[gate->param], bound);
+            ins.matrix = bound;
+        }
+        instruction inverse = ins;
+        if (adjoint_instruction(&inverse, adjoint) != 0) {
+            status = QC_ERR_INVALID_ARGUMENT;
+            break;
+        }
+        status = apply_dense_instruction(psi, &inverse);
+        if (status == QC_OK && gate != NULL) {
+            cnum derivative[4];
+            rotation_derivative(gate->gate, params[gate->param], derivative);
+            ins.matrix = derivative;
+            memcpy(mu->amp, psi->amp, num_states * sizeof(cnum));
+            status = apply_dense_instruction(mu, &ins);
+            if (status == QC_OK) {
+                gradient[gate->param] += 2.0 * real_inner_product(lambda->amp, mu->amp, num_states);
+            }
+            STATS_SWEEPS(2);
+        }
+        if (status == QC_OK) {
+            status = apply_dense_instruction(lambda, &inverse);
+        }
+        STATS_SWEEPS(2);
+    }
+    STATS_END(QC_PHASE_KERNELS, stats_start);
+
+    free_qreg(psi);
+    free_qreg(lambda);
+    free_qreg(mu);
+    free(adjoint);
+    if (status != QC_OK) {
+        fprintf(stderr, "Error computing adjoint gradients\n");
+    }
+    set_status(status);
+    return status;
+}
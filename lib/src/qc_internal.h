@@ -0,0 +1,304 @@
+#ifndef QC_INTERNAL_H // Include guard
+#define QC_INTERNAL_H
+
+// Declarations shared between the library's source files, not part of the public API
+#include "qc_lib.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Kernels sweeping fewer amplitudes than this stay serial: below it, waking up the thread pool
+// costs more than the sweep itself (this covers all of the small example circuits)
+#define PARALLEL_THRESHOLD (1ULL << 14)
+
+static inline cnum cnum_mul(cnum a, cnum b) {
+    return (cnum){a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+
+static inline cnum cnum_add(cnum a, cnum b) {
+    return (cnum){a.re + b.re, a.im + b.im};
+}
+
+// Insert a zero bit at position `bit` into `index`, shifting the higher bits up by one
+static inline uint64_t insert_zero_bit(uint64_t index, int bit) {
+    uint64_t low_mask = (1ULL << bit) - 1;
+    return ((index & ~low_mask) << 1) | (index & low_mask);
+}
+
+// Insert zero bits at all the given positions, which must be sorted in increasing order
+static inline uint64_t insert_zero_bits(uint64_t index, const int *sorted_bits, int count) {
+    for (int j = 0; j < count; j++) {
+        index = insert_zero_bit(index, sorted_bits[j]);
+    }
+    return index;
+}
+
+// How the in-place engine executes a gate
+typedef enum gate_op {
+    GATE_OP_MATRIX,       // Dense 2^k x 2^k matrix over the gate's qubits
+    GATE_OP_CONTROLLED_X, // X on the target when all the controls are set (CNOT, CCNOT, MCX)
+    GATE_OP_CONTROLLED_PHASE, // Phase on the amplitudes where the controls and the target are all set (MCZ, MCP)
+    GATE_OP_SWAP,         // Exchange of two qubits
+    GATE_OP_DIAGONAL,     // Diagonal over the gate's qubits, stored as a table of its 2^k entries
+} gate_op;
+
+// Widest dense matrix the in-place engine applies in one pass
+#define MATRIX_GATE_MAX_QUBITS 6
+
+// Widest diagonal table: the diagonal gates of a layer are merged into one table over up to this many qubits
+#define DIAGONAL_GATE_MAX_QUBITS 10
+
+// A gate lowered for the in-place engine: everything needed to run it, with no parsing or allocation
+typedef struct instruction {
+    gate_op op;
+    int num_qubits;      // Number of qubits, controls included
+    int num_controls;
+    const int *qubits;   // Controls first, then targets (the first target is the matrix's MSB)
+    const cnum *matrix;  // Row-major 2^t x 2^t matrix over the t target qubits (the 2^k diagonal for GATE_OP_DIAGONAL)
+} instruction;
+
+// Number of entries `matrix` holds for an instruction
+static inline int instruction_matrix_entries(gate_op op, int num_qubits, int num_controls) {
+    if (op == GATE_OP_DIAGONAL) {
+        return 1 << num_qubits;
+    }
+    int dim = 1 << (num_qubits - num_controls);
+    return dim * dim;
+}
+
+// Noise channel attached to a compiled circuit (qc_noise.c)
+typedef struct noise_channel {
+    int gate;                // Instruction the channel follows, or QC_ALL_GATES
+    qc_channel channel;
+    double probability;
+} noise_channel;
+
+// Single qubit gates whose angle can be a circuit parameter ("RX_0_$theta3")
+typedef enum rotation_gate {
+    ROTATION_RX,
+    ROTATION_RY,
+    ROTATION_RZ,
+    ROTATION_P,
+} rotation_gate;
+
+// Row-major matrix of a rotation, as used by the RX, RY, RZ & P layer gates (qc_lib.c)
+void rotation_matrix(rotation_gate gate, double angle, cnum m[4]);
+
+// Gate of a compiled circuit whose angle is bound when the circuit runs
+typedef struct parametric_gate {
+    int instruction;         // Its instruction, a GATE_OP_MATRIX holding the gate for angle 0
+    rotation_gate gate;
+    int param;               // Column of the parameter array holding the angle
+} parametric_gate;
+
+// Compiled circuit: the gates of all its layers flattened, in order, into a single instruction array.
+// The instructions point into the qubit & matrix pools owned by the circuit.
+struct quantum_circuit {
+    int num_layers;
+    int num_instructions;
+    int min_qubits;          // Registers running the circuit need at least this many qubits
+    instruction *instructions;
+    int *qubit_pool;
+    cnum *matrix_pool;
+    noise_channel *noise;    // Sorted by gate, the QC_ALL_GATES channels first
+    int num_noise;
+    parametric_gate *parametric; // Sorted by instruction
+    int num_parametric;
+    int num_params;          // Parameters the placeholders refer to (highest index + 1)
+};
+
+// Runners needing fixed angles: returns -1 (with the status set) if the circuit has parameters
+int reject_parametric(const qcircuit *circuit);
+
+// Key of an amplitude index in a diagonal table: its bits at the given qubits, qubits[0] being the MSB
+static inline int diagonal_key(uint64_t index, const int *qubits, int k) {
+    int key = 0;
+    for (int j = 0; j < k; j++) {
+        key = (key << 1) | (int)((index >> qubits[j]) & 1);
+    }
+    return key;
+}
+
+// Diagonal gates (Z, S, T, RZ, P, MCZ, MCP) of a layer, merged into a single table so that they
+// all cost one pass over the state vector (qc_lib.c)
+typedef struct diagonal_group {
+    int num_gates;
+    int num_qubits;
+    int qubits[DIAGONAL_GATE_MAX_QUBITS];   // qubits[0] is the most significant bit of the table key
+    cnum table[1 << DIAGONAL_GATE_MAX_QUBITS];
+    instruction first;                      // Emitted as is when the group only holds one gate
+    int first_qubits[DIAGONAL_GATE_MAX_QUBITS];
+    cnum first_matrix[4];
+} diagonal_group;
+
+// Apply the gates of a layer one by one, the way circuit_layer does: start with diagonal_group_reset,
+// then layer_apply every gate (which may hold it back in the group), and layer_end to apply what's
+// left. Return 0 on success
+void diagonal_group_reset(diagonal_group *group);
+int layer_apply(qreg *qr, diagonal_group *group, const instruction *ins);
+int layer_end(qreg *qr, diagonal_group *group);
+
+// Apply one instruction to a register in place, whatever its storage. Returns QC_OK, or why it failed
+// (QC_ERR_OUT_OF_MEMORY when a backend ran out of memory, QC_ERR_INVALID_ARGUMENT for an unsupported gate, ...)
+qc_status apply_instruction(qreg *qr, const instruction *ins);
+// Same, with the state vector kernels only (qr->amp must be set)
+qc_status apply_dense_instruction(qreg *qr, const instruction *ins);
+
+// Allocate a zero-initialized, aligned state vector of num_states amplitudes (NULL on failure, including
+// vectors larger than physical memory, which check_state_vector_fits refuses with a message)
+int check_state_vector_fits(uint64_t num_states);
+cnum *alloc_state_vector(uint64_t num_states);
+
+// Layer scratch memory (qc_arena.c): a per-thread bump allocator. Take a mark before a layer, allocate its
+// scratch with arena_alloc (aligned like malloc, NULL on failure, never freed one by one), and release the
+// mark once the layer is done to free all of it in O(1). Marks nest, and are released in reverse order
+typedef struct arena_mark {
+    struct arena_block *block;
+    size_t used;
+} arena_mark;
+
+void *arena_alloc(size_t bytes);
+arena_mark arena_get_mark(void);
+void arena_release(arena_mark mark);
+
+// Sparse storage (qc_sparse.c): open addressing hash map from basis state index to amplitude, with
+// linear probing. Free slots hold SPARSE_EMPTY_KEY, which no register index can reach.
+#define SPARSE_EMPTY_KEY UINT64_MAX
+
+typedef struct sparse_state {
+    int capacity_bits;  // 2^capacity_bits slots, at least twice the number of entries
+    uint64_t count;
+    uint64_t *keys;
+    cnum *values;
+} sparse_state;
+
+static inline uint64_t sparse_capacity(const sparse_state *s) {
+    return 1ULL << s->capacity_bits;
+}
+
+cnum sparse_get(const sparse_state *s, uint64_t index);
+void sparse_free(sparse_state *s);
+// Keys of all the entries in increasing order (count of them, to be freed), NULL on allocation failure
+uint64_t *sparse_sorted_keys(const sparse_state *s);
+// Replace a sparse register's entries with the ones whose index satisfies (index & mask) == value,
+// multiplied by scale. Returns 0 on success
+int sparse_filter(qreg *qr, uint64_t mask, uint64_t value, qc_real scale);
+qc_status apply_sparse_instruction(qreg *qr, const instruction *ins);
+// Register of `size` qubits holding the `count` amplitudes returned by next(context, &index, &value), each index
+// once. It is sparse, or dense if they fill it up like a sparse gate would. NULL on failure, with the status set
+qreg *sparse_qreg_from_amplitudes(int size, uint64_t count, void (*next)(void *context, uint64_t *index, cnum *value), void *context);
+
+// Stabilizer tableau (qc_stabilizer.c)
+typedef struct stabilizer_tableau stabilizer_tableau;
+
+qreg *new_stabilizer_qreg(int size);
+void tableau_free(stabilizer_tableau *t);
+stabilizer_tableau *tableau_clone(const stabilizer_tableau *t); // Without the gate log
+void tableau_copy(stabilizer_tableau *dst, const stabilizer_tableau *src);
+// Returns 1 if the instruction was a Clifford and got applied, 0 if it wasn't (tableau unchanged)
+int apply_tableau_instruction(stabilizer_tableau *t, const instruction *ins);
+int is_clifford_instruction(const instruction *ins);
+// Measure a qubit, collapsing the tableau; a random outcome is 1 when draw (in [0, 1)) is below 0.5
+int tableau_measure(stabilizer_tableau *t, int qubit, double draw);
+qc_status tableau_pauli_expectation(stabilizer_tableau *t, const char *paulis, double *value);
+void tableau_print(const stabilizer_tableau *t);
+// Replace a stabilizer register's tableau with the state vector it represents
+qc_status tableau_to_state(qreg *qr);
+
+// Matrix product state (qc_mps.c)
+typedef struct mps_state mps_state;
+
+qreg *new_mps_qreg(int size);
+void mps_free(mps_state *m);
+qc_status apply_mps_instruction(qreg *qr, const instruction *ins);
+uint64_t mps_num_entries(const mps_state *m);
+cnum mps_amplitude(const mps_state *m, const uint8_t *bits); // bits[q] is the value of qubit q
+// Samples as indices (at most 64 qubits) and/or bits, site s of shot t using draw t * size + s. The chain gets
+// regauged, but the state it represents is unchanged
+qc_status mps_sample(mps_state *m, uint64_t shots, uint64_t rng_seed, uint64_t *indices, uint8_t *bits);
+// Measure a qubit, collapsing the state: the result is 1 when draw * (p0 + p1) < p1, -1 on failure
+int mps_measure(mps_state *m, int qubit, double draw);
+qc_status mps_pauli_expectation(mps_state *m, const char *paulis, double *value);
+void mps_print(const mps_state *m);
+// Replace an MPS register's tensors with its state vector
+qc_status mps_to_state(qreg *qr);
+
+// Random draws shared by the samplers: splitmix64 keyed by the seed and the draw index, so the
+// samples don't depend on the number of threads
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Uniform double in [0, 1) for the n-th draw of a seed
+static inline double uniform_draw(uint64_t seed, uint64_t n) {
+    return (splitmix64(seed ^ splitmix64(n)) >> 11) * 0x1.0p-53;
+}
+
+// Matrices of the X, Y & Z gates, row-major (qc_lib.c), returns 0 on success
+int pauli_matrices(cnum matrices[3][4]);
+// Matrix of a fixed single qubit layer gate ("X", "Y", "Z", "H", "S" or "T") and the operation it runs
+// as (qc_lib.c), returns 0 on success
+int fixed_gate_matrix(const char *type, cnum m[4], gate_op *op);
+
+// Probability of a qubit being 1, for a state vector register (qc_measure.c)
+double qubit_one_probability(const qreg *qr, int qubit);
+
+// Project a state vector register onto a measurement result and renormalize it (qc_measure.c),
+// returns 0 on success
+int project_qubit(qreg *qr, int qubit, int result);
+
+// Read the next factor of a Pauli string like "X0 Z3 Y5" (qc_expectation.c): returns 1 with the
+// factor in op & qubit, 0 at the end of the string, -1 on a malformed factor
+int next_pauli_factor(const char *paulis, const char **p, int num_qubits, char *op, int *qubit);
+
+// out = H psi for a state vector register and H = sum_t coeffs[t] P_t (qc_expectation.c), returns 0 on success
+int hamiltonian_product(const qreg *qr, const char *const paulis[], const double *coeffs, int num_terms, cnum *out);
+
+// Record the outcome of a public API call for qc_last_status()
+void set_status(qc_status status);
+
+// Instrumentation hooks (qc_stats.c), compiled out unless QC_STATS is defined:
+//   STATS_BEGIN(t); ...; STATS_END(QC_PHASE_..., t); records the time spent in between
+#ifdef QC_STATS
+double stats_now(void);
+void stats_record_phase(qc_phase phase, double start);
+void stats_add_allocations(uint64_t count, uint64_t bytes);
+void stats_add_sweeps(uint64_t sweeps);
+void stats_count_gate(const char *type);
+#define STATS_BEGIN(start) double start = stats_now()
+#define STATS_END(phase, start) stats_record_phase(phase, start)
+#define STATS_ALLOC(bytes) stats_add_allocations(1, bytes)
+#define STATS_ALLOCS(count, bytes) stats_add_allocations(count, bytes)
+#define STATS_SWEEPS(count) stats_add_sweeps(count)
+#define STATS_GATE(type) stats_count_gate(type)
+#else
+#define STATS_BEGIN(start) ((void)0)
+#define STATS_END(phase, start) ((void)0)
+#define STATS_ALLOC(bytes) ((void)0)
+#define STATS_ALLOCS(count, bytes) ((void)0)
+#define STATS_SWEEPS(count) ((void)0)
+#define STATS_GATE(type) ((void)0)
+#endif
+
+// Release the state vector of a register loaded with qc_load_state (qc_checkpoint.c)
+void unmap_state_vector(qreg *qr);
+
+// Dense state vector kernels that have instruction set specific versions.
+// Matrices are row-major; for the two qubit kernel q_hi is the most significant bit of the sub-index.
+typedef struct gate_kernels {
+    void (*single_qubit)(cnum *amp, int num_qubits, int target, const cnum *m);
+    void (*diagonal)(cnum *amp, int num_qubits, int target, cnum d0, cnum d1);
+    void (*two_qubit)(cnum *amp, int num_qubits, int q_hi, int q_lo, const cnum *m);
+} gate_kernels;
+
+// Portable versions (qc_lib.c), also used by the SIMD versions for the cases they don't cover
+void scalar_single_qubit_kernel(cnum *amp, int num_qubits, int target, const cnum *m);
+void scalar_diagonal_kernel(cnum *amp, int num_qubits, int target, cnum d0, cnum d1);
+void scalar_two_qubit_kernel(cnum *amp, int num_qubits, int q_hi, int q_lo, const cnum *m);
+
+// Versions picked for this CPU (qc_simd.c)
+const gate_kernels *active_kernels(void);
+
+#endif // End of include guard
@@ -1,9 +1,14 @@
-#include "qc_lib.h"
+#include "qc_internal.h"
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // #define DEBUG_PRINTS
 
@@ -15,25 +20,133 @@
 
 typedef struct quantum_gate {
     char type[10];    // Type of the gate (e.g., "X", "H", "CNOT", "SWP")
-    int size;         // Number of qubits it’s applied to (1 or 2)
-    cnum **matrix;    // Matrix operator for the particular gate
+    int size;         // Number of qubits it’s applied to (controls included)
+    int num_controls; // Number of control qubits, the matrix only acts on the remaining (size - num_controls) targets
+    gate_op op;       // Kernel used by the in-place engine
+    const cnum *matrix; // Row-major matrix operator for the gate's target qubits, from gate_table or a node's rotation
 } qgate;
 
 typedef struct gate_node {
-    qgate *gate;
-    int *qubits; // List of qubits this gate acts on
+    qgate gate;
+    cnum rotation[4]; // Matrix of a rotation (RX, RY, RZ, P, MCP), which gate.matrix then points to
+    int *qubits; // List of qubits this gate acts on: controls first, then targets (the first target is the matrix's MSB)
+    int param;   // Parameter index of a "$theta<k>" angle (the matrix then holds angle 0), -1 for a fixed angle
     struct gate_node *next;
 } gate_node;
 
 typedef struct gate_list {
     gate_node *head;
+    gate_node *tail;
 } gate_list;
 
-void apply_gate(qreg *qr, gate_list *gates);
+qc_status apply_gate(qreg *qr, gate_list *gates);
+
+// Debug switch: when set, layers are evaluated by building the full 2^n x 2^n operator matrix
+static int use_dense_engine = 0;
+// The dense operator engine needs 2^n x 2^n matrices, so it is only usable on small registers
+#define DENSE_ENGINE_QUBIT_LIMIT 12
+
+// Largest MPS register whose amplitudes view_state_vector lists
+#define MPS_VIEW_QUBIT_LIMIT 16
+
+// State vectors are aligned to a cache line, and to a page once they are at least a page long
+#define STATE_VECTOR_ALIGNMENT 64
+
+// Number of threads used by the kernels, 0 until configured by qc_set_num_threads() or QC_NUM_THREADS
+static int kernel_threads = 0;
+
+int qc_get_num_threads(void) {
+    if (kernel_threads == 0) {
+        const char *env = getenv("QC_NUM_THREADS");
+        int threads = (env != NULL) ? atoi(env) : 0;
+#ifdef _OPENMP
+        if (threads <= 0) {
+            threads = omp_get_max_threads();
+        }
+#else
+        threads = 1;
+#endif
+        kernel_threads = (threads > 0) ? threads : 1;
+    }
+    return kernel_threads;
+}
+
+void qc_set_num_threads(int num_threads) {
+    // A non-positive value goes back to the default (QC_NUM_THREADS, or OpenMP's own default)
+    kernel_threads = 0;
+#ifdef _OPENMP
+    if (num_threads > 0) {
+        kernel_threads = num_threads;
+    }
+#else
+    (void)num_threads;
+#endif
+}
+
+// Status of the last failing (or succeeding) call, per thread
+static _Thread_local qc_status last_status = QC_OK;
+
+void set_status(qc_status status) {
+    last_status = status;
+}
+
+qc_status qc_last_status(void) {
+    return last_status;
+}
+
+const char *qc_status_string(qc_status status) {
+    switch (status) {
+        case QC_OK: return "success";
+        case QC_ERR_INVALID_ARGUMENT: return "invalid argument";
+        case QC_ERR_TOO_MANY_QUBITS: return "too many qubits";
+        case QC_ERR_OUT_OF_MEMORY: return "out of memory";
+        case QC_ERR_IO: return "input/output error";
+    }
+    return "unknown status";
+}
+
+// Refuse up front the state vectors that cannot fit in physical memory, instead of relying on the
+// allocator (which may overcommit and get the process killed once the pages are zeroed)
+int check_state_vector_fits(uint64_t num_states) {
+    uint64_t bytes = num_states * sizeof(cnum);
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0 && bytes > (uint64_t)pages * (uint64_t)page_size) {
+        fprintf(stderr, "Error: a state vector of %llu amplitudes needs %llu bytes, more than the %llu bytes of physical memory\n",
+                (unsigned long long)num_states, (unsigned long long)bytes, (unsigned long long)pages * (unsigned long long)page_size);
+        return -1;
+    }
+    return 0;
+}
+
+// Allocate a zero-initialized, aligned state vector of num_states amplitudes, NULL if it doesn't fit in
+// physical memory or cannot be allocated
+cnum *alloc_state_vector(uint64_t num_states) {
+    if (check_state_vector_fits(num_states) != 0) {
+        return NULL;
+    }
+    uint64_t bytes = num_states * sizeof(cnum);
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t alignment = (page_size > 0 && bytes >= (uint64_t)page_size) ? (size_t)page_size : STATE_VECTOR_ALIGNMENT;
+
+    void *amp = NULL;
+    if (posix_memalign(&amp, alignment, bytes) != 0) {
+        return NULL;
+    }
+    STATS_ALLOC(bytes);
+
+    // Zero the vector with the same static split as the kernels, so that on NUMA machines each
+    // page is first touched (and placed) by the thread that will sweep it
+    cnum *state = (cnum *)amp;
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t i = 0; i < num_states; i++) {
+        state[i] = (cnum){0.0, 0.0};
+    }
+    return state;
+}
 
 // Helper function to allocate a 2D matrix of complex numbers
 cnum **allocate_matrix(int size) {
-    // Improvement: if there are allocation issues, first free previous allocations then return NULL
     if(size) {
         cnum **matrix = (cnum **)malloc(size * sizeof(cnum *));
         if (matrix == NULL) {
@@ -44,9 +157,15 @@ cnum **allocate_matrix(int size) {
             matrix[i] = (cnum *)calloc(size, sizeof(cnum)); // Zero-initialize each element
             if (matrix[i] == NULL) {
                 fprintf(stderr, "Error zero-allocating each row of the new matrix\n");
+                // Free the rows allocated so far, so that a failure doesn't leak them
+                while (i-- > 0) {
+                    free(matrix[i]);
+                }
+                free(matrix);
                 return NULL;
             }
         }
+        STATS_ALLOCS(size + 1, (uint64_t)size * (sizeof(cnum *) + size * sizeof(cnum)));
         return matrix;
     }
     else {
@@ -71,29 +190,39 @@ void free_matrix(cnum **matrix, int dim) {
 // Function to initialize the gate list
 void init_gate_list(gate_list *gates) {
     gates->head = NULL;
+    gates->tail = NULL;
 }
 
-// Function to add a gate to the gate list
-void add_gate_to_list(gate_list *gates, qgate *gate, int *qubits) {
-    gate_node *node = malloc(sizeof(gate_node));
-    node->gate = gate;
-    node->qubits = qubits;
-    node->next = gates->head;
-    gates->head = node;
+// Allocate the qubit list of a parsed gate, in the layer arena like the gate list itself
+static int *alloc_gate_qubits(int count) {
+    int *qubits = arena_alloc(count * sizeof(int));
+    if (qubits == NULL) {
+        fprintf(stderr, "Error allocating memory for gate qubits\n");
+    }
+    return qubits;
 }
 
-// Function to clear the gate list
-void clear_gate_list(gate_list *gates) {
-    gate_node *current = gates->head;
-    while (current != NULL) {
-        free_matrix(current->gate->matrix, current->gate->size == 1 ? 2 : 4);
-        free(current->gate);
-        free(current->qubits);
-        gate_node *next = current->next;
-        free(current);
-        current = next;
-    }
-    gates->head = NULL;
+// Function to add a gate to the end of the gate list, so that gates are applied in the order they were parsed.
+// The gate is copied into the new node. Nodes come from the layer arena: a list is freed by releasing the
+// arena mark taken before parsing it. Returns 0 on success
+int add_gate_to_list(gate_list *gates, const qgate *gate, int *qubits) {
+    STATS_GATE(gate->type);
+    gate_node *node = arena_alloc(sizeof(gate_node));
+    if (node == NULL) {
+        fprintf(stderr, "Error allocating memory for a %s gate\n", gate->type);
+        return -1;
+    }
+    node->gate = *gate;
+    node->qubits = qubits;
+    node->param = -1;
+    node->next = NULL;
+    if (gates->tail != NULL) {
+        gates->tail->next = node;
+    } else {
+        gates->head = node;
+    }
+    gates->tail = node;
+    return 0;
 }
 
 // Function to create a 2x2 identity matrix
@@ -108,386 +237,229 @@ cnum **create_identity_matrix() {
     return matrix;
 }
 
-qgate *create_x_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for Y gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "X", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for X gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][1] = (cnum){1, 0};
-    gate->matrix[1][0] = (cnum){1, 0};
-    return gate;
-}
-
-qgate *create_y_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for Y gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "Y", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for Y gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][1] = (cnum){0, -1};
-    gate->matrix[1][0] = (cnum){0, 1};
-    return gate;
-}
-
-qgate *create_z_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for Z gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "Z", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for Z gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][1] = (cnum){-1, 0};
-    return gate;
-}
-
-qgate *create_h_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for H gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "H", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for H gate's matrix\n");
-        return NULL;
-    }
-    double inv_sqrt_2 = 1.0 / sqrt(2.0);
-    gate->matrix[0][0] = (cnum){inv_sqrt_2, 0};
-    gate->matrix[0][1] = (cnum){inv_sqrt_2, 0};
-    gate->matrix[1][0] = (cnum){inv_sqrt_2, 0};
-    gate->matrix[1][1] = (cnum){-inv_sqrt_2, 0};
-    return gate;
-}
-
-qgate *create_s_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for S gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "S", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for S gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][1] = (cnum){0, 1};
-    return gate;
-}
-
-qgate *create_t_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for T gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "T", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for T gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    // I got the values below using Euler's formula, to avoid having to write a complex number power function for e^(i*M_PI/4)
-    gate->matrix[1][1] = (cnum){cos(M_PI / 4), sin(M_PI / 4)};  
-    return gate;
-}
-
-qgate *create_rx_gate(double angle) {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RX gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "RX", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RX gate's matrix\n");
-        return NULL;
+// The doubles nearest to 1 / sqrt(2): 1.0 / sqrt(2.0) (= sin(M_PI / 4)) rounds down, cos(M_PI / 4) rounds up
+#define INV_SQRT_2 0x1.6a09e667f3bccp-1
+#define COS_PI_4 0x1.6a09e667f3bcdp-1
+
+// Row-major matrices of the fixed gates
+static const cnum x_matrix[4] = {{0, 0}, {1, 0}, {1, 0}, {0, 0}};
+static const cnum y_matrix[4] = {{0, 0}, {0, -1}, {0, 1}, {0, 0}};
+static const cnum z_matrix[4] = {{1, 0}, {0, 0}, {0, 0}, {-1, 0}};
+static const cnum h_matrix[4] = {{INV_SQRT_2, 0}, {INV_SQRT_2, 0}, {INV_SQRT_2, 0}, {-INV_SQRT_2, 0}};
+static const cnum s_matrix[4] = {{1, 0}, {0, 0}, {0, 0}, {0, 1}};
+// e^(i*M_PI/4) from Euler's formula, to avoid having to write a complex number power function
+static const cnum t_matrix[4] = {{1, 0}, {0, 0}, {0, 0}, {COS_PI_4, INV_SQRT_2}};
+static const cnum swap_matrix[16] = {
+    {1, 0}, {0, 0}, {0, 0}, {0, 0},
+    {0, 0}, {0, 0}, {1, 0}, {0, 0},
+    {0, 0}, {1, 0}, {0, 0}, {0, 0},
+    {0, 0}, {0, 0}, {0, 0}, {1, 0},
+};
+
+// Gates without parameters, shared read-only by every layer: parsing one allocates nothing. The controls
+// are not part of the matrices, so the qubits can be arbitrarily far apart.
+static const qgate gate_table[] = {
+    {"X", 1, 0, GATE_OP_CONTROLLED_X, x_matrix}, // A permutation: executed as amplitude swaps, with no controls
+    {"Y", 1, 0, GATE_OP_MATRIX, y_matrix},
+    {"Z", 1, 0, GATE_OP_MATRIX, z_matrix},
+    {"H", 1, 0, GATE_OP_MATRIX, h_matrix},
+    {"S", 1, 0, GATE_OP_MATRIX, s_matrix},
+    {"T", 1, 0, GATE_OP_MATRIX, t_matrix},
+    {"SWP", 2, 0, GATE_OP_SWAP, swap_matrix},
+    {"CNOT", 2, 1, GATE_OP_CONTROLLED_X, x_matrix},
+    {"CCNOT", 3, 2, GATE_OP_CONTROLLED_X, x_matrix},
+};
+
+// Rotations, whose matrix is filled in their node by set_node_rotation
+static const qgate rotation_gates[] = {
+    [ROTATION_RX] = {"RX", 1, 0, GATE_OP_MATRIX, NULL},
+    [ROTATION_RY] = {"RY", 1, 0, GATE_OP_MATRIX, NULL},
+    [ROTATION_RZ] = {"RZ", 1, 0, GATE_OP_MATRIX, NULL},
+    [ROTATION_P] = {"P", 1, 0, GATE_OP_MATRIX, NULL},
+};
+
+static const qgate *find_gate(const char *type) {
+    for (size_t g = 0; g < sizeof(gate_table) / sizeof(gate_table[0]); g++) {
+        if (strcmp(gate_table[g].type, type) == 0) {
+            return &gate_table[g];
+        }
     }
-    gate->matrix[0][0] = (cnum){cos(angle / 2), 0};
-    gate->matrix[0][1] = (cnum){0, -sin(angle / 2)};
-    gate->matrix[1][0] = (cnum){0, -sin(angle / 2)};
-    gate->matrix[1][1] = (cnum){cos(angle / 2), 0};
-    return gate;
+    return NULL;
 }
 
-qgate *create_ry_gate(double angle) {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RY gate\n");
-        return NULL;
+// A multi-controlled X, Z or P ("MCX", "MCZ" or "MCP"): the gate is applied to the target only where all
+// the controls are set. Z and P are diagonal, so a multi-controlled Z/P is symmetric in all its qubits.
+// An MCP gets its matrix from set_node_rotation.
+static qgate multi_controlled_gate(const char *type, int num_controls) {
+    qgate gate = {"", num_controls + 1, num_controls, GATE_OP_CONTROLLED_PHASE, z_matrix};
+    if (strcmp(type, "MCX") == 0) {
+        gate.op = GATE_OP_CONTROLLED_X;
+        gate.matrix = x_matrix;
     }
-    strncpy(gate->type, "RY", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RY gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){cos(angle / 2), 0};
-    gate->matrix[0][1] = (cnum){-sin(angle / 2), 0};
-    gate->matrix[1][0] = (cnum){sin(angle / 2), 0};
-    gate->matrix[1][1] = (cnum){cos(angle / 2), 0};
+    snprintf(gate.type, sizeof(gate.type), "%s", type);
     return gate;
 }
 
-qgate *create_rz_gate(double angle) {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RZ gate\n");
-        return NULL;
+int fixed_gate_matrix(const char *type, cnum m[4], gate_op *op) {
+    const qgate *gate = find_gate(type);
+    if (gate == NULL || gate->size != 1) {
+        return -1;
     }
-    strncpy(gate->type, "RZ", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for RZ gate's matrix\n");
-        return NULL;
+    memcpy(m, gate->matrix, 4 * sizeof(cnum));
+    if (op != NULL) {
+        *op = gate->op;
     }
-    // I got the values below using Euler's formula, to avoid having to write a complex number power function for e^(i*angle/2) & e^(-i*angle/2)
-    gate->matrix[0][0] = (cnum){cos(angle / 2), -sin(angle / 2)};
-    gate->matrix[1][1] = (cnum){cos(angle / 2), sin(angle / 2)};
-    return gate;
+    return 0;
 }
 
-qgate *create_phase_gate(double angle) {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for P gate\n");
-        return NULL;
+int pauli_matrices(cnum matrices[3][4]) {
+    if (fixed_gate_matrix("X", matrices[0], NULL) != 0 || fixed_gate_matrix("Y", matrices[1], NULL) != 0 ||
+        fixed_gate_matrix("Z", matrices[2], NULL) != 0) {
+        return -1;
     }
-    strncpy(gate->type, "P", sizeof(gate->type));
-    gate->size = 1;
-    gate->matrix = allocate_matrix(2);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for P gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][1] = (cnum){cos(angle), sin(angle)};
-    return gate;
+    return 0;
 }
 
-qgate *create_cnot_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for CNOT gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "CNOT", sizeof(gate->type));
-    gate->size = 2;
-    gate->matrix = allocate_matrix(4);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for CNOT gate's matrix\n");
-        return NULL;
+void rotation_matrix(rotation_gate gate, double angle, cnum m[4]) {
+    double c = cos(angle / 2), s = sin(angle / 2);
+    switch (gate) {
+        case ROTATION_RX:
+            m[0] = (cnum){c, 0}; m[1] = (cnum){0, -s};
+            m[2] = (cnum){0, -s}; m[3] = (cnum){c, 0};
+            break;
+        case ROTATION_RY:
+            m[0] = (cnum){c, 0}; m[1] = (cnum){-s, 0};
+            m[2] = (cnum){s, 0}; m[3] = (cnum){c, 0};
+            break;
+        case ROTATION_RZ:
+            // Euler's formula, to avoid having to write a complex number power function for e^(i*angle/2) & e^(-i*angle/2)
+            m[0] = (cnum){c, -s}; m[1] = (cnum){0, 0};
+            m[2] = (cnum){0, 0}; m[3] = (cnum){c, s};
+            break;
+        case ROTATION_P:
+            m[0] = (cnum){1, 0}; m[1] = (cnum){0, 0};
+            m[2] = (cnum){0, 0}; m[3] = (cnum){cos(angle), sin(angle)};
+            break;
     }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][1] = (cnum){1, 0};
-    gate->matrix[2][3] = (cnum){1, 0};
-    gate->matrix[3][2] = (cnum){1, 0};
-    return gate;
 }
 
-qgate *create_reverse_cnot_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for CNOT gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "RCNOT", sizeof(gate->type));
-    gate->size = 2;
-    gate->matrix = allocate_matrix(4);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for CNOT gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][3] = (cnum){1, 0};
-    gate->matrix[2][2] = (cnum){1, 0};
-    gate->matrix[3][1] = (cnum){1, 0};
-    return gate;
+// Rotation matrices of the last angles seen, per thread: repeated layers & sweeps reuse few angles, whose
+// sines & cosines are then computed once. Direct mapped on the angle's bits, so a hit is exact
+#define ROTATION_CACHE_SIZE 64
+
+typedef struct rotation_cache_entry {
+    uint64_t angle_bits;
+    int gate;  // rotation_gate + 1, 0 for an empty entry
+    cnum m[4];
+} rotation_cache_entry;
+
+static _Thread_local rotation_cache_entry rotation_cache[ROTATION_CACHE_SIZE];
+
+static void set_node_rotation(gate_node *node, rotation_gate gate, double angle) {
+    uint64_t bits;
+    memcpy(&bits, &angle, sizeof(bits));
+    rotation_cache_entry *entry = &rotation_cache[(splitmix64(bits) + gate) % ROTATION_CACHE_SIZE];
+    if (entry->gate != (int)gate + 1 || entry->angle_bits != bits) {
+        rotation_matrix(gate, angle, entry->m);
+        entry->gate = (int)gate + 1;
+        entry->angle_bits = bits;
+    }
+    memcpy(node->rotation, entry->m, sizeof(node->rotation));
+    node->gate.matrix = node->rotation;
 }
 
-qgate *create_swap_gate() {
-    qgate *gate = malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Failed to allocate memory for SWP gate\n");
-        return NULL;
-    }
-    strncpy(gate->type, "SWP", sizeof(gate->type));
-    gate->size = 2;
-    gate->matrix = allocate_matrix(4);
-    if (gate->matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for SWP gate's matrix\n");
-        return NULL;
-    }
-    gate->matrix[0][0] = (cnum){1, 0};
-    gate->matrix[1][2] = (cnum){1, 0};
-    gate->matrix[2][1] = (cnum){1, 0};
-    gate->matrix[3][3] = (cnum){1, 0};
-    return gate;
-}
-
-qgate *create_custom_gate(cnum **matrix, int num_qubits) {
-    debug_printf("Creating custom gate for %d qubits\n", num_qubits);
-    
-    // Allocate memory for the gate
-    qgate *gate = (qgate *)malloc(sizeof(qgate));
-    if (gate == NULL) {
-        fprintf(stderr, "Error allocating memory for custom gate.\n");
-        return NULL;
+// Check that a list of gate qubits fits in the register and has no duplicates
+static int validate_gate_qubits(int num_qubits, const char *gate_type, const int *qubits, int count) {
+    for (int j = 0; j < count; j++) {
+        if (qubits[j] < 0 || qubits[j] >= num_qubits) {
+            fprintf(stderr, "Error: specified qubit in gate %s is out of the circuit range: %d\n", gate_type, qubits[j]);
+            return -1;
+        }
+        for (int l = 0; l < j; l++) {
+            if (qubits[l] == qubits[j]) {
+                fprintf(stderr, "Error: specified qubits in gate %s are equal: %d\n", gate_type, qubits[j]);
+                return -1;
+            }
+        }
     }
-
-    // Set the number of qubits for the gate
-    gate->size = num_qubits;
-
-    // Assign the matrix to the gate (assuming the matrix is already allocated)
-    gate->matrix = matrix;
-
-    return gate;
+    return 0;
 }
 
-
-qgate *generate_generic_swap(int num_qubits, int qubit_1, int qubit_2) {
-    debug_printf("Generating generic SWAP gate for qubits %d and %d across %d qubits\n", qubit_1, qubit_2, num_qubits);
-
-    int size = 1 << num_qubits;  // 2^num_qubits
-    cnum **swap_matrix = allocate_matrix(size);
-    if (swap_matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for generic SWAP matrix\n");
-        return NULL;
-    }
-
-    // Initialize to identity matrix
-    for (int i = 0; i < size; i++) {
-        swap_matrix[i][i].re = 1.0;
-        swap_matrix[i][i].im = 0.0;
-    }
-
-    // Adjust indices so that we can effectively work as if qubit_1 is at position 0
-    int min_qubit = (qubit_1 < qubit_2) ? qubit_1 : qubit_2;
-    int adjusted_qubit_1 = qubit_1 - min_qubit;
-    int adjusted_qubit_2 = qubit_2 - min_qubit;
-    debug_printf("Translates to a swap in-between %d and %d\n", adjusted_qubit_1, adjusted_qubit_2);
-
-    // Apply swaps to construct the composite matrix
-    for (int i = 0; i < size; i++) {
-        int swapped_idx = i;
-        if (((i >> adjusted_qubit_1) & 1) != ((i >> adjusted_qubit_2) & 1)) {
-            swapped_idx ^= (1 << adjusted_qubit_1) | (1 << adjusted_qubit_2);
-            swap_matrix[i][swapped_idx].re = 1.0;
-            swap_matrix[i][i].re = 0.0; // Clear original entry if swapped
+// Parse the '_' separated arguments of a multi-controlled gate, up to the end of the operation.
+// Returns the number of arguments, with the qubit list allocated in *qubits, or -1 on error.
+// When has_angle is set, the last argument is an angle instead of a qubit.
+static int parse_multi_qubit_arguments(const char *op_ptr, int **qubits, int has_angle, double *angle) {
+    int count = 1;
+    for (const char *c = op_ptr; *c != '\0' && *c != '|'; c++) {
+        if (*c == '_') {
+            count++;
         }
     }
-
-    qgate *swap_gate = create_custom_gate(swap_matrix, num_qubits);
-    if (swap_gate == NULL) {
-        fprintf(stderr, "Failed to create custom SWAP gate\n");
-        free_matrix(swap_matrix, size);
-        return NULL;
+    int num_qubits = has_angle ? count - 1 : count;
+    if (num_qubits < 1) {
+        return -1;
     }
 
-    return swap_gate;
-}
-
-qgate *generate_dynamic_ccnot(int num_qubits, int control_1, int control_2, int target) {
-    debug_printf("Generating CCNOT gate for control qubits %d, %d and target qubit %d across %d qubits\n", control_1, control_2, target, num_qubits);
-
-    int size = 1 << num_qubits;  // 2^num_qubits
-    cnum **ccnot_matrix = allocate_matrix(size);
-    if (ccnot_matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for CCNOT matrix\n");
-        return NULL;
-    }
-
-    // Initialize to identity matrix
-    for (int i = 0; i < size; i++) {
-        ccnot_matrix[i][i].re = 1.0;
-        ccnot_matrix[i][i].im = 0.0;
+    *qubits = alloc_gate_qubits(num_qubits);
+    if (*qubits == NULL) {
+        return -1;
     }
 
-    // Adjust indices so that we can effectively work as if control_1, control_2, and target are relative positions
-    int min_qubit = (control_1 < control_2) ? (control_1 < target ? control_1 : target) : (control_2 < target ? control_2 : target);
-    int adjusted_control_1 = control_1 - min_qubit;
-    int adjusted_control_2 = control_2 - min_qubit;
-    int adjusted_target = target - min_qubit;
-
-    debug_printf("Adjusted control_1 = %d, ctrl 2 = %d, target = %d\n", adjusted_control_1, adjusted_control_2, adjusted_target);
-
-    // Apply Toffoli logic to construct the matrix
-    for (int i = 0; i < size; i++) {
-        // Check if both control qubits are set to 1
-        if (((i >> (num_qubits-1-adjusted_control_1)) & 1) == 1 && ((i >> (num_qubits-1-adjusted_control_2)) & 1) == 1) {
-            debug_printf("Hit! i=%d\n", i);
-            // Flip the target qubit only if both control qubits are 1
-            int flipped_idx = i ^ (1<< (num_qubits-1-adjusted_target));
-            if (flipped_idx != i) {
-                debug_printf("Hit hit, flipped_idx=%d\n", flipped_idx);
-                ccnot_matrix[flipped_idx][i].re = 1.0;
-                ccnot_matrix[i][i].re = 0.0;  // Clear original entry if swapped
-            }
+    const char *arg = op_ptr;
+    for (int j = 0; j < num_qubits; j++) {
+        char *end;
+        long value = strtol(arg, &end, 10);
+        if (end == arg || (*end != '_' && *end != '|' && *end != '\0')) {
+            return -1;
+        }
+        (*qubits)[j] = (int)value;
+        arg = (*end == '_') ? end + 1 : end;
+    }
+    if (has_angle) {
+        char *end;
+        *angle = strtod(arg, &end);
+        if (end == arg) {
+            return -1;
         }
     }
-
-    qgate *ccnot_gate = create_custom_gate(ccnot_matrix, num_qubits);
-    if (ccnot_gate == NULL) {
-        fprintf(stderr, "Failed to create custom CCNOT gate\n");
-        free_matrix(ccnot_matrix, size);
-        return NULL;
-    }
-
-    return ccnot_gate;
+    return num_qubits;
 }
 
+// Parse the "qubit_$name<k>" arguments of a rotation whose angle is a placeholder: any letters followed by
+// the parameter index k, e.g. "RX_0_$theta3". Returns 0 on success
+static int parse_parameter_argument(const char *op_ptr, int *qubit, int *param) {
+    char *end;
+    long value = strtol(op_ptr, &end, 10);
+    if (end == op_ptr || end[0] != '_' || end[1] != '$') {
+        return -1;
+    }
+    *qubit = (int)value;
+    const char *name = end + 2;
+    while ((*name >= 'a' && *name <= 'z') || (*name >= 'A' && *name <= 'Z')) {
+        name++;
+    }
+    long index = strtol(name, &end, 10);
+    if (end == name || *name == '-' || *name == '+' || index > INT_MAX - 1 || (*end != '|' && *end != '\0')) {
+        return -1;
+    }
+    *param = (int)index;
+    return 0;
+}
 
-
-void parse_circuit_layer(qreg *qr, const char *operations) {
+// Parse a layer's operations string (e.g. "H_0|CNOT_1_2") into a list of gates for a register of
+// num_qubits qubits. On error the gates parsed so far stay in the list, for the caller to clear.
+int parse_circuit_layer(const char *operations, int num_qubits, gate_list *gates) {
     debug_printf("Parsing circuit layer: %s\n", operations);
     const char *op_ptr = operations;
     char gate_type[16];
     int qubit_1, qubit_2, qubit_3;
     double angle;
 
-    gate_list swap_gates;
-    gate_list current_gates;
-
-    init_gate_list(&swap_gates);
-    init_gate_list(&current_gates);
-
     while (*op_ptr != '\0') {
         // Parse the gate type
         if (sscanf(op_ptr, "%15[^_]_", gate_type) != 1) {
             fprintf(stderr, "Error parsing gate type\n");
-            return;
+            return -1;
         }
 
         op_ptr += strlen(gate_type) + 1;
@@ -496,301 +468,190 @@ void parse_circuit_layer(qreg *qr, const char *operations) {
             // Parse three qubit indices for CCNOT gate
             if (sscanf(op_ptr, "%d_%d_%d", &qubit_1, &qubit_2, &qubit_3) != 3) {
                 fprintf(stderr, "Error parsing %s qubits\n", gate_type);
-                return;
+                return -1;
             }
-            if(qubit_1 > qr->size || qubit_2 > qr->size || qubit_3 > qr->size) {
+            if(qubit_1 >= num_qubits || qubit_2 >= num_qubits || qubit_3 >= num_qubits) {
                 fprintf(stderr, "Error: specified qubit in gate %s is greater than the circuit size: %d %d %d\n", gate_type, qubit_1, qubit_2, qubit_3);
-                return;
+                return -1;
             }
             if(qubit_1 < 0 || qubit_2 < 0 || qubit_3 < 0) {
                 fprintf(stderr, "Error: specified qubit in gate %s less than zero: %d %d %d\n", gate_type, qubit_1, qubit_2, qubit_3);
-                return;
+                return -1;
             }
             if(qubit_1 == qubit_2 || qubit_1 == qubit_3 || qubit_2 == qubit_3) {
                 fprintf(stderr, "Error: specified qubits in gate %s are equal: %d %d %d\n", gate_type, qubit_1, qubit_2, qubit_3);
-                return;
+                return -1;
             }
             debug_printf("Parsed CCNOT gate for control qubits %d, %d and target qubit %d\n", qubit_1, qubit_2, qubit_3);
 
-            // Re-order qubit index
-            qubit_1 = (qr->size - 1) - qubit_1;
-            qubit_2 = (qr->size - 1) - qubit_2;
-            qubit_3 = (qr->size - 1) - qubit_3;
-
-            // Generate dynamic CCNOT gate
-            int max_gate_qbit, min_gate_qbit;
-            max_gate_qbit = (qubit_1 > qubit_2) ? ((qubit_1 > qubit_3) ? qubit_1 : qubit_3) : ((qubit_2 > qubit_3) ? qubit_2 : qubit_3); 
-            min_gate_qbit = (qubit_1 < qubit_2) ? ((qubit_1 < qubit_3) ? qubit_1 : qubit_3) : ((qubit_2 < qubit_3) ? qubit_2 : qubit_3); 
+            int *qubits = alloc_gate_qubits(3);
+            if (qubits == NULL) {
+                return -1;
+            }
+            qubits[0] = qubit_1;
+            qubits[1] = qubit_2;
+            qubits[2] = qubit_3;
+            if (add_gate_to_list(gates, find_gate("CCNOT"), qubits) != 0) {
+                return -1;
+            }
+        }
+        else if (strcmp(gate_type, "MCX") == 0 || strcmp(gate_type, "MCZ") == 0 || strcmp(gate_type, "MCP") == 0) {
+            // Parse any number of qubits: controls followed by the target (and an angle for MCP)
+            int *qubits;
+            int has_angle = (strcmp(gate_type, "MCP") == 0);
+            int num_gate_qubits = parse_multi_qubit_arguments(op_ptr, &qubits, has_angle, &angle);
+            if (num_gate_qubits < 0) {
+                fprintf(stderr, "Error parsing %s qubits\n", gate_type);
+                return -1;
+            }
+            if (validate_gate_qubits(num_qubits, gate_type, qubits, num_gate_qubits) != 0) {
+                return -1;
+            }
+            debug_printf("Parsed %s gate with %d controls\n", gate_type, num_gate_qubits - 1);
 
-            qgate *ccnot_gate = generate_dynamic_ccnot((max_gate_qbit - min_gate_qbit) + 1, qubit_1, qubit_2, qubit_3);
-            if (ccnot_gate == NULL) {
-                fprintf(stderr, "Failed to generate dynamic CCNOT gate\n");
-                return;
+            qgate gate = multi_controlled_gate(gate_type, num_gate_qubits - 1);
+            if (add_gate_to_list(gates, &gate, qubits) != 0) {
+                return -1;
+            }
+            if (has_angle) {
+                set_node_rotation(gates->tail, ROTATION_P, angle);
             }
-            int *qubits = malloc(3 * sizeof(int));
-            // Must assign these in increasing order
-            qubits[0] = qubit_1 < qubit_2 ? (qubit_1 < qubit_3? qubit_1 : qubit_3) : (qubit_2 < qubit_3? qubit_2 : qubit_3);
-            qubits[1] = qubit_1 < qubit_2 ? (qubit_1 < qubit_3 ? (qubit_2 < qubit_3 ? qubit_2: qubit_3) : qubit_1) : (qubit_1 > qubit_3? (qubit_2 > qubit_3 ? qubit_2 : qubit_3) : qubit_1);
-            qubits[2] = qubit_1 > qubit_2 ? (qubit_1 > qubit_3? qubit_1 : qubit_3) : (qubit_2 > qubit_3? qubit_2 : qubit_3);
-            add_gate_to_list(&current_gates, ccnot_gate, qubits);
         }
         else if (strcmp(gate_type, "SWP") == 0) {
             // Parse two qubit indices for SWP gate
             if (sscanf(op_ptr, "%d_%d", &qubit_1, &qubit_2) != 2) {
                 fprintf(stderr, "Error parsing SWP qubits\n");
-                return;
+                return -1;
             }
-            if(qubit_1 > qr->size || qubit_2 > qr->size) {
+            if(qubit_1 >= num_qubits || qubit_2 >= num_qubits) {
                 fprintf(stderr, "Error: specified qubit in gate %s is greater than the circuit size: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
             if(qubit_1 < 0 || qubit_2 < 0) {
                 fprintf(stderr, "Error: specified qubit in gate %s less than zero: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
             if(qubit_1 == qubit_2) {
                 fprintf(stderr, "Error: specified qubits in gate %s are equal: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
 
             debug_printf("Parsed SWP gate for qubits %d and %d\n", qubit_1, qubit_2);
 
-            // Re-order qubit index
-            qubit_1 = (qr->size - 1) - qubit_1;
-            qubit_2 = (qr->size - 1) - qubit_2;
-
-            // Normalize qubit order to ensure qubit_1 < qubit_2
-            if (qubit_1 > qubit_2) {
-                int temp = qubit_1;
-                qubit_1 = qubit_2;
-                qubit_2 = temp;
+            // Create SWP gate and add to circuit, the qubits don't need to be adjacent
+            int *qubits = alloc_gate_qubits(2);
+            if (qubits == NULL) {
+                return -1;
             }
-
-            // Check if qubits are adjacent
-            if (abs(qubit_1 - qubit_2) == 1) {
-                // Add adjacent SWAP gate to the gate list as before
-                // Create SWP gate and add to circuit
-                qgate *swap_gate = create_swap_gate();
-                int *qubits = malloc(2 * sizeof(int));
-                qubits[0] = qubit_1;
-                qubits[1] = qubit_2;
-                add_gate_to_list(&current_gates, swap_gate, qubits);
-            } else {
-                // Generate a generic SWAP matrix and add it to the gate list
-                qgate *swap_gate = generate_generic_swap(abs(qubit_1-qubit_2)+1, qubit_1, qubit_2);
-                if (swap_gate != NULL) {
-                    int *qubits = malloc(2 * sizeof(int));
-                    qubits[0] = qubit_1;
-                    qubits[1] = qubit_2;
-                    add_gate_to_list(&current_gates, swap_gate, qubits);
-                }
+            qubits[0] = qubit_1;
+            qubits[1] = qubit_2;
+            if (add_gate_to_list(gates, find_gate("SWP"), qubits) != 0) {
+                return -1;
             }
         }
         else if (strcmp(gate_type, "CNOT") == 0) {
             // Parse two qubit indices for CNOT gate
             if (sscanf(op_ptr, "%d_%d", &qubit_1, &qubit_2) != 2) {
                 fprintf(stderr, "Error parsing %s qubits\n", gate_type);
-                return;
+                return -1;
             }
-            if(qubit_1 > qr->size || qubit_2 > qr->size) {
+            if(qubit_1 >= num_qubits || qubit_2 >= num_qubits) {
                 fprintf(stderr, "Error: specified qubit in gate %s is greater than the circuit size: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
             if(qubit_1 < 0 || qubit_2 < 0) {
                 fprintf(stderr, "Error: specified qubit in gate %s less than zero: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
             if(qubit_1 == qubit_2) {
                 fprintf(stderr, "Error: specified qubits in gate %s are equal: %d %d\n", gate_type, qubit_1, qubit_2);
-                return;
+                return -1;
             }
 
             debug_printf("Parsed CNOT gate for qubits %d and %d\n", qubit_1, qubit_2);
 
-            // Re-order qubit index
-            qubit_1 = (qr->size - 1) - qubit_1;
-            qubit_2 = (qr->size - 1) - qubit_2;
-
-            // Handle non-adjacent or reverse-ordered CNOTs
-            if (abs(qubit_1 - qubit_2) != 1 || qubit_1 > qubit_2) {
-                if (qubit_1 > qubit_2) {
-                    if(qubit_1 == qubit_2+1) {
-                        // Use the reverse CNOT matrix for non-ordered control and target
-                        qgate *reverse_cnot_gate = create_reverse_cnot_gate();
-                        if (reverse_cnot_gate == NULL) {
-                            fprintf(stderr, "Failed to generate reverse CNOT gate\n");
-                            return;
-                        }
-                        int *qubits = malloc(2 * sizeof(int));
-                        qubits[1] = qubit_1;
-                        qubits[0] = qubit_2;
-                        add_gate_to_list(&current_gates, reverse_cnot_gate, qubits);
-                    }
-                    else {
-                        // Swap control and target to make them adjacent and correctly ordered
-                        int swap_target = qubit_2;
-                        int swap_to = qubit_1 - 1;
-                        qgate *swap_gate;
-                        debug_printf("Qubits %d and %d require swapping\n", swap_target, swap_to);
-
-                        // Check if qubits are adjacent
-                        if (abs(swap_target - swap_to) == 1) {
-                            swap_gate = create_swap_gate();
-                        } else {
-                            // Generate a generic SWAP matrix and add it to the gate list
-                            swap_gate = generate_generic_swap(abs(swap_target-swap_to)+1, swap_target, swap_to);
-                        }
-                        if (swap_gate == NULL) {
-                            fprintf(stderr, "Failed to generate swap gate\n");
-                            return;
-                        }
-                        int *qubits = malloc(2 * sizeof(int));
-                        qubits[0] = swap_target;
-                        qubits[1] = swap_to;
-                        add_gate_to_list(&swap_gates, swap_gate, qubits);
-
-                        // Use the reverse CNOT matrix for non-ordered control and target
-                        qgate *reverse_cnot_gate = create_reverse_cnot_gate();
-                        if (reverse_cnot_gate == NULL) {
-                            fprintf(stderr, "Failed to generate reverse CNOT gate\n");
-                            return;
-                        }
-                        qubits = malloc(2 * sizeof(int));
-                        qubits[1] = qubit_1;
-                        qubits[0] = swap_to;
-                        add_gate_to_list(&current_gates, reverse_cnot_gate, qubits);
-                    }
-                } else {
-                    // Move target qubit adjacent to control
-                    int swap_target = qubit_2;
-                    int swap_to = qubit_1 + 1;
-                    qgate *swap_gate;
-
-                    debug_printf("Qubits %d and %d require swapping\n", swap_target, swap_to);
-
-                    // Check if qubits are adjacent
-                    if (abs(swap_target - swap_to) == 1) {
-                        swap_gate = create_swap_gate();
-                    } else {
-                        // Generate a generic SWAP matrix and add it to the gate list
-                        swap_gate = generate_generic_swap(abs(swap_target-swap_to)+1, swap_target, swap_to);
-                    }
-                    if (swap_gate == NULL) {
-                        fprintf(stderr, "Failed to generate swap gate\n");
-                        return;
-                    }
-                    int *qubits = malloc(2 * sizeof(int));
-                    qubits[1] = swap_target;
-                    qubits[0] = swap_to;
-                    add_gate_to_list(&swap_gates, swap_gate, qubits);
-
-                    // Generate standard CNOT gate
-                    qgate *cnot_gate = create_cnot_gate();
-                    if (cnot_gate == NULL) {
-                        fprintf(stderr, "Failed to generate CNOT gate\n");
-                        return;
-                    }
-                    qubits = malloc(2 * sizeof(int));
-                    qubits[0] = qubit_1;
-                    qubits[1] = swap_to;
-                    add_gate_to_list(&current_gates, cnot_gate, qubits);
-                }
-            } else {
-                // Add standard CNOT gate to current gates if adjacent and in correct order
-                qgate *cnot_gate = create_cnot_gate();
-                if (cnot_gate == NULL) {
-                    fprintf(stderr, "Failed to generate CNOT gate\n");
-                    return;
-                }
-                int *qubits = malloc(2 * sizeof(int));
-                qubits[0] = qubit_1;
-                qubits[1] = qubit_2;
-                add_gate_to_list(&current_gates, cnot_gate, qubits);
+            // Create CNOT gate and add to circuit, in any order and at any distance
+            int *qubits = alloc_gate_qubits(2);
+            if (qubits == NULL) {
+                return -1;
+            }
+            qubits[0] = qubit_1;
+            qubits[1] = qubit_2;
+            if (add_gate_to_list(gates, find_gate("CNOT"), qubits) != 0) {
+                return -1;
             }
         } else if (strcmp(gate_type, "X") == 0 || strcmp(gate_type, "Y") == 0 || strcmp(gate_type, "Z") == 0 ||
                    strcmp(gate_type, "H") == 0 || strcmp(gate_type, "S") == 0 || strcmp(gate_type, "T") == 0) {
             // Parse single qubit index for 1-qubit gates
             if (sscanf(op_ptr, "%d", &qubit_1) != 1) {
                 fprintf(stderr, "Error parsing %s qubit\n", gate_type);
-                return;
+                return -1;
             }
-            if(qubit_1 > qr->size) {
+            if(qubit_1 >= num_qubits) {
                 fprintf(stderr, "Error: specified qubit in gate is greater than the circuit size: %d\n", qubit_1);
+                return -1;
             }
             // Validate qubit index is non-negative
             if (qubit_1 < 0) {
                 fprintf(stderr, "Invalid qubit index for %s gate: must be non-negative\n", gate_type);
-                return;
+                return -1;
             }
 
-            // Re-order qubit index
-            qubit_1 = (qr->size - 1) - qubit_1;
-
-            // Create gate and add to circuit
-            qgate *gate;
-            if (strcmp(gate_type, "X") == 0) {
-                gate = create_x_gate();
-            } else if (strcmp(gate_type, "Y") == 0) {
-                gate = create_y_gate();
-            } else if (strcmp(gate_type, "Z") == 0) {
-                gate = create_z_gate();
-            } else if (strcmp(gate_type, "H") == 0) {
-                gate = create_h_gate();
-            } else if (strcmp(gate_type, "S") == 0) {
-                gate = create_s_gate();
-            } else { // T gate
-                gate = create_t_gate();
+            // Add the gate from the table to circuit
+            int *qubits = alloc_gate_qubits(1);
+            if (qubits == NULL) {
+                return -1;
             }
-            if (gate == NULL) {
-                fprintf(stderr, "Failed to generate %s gate\n", gate_type);
-                return;
-            }
-            
-            int *qubits = malloc(sizeof(int));
             qubits[0] = qubit_1;
 
-            add_gate_to_list(&current_gates, gate, qubits);
+            if (add_gate_to_list(gates, find_gate(gate_type), qubits) != 0) {
+                return -1;
+            }
         } else if (strcmp(gate_type, "RX") == 0 || strcmp(gate_type, "RY") == 0 || strcmp(gate_type, "RZ") == 0 || strcmp(gate_type, "P") == 0) {
-            // Parse single qubit index and angle for rotation or phase gates
+            // Parse single qubit index and angle for rotation or phase gates, the angle can be a parameter
+            int param = -1;
             if (sscanf(op_ptr, "%d_%lf", &qubit_1, &angle) != 2) {
-                fprintf(stderr, "Error parsing %s gate\n", gate_type);
-                return;
+                if (parse_parameter_argument(op_ptr, &qubit_1, &param) != 0) {
+                    fprintf(stderr, "Error parsing %s gate\n", gate_type);
+                    return -1;
+                }
+                angle = 0.0;
             }
-            if(qubit_1 > qr->size) {
+            if(qubit_1 >= num_qubits) {
                 fprintf(stderr, "Error: specified qubit in gate is greater than the circuit size: %d\n", qubit_1);
+                return -1;
             }
             // Validate qubit index is non-negative
             if (qubit_1 < 0) {
                 fprintf(stderr, "Invalid qubit index for %s gate: must be non-negative\n", gate_type);
-                return;
+                return -1;
             }
 
-            // Re-order qubit index
-            qubit_1 = (qr->size - 1) - qubit_1;
-
-            // Create gate and add to circuit
-            qgate *gate;
+            // Add gate to circuit, with its matrix
+            rotation_gate rotation;
             if (strcmp(gate_type, "RX") == 0) {
-                gate = create_rx_gate(angle);
+                rotation = ROTATION_RX;
             } else if (strcmp(gate_type, "RY") == 0) {
-                gate = create_ry_gate(angle);
+                rotation = ROTATION_RY;
             } else if (strcmp(gate_type, "RZ") == 0) {
-                gate = create_rz_gate(angle);
+                rotation = ROTATION_RZ;
             } else { // Phase gate
-                gate = create_phase_gate(angle);
+                rotation = ROTATION_P;
             }
-            if (gate == NULL) {
-                fprintf(stderr, "Failed to generate %s gate\n", gate_type);
-                return;
+            int *qubits = alloc_gate_qubits(1);
+            if (qubits == NULL) {
+                return -1;
             }
-
-            int *qubits = malloc(sizeof(int));
             qubits[0] = qubit_1;
 
-            add_gate_to_list(&current_gates, gate, qubits);
+            if (add_gate_to_list(gates, &rotation_gates[rotation], qubits) != 0) {
+                return -1;
+            }
+            set_node_rotation(gates->tail, rotation, angle);
+            gates->tail->param = param;
         } else {
             fprintf(stderr, "Unsupported gate type: %s\n", gate_type);
-            return;
+            return -1;
         }
 
         // Move pointer to next operation
@@ -798,142 +659,148 @@ void parse_circuit_layer(qreg *qr, const char *operations) {
         if (*op_ptr == '|') op_ptr++;
     }
 
-    // Apply the gates: apply the SWAP gates if they exist, then the current gates, then the SWAP gates again
-    if (swap_gates.head != NULL) {
-        debug_printf("Applying swap gates before main gates:\n");
-        apply_gate(qr, &swap_gates);
-    }
-
-    if (current_gates.head != NULL) {
-        debug_printf("Applying main gates:\n");
-        apply_gate(qr, &current_gates);
-    }
+    return 0;
+}
 
-    if (swap_gates.head != NULL) {
-        debug_printf("Re-applying swap gates after main gates:\n");
-        apply_gate(qr, &swap_gates);
+uint64_t qc_qreg_bytes(int size) {
+    if (size < 1 || size > QUBIT_REGISTER_LIMIT) {
+        return 0;
     }
-
-    // Clean up
-    clear_gate_list(&swap_gates);
-    clear_gate_list(&current_gates);
+    return (1ULL << size) * sizeof(cnum);
 }
 
 qreg *new_qreg(int size) {
+    if (size < 1) {
+        fprintf(stderr, "Error: a quantum register needs at least 1 qubit, attempted %d\n", size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
     if (size > QUBIT_REGISTER_LIMIT) {
-        printf("Cannot support more than %d qubits currently, attempted %d\n", QUBIT_REGISTER_LIMIT, size);
+        fprintf(stderr, "Cannot support more than %d qubits currently, attempted %d\n", QUBIT_REGISTER_LIMIT, size);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
         return NULL;
     }
 
+    uint64_t bytes = qc_qreg_bytes(size);
+    if (check_state_vector_fits(1ULL << size) != 0) {
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    debug_printf("Allocating %d qubit register: %llu bytes\n", size, (unsigned long long)bytes);
+
     // Allocate memory for the quantum register
     qreg *qr = (qreg *)malloc(sizeof(qreg));
     if (qr == NULL) {
         fprintf(stderr, "Error allocating memory for quantum register.\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
         return NULL;
     }
 
     // Set the size
     qr->size = size;
-
-    // Allocate memory for the state vector (2^size complex amplitudes)
-    int num_states = 1 << size; // 2^size
-    qr->amp = (cnum *)malloc(num_states * sizeof(cnum));
+    qr->mapped_bytes = 0;
+    qr->sparse = NULL;
+    qr->tableau = NULL;
+    qr->mps = NULL;
+    qr->back_buffer = NULL;
+
+    // Allocate memory for the state vector (2^size complex amplitudes, all zero)
+    uint64_t num_states = 1ULL << size; // 2^size
+    qr->amp = alloc_state_vector(num_states);
     if (qr->amp == NULL) {
-        fprintf(stderr, "Error allocating memory for state vector.\n");
+        fprintf(stderr, "Error allocating %llu bytes for state vector.\n", (unsigned long long)bytes);
         free(qr);
+        set_status(QC_ERR_OUT_OF_MEMORY);
         return NULL;
     }
 
-    // Initialize all amplitudes to 0 except for the first state |00...0>
+    // Initialize the register to the |00...0> state
     qr->amp[0].re = 1.0;
     qr->amp[0].im = 0.0;
-    for (int i = 1; i < num_states; i++) {
-        qr->amp[i].re = 0.0;
-        qr->amp[i].im = 0.0;
-    }
 
+    set_status(QC_OK);
     return qr;
 }
 
 void free_qreg(qreg *qr) {
     if (qr != NULL) {
-        // Free the state vector
-        if (qr->amp != NULL) {
+        // Free the state vector (or the sparse map), or unmap it if it was loaded from a checkpoint
+        if (qr->tableau != NULL) {
+            tableau_free(qr->tableau);
+        } else if (qr->mps != NULL) {
+            mps_free(qr->mps);
+        } else if (qr->sparse != NULL) {
+            sparse_free(qr->sparse);
+        } else if (qr->mapped_bytes != 0) {
+            unmap_state_vector(qr);
+        } else if (qr->amp != NULL) {
             free(qr->amp);
         }
+        free(qr->back_buffer);
         // Free the quantum register structure itself
         free(qr);
     }
 }
 
 // Helper function to print binary representation of a basis state
-static void print_binary(int num, int bits) {
+static void print_binary(uint64_t num, int bits) {
     for (int i = bits - 1; i >= 0; i--) {
-        printf("%d", (num >> i) & 1);
+        printf("%d", (int)((num >> i) & 1));
     }
 }
 
-void view_state_vector(qreg *qr) {
-    if (qr) {
-        int num_states = 1 << qr->size; // 2^size
-
-        for (int i = 0; i < num_states; i++) {
-            // Get real and imaginary parts of the amplitude
-            double re = qr->amp[i].re;
-            double im = qr->amp[i].im;
+// Helper function to print one amplitude with Dirac notation, skipping it if it is zero
+static void print_amplitude(cnum amplitude, uint64_t index, int bits) {
+    // Get real and imaginary parts of the amplitude
+    double re = amplitude.re;
+    double im = amplitude.im;
 
-            // Skip printing if the amplitude is zero
-            if (fabs(re) < 1e-6 && fabs(im) < 1e-6) {
-                continue;
-            }
-
-            // Print the amplitude with Dirac notation
-            printf("(%.2f%s%.2fi)*|", re, (im >= 0) ? "+" : "", im);
-            print_binary(i, qr->size); // Print binary representation of the state
-            printf(">\n");
-        }
-    }
-    else {
-        fprintf(stderr, "Error trying to view state vector on a null quantum register!\n");
+    // Skip printing if the amplitude is zero
+    if (fabs(re) < 1e-6 && fabs(im) < 1e-6) {
+        return;
     }
+
+    // Print the amplitude with Dirac notation
+    printf("(%.2f%s%.2fi)*|", re, (im >= 0) ? "+" : "", im);
+    print_binary(index, bits); // Print binary representation of the state
+    printf(">\n");
 }
 
-// Compute the tensor product of two matrices A (dimA x dimA) and B (dimB x dimB)
-cnum **tensor_product(cnum **A, int dimA, cnum **B, int dimB) {
-    if(A == NULL || B == NULL) {
-        fprintf(stderr, "Error trying to do tensor product with at least 1 NULL matrix\n");
-        return NULL;
+void view_state_vector(qreg *qr) {
+    if (qr && qr->tableau) {
+        tableau_print(qr->tableau);
+    }
+    else if (qr && qr->mps) {
+        // Amplitudes are contracted one by one, small registers only
+        mps_print(qr->mps);
+        for (uint64_t i = 0; qr->size <= MPS_VIEW_QUBIT_LIMIT && i < (1ULL << qr->size); i++) {
+            print_amplitude(qc_get_amplitude(qr, i), i, qr->size);
+        }
     }
-    
-    int dim_out = dimA * dimB;
-    cnum **result = allocate_matrix(dim_out); // Allocate a dim_out x dim_out matrix
-    if(result == NULL) {
-        fprintf(stderr, "Error allocating matrix for tensor product\n");
-        return NULL;
+    else if (qr && qr->sparse) {
+        // Only the stored amplitudes, in the same order as a dense register
+        uint64_t *keys = sparse_sorted_keys(qr->sparse);
+        if (keys == NULL) {
+            fprintf(stderr, "Error allocating memory to view a sparse state\n");
+            return;
+        }
+        for (uint64_t k = 0; k < qr->sparse->count; k++) {
+            print_amplitude(sparse_get(qr->sparse, keys[k]), keys[k], qr->size);
+        }
+        free(keys);
     }
+    else if (qr) {
+        uint64_t num_states = 1ULL << qr->size; // 2^size
 
-    debug_printf("Computing tensor product: %dx%d ⊗ %dx%d = %dx%d\n", dimA, dimA, dimB, dimB, dim_out, dim_out);
-
-    for (int i = 0; i < dimA; i++) {
-        for (int j = 0; j < dimA; j++) {
-            for (int k = 0; k < dimB; k++) {
-                for (int l = 0; l < dimB; l++) {
-                    int row = i * dimB + k;
-                    int col = j * dimB + l;
-
-                    // Ensure that each row and column are allocated properly
-                    // printf("Setting result[%d][%d]\n", row, col);
-
-                    result[row][col].re = A[i][j].re * B[k][l].re - A[i][j].im * B[k][l].im;
-                    result[row][col].im = A[i][j].re * B[k][l].im + A[i][j].im * B[k][l].re;
-                }
-            }
+        for (uint64_t i = 0; i < num_states; i++) {
+            print_amplitude(qr->amp[i], i, qr->size);
         }
     }
-    return result;
+    else {
+        fprintf(stderr, "Error trying to view state vector on a null quantum register!\n");
+    }
 }
 
-
 void print_gate_matrix(cnum **matrix, int size) {
     if(matrix == NULL) {
         fprintf(stderr, "Error printing a NULL matrix\n");
@@ -954,83 +821,57 @@ void print_gate_matrix(cnum **matrix, int size) {
 }
 
 
-cnum **expand_gate_matrix(qgate *gate, int num_qubits, int *target_qubits) {
+// Expand a gate to the full 2^n x 2^n operator: an entry is non-zero only when the row and column
+// indices agree outside of the gate's target qubits; where all the controls are set it is taken from
+// the gate matrix, elsewhere the operator is the identity.
+cnum **expand_gate_matrix(const qgate *gate, int num_qubits, int *gate_qubits) {
     if (gate == NULL) {
         fprintf(stderr, "Error expanding a NULL gate\n");
         return NULL;
     }
 
-    int gate_size = gate->size;  // Number of qubits the gate operates on
-    cnum **expanded_matrix = NULL;
-
-    // Start with an identity matrix for the expansion
-    expanded_matrix = allocate_matrix(1);
+    STATS_BEGIN(stats_start);
+    int full_size = 1 << num_qubits;
+    int num_targets = gate->size - gate->num_controls;
+    cnum **expanded_matrix = allocate_matrix(full_size);
     if (expanded_matrix == NULL) {
-        fprintf(stderr, "Error allocating the first expansion matrix\n");
+        fprintf(stderr, "Error allocating the expanded gate matrix\n");
         return NULL;
     }
-    expanded_matrix[0][0].re = 1.0; // Start with a 1x1 identity element
-
-    int target_index = 0;
-    int expanded_qubits = 0;  // Tracks the number of qubits incorporated into expanded_matrix
-
-    for (int i = 0; i < num_qubits; i++) {
-        cnum **current_matrix;
-        int current_matrix_size;
-
-        // Check if the current qubit is part of the target qubits for this gate
-        if (target_index < gate_size && i == target_qubits[target_index]) {
-            // Use the gate matrix for the targeted qubits
-            current_matrix = gate->matrix;
-            current_matrix_size = 1 << gate_size;
 
-            // Move to the next target qubit
-            target_index++;
-
-            // Skip the rest of the target qubits covered by this multi-qubit gate
-            i += (gate_size - 1);
-        } else {
-            // Use a 2x2 identity matrix for non-target qubits
-            current_matrix_size = 2;
-            current_matrix = allocate_matrix(current_matrix_size);
-            if (current_matrix == NULL) {
-                fprintf(stderr, "Failed to allocate identity matrix for expansion\n");
-                if (expanded_matrix != NULL) {
-                    free_matrix(expanded_matrix, 1 << expanded_qubits);
-                }
-                return NULL;
-            }
-
-            // Initialize as a 2x2 identity matrix
-            current_matrix[0][0].re = 1.0;
-            current_matrix[1][1].re = 1.0;
-        }
+    int control_mask = 0;
+    for (int q = 0; q < gate->num_controls; q++) {
+        control_mask |= 1 << gate_qubits[q];
+    }
+    int target_mask = 0;
+    for (int q = gate->num_controls; q < gate->size; q++) {
+        target_mask |= 1 << gate_qubits[q];
+    }
 
-        // Compute the tensor product with the current expanded matrix so far
-        int expanded_size = 1 << expanded_qubits;  // Size of the expanded matrix so far
-        cnum **temp_matrix = tensor_product(expanded_matrix, expanded_size, current_matrix, current_matrix_size);
-        if(temp_matrix == NULL) {
-            fprintf(stderr, "Error calculating tensor product\n");
-            return NULL;
+    for (int col = 0; col < full_size; col++) {
+        if ((col & control_mask) != control_mask) {
+            expanded_matrix[col][col].re = 1.0;
+            continue;
         }
 
-        // Free the old expanded matrix if it wasn't the gate itself
-        if (expanded_matrix != gate->matrix) {
-            free_matrix(expanded_matrix, expanded_size);
+        // Position of the column inside the gate matrix, the first target being its MSB
+        int sub_col = 0;
+        for (int t = 0; t < num_targets; t++) {
+            sub_col = (sub_col << 1) | ((col >> gate_qubits[gate->num_controls + t]) & 1);
         }
 
-        // If the current matrix was an identity matrix, we need to free it
-        if (current_matrix != gate->matrix) {
-            free_matrix(current_matrix, current_matrix_size);
+        for (int sub_row = 0; sub_row < (1 << num_targets); sub_row++) {
+            int row = col & ~target_mask;
+            for (int t = 0; t < num_targets; t++) {
+                if ((sub_row >> (num_targets - 1 - t)) & 1) {
+                    row |= 1 << gate_qubits[gate->num_controls + t];
+                }
+            }
+            expanded_matrix[row][col] = gate->matrix[(sub_row << num_targets) + sub_col];
         }
-
-        // Update the expanded matrix with the newly computed tensor product
-        expanded_matrix = temp_matrix;
-
-        // Update the number of qubits incorporated into expanded_matrix
-        expanded_qubits += (current_matrix_size == 1 << gate_size) ? gate_size : 1;
     }
 
+    STATS_END(QC_PHASE_DENSE_EXPAND, stats_start);
     return expanded_matrix;
 }
 
@@ -1043,6 +884,7 @@ cnum **multiply_matrices(cnum **A, cnum **B, int size) {
     }
 
     debug_printf("Multiplying matrices of size %d x %d\n", size, size);
+    STATS_BEGIN(stats_start);
     cnum **result = allocate_matrix(size);
     if (result == NULL) {
         fprintf(stderr, "Failed to allocate memory for result matrix\n");
@@ -1057,7 +899,8 @@ cnum **multiply_matrices(cnum **A, cnum **B, int size) {
         }
     }
 
-    // Perform matrix multiplication
+    // Perform matrix multiplication, rows are independent
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads())
     for (int i = 0; i < size; i++) {
         for (int j = 0; j < size; j++) {
             for (int k = 0; k < size; k++) {
@@ -1071,6 +914,7 @@ cnum **multiply_matrices(cnum **A, cnum **B, int size) {
         }
     }
 
+    STATS_END(QC_PHASE_DENSE_MULTIPLY, stats_start);
     return result;
 }
 
@@ -1101,11 +945,10 @@ cnum **build_full_operator_matrix(gate_list *gates, int num_qubits) {
 
     // Iterate over all gates in the gate list
     for (gate_node *node = gates->head; node != NULL; node = node->next) {
-        debug_printf("Expanding gate matrix for gate with %d qubits:\n", node->gate->size);
-        print_gate_matrix(node->gate->matrix, 1 << node->gate->size);
+        debug_printf("Expanding gate matrix for %s gate with %d qubits:\n", node->gate.type, node->gate.size);
 
         // Expand the gate matrix to the full system size
-        cnum **expanded_matrix = expand_gate_matrix(node->gate, num_qubits, node->qubits);
+        cnum **expanded_matrix = expand_gate_matrix(&node->gate, num_qubits, node->qubits);
         if (expanded_matrix == NULL) {
             fprintf(stderr, "Failed to expand gate matrix\n");
             free_matrix(full_matrix, full_size);
@@ -1116,8 +959,8 @@ cnum **build_full_operator_matrix(gate_list *gates, int num_qubits) {
         print_gate_matrix(expanded_matrix, full_size);
 
 
-        // Multiply the current full matrix with the expanded gate matrix
-        cnum **temp_matrix = multiply_matrices(full_matrix, expanded_matrix, full_size);
+        // Multiply the expanded gate matrix with the current full matrix (later gates act after earlier ones)
+        cnum **temp_matrix = multiply_matrices(expanded_matrix, full_matrix, full_size);
         if (temp_matrix == NULL) {
             fprintf(stderr, "Failed to multiply matrices\n");
             free_matrix(full_matrix, full_size);
@@ -1138,53 +981,511 @@ cnum **build_full_operator_matrix(gate_list *gates, int num_qubits) {
 
 
 
-void apply_operator_to_state(qreg *qr, cnum **operator_matrix) {
+qc_status apply_operator_to_state(qreg *qr, cnum **operator_matrix) {
     if (qr == NULL || operator_matrix == NULL) {
         fprintf(stderr, "Error trying to apply operator to state, with NULL inputs\n");
-        return;
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    STATS_BEGIN(stats_start);
+    int num_states = 1 << qr->size; // 2^N for N qubits, at most 2^DENSE_ENGINE_QUBIT_LIMIT
+    // The product goes to the register's back buffer, allocated by the first layer and swapped with the
+    // state vector after each one, so that the following layers don't allocate a new state vector
+    if (qr->back_buffer == NULL) {
+        qr->back_buffer = alloc_state_vector(num_states);
+        if (qr->back_buffer == NULL) {
+            fprintf(stderr, "Error allocating new state vector\n");
+            return QC_ERR_OUT_OF_MEMORY;
+        }
     }
-
-    int num_states = 1 << qr->size; // 2^N for N qubits
-    cnum *new_state = (cnum *)calloc(num_states, sizeof(cnum)); // Zero-initialize new state vector
+    cnum *new_state = qr->back_buffer;
 
     debug_printf("Applying operator to state vector (size: %d)\n", num_states);
     debug_printf("Address of operator_matrix: %p\n", (void *)operator_matrix);
     debug_printf("Address of qr->amp: %p\n", (void *)qr->amp);
     debug_printf("Address of new_state: %p\n", (void *)new_state);
 
-    // Perform matrix-vector multiplication to apply the operator
+    // Perform matrix-vector multiplication to apply the operator, rows are independent
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads())
     for (int i = 0; i < num_states; i++) {
-        // printf("Processing new_state[%d]\n", i);  // Debug: Track each element
+        // Check bounds to ensure no invalid access
+        if (operator_matrix[i] == NULL || qr->amp == NULL) {
+            fprintf(stderr, "Null pointer access at operator_matrix[%d] or qr->amp\n", i);
+            exit(EXIT_FAILURE);
+        }
+        // Every entry of the back buffer is overwritten, so it doesn't need to be zeroed first
+        cnum sum = {0.0, 0.0};
         for (int j = 0; j < num_states; j++) {
-            // Check bounds to ensure no invalid access
-            if (operator_matrix[i] == NULL || qr->amp == NULL) {
-                fprintf(stderr, "Null pointer access at operator_matrix[%d] or qr->amp\n", i);
-                exit(EXIT_FAILURE);
+            sum.re += operator_matrix[i][j].re * qr->amp[j].re - operator_matrix[i][j].im * qr->amp[j].im;
+            sum.im += operator_matrix[i][j].re * qr->amp[j].im + operator_matrix[i][j].im * qr->amp[j].re;
+        }
+        new_state[i] = sum;
+    }
+
+    // Swap the state vector & the back buffer. A state vector memory mapped from a checkpoint is
+    // unmapped instead, the next layer allocating a back buffer of its own
+    if (qr->mapped_bytes != 0) {
+        unmap_state_vector(qr);
+        qr->back_buffer = NULL;
+    } else {
+        qr->back_buffer = qr->amp;
+    }
+    qr->amp = new_state;
+
+    STATS_SWEEPS(1);
+    STATS_END(QC_PHASE_DENSE_APPLY, stats_start);
+    debug_printf("Operator application complete\n");
+    return QC_OK;
+}
+
+
+
+// In-place execution engine
+//
+// Instead of expanding every gate to a 2^n x 2^n operator, each gate is applied directly to the
+// state vector: a k-qubit gate mixes groups of 2^k amplitudes whose indices only differ in the
+// gate's qubit bits, so one layer costs O(2^n) per gate and needs no operator matrices at all.
+// Qubit arguments of the kernels are bit positions inside the amplitude index (qubit 0 = LSB),
+// and the first qubit of a multi-qubit gate is the most significant bit of the gate's sub-index.
+
+static void sort_qubits(int *qubits, int count) {
+    for (int j = 1; j < count; j++) {
+        for (int l = j; l > 0 && qubits[l - 1] > qubits[l]; l--) {
+            int tmp = qubits[l];
+            qubits[l] = qubits[l - 1];
+            qubits[l - 1] = tmp;
+        }
+    }
+}
+
+// Apply a 2x2 matrix (row-major) to the target qubit, iterating over amplitude pairs
+void scalar_single_qubit_kernel(cnum *amp, int num_qubits, int target, const cnum *m) {
+    uint64_t num_pairs = (1ULL << num_qubits) >> 1;
+    uint64_t stride = 1ULL << target;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_pairs; k++) {
+        uint64_t i0 = insert_zero_bit(k, target);
+        uint64_t i1 = i0 | stride;
+        cnum a0 = amp[i0];
+        cnum a1 = amp[i1];
+        amp[i0] = cnum_add(cnum_mul(m[0], a0), cnum_mul(m[1], a1));
+        amp[i1] = cnum_add(cnum_mul(m[2], a0), cnum_mul(m[3], a1));
+    }
+}
+
+// Multiply the amplitudes by d0 where the target qubit is 0 and by d1 where it is 1 (Z, S, T, RZ, P)
+void scalar_diagonal_kernel(cnum *amp, int num_qubits, int target, cnum d0, cnum d1) {
+    uint64_t num_pairs = (1ULL << num_qubits) >> 1;
+    uint64_t stride = 1ULL << target;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_pairs; k++) {
+        uint64_t i0 = insert_zero_bit(k, target);
+        amp[i0] = cnum_mul(d0, amp[i0]);
+        amp[i0 | stride] = cnum_mul(d1, amp[i0 | stride]);
+    }
+}
+
+// Apply a 4x4 matrix (row-major) to qubits q_hi (sub-index MSB) and q_lo, iterating over amplitude quads
+void scalar_two_qubit_kernel(cnum *amp, int num_qubits, int q_hi, int q_lo, const cnum *m) {
+    uint64_t num_quads = (1ULL << num_qubits) >> 2;
+    uint64_t hi = 1ULL << q_hi;
+    uint64_t lo = 1ULL << q_lo;
+    int first = (q_hi < q_lo) ? q_hi : q_lo;
+    int second = (q_hi < q_lo) ? q_lo : q_hi;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_quads; k++) {
+        uint64_t base = insert_zero_bit(insert_zero_bit(k, first), second);
+        uint64_t idx[4] = {base, base | lo, base | hi, base | hi | lo};
+        cnum a[4] = {amp[idx[0]], amp[idx[1]], amp[idx[2]], amp[idx[3]]};
+        for (int r = 0; r < 4; r++) {
+            cnum sum = {0.0, 0.0};
+            for (int c = 0; c < 4; c++) {
+                sum = cnum_add(sum, cnum_mul(m[r * 4 + c], a[c]));
             }
-            if (j >= num_states) {
-                fprintf(stderr, "Out-of-bounds access at operator_matrix[%d][%d] or qr->amp[%d]\n", i, j, j);
-                exit(EXIT_FAILURE);
+            amp[idx[r]] = sum;
+        }
+    }
+}
+
+// Apply a 2^k x 2^k matrix (row-major) to an arbitrary list of k <= MATRIX_GATE_MAX_QUBITS qubits by
+// gathering, multiplying and scattering each group of 2^k amplitudes
+static void apply_multi_qubit_kernel(cnum *amp, int num_qubits, const int *qubits, int k, const cnum *m) {
+    uint64_t dim = 1ULL << k;
+    uint64_t num_groups = (1ULL << num_qubits) >> k;
+    uint64_t offsets[1 << MATRIX_GATE_MAX_QUBITS];
+    int sorted[MATRIX_GATE_MAX_QUBITS];
+
+    // Offset of every sub-index inside a group, qubits[0] being the most significant sub-index bit
+    for (uint64_t s = 0; s < dim; s++) {
+        offsets[s] = 0;
+        for (int j = 0; j < k; j++) {
+            if ((s >> (k - 1 - j)) & 1) {
+                offsets[s] |= 1ULL << qubits[j];
             }
+        }
+    }
 
-            new_state[i].re += operator_matrix[i][j].re * qr->amp[j].re - operator_matrix[i][j].im * qr->amp[j].im;
-            new_state[i].im += operator_matrix[i][j].re * qr->amp[j].im + operator_matrix[i][j].im * qr->amp[j].re;
+    // Zero bits must be inserted from the lowest position upwards
+    for (int j = 0; j < k; j++) {
+        sorted[j] = qubits[j];
+    }
+    sort_qubits(sorted, k);
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t g = 0; g < num_groups; g++) {
+        cnum group[1 << MATRIX_GATE_MAX_QUBITS];
+        uint64_t base = insert_zero_bits(g, sorted, k);
+        for (uint64_t s = 0; s < dim; s++) {
+            group[s] = amp[base + offsets[s]];
+        }
+        for (uint64_t r = 0; r < dim; r++) {
+            cnum sum = {0.0, 0.0};
+            const cnum *row = &m[r * dim];
+            for (uint64_t c = 0; c < dim; c++) {
+                sum = cnum_add(sum, cnum_mul(row[c], group[c]));
+            }
+            amp[base + offsets[r]] = sum;
         }
-        // printf("new_state[%d]: (%.2f, %.2f)\n", i, new_state[i].re, new_state[i].im); // Debug: Print each new_state entry
     }
+}
 
-    // Free the old state vector and update the quantum register with the new state vector
-    free(qr->amp);
-    qr->amp = new_state;
+// Exchange two runs of amplitudes, moving data only (no floating point arithmetic)
+static inline void swap_runs(cnum *a, cnum *b, uint64_t len) {
+    for (uint64_t j = 0; j < len; j++) {
+        cnum tmp = a[j];
+        a[j] = b[j];
+        b[j] = tmp;
+    }
+}
 
-    debug_printf("Operator application complete\n");
+// Permutation gates move whole runs of amplitudes: all the index bits below the lowest qubit a gate
+// involves are free, so the amplitudes come in contiguous runs of 2^lowest_qubit. Runs are split into
+// segments of at most PERMUTATION_SEGMENT amplitudes so the parallel loop has work to share even when
+// the qubits are high and there are only a few very long runs.
+#define PERMUTATION_SEGMENT (1ULL << 12)
+
+static uint64_t permutation_segment(int lowest_qubit) {
+    uint64_t run = 1ULL << lowest_qubit;
+    return (run < PERMUTATION_SEGMENT) ? run : PERMUTATION_SEGMENT;
+}
+
+// Flip the target qubit of every amplitude whose control bits are all set (X, CNOT, CCNOT, MCX). Only
+// the 2^(n - num_controls) amplitudes matching the control mask are touched, wherever the qubits are.
+static void apply_controlled_x_kernel(cnum *amp, int num_qubits, const int *controls, int num_controls, int target) {
+    int fixed[num_controls + 1];
+    uint64_t control_mask = 0;
+    for (int j = 0; j < num_controls; j++) {
+        fixed[j] = controls[j];
+        control_mask |= 1ULL << controls[j];
+    }
+    fixed[num_controls] = target;
+    sort_qubits(fixed, num_controls + 1);
+
+    uint64_t num_pairs = (1ULL << num_qubits) >> (num_controls + 1);
+    uint64_t segment = permutation_segment(fixed[0]);
+    uint64_t num_segments = num_pairs / segment;
+    uint64_t stride = 1ULL << target;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t s = 0; s < num_segments; s++) {
+        uint64_t i0 = insert_zero_bits(s * segment, fixed, num_controls + 1) | control_mask;
+        swap_runs(&amp[i0], &amp[i0 | stride], segment);
+    }
 }
 
+// Multiply by `phase` every amplitude whose qubits (controls and target) are all set, in a single
+// masked pass over the 2^(n - num_qubits) matching amplitudes
+static void apply_controlled_phase_kernel(cnum *amp, int num_qubits, const int *qubits, int count, cnum phase) {
+    int fixed[count];
+    uint64_t mask = 0;
+    for (int j = 0; j < count; j++) {
+        fixed[j] = qubits[j];
+        mask |= 1ULL << qubits[j];
+    }
+    sort_qubits(fixed, count);
 
+    uint64_t num_matches = (1ULL << num_qubits) >> count;
 
-void apply_gate(qreg *qr, gate_list *gates) {
-    if (qr == NULL || gates == NULL) {
-        fprintf(stderr, "Error applying gate with NULL inputs\n");
-        return;
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_matches; k++) {
+        uint64_t i = insert_zero_bits(k, fixed, count) | mask;
+        amp[i] = cnum_mul(phase, amp[i]);
+    }
+}
+
+// Multiply every amplitude by the table entry selected by its bits at the given qubits. The state is
+// swept in runs of 2^DIAGONAL_RUN_BITS amplitudes: the key part coming from the low index bits is
+// looked up once per run position and the high part once per run, so each amplitude costs a single
+// lookup and complex multiply however many diagonal gates were merged into the table.
+#define DIAGONAL_RUN_BITS 8
+static void apply_diagonal_table_kernel(cnum *amp, int num_qubits, const int *qubits, int k, const cnum *table) {
+    int run_bits = (num_qubits < DIAGONAL_RUN_BITS) ? num_qubits : DIAGONAL_RUN_BITS;
+    uint64_t run = 1ULL << run_bits;
+    uint64_t num_runs = (1ULL << num_qubits) >> run_bits;
+    int low_keys[1 << DIAGONAL_RUN_BITS];
+
+    for (uint64_t i = 0; i < run; i++) {
+        low_keys[i] = diagonal_key(i, qubits, k);
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t r = 0; r < num_runs; r++) {
+        uint64_t base = r << run_bits;
+        int high_key = diagonal_key(base, qubits, k);
+        cnum *chunk = &amp[base];
+        for (uint64_t i = 0; i < run; i++) {
+            chunk[i] = cnum_mul(table[high_key | low_keys[i]], chunk[i]);
+        }
+    }
+}
+
+// Exchange qubits a and b: only the amplitudes where the two bits differ move
+static void apply_swap_kernel(cnum *amp, int num_qubits, int a, int b) {
+    int fixed[2] = {(a < b) ? a : b, (a < b) ? b : a};
+    uint64_t num_pairs = (1ULL << num_qubits) >> 2;
+    uint64_t segment = permutation_segment(fixed[0]);
+    uint64_t num_segments = num_pairs / segment;
+    uint64_t bit_a = 1ULL << a;
+    uint64_t bit_b = 1ULL << b;
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t s = 0; s < num_segments; s++) {
+        uint64_t base = insert_zero_bits(s * segment, fixed, 2);
+        swap_runs(&amp[base | bit_a], &amp[base | bit_b], segment);
+    }
+}
+
+// Apply a dense gate matrix to its qubits in place
+static qc_status apply_matrix_instruction(qreg *qr, const instruction *ins) {
+    const gate_kernels *kernels = active_kernels();
+    const cnum *m = ins->matrix;
+    int k = ins->num_qubits;
+
+    if (k == 1 && m[1].re == 0.0 && m[1].im == 0.0 && m[2].re == 0.0 && m[2].im == 0.0) {
+        kernels->diagonal(qr->amp, qr->size, ins->qubits[0], m[0], m[3]);
+    } else if (k == 1) {
+        kernels->single_qubit(qr->amp, qr->size, ins->qubits[0], m);
+    } else if (k == 2) {
+        kernels->two_qubit(qr->amp, qr->size, ins->qubits[0], ins->qubits[1], m);
+    } else if (k <= MATRIX_GATE_MAX_QUBITS) {
+        apply_multi_qubit_kernel(qr->amp, qr->size, ins->qubits, k, m);
+    } else {
+        fprintf(stderr, "Error: matrix gates are limited to %d qubits, got %d\n", MATRIX_GATE_MAX_QUBITS, k);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    return QC_OK;
+}
+
+// Apply a single instruction in place, with the kernel matching its kind
+qc_status apply_instruction(qreg *qr, const instruction *ins) {
+    if (qr->tableau != NULL) {
+        // Clifford gates stay on the tableau, anything else needs the state vector
+        if (apply_tableau_instruction(qr->tableau, ins)) {
+            return QC_OK;
+        }
+        qc_status status = tableau_to_state(qr);
+        if (status != QC_OK) {
+            return status;
+        }
+    }
+    if (qr->sparse != NULL) {
+        return apply_sparse_instruction(qr, ins);
+    }
+    if (qr->mps != NULL) {
+        return apply_mps_instruction(qr, ins);
+    }
+    // Only gates on a state vector sweep it (callers of apply_dense_instruction count their own)
+    STATS_SWEEPS(1);
+    return apply_dense_instruction(qr, ins);
+}
+
+qc_status apply_dense_instruction(qreg *qr, const instruction *ins) {
+    switch (ins->op) {
+        case GATE_OP_CONTROLLED_X:
+            apply_controlled_x_kernel(qr->amp, qr->size, ins->qubits, ins->num_controls, ins->qubits[ins->num_controls]);
+            return QC_OK;
+        case GATE_OP_CONTROLLED_PHASE:
+            apply_controlled_phase_kernel(qr->amp, qr->size, ins->qubits, ins->num_qubits, ins->matrix[3]);
+            return QC_OK;
+        case GATE_OP_SWAP:
+            apply_swap_kernel(qr->amp, qr->size, ins->qubits[0], ins->qubits[1]);
+            return QC_OK;
+        case GATE_OP_DIAGONAL:
+            if (ins->num_qubits > DIAGONAL_GATE_MAX_QUBITS) {
+                fprintf(stderr, "Error: diagonal tables are limited to %d qubits, got %d\n", DIAGONAL_GATE_MAX_QUBITS, ins->num_qubits);
+                return QC_ERR_INVALID_ARGUMENT;
+            }
+            apply_diagonal_table_kernel(qr->amp, qr->size, ins->qubits, ins->num_qubits, ins->matrix);
+            return QC_OK;
+        case GATE_OP_MATRIX:
+            return apply_matrix_instruction(qr, ins);
+    }
+    return QC_ERR_INVALID_ARGUMENT;
+}
+
+// Lower a parsed gate to an instruction, which keeps pointing to the node's qubits & matrix
+static void lower_gate(const gate_node *node, instruction *ins) {
+    const qgate *gate = &node->gate;
+    ins->op = gate->op;
+    ins->num_qubits = gate->size;
+    ins->num_controls = gate->num_controls;
+    ins->qubits = node->qubits;
+    ins->matrix = gate->matrix;
+}
+
+// Receives the instructions of a lowered layer, in execution order, with the gate node an instruction was
+// lowered from (NULL for merged diagonal tables)
+typedef int (*instruction_sink)(void *context, const instruction *ins, const gate_node *source);
+
+// Diagonal gates: single qubit matrices without off-diagonal entries (Z, S, T, RZ, P) and controlled phases
+static int is_diagonal_instruction(const instruction *ins) {
+    if (ins->op == GATE_OP_CONTROLLED_PHASE) {
+        return 1;
+    }
+    return ins->op == GATE_OP_MATRIX && ins->num_qubits == 1 &&
+           ins->matrix[1].re == 0.0 && ins->matrix[1].im == 0.0 &&
+           ins->matrix[2].re == 0.0 && ins->matrix[2].im == 0.0;
+}
+
+static int diagonal_group_position(const diagonal_group *group, int qubit) {
+    for (int p = 0; p < group->num_qubits; p++) {
+        if (group->qubits[p] == qubit) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+static int diagonal_group_width(const diagonal_group *group, const instruction *ins) {
+    int width = group->num_qubits;
+    for (int q = 0; q < ins->num_qubits; q++) {
+        if (diagonal_group_position(group, ins->qubits[q]) < 0) {
+            width++;
+        }
+    }
+    return width;
+}
+
+void diagonal_group_reset(diagonal_group *group) {
+    group->num_gates = 0;
+    group->num_qubits = 0;
+    group->table[0] = (cnum){1.0, 0.0};
+}
+
+// Multiply a diagonal gate into the group's table, adding its new qubits as the lowest key bits
+static void diagonal_group_add(diagonal_group *group, const instruction *ins) {
+    if (group->num_gates == 0) {
+        group->first = *ins;
+        memcpy(group->first_qubits, ins->qubits, ins->num_qubits * sizeof(int));
+        memcpy(group->first_matrix, ins->matrix, sizeof(group->first_matrix));
+        group->first.qubits = group->first_qubits;
+        group->first.matrix = group->first_matrix;
+    }
+    for (int q = 0; q < ins->num_qubits; q++) {
+        if (diagonal_group_position(group, ins->qubits[q]) < 0) {
+            for (int key = (2 << group->num_qubits) - 1; key >= 0; key--) {
+                group->table[key] = group->table[key >> 1];
+            }
+            group->qubits[group->num_qubits++] = ins->qubits[q];
+        }
+    }
+
+    // A controlled phase multiplies its phase (matrix[3]) where all its qubits are set, a single qubit
+    // diagonal its matrix[0] or matrix[3] depending on the qubit
+    int k = group->num_qubits;
+    for (int key = 0; key < (1 << k); key++) {
+        int all_set = 1, target_bit = 0;
+        for (int q = 0; q < ins->num_qubits; q++) {
+            int bit = (key >> (k - 1 - diagonal_group_position(group, ins->qubits[q]))) & 1;
+            all_set &= bit;
+            target_bit = bit;
+        }
+        if (ins->op == GATE_OP_CONTROLLED_PHASE) {
+            if (all_set) {
+                group->table[key] = cnum_mul(ins->matrix[3], group->table[key]);
+            }
+        } else {
+            group->table[key] = cnum_mul(ins->matrix[3 * target_bit], group->table[key]);
+        }
+    }
+    group->num_gates++;
+}
+
+static int diagonal_group_flush(diagonal_group *group, instruction_sink emit, void *context) {
+    int ret = 0;
+    if (group->num_gates == 1) {
+        ret = emit(context, &group->first, NULL);
+    } else if (group->num_gates > 1) {
+        instruction ins = {GATE_OP_DIAGONAL, group->num_qubits, 0, group->qubits, group->table};
+        ret = emit(context, &ins, NULL);
+    }
+    diagonal_group_reset(group);
+    return ret;
+}
+
+// Lower the next gate of a layer: diagonal gates are held back and merged into a single table until a
+// non-diagonal gate touches one of their qubits. Diagonal gates commute with each other and with
+// every gate acting on other qubits, so the result is unchanged. Gates with a parameter stay separate
+// instructions, their matrices being replaced once the angles are known.
+static int lower_next(diagonal_group *group, const instruction *ins, const gate_node *source, instruction_sink emit, void *context) {
+    if (is_diagonal_instruction(ins) && ins->num_qubits <= DIAGONAL_GATE_MAX_QUBITS && (source == NULL || source->param < 0)) {
+        int ret = (diagonal_group_width(group, ins) > DIAGONAL_GATE_MAX_QUBITS) ? diagonal_group_flush(group, emit, context) : 0;
+        if (ret != 0) {
+            return ret;
+        }
+        diagonal_group_add(group, ins);
+        return 0;
+    }
+    // A gate sharing qubits with the held back diagonal gates has to run after them
+    int shares_qubits = diagonal_group_width(group, ins) < group->num_qubits + ins->num_qubits;
+    if (shares_qubits) {
+        int ret = diagonal_group_flush(group, emit, context);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return emit(context, ins, source);
+}
+
+// Lower the gates of one layer to instructions, see lower_next. Returns the first non-zero value of
+// the sink (the status of the failing instruction when applying them)
+static int lower_layer(const gate_list *gates, instruction_sink emit, void *context) {
+    diagonal_group group;
+
+    diagonal_group_reset(&group);
+    for (gate_node *node = gates->head; node != NULL; node = node->next) {
+        instruction ins;
+        lower_gate(node, &ins);
+        int ret = lower_next(&group, &ins, node, emit, context);
+        if (ret != 0) {
+            fprintf(stderr, "Error applying %s gate in place\n", node->gate.type);
+            return ret;
+        }
+    }
+    return diagonal_group_flush(&group, emit, context);
+}
+
+static int apply_instruction_sink(void *context, const instruction *ins, const gate_node *source) {
+    (void)source;
+    return apply_instruction((qreg *)context, ins);
+}
+
+int layer_apply(qreg *qr, diagonal_group *group, const instruction *ins) {
+    return lower_next(group, ins, NULL, apply_instruction_sink, qr);
+}
+
+int layer_end(qreg *qr, diagonal_group *group) {
+    return diagonal_group_flush(group, apply_instruction_sink, qr);
+}
+
+// Dense reference path: build the full operator for the whole layer and multiply it with the state
+static qc_status apply_gate_dense(qreg *qr, gate_list *gates) {
+    if (qr->size > DENSE_ENGINE_QUBIT_LIMIT) {
+        fprintf(stderr, "Error: the dense engine supports at most %d qubits, register has %d\n", DENSE_ENGINE_QUBIT_LIMIT, qr->size);
+        return QC_ERR_TOO_MANY_QUBITS;
     }
 
     // Build the full operator matrix for this circuit layer
@@ -1192,33 +1493,341 @@ void apply_gate(qreg *qr, gate_list *gates) {
     cnum **operator_matrix = build_full_operator_matrix(gates, qr->size);
     if (operator_matrix == NULL) {
         fprintf(stderr, "Error obtaining full operator matrix\n");
-        return;
+        return QC_ERR_OUT_OF_MEMORY;
     }
     debug_printf("Built following full matrix:\n");
     print_gate_matrix(operator_matrix, 1<<(qr->size));
 
     // Apply the full operator matrix to the quantum register's state vector
-    apply_operator_to_state(qr, operator_matrix);
+    qc_status status = apply_operator_to_state(qr, operator_matrix);
+
+    // Free the full operator matrix after application
+    free_matrix(operator_matrix, 1 << qr->size);
+    return status;
+}
+
+qc_status apply_gate(qreg *qr, gate_list *gates) {
+    if (qr == NULL || gates == NULL) {
+        fprintf(stderr, "Error applying gate with NULL inputs\n");
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    qc_status status;
+    if (use_dense_engine && qr->amp != NULL) {
+        status = apply_gate_dense(qr, gates);
+    } else {
+        STATS_BEGIN(stats_start);
+        status = (qc_status)lower_layer(gates, apply_instruction_sink, qr);
+        STATS_END(QC_PHASE_KERNELS, stats_start);
+        if (status != QC_OK) {
+            fprintf(stderr, "Error applying circuit layer in place\n");
+            return status;
+        }
+    }
 
     debug_printf("State vector afterwards:\n");
 #ifdef DEBUG_PRINTS
     view_state_vector(qr);printf("\n");
 #endif
+    return status;
+}
 
-    // Free the full operator matrix after application
-    free_matrix(operator_matrix, 1 << qr->size);
+// Apply a single multi-controlled gate ("MCX", "MCZ" or "MCP") built from a qubit array, through the same
+// engine as circuit_layer
+static void apply_multi_controlled_gate(qreg *qr, const char *type, const int *controls, int num_controls, int target, double angle) {
+    arena_mark mark = arena_get_mark();
+    int *qubits = alloc_gate_qubits(num_controls + 1);
+    if (qubits == NULL) {
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return;
+    }
+    for (int j = 0; j < num_controls; j++) {
+        qubits[j] = controls[j];
+    }
+    qubits[num_controls] = target;
+
+    gate_list gates;
+    init_gate_list(&gates);
+    qgate gate = multi_controlled_gate(type, num_controls);
+    if (add_gate_to_list(&gates, &gate, qubits) != 0) {
+        arena_release(mark);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return;
+    }
+    if (strcmp(type, "MCP") == 0) {
+        set_node_rotation(gates.tail, ROTATION_P, angle);
+    }
+    if (validate_gate_qubits(qr->size, type, qubits, num_controls + 1) != 0) {
+        set_status(QC_ERR_INVALID_ARGUMENT);
+    } else {
+        set_status(apply_gate(qr, &gates));
+    }
+    arena_release(mark);
+}
+
+static int check_multi_controlled_arguments(qreg *qr, const int *controls, int num_controls) {
+    if (qr == NULL || (controls == NULL && num_controls > 0) || num_controls < 0) {
+        fprintf(stderr, "Error applying a multi-controlled gate with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
+}
+
+void qc_mcx(qreg *qr, const int *controls, int num_controls, int target) {
+    if (check_multi_controlled_arguments(qr, controls, num_controls) == 0) {
+        apply_multi_controlled_gate(qr, "MCX", controls, num_controls, target, 0.0);
+    }
+}
+
+void qc_mcz(qreg *qr, const int *controls, int num_controls, int target) {
+    if (check_multi_controlled_arguments(qr, controls, num_controls) == 0) {
+        apply_multi_controlled_gate(qr, "MCZ", controls, num_controls, target, 0.0);
+    }
+}
+
+void qc_mcp(qreg *qr, const int *controls, int num_controls, int target, double angle) {
+    if (check_multi_controlled_arguments(qr, controls, num_controls) == 0) {
+        apply_multi_controlled_gate(qr, "MCP", controls, num_controls, target, angle);
+    }
+}
+
+void qc_use_dense_engine(int enabled) {
+    use_dense_engine = enabled ? 1 : 0;
 }
 
 
 void circuit_layer(qreg *qr, const char *operations) {
     if (!qr) {
         fprintf(stderr, "Error trying to evaluate a circuit layer on a null quantum register\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
         return;
     }
     if (!operations) {
         fprintf(stderr, "Error trying to evaluate a circuit layer with a null operations list\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
         return;
     }
-    // Parse the operation string and populate the gate list
-    parse_circuit_layer(qr, operations);
+
+    // Parse the operation string and populate the gate list, then apply it
+    arena_mark mark = arena_get_mark();
+    gate_list gates;
+    init_gate_list(&gates);
+    STATS_BEGIN(stats_start);
+    int parsed = parse_circuit_layer(operations, qr->size, &gates);
+    STATS_END(QC_PHASE_PARSE, stats_start);
+    for (gate_node *node = gates.head; parsed == 0 && node != NULL; node = node->next) {
+        if (node->param >= 0) {
+            fprintf(stderr, "Error: parameter placeholders need a compiled circuit, see qc_run_batch\n");
+            parsed = -1;
+        }
+    }
+    qc_status status = (parsed == 0) ? QC_OK : QC_ERR_INVALID_ARGUMENT;
+    if (parsed == 0 && gates.head != NULL) {
+        debug_printf("Applying main gates:\n");
+        status = apply_gate(qr, &gates);
+    }
+    set_status(status);
+
+    // Clean up: the whole gate list goes at once
+    arena_release(mark);
+}
+
+// Copies the instructions of lowered layers into a circuit, or only counts them
+typedef struct compile_context {
+    qcircuit *circuit;
+    int counting;
+    int num_qubit_entries;
+    int num_matrix_entries;
+} compile_context;
+
+static rotation_gate rotation_of(const qgate *gate) {
+    if (strcmp(gate->type, "RX") == 0) {
+        return ROTATION_RX;
+    } else if (strcmp(gate->type, "RY") == 0) {
+        return ROTATION_RY;
+    } else if (strcmp(gate->type, "RZ") == 0) {
+        return ROTATION_RZ;
+    }
+    return ROTATION_P;
+}
+
+static int compile_sink(void *context, const instruction *ins, const gate_node *source) {
+    compile_context *cc = context;
+    qcircuit *circuit = cc->circuit;
+    int entries = instruction_matrix_entries(ins->op, ins->num_qubits, ins->num_controls);
+
+    if (source != NULL && source->param >= 0) {
+        if (!cc->counting) {
+            circuit->parametric[circuit->num_parametric] = (parametric_gate){circuit->num_instructions, rotation_of(&source->gate), source->param};
+        }
+        circuit->num_parametric++;
+        if (source->param + 1 > circuit->num_params) {
+            circuit->num_params = source->param + 1;
+        }
+    }
+
+    if (!cc->counting) {
+        instruction *out = &circuit->instructions[circuit->num_instructions];
+        int *qubits = &circuit->qubit_pool[cc->num_qubit_entries];
+        cnum *matrix = &circuit->matrix_pool[cc->num_matrix_entries];
+        memcpy(qubits, ins->qubits, ins->num_qubits * sizeof(int));
+        memcpy(matrix, ins->matrix, entries * sizeof(cnum));
+        *out = *ins;
+        out->qubits = qubits;
+        out->matrix = matrix;
+        for (int q = 0; q < ins->num_qubits; q++) {
+            if (qubits[q] + 1 > circuit->min_qubits) {
+                circuit->min_qubits = qubits[q] + 1;
+            }
+        }
+    }
+    circuit->num_instructions++;
+    cc->num_qubit_entries += ins->num_qubits;
+    cc->num_matrix_entries += entries;
+    return 0;
+}
+
+qcircuit *qc_compile(const char *layers[], int num_layers) {
+    if (layers == NULL || num_layers < 0) {
+        fprintf(stderr, "Error trying to compile a circuit with invalid layers\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    // Parse every layer first, without a register the qubits are only checked for being non-negative
+    gate_list *parsed = calloc(num_layers > 0 ? num_layers : 1, sizeof(gate_list));
+    qcircuit *circuit = calloc(1, sizeof(qcircuit));
+    if (parsed == NULL || circuit == NULL) {
+        fprintf(stderr, "Error allocating memory for circuit compilation\n");
+        free(parsed);
+        free(circuit);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    qc_status status = QC_OK;
+    arena_mark mark = arena_get_mark();
+    STATS_BEGIN(parse_start);
+    for (int l = 0; l < num_layers; l++) {
+        init_gate_list(&parsed[l]);
+        if (layers[l] == NULL || parse_circuit_layer(layers[l], INT_MAX, &parsed[l]) != 0) {
+            fprintf(stderr, "Error compiling layer %d\n", l);
+            status = QC_ERR_INVALID_ARGUMENT;
+            num_layers = l + 1;
+            break;
+        }
+    }
+
+    STATS_END(QC_PHASE_PARSE, parse_start);
+
+    // Lower the layers twice: once to size the instruction array & pools, then to fill them
+    STATS_BEGIN(lower_start);
+    compile_context context = {circuit, 1, 0, 0};
+    for (int l = 0; l < num_layers && status == QC_OK; l++) {
+        if (lower_layer(&parsed[l], compile_sink, &context) != 0) {
+            status = QC_ERR_INVALID_ARGUMENT;
+        }
+    }
+    if (status == QC_OK) {
+        circuit->num_layers = num_layers;
+        circuit->instructions = malloc((circuit->num_instructions + 1) * sizeof(instruction));
+        circuit->qubit_pool = malloc((context.num_qubit_entries + 1) * sizeof(int));
+        circuit->matrix_pool = malloc((context.num_matrix_entries + 1) * sizeof(cnum));
+        circuit->parametric = malloc((circuit->num_parametric + 1) * sizeof(parametric_gate));
+        if (circuit->instructions == NULL || circuit->qubit_pool == NULL || circuit->matrix_pool == NULL || circuit->parametric == NULL) {
+            fprintf(stderr, "Error allocating memory for compiled circuit\n");
+            status = QC_ERR_OUT_OF_MEMORY;
+        }
+        STATS_ALLOCS(4, (circuit->num_instructions + 1) * sizeof(instruction) + (context.num_qubit_entries + 1) * sizeof(int) +
+                    (context.num_matrix_entries + 1) * sizeof(cnum) + (circuit->num_parametric + 1) * sizeof(parametric_gate));
+    }
+    if (status == QC_OK) {
+        context = (compile_context){circuit, 0, 0, 0};
+        circuit->num_instructions = 0;
+        circuit->num_parametric = 0;
+        for (int l = 0; l < num_layers; l++) {
+            lower_layer(&parsed[l], compile_sink, &context);
+        }
+    }
+    STATS_END(QC_PHASE_LOWER, lower_start);
+
+    arena_release(mark);
+    free(parsed);
+
+    if (status != QC_OK) {
+        qc_free_circuit(circuit);
+        set_status(status);
+        return NULL;
+    }
+    set_status(QC_OK);
+    return circuit;
+}
+
+qc_status qc_run(const qcircuit *circuit, qreg *qr) {
+    if (circuit == NULL || qr == NULL) {
+        fprintf(stderr, "Error trying to run a circuit with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->size < circuit->min_qubits) {
+        fprintf(stderr, "Error: circuit needs %d qubits, register has %d\n", circuit->min_qubits, qr->size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (reject_parametric(circuit) != 0) {
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    STATS_BEGIN(stats_start);
+    for (int i = 0; i < circuit->num_instructions; i++) {
+        qc_status status = apply_instruction(qr, &circuit->instructions[i]);
+        if (status != QC_OK) {
+            set_status(status);
+            return status;
+        }
+    }
+    STATS_END(QC_PHASE_KERNELS, stats_start);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+void qc_free_circuit(qcircuit *circuit) {
+    if (circuit != NULL) {
+        free(circuit->noise);
+        free(circuit->parametric);
+        free(circuit->instructions);
+        free(circuit->qubit_pool);
+        free(circuit->matrix_pool);
+        free(circuit);
+    }
+}
+
+int qc_circuit_num_gates(const qcircuit *circuit) {
+    return (circuit != NULL) ? circuit->num_instructions : 0;
+}
+
+int qc_circuit_num_params(const qcircuit *circuit) {
+    return (circuit != NULL) ? circuit->num_params : 0;
+}
+
+int qc_circuit_is_clifford(const qcircuit *circuit) {
+    if (circuit == NULL || circuit->num_params > 0) {
+        return 0;
+    }
+    for (int i = 0; i < circuit->num_instructions; i++) {
+        if (!is_clifford_instruction(&circuit->instructions[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int reject_parametric(const qcircuit *circuit) {
+    if (circuit->num_params > 0) {
+        fprintf(stderr, "Error: circuit has %d unbound parameters, run it with qc_run_batch\n", circuit->num_params);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return -1;
+    }
+    return 0;
 }
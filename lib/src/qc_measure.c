@@ -0,0 +1,359 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Measurement & sampling
+//
+// Sampling uses a two-level cumulative distribution: the probabilities of each block of
+// SAMPLING_BLOCK amplitudes are summed and prefix-summed in parallel, then every shot binary
+// searches its block (O(log N)) and scans at most SAMPLING_BLOCK amplitudes inside it. The table only
+// takes 1/SAMPLING_BLOCK of the amplitudes' count, instead of a full copy of the probabilities.
+// The prefix sum is a two-level scan over chunks of SAMPLING_SCAN_CHUNK blocks: each chunk is scanned
+// on its own, the chunk totals are scanned serially, and their offsets are added to the chunks. The
+// chunks have a fixed size rather than one per thread, so that the table (and the samples) are the
+// same bit for bit whatever the number of threads.
+// Random numbers come from splitmix64 keyed by the seed and the shot index, so the samples don't
+// depend on the number of threads. Sparse registers use a single-level table over their sorted
+// entries, so the same seed draws the same samples from either storage. Stabilizer registers
+// measure all the qubits of a copy of their tableau for every shot, and MPS registers draw each shot
+// qubit by qubit along their chain.
+
+#define SAMPLING_BLOCK 64
+#define SAMPLING_SCAN_CHUNK 1024
+
+static inline double probability(cnum a) {
+    return (double)a.re * a.re + (double)a.im * a.im;
+}
+
+// First position whose cumulative probability exceeds r (the last one if rounding leaves r past it)
+static uint64_t search_cumulative(const double *cumulative, uint64_t count, double r) {
+    uint64_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (cumulative[mid] > r) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+static qc_status sample_sparse(const sparse_state *s, uint64_t shots, uint64_t rng_seed, uint64_t *out) {
+    uint64_t *keys = sparse_sorted_keys(s);
+    double *cumulative = malloc((s->count + 1) * sizeof(double));
+    if (keys == NULL || cumulative == NULL) {
+        fprintf(stderr, "Error allocating memory for the sampling table\n");
+        free(keys);
+        free(cumulative);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    double total = 0.0;
+    uint64_t count = 0;
+    for (uint64_t k = 0; k < s->count; k++) {
+        double p = probability(sparse_get(s, keys[k]));
+        if (p > 0.0) {
+            total += p;
+            keys[count] = keys[k];
+            cumulative[count++] = total;
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "Error: cannot sample a register whose amplitudes are all 0\n");
+        free(keys);
+        free(cumulative);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (shots >= PARALLEL_THRESHOLD)
+    for (uint64_t shot = 0; shot < shots; shot++) {
+        out[shot] = keys[search_cumulative(cumulative, count, uniform_draw(rng_seed, shot) * total)];
+    }
+
+    free(keys);
+    free(cumulative);
+    return QC_OK;
+}
+
+// Each shot measures every qubit of a copy of the tableau, qubit q of shot s using draw s * n + q.
+// Outcomes go to indices and/or bits, whichever isn't NULL
+static qc_status sample_tableau(const stabilizer_tableau *t, int num_qubits, uint64_t shots, uint64_t rng_seed, uint64_t *indices, uint8_t *bits) {
+    if (indices != NULL && num_qubits > 64) {
+        fprintf(stderr, "Error: outcomes of %d qubits don't fit in 64 bit samples, use qc_sample_bits\n", num_qubits);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    stabilizer_tableau *copy = tableau_clone(t);
+    if (copy == NULL) {
+        fprintf(stderr, "Error allocating memory to sample a stabilizer register\n");
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    for (uint64_t shot = 0; shot < shots; shot++) {
+        tableau_copy(copy, t);
+        uint64_t outcome = 0;
+        for (int q = 0; q < num_qubits; q++) {
+            int result = tableau_measure(copy, q, uniform_draw(rng_seed, shot * num_qubits + q));
+            if (bits != NULL) {
+                bits[shot * num_qubits + q] = (uint8_t)result;
+            }
+            outcome |= (uint64_t)result << (q & 63);
+        }
+        if (indices != NULL) {
+            indices[shot] = outcome;
+        }
+    }
+    tableau_free(copy);
+    return QC_OK;
+}
+
+qc_status qc_measure_all(const qreg *qr, uint64_t shots, uint64_t rng_seed, uint64_t *out) {
+    if (qr == NULL || (out == NULL && shots > 0)) {
+        fprintf(stderr, "Error trying to sample a register with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->mps != NULL && qr->size > 64) {
+        fprintf(stderr, "Error: outcomes of %d qubits don't fit in 64 bit samples, use qc_sample_bits\n", qr->size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->sparse != NULL || qr->tableau != NULL || qr->mps != NULL) {
+        STATS_BEGIN(sparse_start);
+        qc_status status;
+        if (qr->mps != NULL) {
+            status = mps_sample(qr->mps, shots, rng_seed, out, NULL);
+        } else if (qr->tableau != NULL) {
+            status = sample_tableau(qr->tableau, qr->size, shots, rng_seed, out, NULL);
+        } else {
+            status = sample_sparse(qr->sparse, shots, rng_seed, out);
+        }
+        STATS_END(QC_PHASE_OBSERVE, sparse_start);
+        set_status(status);
+        return status;
+    }
+
+    STATS_BEGIN(stats_start);
+    uint64_t num_states = 1ULL << qr->size;
+    uint64_t block = (num_states < SAMPLING_BLOCK) ? num_states : SAMPLING_BLOCK;
+    uint64_t num_blocks = num_states / block;
+    double *cumulative = malloc(num_blocks * sizeof(double));
+    if (cumulative == NULL) {
+        fprintf(stderr, "Error allocating memory for the sampling table\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    STATS_ALLOC(num_blocks * sizeof(double));
+    STATS_SWEEPS(1);
+
+    // Block sums & their prefix sum within each chunk
+    uint64_t num_chunks = (num_blocks + SAMPLING_SCAN_CHUNK - 1) / SAMPLING_SCAN_CHUNK;
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t c = 0; c < num_chunks; c++) {
+        uint64_t end = (c + 1) * SAMPLING_SCAN_CHUNK < num_blocks ? (c + 1) * SAMPLING_SCAN_CHUNK : num_blocks;
+        double prefix = 0.0;
+        for (uint64_t b = c * SAMPLING_SCAN_CHUNK; b < end; b++) {
+            double sum = 0.0;
+            for (uint64_t i = b * block; i < (b + 1) * block; i++) {
+                sum += probability(qr->amp[i]);
+            }
+            prefix += sum;
+            cumulative[b] = prefix;
+        }
+    }
+    // Chunk offsets: a serial scan over the chunk totals only (the last block of each chunk holds its
+    // total, and ends up holding the cumulative total), then a parallel pass adding them to the chunks
+    for (uint64_t c = 1; c < num_chunks; c++) {
+        uint64_t last = ((c + 1) * SAMPLING_SCAN_CHUNK < num_blocks ? (c + 1) * SAMPLING_SCAN_CHUNK : num_blocks) - 1;
+        cumulative[last] += cumulative[c * SAMPLING_SCAN_CHUNK - 1];
+    }
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t c = 1; c < num_chunks; c++) {
+        uint64_t last = ((c + 1) * SAMPLING_SCAN_CHUNK < num_blocks ? (c + 1) * SAMPLING_SCAN_CHUNK : num_blocks) - 1;
+        double offset = cumulative[c * SAMPLING_SCAN_CHUNK - 1];
+        for (uint64_t b = c * SAMPLING_SCAN_CHUNK; b < last; b++) {
+            cumulative[b] += offset;
+        }
+    }
+    double total = cumulative[num_blocks - 1];
+    if (!(total > 0.0)) {
+        fprintf(stderr, "Error: cannot sample a register whose amplitudes are all 0\n");
+        free(cumulative);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (shots >= PARALLEL_THRESHOLD)
+    for (uint64_t s = 0; s < shots; s++) {
+        // The state isn't necessarily normalized, the draw is scaled to the total probability
+        double r = uniform_draw(rng_seed, s) * total;
+
+        // First block whose cumulative probability exceeds r
+        uint64_t lo = search_cumulative(cumulative, num_blocks, r);
+
+        // Then the amplitude inside it; rounding can leave r past the block's last non-zero
+        // amplitude, which is then the result
+        double acc = (lo > 0) ? cumulative[lo - 1] : 0.0;
+        uint64_t outcome = lo * block;
+        for (uint64_t i = lo * block; i < (lo + 1) * block; i++) {
+            double p = probability(qr->amp[i]);
+            if (p > 0.0) {
+                outcome = i;
+                acc += p;
+                if (acc > r) {
+                    break;
+                }
+            }
+        }
+        out[s] = outcome;
+    }
+
+    free(cumulative);
+    STATS_END(QC_PHASE_OBSERVE, stats_start);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+qc_status qc_sample_bits(const qreg *qr, uint64_t shots, uint64_t rng_seed, uint8_t *out) {
+    if (qr == NULL || (out == NULL && shots > 0)) {
+        fprintf(stderr, "Error trying to sample a register with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->mps != NULL || qr->tableau != NULL) {
+        STATS_BEGIN(stats_start);
+        qc_status status = (qr->mps != NULL) ? mps_sample(qr->mps, shots, rng_seed, NULL, out)
+                                             : sample_tableau(qr->tableau, qr->size, shots, rng_seed, NULL, out);
+        STATS_END(QC_PHASE_OBSERVE, stats_start);
+        set_status(status);
+        return status;
+    }
+
+    // State vectors never exceed 64 qubits: unpack their indices
+    uint64_t *indices = malloc((shots + 1) * sizeof(uint64_t));
+    if (indices == NULL) {
+        fprintf(stderr, "Error allocating memory for samples\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    qc_status status = qc_measure_all(qr, shots, rng_seed, indices);
+    if (status == QC_OK) {
+        for (uint64_t shot = 0; shot < shots; shot++) {
+            for (int q = 0; q < qr->size; q++) {
+                out[shot * qr->size + q] = (uint8_t)((indices[shot] >> q) & 1);
+            }
+        }
+    }
+    free(indices);
+    return status;
+}
+
+// Probabilities of a qubit being 0 and 1, for a state vector register
+static void qubit_probabilities(const qreg *qr, uint64_t bit, double *p0_out, double *p1_out) {
+    uint64_t num_states = 1ULL << qr->size;
+    double p0 = 0.0, p1 = 0.0;
+
+    if (qr->sparse != NULL) {
+        const sparse_state *s = qr->sparse;
+        for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+            if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+                *((s->keys[slot] & bit) ? &p1 : &p0) += probability(s->values[slot]);
+            }
+        }
+        num_states = 0; // Nothing to sweep below
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD) reduction(+:p0, p1)
+    for (uint64_t i = 0; i < num_states; i++) {
+        if (i & bit) {
+            p1 += probability(qr->amp[i]);
+        } else {
+            p0 += probability(qr->amp[i]);
+        }
+    }
+    *p0_out = p0;
+    *p1_out = p1;
+}
+
+double qubit_one_probability(const qreg *qr, int qubit) {
+    double p0, p1;
+    qubit_probabilities(qr, 1ULL << qubit, &p0, &p1);
+    return (p0 + p1 > 0.0) ? p1 / (p0 + p1) : 0.0;
+}
+
+// Collapse onto the result, whose probability is p: the other half of the amplitudes is zeroed, this
+// half renormalized. Returns 0 on success
+static int collapse_qubit(qreg *qr, uint64_t bit, int result, double p) {
+    uint64_t kept = result ? bit : 0;
+    qc_real scale = (qc_real)(1.0 / sqrt(p));
+    if (qr->sparse != NULL) {
+        return sparse_filter(qr, bit, kept, scale);
+    }
+
+    uint64_t num_states = 1ULL << qr->size;
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t i = 0; i < num_states; i++) {
+        if ((i & bit) == kept) {
+            qr->amp[i].re *= scale;
+            qr->amp[i].im *= scale;
+        } else {
+            qr->amp[i] = (cnum){0.0, 0.0};
+        }
+    }
+    return 0;
+}
+
+int project_qubit(qreg *qr, int qubit, int result) {
+    uint64_t bit = 1ULL << qubit;
+    double p0, p1;
+    qubit_probabilities(qr, bit, &p0, &p1);
+    double p = result ? p1 : p0;
+    if (!(p > 0.0)) {
+        return -1;
+    }
+    return collapse_qubit(qr, bit, result, p);
+}
+
+int qc_measure_qubit(qreg *qr, int qubit, uint64_t rng_seed) {
+    if (qr == NULL || qubit < 0 || qubit >= qr->size) {
+        fprintf(stderr, "Error trying to measure an invalid qubit\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return -1;
+    }
+
+    STATS_BEGIN(stats_start);
+    int result;
+    if (qr->tableau != NULL) {
+        result = tableau_measure(qr->tableau, qubit, uniform_draw(rng_seed, 0));
+        STATS_END(QC_PHASE_OBSERVE, stats_start);
+        set_status(QC_OK);
+        return result;
+    }
+    if (qr->mps != NULL) {
+        result = mps_measure(qr->mps, qubit, uniform_draw(rng_seed, 0));
+        STATS_END(QC_PHASE_OBSERVE, stats_start);
+        set_status(result < 0 ? QC_ERR_OUT_OF_MEMORY : QC_OK);
+        return result;
+    }
+
+    uint64_t bit = 1ULL << qubit;
+    double p0, p1;
+    qubit_probabilities(qr, bit, &p0, &p1);
+    if (!(p0 + p1 > 0.0)) {
+        fprintf(stderr, "Error: cannot measure a register whose amplitudes are all 0\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return -1;
+    }
+
+    result = (uniform_draw(rng_seed, 0) * (p0 + p1) < p1) ? 1 : 0;
+    if (collapse_qubit(qr, bit, result, result ? p1 : p0) != 0) {
+        fprintf(stderr, "Error allocating memory to collapse a sparse state\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return -1;
+    }
+
+    STATS_SWEEPS(2);
+    STATS_END(QC_PHASE_OBSERVE, stats_start);
+    set_status(QC_OK);
+    return result;
+}
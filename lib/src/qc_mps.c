@@ -0,0 +1,955 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+// Matrix product state registers
+//
+// The state is a chain of tensors, one per site: site s holds a bonds[s] x 2 x bonds[s + 1] tensor,
+// and the amplitude of a basis state is the product of the matrices its bits select along the chain.
+// Qubits are assigned to sites through site_of / qubit_at, starting as the identity: a gate whose
+// qubits aren't neighbours first swaps them next to each other, and they stay where the swaps put them.
+//
+// A gate over k neighbouring sites contracts them into one bonds x 2^k x bonds tensor, runs the state
+// vector kernels on each of its 2^k entry slices (seen as a k qubit register), then splits it back into
+// k sites with singular value decompositions, truncating the new bonds. The chain is kept in mixed
+// canonical form: sites before `center` are left-orthonormal and sites after it right-orthonormal,
+// so the singular values of any split around the center are those of the whole state, and dropping
+// the smallest ones is the optimal truncation. Diagonal tables that are products of single qubit
+// phases (merged layers of RZ, S, T, ...) are applied site by site, without contracting anything.
+
+// Widest gate applied by contracting its sites (bond^2 2^k entries)
+#define MPS_MAX_GATE_QUBITS 12
+
+// One-sided Jacobi SVD: two columns are orthogonal once their overlap is below this fraction of their
+// norms, and singular values below this fraction of the largest one are rounding noise
+#ifdef QC_SINGLE_PRECISION
+#define SVD_EPSILON 1e-6
+#else
+#define SVD_EPSILON 1e-14
+#endif
+#define SVD_MAX_SWEEPS 60
+
+// Distance from an exact product of single qubit phases under which a diagonal table is applied per site
+#define PRODUCT_TOLERANCE (QC_AMPLITUDE_TOLERANCE * 1e-2)
+
+struct mps_state {
+    int num_qubits;
+    int max_bond;
+    double truncation_threshold;
+    double discarded_weight;  // Relative weight of all the singular values truncated so far
+    int center;               // Orthogonality center
+    int *bonds;               // num_qubits + 1 bond dimensions, the outer two being 1
+    int *site_of;             // Site holding each qubit
+    int *qubit_at;            // Qubit held by each site
+    cnum **sites;
+};
+
+static inline cnum cnum_conj(cnum a) {
+    return (cnum){a.re, -a.im};
+}
+
+static inline double norm2(cnum a) {
+    return (double)a.re * a.re + (double)a.im * a.im;
+}
+
+// c = a b, with a m x k and b k x n, all row-major (m reaches 2^(n - 1) when converting an MPS register)
+static void matmul(const cnum *a, const cnum *b, cnum *c, size_t m, int k, int n) {
+    memset(c, 0, m * n * sizeof(cnum));
+    for (size_t i = 0; i < m; i++) {
+        cnum *out = c + i * n;
+        for (int l = 0; l < k; l++) {
+            cnum x = a[i * k + l];
+            if (x.re == 0.0 && x.im == 0.0) {
+                continue;
+            }
+            const cnum *row = b + (size_t)l * n;
+            for (int j = 0; j < n; j++) {
+                out[j] = cnum_add(out[j], cnum_mul(x, row[j]));
+            }
+        }
+    }
+}
+
+static int max_bond_dimension(const mps_state *m) {
+    int max = 1;
+    for (int s = 1; s < m->num_qubits; s++) {
+        max = (m->bonds[s] > max) ? m->bonds[s] : max;
+    }
+    return max;
+}
+
+// Singular value decomposition
+
+// (a, b) <- (c a - s b', s a + c b'), where b' is b times the phase (ph_re, ph_im)
+static inline void rotate_pair(cnum *a, cnum *b, double c, double s, double ph_re, double ph_im) {
+    double b_re = b->re * ph_re - b->im * ph_im;
+    double b_im = b->re * ph_im + b->im * ph_re;
+    double a_re = a->re, a_im = a->im;
+    a->re = (qc_real)(c * a_re - s * b_re);
+    a->im = (qc_real)(c * a_im - s * b_im);
+    b->re = (qc_real)(s * a_re + c * b_re);
+    b->im = (qc_real)(s * a_im + c * b_im);
+}
+
+// Rotate columns wp & wq (and the same columns of v) so they become orthogonal, returns 0 if they
+// already were
+static int jacobi_rotate(cnum *wp, cnum *wq, int rows, cnum *vp, cnum *vq, int cols) {
+    double alpha = 0.0, beta = 0.0, g_re = 0.0, g_im = 0.0;
+    for (int i = 0; i < rows; i++) {
+        alpha += norm2(wp[i]);
+        beta += norm2(wq[i]);
+        g_re += (double)wp[i].re * wq[i].re + (double)wp[i].im * wq[i].im;
+        g_im += (double)wp[i].re * wq[i].im - (double)wp[i].im * wq[i].re;
+    }
+    double g = hypot(g_re, g_im);
+    if (g == 0.0 || g <= SVD_EPSILON * sqrt(alpha * beta)) {
+        return 0;
+    }
+
+    // Phase making the overlap real, then the real Jacobi rotation zeroing it
+    double zeta = (beta - alpha) / (2.0 * g);
+    double t = ((zeta >= 0.0) ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+    double c = 1.0 / sqrt(1.0 + t * t);
+    double s = c * t;
+    double ph_re = g_re / g, ph_im = -g_im / g;
+    for (int i = 0; i < rows; i++) {
+        rotate_pair(&wp[i], &wq[i], c, s, ph_re, ph_im);
+    }
+    for (int i = 0; i < cols; i++) {
+        rotate_pair(&vp[i], &vq[i], c, s, ph_re, ph_im);
+    }
+    return 1;
+}
+
+// a = u diag(s) vh for the m x n row-major matrix a, with r = min(m, n): u is m x r and vh r x n
+// (row-major), s decreasing. Returns 0 on success, -1 if out of memory
+static int svd(const cnum *a, int m, int n, cnum *u, double *s, cnum *vh) {
+    // Orthogonalize the columns of a, or those of a^dagger when it has fewer. Columns are contiguous
+    int transposed = (n > m);
+    int rows = transposed ? n : m;
+    int cols = transposed ? m : n;
+    cnum *w = malloc((size_t)rows * cols * sizeof(cnum));
+    cnum *v = calloc((size_t)cols * cols, sizeof(cnum));
+    double *norms = malloc(cols * sizeof(double));
+    int *order = malloc(cols * sizeof(int));
+    if (w == NULL || v == NULL || norms == NULL || order == NULL) {
+        free(w);
+        free(v);
+        free(norms);
+        free(order);
+        return -1;
+    }
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            cnum x = a[(size_t)i * n + j];
+            if (transposed) {
+                w[(size_t)i * rows + j] = cnum_conj(x);
+            } else {
+                w[(size_t)j * rows + i] = x;
+            }
+        }
+    }
+    for (int c = 0; c < cols; c++) {
+        v[(size_t)c * cols + c].re = 1.0;
+    }
+
+    for (int sweep = 0; sweep < SVD_MAX_SWEEPS; sweep++) {
+        int rotated = 0;
+        for (int p = 0; p + 1 < cols; p++) {
+            for (int q = p + 1; q < cols; q++) {
+                rotated |= jacobi_rotate(w + (size_t)p * rows, w + (size_t)q * rows, rows, v + (size_t)p * cols, v + (size_t)q * cols, cols);
+            }
+        }
+        if (!rotated) {
+            break;
+        }
+    }
+
+    // w = a' v has orthogonal columns: their norms are the singular values of a'
+    for (int c = 0; c < cols; c++) {
+        double sum = 0.0;
+        for (int i = 0; i < rows; i++) {
+            sum += norm2(w[(size_t)c * rows + i]);
+        }
+        norms[c] = sqrt(sum);
+        order[c] = c;
+    }
+    for (int c = 1; c < cols; c++) {
+        int key = order[c], j = c;
+        while (j > 0 && norms[order[j - 1]] < norms[key]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = key;
+    }
+
+    for (int k = 0; k < cols; k++) {
+        int c = order[k];
+        const cnum *wc = w + (size_t)c * rows;
+        const cnum *vc = v + (size_t)c * cols;
+        double inverse = (norms[c] > 0.0) ? 1.0 / norms[c] : 0.0;
+        s[k] = norms[c];
+        if (!transposed) {
+            for (int i = 0; i < m; i++) {
+                u[(size_t)i * cols + k] = (cnum){(qc_real)(wc[i].re * inverse), (qc_real)(wc[i].im * inverse)};
+            }
+            for (int j = 0; j < n; j++) {
+                vh[(size_t)k * n + j] = cnum_conj(vc[j]);
+            }
+        } else {
+            // a^dagger = u' s v'^dagger, so a = v' s u'^dagger
+            for (int i = 0; i < m; i++) {
+                u[(size_t)i * cols + k] = vc[i];
+            }
+            for (int j = 0; j < n; j++) {
+                vh[(size_t)k * n + j] = (cnum){(qc_real)(wc[j].re * inverse), (qc_real)(-wc[j].im * inverse)};
+            }
+        }
+    }
+
+    free(w);
+    free(v);
+    free(norms);
+    free(order);
+    return 0;
+}
+
+// Number of the r decreasing singular values to keep: rounding noise is always dropped, then the
+// smallest values while their total weight stays within threshold, then all those beyond max_bond.
+// The kept values are rescaled to the full norm; *dropped receives the relative weight truncated
+// (noise excluded)
+static int truncate_singular_values(double *s, int r, int max_bond, double threshold, double *dropped) {
+    double total = 0.0;
+    for (int k = 0; k < r; k++) {
+        total += s[k] * s[k];
+    }
+    *dropped = 0.0;
+    if (total == 0.0) {
+        return 1;
+    }
+
+    int keep = r;
+    double noise = 0.0, weight = 0.0;
+    while (keep > 1 && s[keep - 1] <= SVD_EPSILON * s[0]) {
+        noise += s[keep - 1] * s[keep - 1];
+        keep--;
+    }
+    while (keep > 1 && weight + s[keep - 1] * s[keep - 1] <= threshold * total) {
+        weight += s[keep - 1] * s[keep - 1];
+        keep--;
+    }
+    while (keep > max_bond) {
+        weight += s[keep - 1] * s[keep - 1];
+        keep--;
+    }
+
+    double scale = sqrt(total / (total - noise - weight));
+    for (int k = 0; k < keep; k++) {
+        s[k] *= scale;
+    }
+    *dropped = weight / total;
+    return keep;
+}
+
+// Canonical form
+
+// Move the orthogonality center one site to the right (direction 1) or left (-1), splitting the
+// center site with an exact SVD. Returns 0 on success
+static int shift_center(mps_state *m, int direction) {
+    int c = m->center;
+    int dl = m->bonds[c], dr = m->bonds[c + 1];
+    int rows = (direction > 0) ? 2 * dl : dl;
+    int cols = (direction > 0) ? dr : 2 * dr;
+    int r = (rows < cols) ? rows : cols;
+    int outer = (direction > 0) ? 2 * m->bonds[c + 2] : 2 * m->bonds[c - 1]; // Other dimensions of the neighbour
+    cnum *u = malloc((size_t)rows * r * sizeof(cnum));
+    cnum *vh = malloc((size_t)r * cols * sizeof(cnum));
+    double *s = malloc(r * sizeof(double));
+    cnum *site = malloc((size_t)rows * cols * sizeof(cnum)); // Upper bound for either new tensor
+    cnum *neighbour = malloc((size_t)outer * r * sizeof(cnum));
+    if (u == NULL || vh == NULL || s == NULL || site == NULL || neighbour == NULL || svd(m->sites[c], rows, cols, u, s, vh) != 0) {
+        free(u);
+        free(vh);
+        free(s);
+        free(site);
+        free(neighbour);
+        return -1;
+    }
+    double dropped;
+    int keep = truncate_singular_values(s, r, INT_MAX, 0.0, &dropped);
+
+    if (direction > 0) {
+        // Center site <- u, next site <- s vh next
+        for (int i = 0; i < rows; i++) {
+            memcpy(site + (size_t)i * keep, u + (size_t)i * r, keep * sizeof(cnum));
+        }
+        for (int k = 0; k < keep; k++) {
+            for (int j = 0; j < cols; j++) {
+                vh[(size_t)k * cols + j].re *= (qc_real)s[k];
+                vh[(size_t)k * cols + j].im *= (qc_real)s[k];
+            }
+        }
+        matmul(vh, m->sites[c + 1], neighbour, keep, dr, outer);
+        free(m->sites[c + 1]);
+        m->sites[c + 1] = neighbour;
+        m->bonds[c + 1] = keep;
+    } else {
+        // Center site <- vh, previous site <- previous u s
+        memcpy(site, vh, (size_t)keep * cols * sizeof(cnum));
+        for (int i = 0; i < rows; i++) {
+            for (int k = 0; k < keep; k++) {
+                u[(size_t)i * keep + k] = (cnum){(qc_real)(u[(size_t)i * r + k].re * s[k]), (qc_real)(u[(size_t)i * r + k].im * s[k])};
+            }
+        }
+        matmul(m->sites[c - 1], u, neighbour, outer, dl, keep);
+        free(m->sites[c - 1]);
+        m->sites[c - 1] = neighbour;
+        m->bonds[c] = keep;
+    }
+    free(m->sites[c]);
+    m->sites[c] = site;
+    m->center = c + direction;
+
+    free(u);
+    free(vh);
+    free(s);
+    return 0;
+}
+
+static int move_center(mps_state *m, int target) {
+    while (m->center < target) {
+        if (shift_center(m, 1) != 0) {
+            return -1;
+        }
+    }
+    while (m->center > target) {
+        if (shift_center(m, -1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Gates
+
+// Split theta (dl x 2^k x dr) back into the k sites starting at `first`, truncating the new bonds.
+// The orthogonality center ends on the last site, or on the first one when to_left is set.
+// Takes ownership of theta; returns 0 on success
+static int split_window(mps_state *m, int first, int k, cnum *theta, int to_left) {
+    int dim = 1 << k;
+    int dl = m->bonds[first], dr = m->bonds[first + k];
+    for (int j = 0; j + 1 < k; j++) {
+        // Peel off the first remaining site (left to right), or the last one (right to left)
+        int site_index = to_left ? first + k - 1 - j : first + j;
+        int rows = to_left ? dl * (dim >> (j + 1)) : 2 * dl;
+        int cols = to_left ? 2 * dr : (dim >> (j + 1)) * dr;
+        int r = (rows < cols) ? rows : cols;
+        cnum *u = malloc((size_t)rows * r * sizeof(cnum));
+        cnum *vh = malloc((size_t)r * cols * sizeof(cnum));
+        double *s = malloc(r * sizeof(double));
+        if (u == NULL || vh == NULL || s == NULL || svd(theta, rows, cols, u, s, vh) != 0) {
+            free(u);
+            free(vh);
+            free(s);
+            free(theta);
+            return -1;
+        }
+        double dropped;
+        int keep = truncate_singular_values(s, r, m->max_bond, m->truncation_threshold, &dropped);
+        m->discarded_weight += dropped;
+
+        // The peeled site keeps the orthonormal factor, the rest of theta absorbs the singular values
+        if (to_left) {
+            for (int i = 0; i < rows; i++) {
+                for (int c = 0; c < keep; c++) {
+                    u[(size_t)i * keep + c] = (cnum){(qc_real)(u[(size_t)i * r + c].re * s[c]), (qc_real)(u[(size_t)i * r + c].im * s[c])};
+                }
+            }
+            free(m->sites[site_index]);
+            m->sites[site_index] = vh; // First keep rows: keep x 2 x dr
+            m->bonds[site_index] = keep;
+            dr = keep;
+            free(theta);
+            theta = u;
+        } else {
+            for (int i = 0; i < rows; i++) {
+                memmove(u + (size_t)i * keep, u + (size_t)i * r, keep * sizeof(cnum));
+            }
+            for (int c = 0; c < keep; c++) {
+                for (int i = 0; i < cols; i++) {
+                    vh[(size_t)c * cols + i].re *= (qc_real)s[c];
+                    vh[(size_t)c * cols + i].im *= (qc_real)s[c];
+                }
+            }
+            free(m->sites[site_index]);
+            m->sites[site_index] = u;
+            m->bonds[site_index + 1] = keep;
+            dl = keep;
+            free(theta);
+            theta = vh;
+        }
+        free(s);
+    }
+
+    int last = to_left ? first : first + k - 1;
+    free(m->sites[last]);
+    m->sites[last] = theta;
+    m->center = last;
+    return 0;
+}
+
+// Apply an instruction over the k neighbouring sites starting at `first`, its qubit indices being
+// positions in the window (site first + j is qubit k - 1 - j). Returns 0 on success
+static int apply_window(mps_state *m, int first, int k, const instruction *ins, int to_left) {
+    // Any center inside the window keeps the truncation optimal
+    int target = (m->center < first) ? first : (m->center > first + k - 1) ? first + k - 1 : m->center;
+    if (k > 1 && move_center(m, target) != 0) {
+        return -1;
+    }
+
+    // Contract the sites into theta: dl x 2^k x dr, the first site's bit being the MSB of the middle index
+    int dim = 1 << k;
+    int dl = m->bonds[first], dr = m->bonds[first + k];
+    size_t entries = (size_t)dl * 2 * m->bonds[first + 1];
+    cnum *theta = malloc(entries * sizeof(cnum));
+    if (theta == NULL) {
+        return -1;
+    }
+    memcpy(theta, m->sites[first], entries * sizeof(cnum));
+    for (int j = 1; j < k; j++) {
+        cnum *next = malloc((size_t)dl * (2 << j) * m->bonds[first + j + 1] * sizeof(cnum));
+        if (next == NULL) {
+            free(theta);
+            return -1;
+        }
+        matmul(theta, m->sites[first + j], next, (size_t)dl << j, m->bonds[first + j], 2 * m->bonds[first + j + 1]);
+        free(theta);
+        theta = next;
+    }
+
+    // Run the gate on each slice of 2^k entries with the state vector kernels
+    cnum *slice = alloc_state_vector(dim);
+    if (slice == NULL) {
+        free(theta);
+        return -1;
+    }
+    qreg window = {.size = k, .amp = slice};
+    int ret = 0;
+    for (int l = 0; l < dl && ret == 0; l++) {
+        for (int r = 0; r < dr && ret == 0; r++) {
+            cnum *base = theta + (size_t)l * dim * dr + r;
+            for (int x = 0; x < dim; x++) {
+                slice[x] = base[(size_t)x * dr];
+            }
+            ret = apply_dense_instruction(&window, ins);
+            for (int x = 0; x < dim; x++) {
+                base[(size_t)x * dr] = slice[x];
+            }
+        }
+    }
+    free(slice);
+    if (ret != 0) {
+        free(theta);
+        return -1;
+    }
+
+    if (k == 1) {
+        free(m->sites[first]);
+        m->sites[first] = theta;
+        return 0;
+    }
+    return split_window(m, first, k, theta, to_left);
+}
+
+// Exchange the qubits of sites s & s + 1
+static int swap_sites(mps_state *m, int s) {
+    static const int positions[2] = {1, 0};
+    instruction swap = {GATE_OP_SWAP, 2, 0, positions, NULL};
+    if (apply_window(m, s, 2, &swap, 1) != 0) {
+        return -1;
+    }
+    int a = m->qubit_at[s], b = m->qubit_at[s + 1];
+    m->qubit_at[s] = b;
+    m->qubit_at[s + 1] = a;
+    m->site_of[a] = s + 1;
+    m->site_of[b] = s;
+    return 0;
+}
+
+// Apply a diagonal table that is a product of one phase per qubit site by site: returns 1 if it was
+// such a product (and got applied), 0 if not, -1 on failure
+static int apply_product_diagonal(mps_state *m, const instruction *ins) {
+    int k = ins->num_qubits;
+    const cnum *table = ins->matrix;
+    double t0 = norm2(table[0]);
+    if (k > DIAGONAL_GATE_MAX_QUBITS || t0 == 0.0) {
+        return 0;
+    }
+
+    // Phase of each qubit being 1, relative to the all zeros entry (qubits[0] is the MSB of the key)
+    cnum ratio[DIAGONAL_GATE_MAX_QUBITS];
+    for (int j = 0; j < k; j++) {
+        cnum e = cnum_mul(table[1 << (k - 1 - j)], cnum_conj(table[0]));
+        ratio[j] = (cnum){(qc_real)(e.re / t0), (qc_real)(e.im / t0)};
+    }
+    for (int key = 1; key < (1 << k); key++) {
+        cnum expected = table[0];
+        for (int j = 0; j < k; j++) {
+            if ((key >> (k - 1 - j)) & 1) {
+                expected = cnum_mul(expected, ratio[j]);
+            }
+        }
+        cnum diff = {expected.re - table[key].re, expected.im - table[key].im};
+        if (norm2(diff) > PRODUCT_TOLERANCE * PRODUCT_TOLERANCE) {
+            return 0;
+        }
+    }
+
+    static const int position[1] = {0};
+    for (int j = 0; j < k; j++) {
+        // The first qubit also carries the table's global phase
+        cnum phases[2] = {{1.0, 0.0}, ratio[j]};
+        if (j == 0) {
+            phases[0] = table[0];
+            phases[1] = cnum_mul(table[0], ratio[0]);
+        }
+        instruction diagonal = {GATE_OP_DIAGONAL, 1, 0, position, phases};
+        if (apply_window(m, m->site_of[ins->qubits[j]], 1, &diagonal, 0) != 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+qc_status apply_mps_instruction(qreg *qr, const instruction *ins) {
+    mps_state *m = qr->mps;
+    int k = ins->num_qubits;
+    if (ins->op == GATE_OP_DIAGONAL && k > 1) {
+        int ret = apply_product_diagonal(m, ins);
+        if (ret != 0) {
+            return (ret > 0) ? QC_OK : QC_ERR_OUT_OF_MEMORY;
+        }
+    }
+    if (k > MPS_MAX_GATE_QUBITS) {
+        fprintf(stderr, "Error: MPS registers apply gates over at most %d qubits, got %d\n", MPS_MAX_GATE_QUBITS, k);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    // Sort the gate's qubits along the chain, then swap each one next to the first
+    int order[MPS_MAX_GATE_QUBITS] = {0};
+    for (int j = 0; j < k; j++) {
+        int q = ins->qubits[j], i = j;
+        while (i > 0 && m->site_of[order[i - 1]] > m->site_of[q]) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = q;
+    }
+    int first = m->site_of[order[0]];
+    for (int j = 1; j < k; j++) {
+        while (m->site_of[order[j]] > first + j) {
+            if (swap_sites(m, m->site_of[order[j]] - 1) != 0) {
+                fprintf(stderr, "Error allocating memory for an MPS gate\n");
+                return QC_ERR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    // The kernels see the window as a k qubit register whose MSB is the first site
+    int positions[MPS_MAX_GATE_QUBITS];
+    for (int j = 0; j < k; j++) {
+        positions[j] = k - 1 - (m->site_of[ins->qubits[j]] - first);
+    }
+    instruction local = *ins;
+    local.qubits = positions;
+    if (apply_window(m, first, k, &local, 0) != 0) {
+        fprintf(stderr, "Error allocating memory for an MPS gate\n");
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    return QC_OK;
+}
+
+// Observables
+
+uint64_t mps_num_entries(const mps_state *m) {
+    uint64_t entries = 0;
+    for (int s = 0; s < m->num_qubits; s++) {
+        entries += 2 * (uint64_t)m->bonds[s] * m->bonds[s + 1];
+    }
+    return entries;
+}
+
+cnum mps_amplitude(const mps_state *m, const uint8_t *bits) {
+    int max_bond = max_bond_dimension(m);
+    cnum *left = malloc(max_bond * sizeof(cnum));
+    cnum *next = malloc(max_bond * sizeof(cnum));
+    if (left == NULL || next == NULL) {
+        fprintf(stderr, "Error allocating memory to read an amplitude\n");
+        free(left);
+        free(next);
+        return (cnum){0.0, 0.0};
+    }
+
+    // Row vector times the matrix each site's bit selects
+    left[0] = (cnum){1.0, 0.0};
+    for (int s = 0; s < m->num_qubits; s++) {
+        int dl = m->bonds[s], dr = m->bonds[s + 1];
+        const cnum *a = m->sites[s] + (size_t)(bits[m->qubit_at[s]] & 1) * dr;
+        for (int r = 0; r < dr; r++) {
+            cnum sum = {0.0, 0.0};
+            for (int l = 0; l < dl; l++) {
+                sum = cnum_add(sum, cnum_mul(left[l], a[(size_t)l * 2 * dr + r]));
+            }
+            next[r] = sum;
+        }
+        cnum *tmp = left;
+        left = next;
+        next = tmp;
+    }
+    cnum amplitude = left[0];
+    free(left);
+    free(next);
+    return amplitude;
+}
+
+// With the center on the first site, the rest of the chain is right-orthonormal: the probability of
+// each site's bit given the previous ones is the norm of the row vector it selects
+qc_status mps_sample(mps_state *m, uint64_t shots, uint64_t rng_seed, uint64_t *indices, uint8_t *bits) {
+    int n = m->num_qubits;
+    if (move_center(m, 0) != 0) {
+        fprintf(stderr, "Error allocating memory to sample an MPS register\n");
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    int max_bond = max_bond_dimension(m);
+    cnum *left = malloc(max_bond * sizeof(cnum));
+    cnum *w = malloc(2 * max_bond * sizeof(cnum));
+    if (left == NULL || w == NULL) {
+        fprintf(stderr, "Error allocating memory to sample an MPS register\n");
+        free(left);
+        free(w);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    for (uint64_t shot = 0; shot < shots; shot++) {
+        uint64_t outcome = 0;
+        left[0] = (cnum){1.0, 0.0};
+        for (int s = 0; s < n; s++) {
+            int dl = m->bonds[s], dr = m->bonds[s + 1];
+            const cnum *a = m->sites[s];
+            double p[2] = {0.0, 0.0};
+            for (int b = 0; b < 2; b++) {
+                for (int r = 0; r < dr; r++) {
+                    cnum sum = {0.0, 0.0};
+                    for (int l = 0; l < dl; l++) {
+                        sum = cnum_add(sum, cnum_mul(left[l], a[((size_t)l * 2 + b) * dr + r]));
+                    }
+                    w[b * dr + r] = sum;
+                    p[b] += norm2(sum);
+                }
+            }
+            int result = (uniform_draw(rng_seed, shot * n + s) * (p[0] + p[1]) < p[1]) ? 1 : 0;
+            qc_real scale = (qc_real)(1.0 / sqrt(p[result]));
+            for (int r = 0; r < dr; r++) {
+                left[r] = (cnum){w[result * dr + r].re * scale, w[result * dr + r].im * scale};
+            }
+
+            int q = m->qubit_at[s];
+            if (bits != NULL) {
+                bits[shot * n + q] = (uint8_t)result;
+            }
+            outcome |= (uint64_t)result << (q & 63);
+        }
+        if (indices != NULL) {
+            indices[shot] = outcome;
+        }
+    }
+    free(left);
+    free(w);
+    return QC_OK;
+}
+
+int mps_measure(mps_state *m, int qubit, double draw) {
+    int s = m->site_of[qubit];
+    if (move_center(m, s) != 0) {
+        fprintf(stderr, "Error allocating memory to measure an MPS register\n");
+        return -1;
+    }
+
+    // The center site holds the whole state's norm
+    int dl = m->bonds[s], dr = m->bonds[s + 1];
+    cnum *a = m->sites[s];
+    double p[2] = {0.0, 0.0};
+    for (int l = 0; l < dl; l++) {
+        for (int b = 0; b < 2; b++) {
+            for (int r = 0; r < dr; r++) {
+                p[b] += norm2(a[((size_t)l * 2 + b) * dr + r]);
+            }
+        }
+    }
+    int result = (draw * (p[0] + p[1]) < p[1]) ? 1 : 0;
+    qc_real scale = (qc_real)(1.0 / sqrt(p[result]));
+    for (int l = 0; l < dl; l++) {
+        for (int b = 0; b < 2; b++) {
+            cnum *row = a + ((size_t)l * 2 + b) * dr;
+            for (int r = 0; r < dr; r++) {
+                row[r] = (b == result) ? (cnum){row[r].re * scale, row[r].im * scale} : (cnum){0.0, 0.0};
+            }
+        }
+    }
+    return result;
+}
+
+// <psi|P|psi> through the transfer matrices of the sites between the term's first & last factors
+// (and the center): the left-orthonormal sites before them contract to the identity, the
+// right-orthonormal sites after them to a trace
+qc_status mps_pauli_expectation(mps_state *m, const char *paulis, double *value) {
+    static const cnum matrices[4][4] = {
+        {{1.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}, {1.0, 0.0}},   // I
+        {{0.0, 0.0}, {1.0, 0.0}, {1.0, 0.0}, {0.0, 0.0}},   // X
+        {{0.0, 0.0}, {0.0, -1.0}, {0.0, 1.0}, {0.0, 0.0}},  // Y
+        {{1.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}, {-1.0, 0.0}},  // Z
+    };
+    int n = m->num_qubits;
+    uint8_t *ops = calloc(n, 1); // Index in matrices, plus 4 once a qubit has been seen
+    if (ops == NULL) {
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    const char *p = paulis;
+    char op;
+    int qubit, ret;
+    int lo = m->center, hi = m->center;
+    while ((ret = next_pauli_factor(paulis, &p, n, &op, &qubit)) > 0) {
+        if (ops[qubit] != 0) {
+            fprintf(stderr, "Error: qubit %d appears twice in Pauli string \"%s\"\n", qubit, paulis);
+            ret = -1;
+            break;
+        }
+        ops[qubit] = 4 | ((op == 'X') ? 1 : (op == 'Y') ? 2 : (op == 'Z') ? 3 : 0);
+        int s = m->site_of[qubit];
+        lo = (s < lo) ? s : lo;
+        hi = (s > hi) ? s : hi;
+    }
+    if (ret < 0) {
+        free(ops);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    int max_bond = max_bond_dimension(m);
+    size_t square = (size_t)max_bond * max_bond;
+    cnum *e = calloc(square, sizeof(cnum));
+    cnum *e_next = malloc(square * sizeof(cnum));
+    cnum *f = malloc(2 * square * sizeof(cnum));
+    if (e == NULL || e_next == NULL || f == NULL) {
+        free(ops);
+        free(e);
+        free(e_next);
+        free(f);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    int d = m->bonds[lo];
+    for (int i = 0; i < d; i++) {
+        e[(size_t)i * d + i] = (cnum){1.0, 0.0};
+    }
+    for (int s = lo; s <= hi; s++) {
+        int dl = m->bonds[s], dr = m->bonds[s + 1];
+        const cnum *a = m->sites[s];
+        const cnum *pauli = matrices[ops[m->qubit_at[s]] & 3];
+
+        // f[l][b][r'] = sum_l' e[l][l'] a[l'][b][r'], then e'[r][r'] = sum_{l,a,b} conj(a[l][a][r]) P[a][b] f[l][b][r']
+        matmul(e, a, f, dl, dl, 2 * dr);
+        memset(e_next, 0, (size_t)dr * dr * sizeof(cnum));
+        for (int l = 0; l < dl; l++) {
+            for (int x = 0; x < 2; x++) {
+                for (int y = 0; y < 2; y++) {
+                    cnum pxy = pauli[x * 2 + y];
+                    if (pxy.re == 0.0 && pxy.im == 0.0) {
+                        continue;
+                    }
+                    const cnum *bra = a + ((size_t)l * 2 + x) * dr;
+                    const cnum *ket = f + ((size_t)l * 2 + y) * dr;
+                    for (int r = 0; r < dr; r++) {
+                        cnum c = cnum_mul(cnum_conj(bra[r]), pxy);
+                        if (c.re == 0.0 && c.im == 0.0) {
+                            continue;
+                        }
+                        cnum *row = e_next + (size_t)r * dr;
+                        for (int r2 = 0; r2 < dr; r2++) {
+                            row[r2] = cnum_add(row[r2], cnum_mul(c, ket[r2]));
+                        }
+                    }
+                }
+            }
+        }
+        cnum *tmp = e;
+        e = e_next;
+        e_next = tmp;
+    }
+
+    double trace = 0.0;
+    d = m->bonds[hi + 1];
+    for (int i = 0; i < d; i++) {
+        trace += e[(size_t)i * d + i].re;
+    }
+    *value = trace;
+
+    free(ops);
+    free(e);
+    free(e_next);
+    free(f);
+    return QC_OK;
+}
+
+void mps_print(const mps_state *m) {
+    printf("Matrix product state of %d qubits, bond dimensions:", m->num_qubits);
+    for (int s = 1; s < m->num_qubits; s++) {
+        printf(" %d", m->bonds[s]);
+    }
+    printf(" (discarded weight %.3g)\n", m->discarded_weight);
+}
+
+// Registers
+
+qc_status mps_to_state(qreg *qr) {
+    mps_state *m = qr->mps;
+    int n = m->num_qubits;
+    cnum *amp = alloc_state_vector(1ULL << n);
+    cnum *psi = malloc(2 * (size_t)m->bonds[1] * sizeof(cnum));
+    if (amp == NULL || psi == NULL) {
+        fprintf(stderr, "Error allocating memory to convert an MPS register\n");
+        free(amp);
+        free(psi);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    // psi: 2^(s + 1) x bonds[s + 1] after site s, site 0's bit being the MSB of the row
+    memcpy(psi, m->sites[0], 2 * (size_t)m->bonds[1] * sizeof(cnum));
+    for (int s = 1; s < n; s++) {
+        cnum *next = malloc((2ULL << s) * m->bonds[s + 1] * sizeof(cnum));
+        if (next == NULL) {
+            fprintf(stderr, "Error allocating memory to convert an MPS register\n");
+            free(amp);
+            free(psi);
+            set_status(QC_ERR_OUT_OF_MEMORY);
+            return QC_ERR_OUT_OF_MEMORY;
+        }
+        matmul(psi, m->sites[s], next, 1ULL << s, m->bonds[s], 2 * m->bonds[s + 1]);
+        free(psi);
+        psi = next;
+    }
+    for (uint64_t x = 0; x < (1ULL << n); x++) {
+        uint64_t index = 0;
+        for (int s = 0; s < n; s++) {
+            index |= ((x >> (n - 1 - s)) & 1) << m->qubit_at[s];
+        }
+        amp[index] = psi[x];
+    }
+    free(psi);
+
+    mps_free(m);
+    qr->mps = NULL;
+    qr->amp = amp;
+    STATS_SWEEPS(1);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+void mps_free(mps_state *m) {
+    if (m != NULL) {
+        for (int s = 0; m->sites != NULL && s < m->num_qubits; s++) {
+            free(m->sites[s]);
+        }
+        free(m->sites);
+        free(m->bonds);
+        free(m->site_of);
+        free(m->qubit_at);
+        free(m);
+    }
+}
+
+qreg *new_mps_qreg(int size) {
+    if (size > MPS_QUBIT_LIMIT) {
+        fprintf(stderr, "Cannot support more than %d qubits in an MPS register, attempted %d\n", MPS_QUBIT_LIMIT, size);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return NULL;
+    }
+
+    qreg *qr = malloc(sizeof(qreg));
+    mps_state *m = calloc(1, sizeof(mps_state));
+    if (qr == NULL || m == NULL) {
+        goto fail;
+    }
+    m->num_qubits = size;
+    m->max_bond = MPS_DEFAULT_MAX_BOND_DIMENSION;
+    m->truncation_threshold = MPS_DEFAULT_TRUNCATION_THRESHOLD;
+    m->bonds = malloc((size + 1) * sizeof(int));
+    m->site_of = malloc(size * sizeof(int));
+    m->qubit_at = malloc(size * sizeof(int));
+    m->sites = calloc(size, sizeof(cnum *));
+    if (m->bonds == NULL || m->site_of == NULL || m->qubit_at == NULL || m->sites == NULL) {
+        goto fail;
+    }
+
+    // |00...0>: a product state, every bond of dimension 1
+    m->bonds[size] = 1;
+    for (int s = 0; s < size; s++) {
+        m->bonds[s] = 1;
+        m->site_of[s] = m->qubit_at[s] = s;
+        m->sites[s] = calloc(2, sizeof(cnum));
+        if (m->sites[s] == NULL) {
+            goto fail;
+        }
+        m->sites[s][0].re = 1.0;
+    }
+    STATS_ALLOCS(size + 4, (uint64_t)size * (2 * sizeof(cnum) + 3 * sizeof(int)));
+
+    qr->size = size;
+    qr->amp = NULL;
+    qr->mapped_bytes = 0;
+    qr->back_buffer = NULL;
+    qr->sparse = NULL;
+    qr->tableau = NULL;
+    qr->mps = m;
+    set_status(QC_OK);
+    return qr;
+
+fail:
+    fprintf(stderr, "Error allocating memory for quantum register.\n");
+    free(qr);
+    mps_free(m);
+    set_status(QC_ERR_OUT_OF_MEMORY);
+    return NULL;
+}
+
+qc_status qc_set_mps_limits(qreg *qr, int max_bond_dimension, double truncation_threshold) {
+    if (qr == NULL || qr->mps == NULL || max_bond_dimension < 1 || !(truncation_threshold >= 0.0 && truncation_threshold < 1.0)) {
+        fprintf(stderr, "Error: MPS limits need an MPS register, a bond dimension >= 1 and a threshold in [0, 1)\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    qr->mps->max_bond = max_bond_dimension;
+    qr->mps->truncation_threshold = truncation_threshold;
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+qc_status qc_get_mps_info(const qreg *qr, int *bond_dimension, double *discarded_weight) {
+    if (qr == NULL || qr->mps == NULL) {
+        fprintf(stderr, "Error trying to read the bonds of a register that isn't an MPS\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (bond_dimension != NULL) {
+        *bond_dimension = max_bond_dimension(qr->mps);
+    }
+    if (discarded_weight != NULL) {
+        *discarded_weight = qr->mps->discarded_weight;
+    }
+    set_status(QC_OK);
+    return QC_OK;
+}
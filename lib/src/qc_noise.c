@@ -0,0 +1,198 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Noise channels & Monte-Carlo trajectories
+//
+// A trajectory applies, after each noisy gate, one Kraus operator K_k of every attached channel on
+// every qubit of the gate, drawn with probability ||K_k psi||^2, and renormalizes the state. The
+// depolarizing channel's operators are multiples of the identity & the Paulis, so its draw doesn't
+// depend on the state; amplitude damping's operators K1 = sqrt(p) |0><1| and
+// K0 = |0><0| + sqrt(1 - p) |1><1| need the probability of the qubit being 1 first.
+//
+// Every trajectory draws its random numbers from splitmix64 keyed by its own seed, derived from the
+// caller's seed and the trajectory index, so the counts don't depend on how trajectories are spread
+// over the threads.
+
+qc_status qc_add_noise(qcircuit *circuit, int gate, qc_channel channel, double probability) {
+    if (circuit == NULL || gate < QC_ALL_GATES || gate >= circuit->num_instructions ||
+        (channel != QC_CHANNEL_DEPOLARIZING && channel != QC_CHANNEL_AMPLITUDE_DAMPING) || !(probability >= 0.0 && probability <= 1.0)) {
+        fprintf(stderr, "Error: noise needs a circuit, a gate index (or QC_ALL_GATES), a channel and a probability in [0, 1]\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    noise_channel *noise = realloc(circuit->noise, (circuit->num_noise + 1) * sizeof(noise_channel));
+    if (noise == NULL) {
+        fprintf(stderr, "Error allocating memory for a noise channel\n");
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    // Keep the channels sorted by gate, in the order they were added for each gate
+    int i = circuit->num_noise;
+    while (i > 0 && noise[i - 1].gate > gate) {
+        noise[i] = noise[i - 1];
+        i--;
+    }
+    noise[i] = (noise_channel){gate, channel, probability};
+    circuit->noise = noise;
+    circuit->num_noise++;
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+// Apply one Kraus operator of a channel to each qubit of the gate, returns QC_OK on success
+static qc_status apply_channel(qreg *qr, const noise_channel *noise, const instruction *gate, const cnum paulis[3][4], uint64_t seed, uint64_t *draw) {
+    double p = noise->probability;
+    for (int j = 0; j < gate->num_qubits; j++) {
+        int qubit = gate->qubits[j];
+        double r = uniform_draw(seed, (*draw)++);
+        cnum kraus[4];
+        if (noise->channel == QC_CHANNEL_DEPOLARIZING) {
+            if (r >= p) {
+                continue;
+            }
+            int pauli = (int)(r / p * 3.0);
+            memcpy(kraus, paulis[pauli < 2 ? pauli : 2], sizeof(kraus));
+        } else {
+            // Decay with probability p * P(1): K1 / sqrt(p P(1)) = |0><1| / sqrt(P(1)), otherwise K0 renormalized
+            double p1 = qubit_one_probability(qr, qubit);
+            double jump = p * p1;
+            if (r < jump) {
+                kraus[0] = kraus[2] = kraus[3] = (cnum){0.0, 0.0};
+                kraus[1] = (cnum){(qc_real)(1.0 / sqrt(p1)), 0.0};
+            } else {
+                double scale = 1.0 / sqrt(1.0 - jump);
+                kraus[1] = kraus[2] = (cnum){0.0, 0.0};
+                kraus[0] = (cnum){(qc_real)scale, 0.0};
+                kraus[3] = (cnum){(qc_real)(sqrt(1.0 - p) * scale), 0.0};
+            }
+        }
+        instruction ins = {GATE_OP_MATRIX, 1, 0, &qubit, kraus};
+        qc_status status = apply_instruction(qr, &ins);
+        if (status != QC_OK) {
+            return status;
+        }
+    }
+    return QC_OK;
+}
+
+qc_status qc_run_noisy(const qcircuit *circuit, qreg *qr, uint64_t rng_seed) {
+    if (circuit == NULL || qr == NULL) {
+        fprintf(stderr, "Error trying to run a circuit with NULL inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->size < circuit->min_qubits || (qr->amp == NULL && qr->sparse == NULL)) {
+        fprintf(stderr, "Error: noisy circuits need a dense or sparse register of at least %d qubits\n", circuit->min_qubits);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (reject_parametric(circuit) != 0) {
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    cnum paulis[3][4];
+    if (pauli_matrices(paulis) != 0) {
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+
+    int num_global = 0;
+    while (num_global < circuit->num_noise && circuit->noise[num_global].gate == QC_ALL_GATES) {
+        num_global++;
+    }
+
+    STATS_BEGIN(stats_start);
+    uint64_t draw = 0;
+    int next = num_global;
+    for (int i = 0; i < circuit->num_instructions; i++) {
+        const instruction *gate = &circuit->instructions[i];
+        qc_status status = apply_instruction(qr, gate);
+        for (int c = 0; c < num_global && status == QC_OK; c++) {
+            status = apply_channel(qr, &circuit->noise[c], gate, paulis, rng_seed, &draw);
+        }
+        for (; next < circuit->num_noise && circuit->noise[next].gate == i && status == QC_OK; next++) {
+            status = apply_channel(qr, &circuit->noise[next], gate, paulis, rng_seed, &draw);
+        }
+        if (status != QC_OK) {
+            set_status(status);
+            return status;
+        }
+    }
+    STATS_END(QC_PHASE_KERNELS, stats_start);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+qc_status qc_run_trajectories(const qcircuit *circuit, int num_qubits, uint64_t trajectories, uint64_t shots_per_trajectory,
+                              double readout_error, uint64_t rng_seed, uint64_t *counts) {
+    if (circuit == NULL || counts == NULL || num_qubits < circuit->min_qubits || num_qubits < 1 || num_qubits > QUBIT_REGISTER_LIMIT ||
+        !(readout_error >= 0.0 && readout_error <= 1.0)) {
+        fprintf(stderr, "Error trying to run trajectories with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (reject_parametric(circuit) != 0) {
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    uint64_t num_states = 1ULL << num_qubits;
+    memset(counts, 0, num_states * sizeof(uint64_t));
+
+    qc_status status = QC_OK;
+    #pragma omp parallel num_threads(qc_get_num_threads()) if (trajectories > 1)
+    {
+        // Each thread reuses one register, sample buffer & count table for all of its trajectories
+        qreg *qr = new_qreg(num_qubits);
+        uint64_t *samples = malloc((shots_per_trajectory + 1) * sizeof(uint64_t));
+        uint64_t *local_counts = calloc(num_states, sizeof(uint64_t));
+        qc_status local_status = (qr != NULL && samples != NULL && local_counts != NULL) ? QC_OK : QC_ERR_OUT_OF_MEMORY;
+
+        #pragma omp for schedule(dynamic)
+        for (uint64_t t = 0; t < trajectories; t++) {
+            if (local_status != QC_OK) {
+                continue;
+            }
+            uint64_t seed = splitmix64(rng_seed ^ splitmix64(t));
+            uint64_t sample_seed = splitmix64(seed);
+            uint64_t readout_seed = splitmix64(sample_seed);
+
+            memset(qr->amp, 0, num_states * sizeof(cnum));
+            qr->amp[0].re = 1.0;
+            local_status = qc_run_noisy(circuit, qr, seed);
+            if (local_status == QC_OK) {
+                local_status = qc_measure_all(qr, shots_per_trajectory, sample_seed, samples);
+            }
+            for (uint64_t shot = 0; shot < shots_per_trajectory && local_status == QC_OK; shot++) {
+                uint64_t outcome = samples[shot];
+                for (int q = 0; q < num_qubits && readout_error > 0.0; q++) {
+                    if (uniform_draw(readout_seed, shot * num_qubits + q) < readout_error) {
+                        outcome ^= 1ULL << q;
+                    }
+                }
+                local_counts[outcome]++;
+            }
+        }
+
+        #pragma omp critical(qc_trajectories)
+        {
+            if (local_status != QC_OK) {
+                status = local_status;
+            } else if (local_counts != NULL) {
+                for (uint64_t i = 0; i < num_states; i++) {
+                    counts[i] += local_counts[i];
+                }
+            }
+        }
+        free_qreg(qr);
+        free(samples);
+        free(local_counts);
+    }
+
+    if (status != QC_OK) {
+        fprintf(stderr, "Error running noisy trajectories: %s\n", qc_status_string(status));
+    }
+    set_status(status);
+    return status;
+}
@@ -0,0 +1,759 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// OpenQASM 2.0 front-end
+//
+// The file is memory mapped and tokenized on the fly: every statement is lowered to instructions and
+// applied as soon as its ';' is read, so only the current statement is ever held, however long the
+// file. The statements between two barriers form a layer whose diagonal gates get merged, as in
+// circuit_layer (measurements end a layer too). The qelib1 gates map directly onto the engine's
+// operations, the fixed ones with the layer gates' matrices; gate definitions, opaque gates, if &
+// reset have no equivalent and are rejected.
+
+#define QASM_MAX_REGISTERS 64
+#define QASM_MAX_NAME 32
+#define QASM_MAX_ARGS 3
+#define QASM_MAX_PARAMS 3
+#define QASM_MAX_NUMBER 64
+
+typedef enum token_type {
+    TOKEN_END,
+    TOKEN_IDENTIFIER,
+    TOKEN_NUMBER,
+    TOKEN_STRING,  // Between double quotes, start & length exclude them
+    TOKEN_ARROW,   // ->
+    TOKEN_SYMBOL,  // Any other single character: ; , [ ] ( ) + - * / ^ ...
+} token_type;
+
+typedef struct token {
+    token_type type;
+    const char *start;
+    int length;
+    double value;  // TOKEN_NUMBER
+} token;
+
+typedef struct qasm_register {
+    char name[QASM_MAX_NAME];
+    int size;
+    int offset;    // First qubit (or classical bit) in the flattened registers
+    int classical;
+} qasm_register;
+
+// Gates of qelib1.inc (and the built-in U & CX) the engine runs
+typedef enum qasm_gate {
+    QASM_ID, QASM_U0, QASM_X, QASM_Y, QASM_Z, QASM_H, QASM_S, QASM_T, QASM_SDG, QASM_TDG, QASM_SX,
+    QASM_RX, QASM_RY, QASM_RZ, QASM_P, QASM_U1, QASM_U2, QASM_U3, QASM_U, QASM_BUILTIN_U,
+    QASM_CX, QASM_BUILTIN_CX, QASM_CY, QASM_CZ, QASM_CH, QASM_CRX, QASM_CRY, QASM_CRZ, QASM_CU1, QASM_CP, QASM_CU3,
+    QASM_SWAP, QASM_RZZ, QASM_CCX, QASM_CSWAP,
+    QASM_NUM_GATES,
+} qasm_gate;
+
+static const struct {
+    const char *name;
+    int num_params;
+    int num_qubits;
+} qasm_gates[QASM_NUM_GATES] = {
+    {"id", 0, 1}, {"u0", 1, 1}, {"x", 0, 1}, {"y", 0, 1}, {"z", 0, 1}, {"h", 0, 1}, {"s", 0, 1}, {"t", 0, 1},
+    {"sdg", 0, 1}, {"tdg", 0, 1}, {"sx", 0, 1},
+    {"rx", 1, 1}, {"ry", 1, 1}, {"rz", 1, 1}, {"p", 1, 1}, {"u1", 1, 1}, {"u2", 2, 1}, {"u3", 3, 1}, {"u", 3, 1}, {"U", 3, 1},
+    {"cx", 0, 2}, {"CX", 0, 2}, {"cy", 0, 2}, {"cz", 0, 2}, {"ch", 0, 2}, {"crx", 1, 2}, {"cry", 1, 2}, {"crz", 1, 2},
+    {"cu1", 1, 2}, {"cp", 1, 2}, {"cu3", 3, 2},
+    {"swap", 0, 2}, {"rzz", 1, 2}, {"ccx", 0, 3}, {"cswap", 0, 3},
+};
+
+// Layer gates whose matrices the qelib1 gates of the same name use, in qasm_gate order from QASM_X
+static const char *const fixed_gates[] = {"X", "Y", "Z", "H", "S", "T"};
+#define NUM_FIXED_GATES 6
+
+typedef struct qasm_reader {
+    const char *path;
+    const char *pos, *end;
+    int line;
+    token tok;                  // Current token
+    qasm_register registers[QASM_MAX_REGISTERS];
+    int num_registers;
+    int num_qubits, num_clbits;
+    qreg *qr;                   // Created at the first statement needing it, once all the qregs are known
+    qc_storage storage;
+    qc_status status;           // Reported on failure
+    diagonal_group *layer;
+    uint64_t rng_seed;
+    uint64_t num_measurements;
+    uint8_t *clbits;
+    int max_clbits;
+    cnum fixed[NUM_FIXED_GATES][4];
+    gate_op fixed_ops[NUM_FIXED_GATES];
+} qasm_reader;
+
+static int qasm_error(qasm_reader *r, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Error: %s:%d: ", r->path, r->line);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    if (r->status == QC_OK) {
+        r->status = QC_ERR_INVALID_ARGUMENT;
+    }
+    return -1;
+}
+
+static int is_identifier_char(char c, int first) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (!first && c >= '0' && c <= '9');
+}
+
+// Read the next token into r->tok, skipping white space & comments. Returns 0 on success
+static int next_token(qasm_reader *r) {
+    const char *p = r->pos;
+    for (;;) {
+        while (p < r->end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            r->line += (*p == '\n');
+            p++;
+        }
+        if (p + 1 < r->end && p[0] == '/' && p[1] == '/') {
+            while (p < r->end && *p != '\n') {
+                p++;
+            }
+            continue;
+        }
+        break;
+    }
+
+    token *tok = &r->tok;
+    tok->start = p;
+    if (p == r->end) {
+        tok->type = TOKEN_END;
+        tok->length = 0;
+    } else if (is_identifier_char(*p, 1)) {
+        while (p < r->end && is_identifier_char(*p, 0)) {
+            p++;
+        }
+        tok->type = TOKEN_IDENTIFIER;
+    } else if ((*p >= '0' && *p <= '9') || (*p == '.' && p + 1 < r->end && p[1] >= '0' && p[1] <= '9')) {
+        // Copied out before strtod, the mapping isn't NUL terminated
+        char number[QASM_MAX_NUMBER];
+        int n = 0;
+        while (p < r->end && n < QASM_MAX_NUMBER - 1 && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' ||
+               ((*p == '+' || *p == '-') && n > 0 && (number[n - 1] == 'e' || number[n - 1] == 'E')))) {
+            number[n++] = *p++;
+        }
+        number[n] = '\0';
+        char *parsed;
+        tok->value = strtod(number, &parsed);
+        if (parsed != number + n) {
+            return qasm_error(r, "invalid number \"%s\"", number);
+        }
+        tok->type = TOKEN_NUMBER;
+    } else if (*p == '"') {
+        p++;
+        tok->start = p;
+        while (p < r->end && *p != '"' && *p != '\n') {
+            p++;
+        }
+        if (p == r->end || *p != '"') {
+            return qasm_error(r, "unterminated string");
+        }
+        tok->type = TOKEN_STRING;
+        tok->length = (int)(p - tok->start);
+        r->pos = p + 1;
+        return 0;
+    } else if (*p == '-' && p + 1 < r->end && p[1] == '>') {
+        p += 2;
+        tok->type = TOKEN_ARROW;
+    } else {
+        p++;
+        tok->type = TOKEN_SYMBOL;
+    }
+    tok->length = (int)(p - tok->start);
+    r->pos = p;
+    return 0;
+}
+
+static int token_is(const token *tok, token_type type, const char *text) {
+    return tok->type == type && (int)strlen(text) == tok->length && memcmp(tok->start, text, tok->length) == 0;
+}
+
+static int is_symbol(const qasm_reader *r, char c) {
+    return r->tok.type == TOKEN_SYMBOL && r->tok.start[0] == c;
+}
+
+static int expect_symbol(qasm_reader *r, char c) {
+    if (!is_symbol(r, c)) {
+        return qasm_error(r, "expected '%c', got \"%.*s\"", c, r->tok.length, r->tok.start);
+    }
+    return next_token(r);
+}
+
+// Copy an identifier token to a NUL terminated name, returns 0 on success
+static int read_name(qasm_reader *r, char name[QASM_MAX_NAME]) {
+    if (r->tok.type != TOKEN_IDENTIFIER || r->tok.length >= QASM_MAX_NAME) {
+        return qasm_error(r, "expected a name, got \"%.*s\"", r->tok.length, r->tok.start);
+    }
+    memcpy(name, r->tok.start, r->tok.length);
+    name[r->tok.length] = '\0';
+    return next_token(r);
+}
+
+// Parameter expressions: + - * / ^, unary minus, parentheses, pi, numbers & sin cos tan exp ln sqrt
+static int parse_expression(qasm_reader *r, double *value);
+
+static int parse_primary(qasm_reader *r, double *value) {
+    if (r->tok.type == TOKEN_NUMBER) {
+        *value = r->tok.value;
+        return next_token(r);
+    }
+    if (is_symbol(r, '(')) {
+        if (next_token(r) != 0 || parse_expression(r, value) != 0) {
+            return -1;
+        }
+        return expect_symbol(r, ')');
+    }
+    char name[QASM_MAX_NAME];
+    if (read_name(r, name) != 0) {
+        return -1;
+    }
+    if (strcmp(name, "pi") == 0) {
+        *value = M_PI;
+        return 0;
+    }
+    static const char *const functions[] = {"sin", "cos", "tan", "exp", "ln", "sqrt"};
+    for (int f = 0; f < 6; f++) {
+        if (strcmp(name, functions[f]) == 0) {
+            double x;
+            if (expect_symbol(r, '(') != 0 || parse_expression(r, &x) != 0 || expect_symbol(r, ')') != 0) {
+                return -1;
+            }
+            double results[6] = {sin(x), cos(x), tan(x), exp(x), log(x), sqrt(x)};
+            *value = results[f];
+            return 0;
+        }
+    }
+    return qasm_error(r, "unknown identifier \"%s\" in expression", name);
+}
+
+static int parse_factor(qasm_reader *r, double *value) {
+    if (is_symbol(r, '-') || is_symbol(r, '+')) {
+        int negate = is_symbol(r, '-');
+        if (next_token(r) != 0 || parse_factor(r, value) != 0) {
+            return -1;
+        }
+        *value = negate ? -*value : *value;
+        return 0;
+    }
+    if (parse_primary(r, value) != 0) {
+        return -1;
+    }
+    if (is_symbol(r, '^')) {
+        double exponent;
+        if (next_token(r) != 0 || parse_factor(r, &exponent) != 0) {
+            return -1;
+        }
+        *value = pow(*value, exponent);
+    }
+    return 0;
+}
+
+static int parse_term(qasm_reader *r, double *value) {
+    if (parse_factor(r, value) != 0) {
+        return -1;
+    }
+    while (is_symbol(r, '*') || is_symbol(r, '/')) {
+        int divide = is_symbol(r, '/');
+        double rhs;
+        if (next_token(r) != 0 || parse_factor(r, &rhs) != 0) {
+            return -1;
+        }
+        *value = divide ? *value / rhs : *value * rhs;
+    }
+    return 0;
+}
+
+static int parse_expression(qasm_reader *r, double *value) {
+    if (parse_term(r, value) != 0) {
+        return -1;
+    }
+    while (is_symbol(r, '+') || is_symbol(r, '-')) {
+        int subtract = is_symbol(r, '-');
+        double rhs;
+        if (next_token(r) != 0 || parse_term(r, &rhs) != 0) {
+            return -1;
+        }
+        *value = subtract ? *value - rhs : *value + rhs;
+    }
+    return 0;
+}
+
+// "name" or "name[index]" for a declared register: *index is -1 for a whole register. Returns 0 on success
+static int parse_argument(qasm_reader *r, int classical, const qasm_register **reg, int *index) {
+    char name[QASM_MAX_NAME];
+    if (read_name(r, name) != 0) {
+        return -1;
+    }
+    *reg = NULL;
+    for (int i = 0; i < r->num_registers; i++) {
+        if (r->registers[i].classical == classical && strcmp(r->registers[i].name, name) == 0) {
+            *reg = &r->registers[i];
+        }
+    }
+    if (*reg == NULL) {
+        return qasm_error(r, "undeclared %s register \"%s\"", classical ? "classical" : "quantum", name);
+    }
+    *index = -1;
+    if (is_symbol(r, '[')) {
+        if (next_token(r) != 0) {
+            return -1;
+        }
+        if (r->tok.type != TOKEN_NUMBER || r->tok.value != floor(r->tok.value) || r->tok.value < 0 || r->tok.value >= (*reg)->size) {
+            return qasm_error(r, "invalid index for register \"%s\" of size %d", name, (*reg)->size);
+        }
+        *index = (int)r->tok.value;
+        if (next_token(r) != 0 || expect_symbol(r, ']') != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Number of times a statement applies to its arguments: whole registers broadcast over their qubits
+// and must have the same size. Returns -1 on mismatch
+static int broadcast_width(qasm_reader *r, const qasm_register *const regs[], const int *indices, int count) {
+    int width = 0;
+    for (int a = 0; a < count; a++) {
+        if (indices[a] < 0) {
+            if (width != 0 && width != regs[a]->size) {
+                return qasm_error(r, "registers of different sizes in one statement");
+            }
+            width = regs[a]->size;
+        }
+    }
+    return (width == 0) ? 1 : width;
+}
+
+// Make sure the register exists before the first statement touching it, returns 0 on success
+static int ensure_register(qasm_reader *r) {
+    if (r->qr != NULL) {
+        return 0;
+    }
+    if (r->num_qubits == 0) {
+        return qasm_error(r, "no qreg declared");
+    }
+    r->qr = new_qreg_with_storage(r->num_qubits, r->storage);
+    if (r->qr == NULL) {
+        r->status = qc_last_status();
+        return qasm_error(r, "cannot create a %d qubit register", r->num_qubits);
+    }
+    return 0;
+}
+
+// "qreg name[size];" or "creg name[size];"
+static int parse_declaration(qasm_reader *r, int classical) {
+    if (!classical && r->qr != NULL) {
+        return qasm_error(r, "qreg declarations must come before the first gate or measurement");
+    }
+    if (r->num_registers == QASM_MAX_REGISTERS) {
+        return qasm_error(r, "more than %d registers", QASM_MAX_REGISTERS);
+    }
+    qasm_register *reg = &r->registers[r->num_registers];
+    if (next_token(r) != 0 || read_name(r, reg->name) != 0 || expect_symbol(r, '[') != 0) {
+        return -1;
+    }
+    if (r->tok.type != TOKEN_NUMBER || r->tok.value != floor(r->tok.value) || r->tok.value < 1 || r->tok.value > STABILIZER_QUBIT_LIMIT) {
+        return qasm_error(r, "invalid size for register \"%s\"", reg->name);
+    }
+    reg->size = (int)r->tok.value;
+    reg->classical = classical;
+    for (int i = 0; i < r->num_registers; i++) {
+        if (strcmp(r->registers[i].name, reg->name) == 0) {
+            return qasm_error(r, "register \"%s\" declared twice", reg->name);
+        }
+    }
+    if (next_token(r) != 0 || expect_symbol(r, ']') != 0 || expect_symbol(r, ';') != 0) {
+        return -1;
+    }
+
+    int *total = classical ? &r->num_clbits : &r->num_qubits;
+    reg->offset = *total;
+    *total += reg->size;
+    if (classical && r->clbits != NULL) {
+        if (r->num_clbits > r->max_clbits) {
+            return qasm_error(r, "%d classical bits don't fit in the %d given", r->num_clbits, r->max_clbits);
+        }
+        memset(&r->clbits[reg->offset], 0, reg->size);
+    }
+    r->num_registers++;
+    return 0;
+}
+
+// "measure q[i] -> c[j];" or "measure q -> c;", ending the current layer
+static int parse_measure(qasm_reader *r) {
+    const qasm_register *regs[2];
+    int indices[2];
+    if (next_token(r) != 0 || parse_argument(r, 0, &regs[0], &indices[0]) != 0) {
+        return -1;
+    }
+    if (r->tok.type != TOKEN_ARROW) {
+        return qasm_error(r, "expected \"->\" in measure");
+    }
+    if (next_token(r) != 0 || parse_argument(r, 1, &regs[1], &indices[1]) != 0 || expect_symbol(r, ';') != 0) {
+        return -1;
+    }
+    int width = broadcast_width(r, regs, indices, 2);
+    if (width < 0 || ensure_register(r) != 0) {
+        return -1;
+    }
+    if ((indices[0] < 0) != (indices[1] < 0)) {
+        return qasm_error(r, "measure needs two whole registers or two single bits");
+    }
+    if (layer_end(r->qr, r->layer) != 0) {
+        return qasm_error(r, "error applying the layer before a measurement");
+    }
+    for (int k = 0; k < width; k++) {
+        int qubit = regs[0]->offset + (indices[0] < 0 ? k : indices[0]);
+        int bit = regs[1]->offset + (indices[1] < 0 ? k : indices[1]);
+        int result = qc_measure_qubit(r->qr, qubit, splitmix64(r->rng_seed ^ splitmix64(r->num_measurements++)));
+        if (result < 0) {
+            r->status = qc_last_status();
+            return qasm_error(r, "error measuring qubit %d", qubit);
+        }
+        if (r->clbits != NULL) {
+            r->clbits[bit] = (uint8_t)result;
+        }
+    }
+    return 0;
+}
+
+// Row-major U(theta, phi, lambda) = RZ(phi) RY(theta) RZ(lambda) up to a global phase, as defined by OpenQASM
+static void u3_matrix(double theta, double phi, double lambda, cnum m[4]) {
+    double c = cos(theta / 2), s = sin(theta / 2);
+    m[0] = (cnum){c, 0};
+    m[1] = (cnum){-cos(lambda) * s, -sin(lambda) * s};
+    m[2] = (cnum){cos(phi) * s, sin(phi) * s};
+    m[3] = (cnum){cos(phi + lambda) * c, sin(phi + lambda) * c};
+}
+
+// 4x4 matrix applying u to the target (low sub-index bit) when the control (high bit) is set
+static void controlled_matrix(const cnum u[4], cnum m[16]) {
+    memset(m, 0, 16 * sizeof(cnum));
+    m[0] = m[5] = (cnum){1.0, 0.0};
+    m[10] = u[0];
+    m[11] = u[1];
+    m[14] = u[2];
+    m[15] = u[3];
+}
+
+// Lower a qelib1 gate to an instruction over the given qubits, its matrix written to `matrix` (64 entries).
+// Returns 1 for gates without effect, 0 otherwise
+static int lower_qasm_gate(const qasm_reader *r, qasm_gate gate, const double *p, int *qubits, instruction *ins, cnum *matrix) {
+    cnum u[4];
+    *ins = (instruction){GATE_OP_MATRIX, qasm_gates[gate].num_qubits, 0, qubits, matrix};
+    switch (gate) {
+        case QASM_ID:
+        case QASM_U0:
+            return 1;
+        case QASM_X: case QASM_Y: case QASM_Z: case QASM_H: case QASM_S: case QASM_T:
+            ins->op = r->fixed_ops[gate - QASM_X];
+            memcpy(matrix, r->fixed[gate - QASM_X], 4 * sizeof(cnum));
+            break;
+        case QASM_SDG:
+        case QASM_TDG:
+            memcpy(matrix, r->fixed[(gate == QASM_SDG ? QASM_S : QASM_T) - QASM_X], 4 * sizeof(cnum));
+            matrix[3].im = -matrix[3].im;
+            break;
+        case QASM_SX:
+            matrix[0] = matrix[3] = (cnum){0.5, 0.5};
+            matrix[1] = matrix[2] = (cnum){0.5, -0.5};
+            break;
+        case QASM_RX: rotation_matrix(ROTATION_RX, p[0], matrix); break;
+        case QASM_RY: rotation_matrix(ROTATION_RY, p[0], matrix); break;
+        case QASM_RZ: rotation_matrix(ROTATION_RZ, p[0], matrix); break;
+        case QASM_P:
+        case QASM_U1:
+            rotation_matrix(ROTATION_P, p[0], matrix);
+            break;
+        case QASM_U2: u3_matrix(M_PI / 2, p[0], p[1], matrix); break;
+        case QASM_U3:
+        case QASM_U:
+        case QASM_BUILTIN_U:
+            u3_matrix(p[0], p[1], p[2], matrix);
+            break;
+        case QASM_CX:
+        case QASM_BUILTIN_CX:
+        case QASM_CCX:
+            *ins = (instruction){GATE_OP_CONTROLLED_X, ins->num_qubits, ins->num_qubits - 1, qubits, matrix};
+            memcpy(matrix, r->fixed[QASM_X - QASM_X], 4 * sizeof(cnum));
+            break;
+        case QASM_CZ:
+            *ins = (instruction){GATE_OP_CONTROLLED_PHASE, 2, 1, qubits, matrix};
+            memcpy(matrix, r->fixed[QASM_Z - QASM_X], 4 * sizeof(cnum));
+            break;
+        case QASM_CU1:
+        case QASM_CP:
+            *ins = (instruction){GATE_OP_CONTROLLED_PHASE, 2, 1, qubits, matrix};
+            rotation_matrix(ROTATION_P, p[0], matrix);
+            break;
+        case QASM_CY: controlled_matrix(r->fixed[QASM_Y - QASM_X], matrix); break;
+        case QASM_CH: controlled_matrix(r->fixed[QASM_H - QASM_X], matrix); break;
+        case QASM_CRX: rotation_matrix(ROTATION_RX, p[0], u); controlled_matrix(u, matrix); break;
+        case QASM_CRY: rotation_matrix(ROTATION_RY, p[0], u); controlled_matrix(u, matrix); break;
+        case QASM_CU3: u3_matrix(p[0], p[1], p[2], u); controlled_matrix(u, matrix); break;
+        case QASM_CRZ:
+            // Diagonal over (control, target): 1, 1, e^(-i lambda / 2), e^(i lambda / 2)
+            ins->op = GATE_OP_DIAGONAL;
+            rotation_matrix(ROTATION_RZ, p[0], u);
+            matrix[0] = matrix[1] = (cnum){1.0, 0.0};
+            matrix[2] = u[0];
+            matrix[3] = u[3];
+            break;
+        case QASM_RZZ:
+            // Diagonal e^(-i theta / 2) where the qubits are equal, e^(i theta / 2) where they differ
+            ins->op = GATE_OP_DIAGONAL;
+            rotation_matrix(ROTATION_RZ, p[0], u);
+            matrix[0] = matrix[3] = u[0];
+            matrix[1] = matrix[2] = u[3];
+            break;
+        case QASM_SWAP:
+            ins->op = GATE_OP_SWAP;
+            memset(matrix, 0, 16 * sizeof(cnum));
+            matrix[0] = matrix[6] = matrix[9] = matrix[15] = (cnum){1.0, 0.0};
+            break;
+        case QASM_CSWAP:
+            // 8x8 permutation over (control, a, b) exchanging 101 & 110
+            memset(matrix, 0, 64 * sizeof(cnum));
+            for (int i = 0; i < 8; i++) {
+                int j = (i == 5) ? 6 : (i == 6) ? 5 : i;
+                matrix[i * 8 + j] = (cnum){1.0, 0.0};
+            }
+            break;
+        case QASM_NUM_GATES:
+            break;
+    }
+    return 0;
+}
+
+// "name(params) args;" for a qelib1 gate
+static int parse_gate(qasm_reader *r) {
+    char name[QASM_MAX_NAME];
+    int line = r->line;
+    if (read_name(r, name) != 0) {
+        return -1;
+    }
+    int gate = 0;
+    while (gate < QASM_NUM_GATES && strcmp(qasm_gates[gate].name, name) != 0) {
+        gate++;
+    }
+    if (gate == QASM_NUM_GATES) {
+        r->line = line;
+        return qasm_error(r, "unsupported gate \"%s\"", name);
+    }
+
+    double params[QASM_MAX_PARAMS];
+    int num_params = 0;
+    if (is_symbol(r, '(')) {
+        if (next_token(r) != 0) {
+            return -1;
+        }
+        while (!is_symbol(r, ')')) {
+            if (num_params == QASM_MAX_PARAMS) {
+                return qasm_error(r, "too many parameters for \"%s\"", name);
+            }
+            if (parse_expression(r, &params[num_params++]) != 0) {
+                return -1;
+            }
+            if (!is_symbol(r, ')') && expect_symbol(r, ',') != 0) {
+                return -1;
+            }
+        }
+        if (next_token(r) != 0) {
+            return -1;
+        }
+    }
+    if (num_params != qasm_gates[gate].num_params) {
+        return qasm_error(r, "\"%s\" takes %d parameters, got %d", name, qasm_gates[gate].num_params, num_params);
+    }
+
+    const qasm_register *regs[QASM_MAX_ARGS];
+    int indices[QASM_MAX_ARGS];
+    int num_args = 0;
+    for (;;) {
+        if (num_args == qasm_gates[gate].num_qubits) {
+            return qasm_error(r, "\"%s\" takes %d qubits", name, qasm_gates[gate].num_qubits);
+        }
+        if (parse_argument(r, 0, &regs[num_args], &indices[num_args]) != 0) {
+            return -1;
+        }
+        num_args++;
+        if (!is_symbol(r, ',')) {
+            break;
+        }
+        if (next_token(r) != 0) {
+            return -1;
+        }
+    }
+    if (num_args != qasm_gates[gate].num_qubits) {
+        return qasm_error(r, "\"%s\" takes %d qubits, got %d", name, qasm_gates[gate].num_qubits, num_args);
+    }
+    if (expect_symbol(r, ';') != 0) {
+        return -1;
+    }
+    int width = broadcast_width(r, regs, indices, num_args);
+    if (width < 0 || ensure_register(r) != 0) {
+        return -1;
+    }
+
+    STATS_GATE(name);
+    for (int k = 0; k < width; k++) {
+        int qubits[QASM_MAX_ARGS];
+        cnum matrix[64];
+        instruction ins;
+        for (int a = 0; a < num_args; a++) {
+            qubits[a] = regs[a]->offset + (indices[a] < 0 ? k : indices[a]);
+            for (int b = 0; b < a; b++) {
+                if (qubits[b] == qubits[a]) {
+                    return qasm_error(r, "\"%s\" applied twice to the same qubit", name);
+                }
+            }
+        }
+        if (lower_qasm_gate(r, (qasm_gate)gate, params, qubits, &ins, matrix) == 0 && layer_apply(r->qr, r->layer, &ins) != 0) {
+            return qasm_error(r, "error applying \"%s\"", name);
+        }
+    }
+    return 0;
+}
+
+static int parse_statement(qasm_reader *r) {
+    const token *tok = &r->tok;
+    if (token_is(tok, TOKEN_IDENTIFIER, "OPENQASM")) {
+        if (next_token(r) != 0) {
+            return -1;
+        }
+        if (r->tok.type != TOKEN_NUMBER || r->tok.value < 2.0 || r->tok.value >= 3.0) {
+            return qasm_error(r, "only OpenQASM 2 is supported");
+        }
+        return (next_token(r) != 0) ? -1 : expect_symbol(r, ';');
+    }
+    if (token_is(tok, TOKEN_IDENTIFIER, "include")) {
+        if (next_token(r) != 0) {
+            return -1;
+        }
+        if (!token_is(tok, TOKEN_STRING, "qelib1.inc")) {
+            return qasm_error(r, "only qelib1.inc can be included");
+        }
+        return (next_token(r) != 0) ? -1 : expect_symbol(r, ';');
+    }
+    if (token_is(tok, TOKEN_IDENTIFIER, "qreg") || token_is(tok, TOKEN_IDENTIFIER, "creg")) {
+        return parse_declaration(r, tok->start[0] == 'c');
+    }
+    if (token_is(tok, TOKEN_IDENTIFIER, "measure")) {
+        return parse_measure(r);
+    }
+    if (token_is(tok, TOKEN_IDENTIFIER, "barrier")) {
+        // Layer boundary, the arguments don't matter
+        while (!is_symbol(r, ';')) {
+            if (r->tok.type == TOKEN_END) {
+                return qasm_error(r, "expected ';'");
+            }
+            if (next_token(r) != 0) {
+                return -1;
+            }
+        }
+        if (ensure_register(r) != 0 || layer_end(r->qr, r->layer) != 0) {
+            return -1;
+        }
+        return next_token(r);
+    }
+    static const char *const unsupported[] = {"gate", "opaque", "if", "reset"};
+    for (int i = 0; i < 4; i++) {
+        if (token_is(tok, TOKEN_IDENTIFIER, unsupported[i])) {
+            return qasm_error(r, "\"%s\" statements are not supported", unsupported[i]);
+        }
+    }
+    return parse_gate(r);
+}
+
+qreg *qc_run_qasm(const char *path, qc_storage storage, uint64_t rng_seed, uint8_t *clbits, int max_clbits) {
+    if (path == NULL || max_clbits < 0) {
+        fprintf(stderr, "Error trying to run an OpenQASM file with invalid inputs\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot read OpenQASM file %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map OpenQASM file %s\n", path);
+        set_status(QC_ERR_IO);
+        return NULL;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    qasm_reader *r = calloc(1, sizeof(qasm_reader));
+    diagonal_group *layer = malloc(sizeof(diagonal_group));
+    if (r == NULL || layer == NULL) {
+        fprintf(stderr, "Error allocating memory for the OpenQASM reader\n");
+        free(r);
+        free(layer);
+        munmap(base, st.st_size);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    r->path = path;
+    r->pos = base;
+    r->end = (const char *)base + st.st_size;
+    r->line = 1;
+    r->storage = storage;
+    r->rng_seed = rng_seed;
+    r->clbits = clbits;
+    r->max_clbits = max_clbits;
+    r->layer = layer;
+    diagonal_group_reset(layer);
+
+    int ret = 0;
+    for (int g = 0; g < NUM_FIXED_GATES && ret == 0; g++) {
+        ret = fixed_gate_matrix(fixed_gates[g], r->fixed[g], &r->fixed_ops[g]);
+    }
+    if (ret != 0) {
+        r->status = QC_ERR_OUT_OF_MEMORY;
+    }
+    if (ret == 0) {
+        ret = next_token(r);
+    }
+    while (ret == 0 && r->tok.type != TOKEN_END) {
+        ret = parse_statement(r);
+    }
+    if (ret == 0) {
+        ret = ensure_register(r);
+    }
+    if (ret == 0 && layer_end(r->qr, layer) != 0) {
+        ret = qasm_error(r, "error applying the last layer");
+    }
+
+    qreg *qr = r->qr;
+    qc_status status = (ret == 0) ? QC_OK : r->status;
+    munmap(base, st.st_size);
+    free(layer);
+    free(r);
+    if (status != QC_OK) {
+        free_qreg(qr);
+        set_status(status);
+        return NULL;
+    }
+    set_status(QC_OK);
+    return qr;
+}
@@ -0,0 +1,357 @@
+#include "qc_internal.h"
+#include <stdio.h>
+
+// Vectorized dense kernels, selected once from the CPU features.
+//
+// The state vector keeps its interleaved {re, im} layout (it is part of the public qreg), so the
+// complex products are done with fmaddsub on packed [re0 im0 re1 im1 ...] registers: an AVX2
+// register holds 2 amplitudes and an AVX-512 register holds 4 (twice as many in single precision).
+// When the gate qubits are too low for the amplitudes of a pair to be contiguous, the kernels fall
+// back to the narrower version.
+// Anything else (and non-x86 builds) uses the portable kernels, which the compiler vectorizes to SSE2.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef SIMD_X86
+
+// The kernels are written once for both amplitude precisions: a register holds 2^V256_AMP_BITS
+// (V512_AMP_BITS) amplitudes, 2 (4) doubles or 4 (8) floats, and gate qubits below that count are
+// left to the narrower kernels.
+#ifdef QC_SINGLE_PRECISION
+typedef __m256 v256;
+typedef __m512 v512;
+#define V256_AMP_BITS 2
+#define V512_AMP_BITS 3
+#define v256_loadu _mm256_loadu_ps
+#define v256_storeu _mm256_storeu_ps
+#define v256_set1 _mm256_set1_ps
+#define v256_add _mm256_add_ps
+#define v256_mul _mm256_mul_ps
+#define v256_fmaddsub _mm256_fmaddsub_ps
+#define v256_swap_re_im(a) _mm256_permute_ps(a, 0xB1)
+#define v256_swap_halves(a) _mm256_permute2f128_ps(a, a, 0x1)
+#define v512_loadu _mm512_loadu_ps
+#define v512_storeu _mm512_storeu_ps
+#define v512_set1 _mm512_set1_ps
+#define v512_add _mm512_add_ps
+#define v512_mul _mm512_mul_ps
+#define v512_fmaddsub _mm512_fmaddsub_ps
+#define v512_swap_re_im(a) _mm512_permute_ps(a, 0xB1)
+#else
+typedef __m256d v256;
+typedef __m512d v512;
+#define V256_AMP_BITS 1
+#define V512_AMP_BITS 2
+#define v256_loadu _mm256_loadu_pd
+#define v256_storeu _mm256_storeu_pd
+#define v256_set1 _mm256_set1_pd
+#define v256_add _mm256_add_pd
+#define v256_mul _mm256_mul_pd
+#define v256_fmaddsub _mm256_fmaddsub_pd
+#define v256_swap_re_im(a) _mm256_permute_pd(a, 0x5)
+#define v256_swap_halves(a) _mm256_permute2f128_pd(a, a, 0x1)
+#define v512_loadu _mm512_loadu_pd
+#define v512_storeu _mm512_storeu_pd
+#define v512_set1 _mm512_set1_pd
+#define v512_add _mm512_add_pd
+#define v512_mul _mm512_mul_pd
+#define v512_fmaddsub _mm512_fmaddsub_pd
+#define v512_swap_re_im(a) _mm512_permute_pd(a, 0x55)
+#endif
+#define V256_AMPS (1 << V256_AMP_BITS)
+#define V512_AMPS (1 << V512_AMP_BITS)
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+// a * m for packed amplitudes, m given as its real and imaginary parts duplicated per amplitude
+static inline v256 avx2_cmul(v256 a, v256 m_re, v256 m_im) {
+    return v256_fmaddsub(a, m_re, v256_mul(v256_swap_re_im(a), m_im));
+}
+
+// Per amplitude factors of one register, e.g. alternating when a gate qubit lies inside the register
+static inline void avx2_factors(v256 *f_re, v256 *f_im, const cnum *factors) {
+    qc_real re[2 * V256_AMPS], im[2 * V256_AMPS];
+    for (int j = 0; j < V256_AMPS; j++) {
+        re[2 * j] = re[2 * j + 1] = factors[j].re;
+        im[2 * j] = im[2 * j + 1] = factors[j].im;
+    }
+    *f_re = v256_loadu(re);
+    *f_im = v256_loadu(im);
+}
+
+static void avx2_single_qubit_kernel(cnum *amp, int num_qubits, int target, const cnum *m) {
+    uint64_t num_pairs = (1ULL << num_qubits) >> 1;
+    if (num_pairs < V256_AMPS || target < V256_AMP_BITS - 1) {
+        scalar_single_qubit_kernel(amp, num_qubits, target, m);
+        return;
+    }
+
+    if (target == V256_AMP_BITS - 1) {
+        // The two amplitudes of a pair sit in opposite halves of the same register:
+        // [a0 a1] -> [m00 a0 + m01 a1, m10 a0 + m11 a1]
+        cnum diag[V256_AMPS], off[V256_AMPS];
+        for (int j = 0; j < V256_AMPS; j++) {
+            int hi = j >> target;
+            diag[j] = hi ? m[3] : m[0];
+            off[j] = hi ? m[2] : m[1];
+        }
+        v256 diag_re, diag_im, off_re, off_im;
+        avx2_factors(&diag_re, &diag_im, diag);
+        avx2_factors(&off_re, &off_im, off);
+
+        #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+        for (uint64_t k = 0; k < num_pairs; k += V256_AMPS / 2) {
+            qc_real *p = (qc_real *)&amp[2 * k];
+            v256 a = v256_loadu(p);
+            v256 a_swapped = v256_swap_halves(a);
+            v256_storeu(p, v256_add(avx2_cmul(a, diag_re, diag_im), avx2_cmul(a_swapped, off_re, off_im)));
+        }
+        return;
+    }
+
+    uint64_t stride = 1ULL << target;
+    v256 m00_re = v256_set1(m[0].re), m00_im = v256_set1(m[0].im);
+    v256 m01_re = v256_set1(m[1].re), m01_im = v256_set1(m[1].im);
+    v256 m10_re = v256_set1(m[2].re), m10_im = v256_set1(m[2].im);
+    v256 m11_re = v256_set1(m[3].re), m11_im = v256_set1(m[3].im);
+
+    // target >= V256_AMP_BITS, so a register's worth of consecutive pairs start at consecutive indices
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_pairs; k += V256_AMPS) {
+        uint64_t i0 = insert_zero_bit(k, target);
+        qc_real *p0 = (qc_real *)&amp[i0];
+        qc_real *p1 = (qc_real *)&amp[i0 + stride];
+        v256 a0 = v256_loadu(p0);
+        v256 a1 = v256_loadu(p1);
+        v256_storeu(p0, v256_add(avx2_cmul(a0, m00_re, m00_im), avx2_cmul(a1, m01_re, m01_im)));
+        v256_storeu(p1, v256_add(avx2_cmul(a0, m10_re, m10_im), avx2_cmul(a1, m11_re, m11_im)));
+    }
+}
+
+static void avx2_diagonal_kernel(cnum *amp, int num_qubits, int target, cnum d0, cnum d1) {
+    uint64_t num_states = 1ULL << num_qubits;
+    if (num_states < V256_AMPS) {
+        scalar_diagonal_kernel(amp, num_qubits, target, d0, d1);
+        return;
+    }
+
+    // With the target inside a register the factors follow a fixed pattern, otherwise they come in runs
+    uint64_t stride = 1ULL << target;
+    int inside = target < V256_AMP_BITS;
+    cnum lo[V256_AMPS];
+    for (int j = 0; j < V256_AMPS; j++) {
+        lo[j] = (inside && ((j >> target) & 1)) ? d1 : d0;
+    }
+    v256 lo_re, lo_im;
+    avx2_factors(&lo_re, &lo_im, lo);
+    v256 hi_re = v256_set1(d1.re);
+    v256 hi_im = v256_set1(d1.im);
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t i = 0; i < num_states; i += V256_AMPS) {
+        qc_real *p = (qc_real *)&amp[i];
+        v256 a = v256_loadu(p);
+        if (inside || !(i & stride)) {
+            v256_storeu(p, avx2_cmul(a, lo_re, lo_im));
+        } else {
+            v256_storeu(p, avx2_cmul(a, hi_re, hi_im));
+        }
+    }
+}
+
+static void avx2_two_qubit_kernel(cnum *amp, int num_qubits, int q_hi, int q_lo, const cnum *m) {
+    int first = (q_hi < q_lo) ? q_hi : q_lo;
+    int second = (q_hi < q_lo) ? q_lo : q_hi;
+    uint64_t num_quads = (1ULL << num_qubits) >> 2;
+    if (first < V256_AMP_BITS || num_quads < V256_AMPS) {
+        scalar_two_qubit_kernel(amp, num_qubits, q_hi, q_lo, m);
+        return;
+    }
+
+    uint64_t hi = 1ULL << q_hi;
+    uint64_t lo = 1ULL << q_lo;
+    v256 m_re[16], m_im[16];
+    for (int e = 0; e < 16; e++) {
+        m_re[e] = v256_set1(m[e].re);
+        m_im[e] = v256_set1(m[e].im);
+    }
+
+    // Both qubits are >= V256_AMP_BITS, so a register's worth of consecutive quads start at consecutive indices
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_quads; k += V256_AMPS) {
+        uint64_t base = insert_zero_bit(insert_zero_bit(k, first), second);
+        uint64_t idx[4] = {base, base | lo, base | hi, base | hi | lo};
+        v256 a[4];
+        for (int c = 0; c < 4; c++) {
+            a[c] = v256_loadu((qc_real *)&amp[idx[c]]);
+        }
+        for (int r = 0; r < 4; r++) {
+            v256 sum = avx2_cmul(a[0], m_re[r * 4], m_im[r * 4]);
+            for (int c = 1; c < 4; c++) {
+                sum = v256_add(sum, avx2_cmul(a[c], m_re[r * 4 + c], m_im[r * 4 + c]));
+            }
+            v256_storeu((qc_real *)&amp[idx[r]], sum);
+        }
+    }
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+
+// a * m for packed amplitudes, m given as its real and imaginary parts duplicated per amplitude
+static inline v512 avx512_cmul(v512 a, v512 m_re, v512 m_im) {
+    return v512_fmaddsub(a, m_re, v512_mul(v512_swap_re_im(a), m_im));
+}
+
+static void avx512_single_qubit_kernel(cnum *amp, int num_qubits, int target, const cnum *m) {
+    uint64_t num_pairs = (1ULL << num_qubits) >> 1;
+    if (target < V512_AMP_BITS || num_pairs < V512_AMPS) {
+        avx2_single_qubit_kernel(amp, num_qubits, target, m);
+        return;
+    }
+
+    uint64_t stride = 1ULL << target;
+    v512 m00_re = v512_set1(m[0].re), m00_im = v512_set1(m[0].im);
+    v512 m01_re = v512_set1(m[1].re), m01_im = v512_set1(m[1].im);
+    v512 m10_re = v512_set1(m[2].re), m10_im = v512_set1(m[2].im);
+    v512 m11_re = v512_set1(m[3].re), m11_im = v512_set1(m[3].im);
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_pairs; k += V512_AMPS) {
+        uint64_t i0 = insert_zero_bit(k, target);
+        qc_real *p0 = (qc_real *)&amp[i0];
+        qc_real *p1 = (qc_real *)&amp[i0 + stride];
+        v512 a0 = v512_loadu(p0);
+        v512 a1 = v512_loadu(p1);
+        v512_storeu(p0, v512_add(avx512_cmul(a0, m00_re, m00_im), avx512_cmul(a1, m01_re, m01_im)));
+        v512_storeu(p1, v512_add(avx512_cmul(a0, m10_re, m10_im), avx512_cmul(a1, m11_re, m11_im)));
+    }
+}
+
+static void avx512_diagonal_kernel(cnum *amp, int num_qubits, int target, cnum d0, cnum d1) {
+    uint64_t num_states = 1ULL << num_qubits;
+    if (target < V512_AMP_BITS || num_states < 2 * V512_AMPS) {
+        avx2_diagonal_kernel(amp, num_qubits, target, d0, d1);
+        return;
+    }
+
+    uint64_t stride = 1ULL << target;
+    v512 d0_re = v512_set1(d0.re), d0_im = v512_set1(d0.im);
+    v512 d1_re = v512_set1(d1.re), d1_im = v512_set1(d1.im);
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if (num_states >= PARALLEL_THRESHOLD)
+    for (uint64_t i = 0; i < num_states; i += V512_AMPS) {
+        qc_real *p = (qc_real *)&amp[i];
+        v512 a = v512_loadu(p);
+        if (!(i & stride)) {
+            v512_storeu(p, avx512_cmul(a, d0_re, d0_im));
+        } else {
+            v512_storeu(p, avx512_cmul(a, d1_re, d1_im));
+        }
+    }
+}
+
+static void avx512_two_qubit_kernel(cnum *amp, int num_qubits, int q_hi, int q_lo, const cnum *m) {
+    int first = (q_hi < q_lo) ? q_hi : q_lo;
+    int second = (q_hi < q_lo) ? q_lo : q_hi;
+    uint64_t num_quads = (1ULL << num_qubits) >> 2;
+    if (first < V512_AMP_BITS || num_quads < V512_AMPS) {
+        avx2_two_qubit_kernel(amp, num_qubits, q_hi, q_lo, m);
+        return;
+    }
+
+    uint64_t hi = 1ULL << q_hi;
+    uint64_t lo = 1ULL << q_lo;
+    v512 m_re[16], m_im[16];
+    for (int e = 0; e < 16; e++) {
+        m_re[e] = v512_set1(m[e].re);
+        m_im[e] = v512_set1(m[e].im);
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(qc_get_num_threads()) if ((1ULL << num_qubits) >= PARALLEL_THRESHOLD)
+    for (uint64_t k = 0; k < num_quads; k += V512_AMPS) {
+        uint64_t base = insert_zero_bit(insert_zero_bit(k, first), second);
+        uint64_t idx[4] = {base, base | lo, base | hi, base | hi | lo};
+        v512 a[4];
+        for (int c = 0; c < 4; c++) {
+            a[c] = v512_loadu((qc_real *)&amp[idx[c]]);
+        }
+        for (int r = 0; r < 4; r++) {
+            v512 sum = avx512_cmul(a[0], m_re[r * 4], m_im[r * 4]);
+            for (int c = 1; c < 4; c++) {
+                sum = v512_add(sum, avx512_cmul(a[c], m_re[r * 4 + c], m_im[r * 4 + c]));
+            }
+            v512_storeu((qc_real *)&amp[idx[r]], sum);
+        }
+    }
+}
+
+#pragma GCC pop_options
+
+#endif // SIMD_X86
+
+static const gate_kernels scalar_kernels = {
+    scalar_single_qubit_kernel, scalar_diagonal_kernel, scalar_two_qubit_kernel,
+};
+
+#ifdef SIMD_X86
+static const gate_kernels avx2_kernels = {
+    avx2_single_qubit_kernel, avx2_diagonal_kernel, avx2_two_qubit_kernel,
+};
+
+static const gate_kernels avx512_kernels = {
+    avx512_single_qubit_kernel, avx512_diagonal_kernel, avx512_two_qubit_kernel,
+};
+#endif
+
+static const gate_kernels *selected_kernels = NULL;
+static qc_simd selected_simd = QC_SIMD_SCALAR;
+
+// Widest instruction set supported by this CPU
+static qc_simd detect_simd(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return QC_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return QC_SIMD_AVX2;
+    }
+#endif
+    return QC_SIMD_SCALAR;
+}
+
+int qc_set_simd(qc_simd simd) {
+    if (simd < QC_SIMD_SCALAR || simd > detect_simd()) {
+        fprintf(stderr, "Error: instruction set %d is not supported by this CPU\n", (int)simd);
+        return -1;
+    }
+
+    selected_simd = simd;
+    switch (simd) {
+#ifdef SIMD_X86
+        case QC_SIMD_AVX512: selected_kernels = &avx512_kernels; break;
+        case QC_SIMD_AVX2: selected_kernels = &avx2_kernels; break;
+#endif
+        default: selected_kernels = &scalar_kernels; break;
+    }
+    return 0;
+}
+
+qc_simd qc_get_simd(void) {
+    active_kernels();
+    return selected_simd;
+}
+
+const gate_kernels *active_kernels(void) {
+    if (selected_kernels == NULL) {
+        qc_set_simd(detect_simd());
+    }
+    return selected_kernels;
+}
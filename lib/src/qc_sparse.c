@@ -0,0 +1,476 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Sparse state vectors
+//
+// Only the non-zero amplitudes are stored, in a hash map from basis state index to amplitude. Every
+// instruction visits the stored entries only: diagonal gates rescale them in place, permutations
+// (CNOT, MCX, SWAP) move them to a new map, and dense matrices scatter each entry over the 2^t
+// indices of its target subspace, accumulating into a new map and then dropping what cancelled out.
+// A gate costs O(entries * 2^t) instead of O(2^n), which is what makes 60+ qubit reversible circuits
+// possible; once the state fills up the register switches to the (much faster) dense kernels.
+
+#define SPARSE_MIN_CAPACITY_BITS 4
+
+// A sparse register switches to dense storage once it holds 1/SPARSE_DENSE_FRACTION of its
+// amplitudes: a map entry takes 3 times the memory of a dense amplitude and is far slower to update
+#define SPARSE_DENSE_FRACTION 8
+
+// Amplitudes smaller than this after a gate are cancellation residue, and are dropped
+#define SPARSE_ZERO_TOLERANCE (QC_AMPLITUDE_TOLERANCE * 1e-3)
+
+// Fibonacci hashing: the top capacity_bits bits of index * 2^64 / golden ratio
+static inline uint64_t sparse_slot(const sparse_state *s, uint64_t index) {
+    return (index * 0x9E3779B97F4A7C15ULL) >> (64 - s->capacity_bits);
+}
+
+static sparse_state *sparse_new(uint64_t expected_count) {
+    sparse_state *s = malloc(sizeof(sparse_state));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->capacity_bits = SPARSE_MIN_CAPACITY_BITS;
+    while ((1ULL << s->capacity_bits) < 2 * expected_count && s->capacity_bits < 62) {
+        s->capacity_bits++;
+    }
+    s->count = 0;
+    s->keys = malloc(sparse_capacity(s) * sizeof(uint64_t));
+    s->values = malloc(sparse_capacity(s) * sizeof(cnum));
+    if (s->keys == NULL || s->values == NULL) {
+        sparse_free(s);
+        return NULL;
+    }
+    memset(s->keys, 0xFF, sparse_capacity(s) * sizeof(uint64_t)); // All SPARSE_EMPTY_KEY
+    STATS_ALLOCS(2, sparse_capacity(s) * (sizeof(uint64_t) + sizeof(cnum)));
+    return s;
+}
+
+void sparse_free(sparse_state *s) {
+    if (s != NULL) {
+        free(s->keys);
+        free(s->values);
+        free(s);
+    }
+}
+
+// Slot holding index, or the free slot where it would be inserted
+static inline uint64_t sparse_find(const sparse_state *s, uint64_t index) {
+    uint64_t mask = sparse_capacity(s) - 1;
+    uint64_t slot = sparse_slot(s, index);
+    while (s->keys[slot] != index && s->keys[slot] != SPARSE_EMPTY_KEY) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+cnum sparse_get(const sparse_state *s, uint64_t index) {
+    uint64_t slot = sparse_find(s, index);
+    return (s->keys[slot] == index) ? s->values[slot] : (cnum){0.0, 0.0};
+}
+
+// Double the number of slots, re-inserting every entry
+static int sparse_grow(sparse_state *s) {
+    sparse_state *grown = sparse_new(sparse_capacity(s));
+    if (grown == NULL) {
+        return -1;
+    }
+    for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+        if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+            uint64_t to = sparse_find(grown, s->keys[slot]);
+            grown->keys[to] = s->keys[slot];
+            grown->values[to] = s->values[slot];
+        }
+    }
+    grown->count = s->count;
+    free(s->keys);
+    free(s->values);
+    *s = *grown;
+    free(grown);
+    return 0;
+}
+
+// Add value to the amplitude of index, creating its entry if needed. Returns 0 on success
+static int sparse_add(sparse_state *s, uint64_t index, cnum value) {
+    uint64_t slot = sparse_find(s, index);
+    if (s->keys[slot] == index) {
+        s->values[slot] = cnum_add(s->values[slot], value);
+        return 0;
+    }
+    if (2 * (s->count + 1) > sparse_capacity(s)) {
+        if (sparse_grow(s) != 0) {
+            return -1;
+        }
+        slot = sparse_find(s, index);
+    }
+    s->keys[slot] = index;
+    s->values[slot] = value;
+    s->count++;
+    return 0;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t ka = *(const uint64_t *)a;
+    uint64_t kb = *(const uint64_t *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+uint64_t *sparse_sorted_keys(const sparse_state *s) {
+    uint64_t *keys = malloc((s->count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        return NULL;
+    }
+    uint64_t n = 0;
+    for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+        if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+            keys[n++] = s->keys[slot];
+        }
+    }
+    qsort(keys, n, sizeof(uint64_t), compare_keys);
+    return keys;
+}
+
+// Replace the register's map, switching to dense storage if the new one is no longer sparse enough
+static void sparse_replace(qreg *qr, sparse_state *s) {
+    if (s != qr->sparse) {
+        sparse_free(qr->sparse);
+        qr->sparse = s;
+    }
+    if (qr->size <= QUBIT_REGISTER_LIMIT && s->count >= (1ULL << qr->size) / SPARSE_DENSE_FRACTION) {
+        qc_to_dense(qr); // Stays sparse if the state vector cannot be allocated
+        set_status(QC_OK);
+    }
+}
+
+int sparse_filter(qreg *qr, uint64_t mask, uint64_t value, qc_real scale) {
+    const sparse_state *s = qr->sparse;
+    sparse_state *kept = sparse_new(s->count);
+    if (kept == NULL) {
+        return -1;
+    }
+    for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+        uint64_t index = s->keys[slot];
+        if (index != SPARSE_EMPTY_KEY && (index & mask) == value) {
+            cnum a = s->values[slot];
+            sparse_add(kept, index, (cnum){a.re * scale, a.im * scale}); // Never grows, sized for all entries
+        }
+    }
+    sparse_replace(qr, kept);
+    return 0;
+}
+
+// Where a permutation instruction sends an index
+static inline uint64_t permuted_index(const instruction *ins, uint64_t control_mask, uint64_t index) {
+    if (ins->op == GATE_OP_SWAP) {
+        uint64_t a = (index >> ins->qubits[0]) & 1;
+        uint64_t b = (index >> ins->qubits[1]) & 1;
+        return (a == b) ? index : index ^ ((1ULL << ins->qubits[0]) | (1ULL << ins->qubits[1]));
+    }
+    return ((index & control_mask) == control_mask) ? index ^ (1ULL << ins->qubits[ins->num_controls]) : index;
+}
+
+// Multiply the dense matrix of an instruction with the state, into a new map
+static sparse_state *sparse_apply_matrix(const sparse_state *s, const instruction *ins, uint64_t control_mask) {
+    int t = ins->num_qubits - ins->num_controls;
+    const int *targets = &ins->qubits[ins->num_controls];
+    uint64_t dim = 1ULL << t;
+    uint64_t offsets[1 << MATRIX_GATE_MAX_QUBITS];
+    uint64_t target_mask = 0;
+
+    for (uint64_t r = 0; r < dim; r++) {
+        offsets[r] = 0;
+        for (int j = 0; j < t; j++) {
+            if ((r >> (t - 1 - j)) & 1) {
+                offsets[r] |= 1ULL << targets[j];
+            }
+        }
+    }
+    for (int j = 0; j < t; j++) {
+        target_mask |= 1ULL << targets[j];
+    }
+
+    sparse_state *out = sparse_new(2 * s->count);
+    if (out == NULL) {
+        return NULL;
+    }
+    int ret = 0;
+    for (uint64_t slot = 0; slot < sparse_capacity(s) && ret == 0; slot++) {
+        uint64_t index = s->keys[slot];
+        if (index == SPARSE_EMPTY_KEY) {
+            continue;
+        }
+        cnum a = s->values[slot];
+        if ((index & control_mask) != control_mask) {
+            ret = sparse_add(out, index, a);
+            continue;
+        }
+        // Column of the entry in the gate's matrix, scattered over all the rows
+        int col = diagonal_key(index, targets, t);
+        uint64_t base = index & ~target_mask;
+        for (uint64_t r = 0; r < dim && ret == 0; r++) {
+            cnum m = ins->matrix[r * dim + col];
+            if (m.re != 0.0 || m.im != 0.0) {
+                ret = sparse_add(out, base | offsets[r], cnum_mul(m, a));
+            }
+        }
+    }
+    if (ret != 0) {
+        sparse_free(out);
+        return NULL;
+    }
+
+    // Drop the amplitudes that cancelled out (e.g. H followed by H)
+    uint64_t survivors = 0;
+    double tolerance = SPARSE_ZERO_TOLERANCE * SPARSE_ZERO_TOLERANCE;
+    for (uint64_t slot = 0; slot < sparse_capacity(out); slot++) {
+        cnum a = out->values[slot];
+        if (out->keys[slot] != SPARSE_EMPTY_KEY && (double)a.re * a.re + (double)a.im * a.im >= tolerance) {
+            survivors++;
+        }
+    }
+    if (survivors == out->count) {
+        return out;
+    }
+    sparse_state *pruned = sparse_new(survivors);
+    if (pruned == NULL) {
+        return out;
+    }
+    for (uint64_t slot = 0; slot < sparse_capacity(out); slot++) {
+        cnum a = out->values[slot];
+        if (out->keys[slot] != SPARSE_EMPTY_KEY && (double)a.re * a.re + (double)a.im * a.im >= tolerance) {
+            sparse_add(pruned, out->keys[slot], a);
+        }
+    }
+    sparse_free(out);
+    return pruned;
+}
+
+qc_status apply_sparse_instruction(qreg *qr, const instruction *ins) {
+    sparse_state *s = qr->sparse;
+    uint64_t capacity = sparse_capacity(s);
+    uint64_t control_mask = 0;
+    for (int j = 0; j < ins->num_controls; j++) {
+        control_mask |= 1ULL << ins->qubits[j];
+    }
+
+    sparse_state *out = s;
+    switch (ins->op) {
+        case GATE_OP_CONTROLLED_PHASE: {
+            uint64_t mask = control_mask | (1ULL << ins->qubits[ins->num_qubits - 1]);
+            for (uint64_t slot = 0; slot < capacity; slot++) {
+                if (s->keys[slot] != SPARSE_EMPTY_KEY && (s->keys[slot] & mask) == mask) {
+                    s->values[slot] = cnum_mul(ins->matrix[3], s->values[slot]);
+                }
+            }
+            break;
+        }
+        case GATE_OP_DIAGONAL:
+            for (uint64_t slot = 0; slot < capacity; slot++) {
+                if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+                    s->values[slot] = cnum_mul(ins->matrix[diagonal_key(s->keys[slot], ins->qubits, ins->num_qubits)], s->values[slot]);
+                }
+            }
+            break;
+        case GATE_OP_CONTROLLED_X:
+        case GATE_OP_SWAP:
+            // Permutations move the entries without changing their number
+            out = sparse_new(s->count);
+            if (out == NULL) {
+                break;
+            }
+            for (uint64_t slot = 0; slot < capacity; slot++) {
+                if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+                    sparse_add(out, permuted_index(ins, control_mask, s->keys[slot]), s->values[slot]);
+                }
+            }
+            break;
+        case GATE_OP_MATRIX:
+            if (ins->num_qubits - ins->num_controls > MATRIX_GATE_MAX_QUBITS) {
+                fprintf(stderr, "Error: matrix gates are limited to %d qubits, got %d\n", MATRIX_GATE_MAX_QUBITS, ins->num_qubits);
+                return QC_ERR_INVALID_ARGUMENT;
+            }
+            out = sparse_apply_matrix(s, ins, control_mask);
+            break;
+    }
+    if (out == NULL) {
+        fprintf(stderr, "Error allocating memory for a sparse state\n");
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    sparse_replace(qr, out);
+    return QC_OK;
+}
+
+qreg *new_qreg_with_storage(int size, qc_storage storage) {
+    if (storage == QC_STORAGE_DENSE) {
+        return new_qreg(size);
+    }
+    if ((storage != QC_STORAGE_SPARSE && storage != QC_STORAGE_STABILIZER && storage != QC_STORAGE_MPS && storage != QC_STORAGE_AUTO) || size < 1) {
+        fprintf(stderr, "Error: invalid storage or size for a quantum register (%d qubits)\n", size);
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return NULL;
+    }
+    if (storage == QC_STORAGE_STABILIZER) {
+        return new_stabilizer_qreg(size);
+    }
+    if (storage == QC_STORAGE_MPS) {
+        return new_mps_qreg(size);
+    }
+    if (size > SPARSE_QUBIT_LIMIT) {
+        fprintf(stderr, "Cannot support more than %d qubits in a sparse register, attempted %d\n", SPARSE_QUBIT_LIMIT, size);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return NULL;
+    }
+    if (storage == QC_STORAGE_AUTO) {
+        // The tableau converts itself to a sparse state vector at the first non-Clifford gate
+        return new_stabilizer_qreg(size);
+    }
+
+    qreg *qr = malloc(sizeof(qreg));
+    sparse_state *s = sparse_new(1);
+    if (qr == NULL || s == NULL) {
+        fprintf(stderr, "Error allocating memory for quantum register.\n");
+        free(qr);
+        sparse_free(s);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    qr->size = size;
+    qr->amp = NULL;
+    qr->mapped_bytes = 0;
+    qr->back_buffer = NULL;
+    qr->sparse = s;
+    qr->tableau = NULL;
+    qr->mps = NULL;
+
+    // Initialize the register to the |00...0> state
+    sparse_add(s, 0, (cnum){1.0, 0.0});
+
+    set_status(QC_OK);
+    return qr;
+}
+
+qreg *sparse_qreg_from_amplitudes(int size, uint64_t count, void (*next)(void *context, uint64_t *index, cnum *value), void *context) {
+    if (size > SPARSE_QUBIT_LIMIT || count > (1ULL << size) || count > (UINT64_MAX >> 8) / (sizeof(uint64_t) + sizeof(cnum))) {
+        fprintf(stderr, "Error: %llu amplitudes don't fit in a sparse register of %d qubits\n", (unsigned long long)count, size);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    qreg *qr = new_qreg_with_storage(size, QC_STORAGE_SPARSE);
+    if (qr == NULL) {
+        return NULL;
+    }
+    sparse_state *s = sparse_new(count);
+    if (s == NULL) {
+        fprintf(stderr, "Error allocating memory for a sparse state\n");
+        free_qreg(qr);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    for (uint64_t e = 0; e < count; e++) {
+        uint64_t index;
+        cnum value;
+        next(context, &index, &value);
+        sparse_add(s, index, value); // Never grows, sized for all entries
+    }
+    sparse_replace(qr, s);
+    set_status(QC_OK);
+    return qr;
+}
+
+qc_storage qc_get_storage(const qreg *qr) {
+    if (qr != NULL && qr->tableau != NULL) {
+        return QC_STORAGE_STABILIZER;
+    }
+    if (qr != NULL && qr->mps != NULL) {
+        return QC_STORAGE_MPS;
+    }
+    return (qr != NULL && qr->sparse != NULL) ? QC_STORAGE_SPARSE : QC_STORAGE_DENSE;
+}
+
+uint64_t qc_num_stored_amplitudes(const qreg *qr) {
+    if (qr == NULL || qr->tableau != NULL) {
+        return 0;
+    }
+    if (qr->mps != NULL) {
+        return mps_num_entries(qr->mps);
+    }
+    return (qr->sparse != NULL) ? qr->sparse->count : 1ULL << qr->size;
+}
+
+cnum qc_get_amplitude(const qreg *qr, uint64_t index) {
+    if (qr == NULL || qr->tableau != NULL || (qr->size < 64 && (index >> qr->size) != 0)) {
+        return (cnum){0.0, 0.0};
+    }
+    if (qr->mps != NULL) {
+        uint8_t *bits = calloc(qr->size, 1);
+        if (bits == NULL) {
+            fprintf(stderr, "Error allocating memory to read an amplitude\n");
+            return (cnum){0.0, 0.0};
+        }
+        for (int q = 0; q < qr->size && q < 64; q++) {
+            bits[q] = (uint8_t)((index >> q) & 1);
+        }
+        cnum a = mps_amplitude(qr->mps, bits);
+        free(bits);
+        return a;
+    }
+    return (qr->sparse != NULL) ? sparse_get(qr->sparse, index) : qr->amp[index];
+}
+
+cnum qc_get_amplitude_bits(const qreg *qr, const uint8_t *bits) {
+    if (qr == NULL || bits == NULL || qr->tableau != NULL) {
+        return (cnum){0.0, 0.0};
+    }
+    if (qr->mps != NULL) {
+        return mps_amplitude(qr->mps, bits);
+    }
+    uint64_t index = 0;
+    for (int q = 0; q < qr->size; q++) {
+        index |= (uint64_t)(bits[q] & 1) << q;
+    }
+    return qc_get_amplitude(qr, index);
+}
+
+qc_status qc_to_dense(qreg *qr) {
+    if (qr == NULL) {
+        fprintf(stderr, "Error trying to convert a NULL quantum register\n");
+        set_status(QC_ERR_INVALID_ARGUMENT);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+    if (qr->size > QUBIT_REGISTER_LIMIT && qr->amp == NULL) {
+        fprintf(stderr, "Error: a %d qubit register cannot be stored densely, the limit is %d\n", qr->size, QUBIT_REGISTER_LIMIT);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return QC_ERR_TOO_MANY_QUBITS;
+    }
+
+    if (qr->tableau != NULL && tableau_to_state(qr) != QC_OK) {
+        return qc_last_status();
+    }
+    if (qr->mps != NULL) {
+        return mps_to_state(qr);
+    }
+    if (qr->sparse == NULL) {
+        set_status(QC_OK);
+        return QC_OK;
+    }
+
+    cnum *amp = alloc_state_vector(1ULL << qr->size);
+    if (amp == NULL) {
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    const sparse_state *s = qr->sparse;
+    for (uint64_t slot = 0; slot < sparse_capacity(s); slot++) {
+        if (s->keys[slot] != SPARSE_EMPTY_KEY) {
+            amp[s->keys[slot]] = s->values[slot];
+        }
+    }
+    sparse_free(qr->sparse);
+    qr->sparse = NULL;
+    qr->amp = amp;
+    STATS_SWEEPS(1);
+
+    set_status(QC_OK);
+    return QC_OK;
+}
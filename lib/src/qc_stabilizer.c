@@ -0,0 +1,749 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Stabilizer registers
+//
+// A stabilizer state of n qubits is stored as an Aaronson-Gottesman tableau: n destabilizer rows,
+// n stabilizer rows and a scratch row, each a Pauli string as x & z bit vectors plus a sign bit
+// ((x, z) = (1, 0) is X, (0, 1) Z, (1, 1) Y). Clifford gates update every row in O(n) and
+// measurements take O(n^2), with O(n^2) bits of memory, so thousands of qubits are practical.
+//
+// Instructions are classified by what they do rather than by gate name: single qubit matrices by
+// how they conjugate X, Y & Z, diagonal tables by decomposing their phases into S powers & CZs (so
+// merged layers of Z/S/CZ stay on the tableau), CNOT/X/SWAP directly. Anything else (T, rotations,
+// Toffoli, ...) turns the register into a sparse state vector, if it is small enough to ever hold one.
+// Up to TABLEAU_LOG_MAX_BYTES, every gate & measurement applied to the tableau is logged, and the log
+// is replayed on a fresh state vector, which keeps the exact amplitudes (global phase included) of a
+// direct run. Longer circuits drop the log, keeping the memory O(n^2) whatever the number of gates:
+// their state vector is rebuilt from the stabilizer generators instead, which gives the same state up
+// to a global phase.
+
+// Phases of a Clifford gate's entries are quarter turns, up to rounding of the matrices
+#define CLIFFORD_TOLERANCE 1e-6
+
+// Memory the gate log may use (entries & pools) before it is dropped
+#define TABLEAU_LOG_MAX_BYTES (1 << 20)
+
+typedef struct tableau_log_entry {
+    gate_op op;           // Its qubits & matrix are the next ones in the log's pools, unused for measurements
+    int num_qubits;
+    int num_controls;
+    int measured_qubit;   // >= 0 for a measurement that projected this qubit onto `result`
+    int result;
+} tableau_log_entry;
+
+struct stabilizer_tableau {
+    int num_qubits;
+    int words;            // 64-bit words per bit vector
+    uint64_t *x, *z;      // 2n + 1 rows of `words` words each
+    uint8_t *r;           // Sign of each row: -1 when set
+    int logging;          // Set while the gate log holds everything applied to the tableau
+    tableau_log_entry *log;
+    uint64_t log_count, log_capacity;
+    int *log_qubits;      // Qubits of the logged gates, one after the other
+    cnum *log_matrices;   // Matrices of the logged gates, one after the other
+    uint64_t log_qubit_count, log_qubit_capacity;
+    uint64_t log_matrix_count, log_matrix_capacity;
+};
+
+static inline uint64_t *row_x(const stabilizer_tableau *t, int row) {
+    return t->x + (uint64_t)row * t->words;
+}
+
+static inline uint64_t *row_z(const stabilizer_tableau *t, int row) {
+    return t->z + (uint64_t)row * t->words;
+}
+
+static inline int get_bit(const uint64_t *bits, int q) {
+    return (int)((bits[q >> 6] >> (q & 63)) & 1);
+}
+
+static inline void set_bit(uint64_t *bits, int q, int value) {
+    bits[q >> 6] = (bits[q >> 6] & ~(1ULL << (q & 63))) | ((uint64_t)value << (q & 63));
+}
+
+static stabilizer_tableau *tableau_alloc(int num_qubits) {
+    stabilizer_tableau *t = calloc(1, sizeof(stabilizer_tableau));
+    if (t == NULL) {
+        return NULL;
+    }
+    uint64_t rows = 2 * (uint64_t)num_qubits + 1;
+    t->num_qubits = num_qubits;
+    t->words = (num_qubits + 63) / 64;
+    t->x = calloc(rows * t->words, sizeof(uint64_t));
+    t->z = calloc(rows * t->words, sizeof(uint64_t));
+    t->r = calloc(rows, sizeof(uint8_t));
+    if (t->x == NULL || t->z == NULL || t->r == NULL) {
+        tableau_free(t);
+        return NULL;
+    }
+    STATS_ALLOCS(3, rows * (2 * t->words * sizeof(uint64_t) + 1));
+    return t;
+}
+
+void tableau_free(stabilizer_tableau *t) {
+    if (t != NULL) {
+        free(t->log);
+        free(t->log_qubits);
+        free(t->log_matrices);
+        free(t->x);
+        free(t->z);
+        free(t->r);
+        free(t);
+    }
+}
+
+stabilizer_tableau *tableau_clone(const stabilizer_tableau *t) {
+    stabilizer_tableau *copy = tableau_alloc(t->num_qubits);
+    if (copy != NULL) {
+        tableau_copy(copy, t);
+    }
+    return copy;
+}
+
+void tableau_copy(stabilizer_tableau *dst, const stabilizer_tableau *src) {
+    uint64_t rows = 2 * (uint64_t)src->num_qubits + 1;
+    memcpy(dst->x, src->x, rows * src->words * sizeof(uint64_t));
+    memcpy(dst->z, src->z, rows * src->words * sizeof(uint64_t));
+    memcpy(dst->r, src->r, rows);
+}
+
+// Row h <- row i * row h, tracking the sign through the i factors of the products (the "rowsum" of
+// Aaronson & Gottesman). Each qubit contributes -1, 0 or +1 quarter turns, counted 64 at a time.
+static void rowsum(stabilizer_tableau *t, int h, int i) {
+    uint64_t *xh = row_x(t, h), *zh = row_z(t, h);
+    const uint64_t *xi = row_x(t, i), *zi = row_z(t, i);
+    int sum = 2 * t->r[h] + 2 * t->r[i];
+    for (int w = 0; w < t->words; w++) {
+        uint64_t x1 = xi[w], z1 = zi[w], x2 = xh[w], z2 = zh[w];
+        uint64_t plus = (x1 & z1 & z2 & ~x2) | (x1 & ~z1 & x2 & z2) | (~x1 & z1 & x2 & ~z2);
+        uint64_t minus = (x1 & z1 & x2 & ~z2) | (x1 & ~z1 & ~x2 & z2) | (~x1 & z1 & x2 & z2);
+        sum += __builtin_popcountll(plus) - __builtin_popcountll(minus);
+        xh[w] = x2 ^ x1;
+        zh[w] = z2 ^ z1;
+    }
+    t->r[h] = (((sum % 4) + 4) % 4) == 2;
+}
+
+static void clear_row(stabilizer_tableau *t, int row) {
+    memset(row_x(t, row), 0, t->words * sizeof(uint64_t));
+    memset(row_z(t, row), 0, t->words * sizeof(uint64_t));
+    t->r[row] = 0;
+}
+
+// Gates
+
+// Image of each single qubit Pauli under a Clifford, indexed by its (x | z << 1) code
+typedef struct pauli_image {
+    int x, z, sign;
+} pauli_image;
+
+static void tableau_single_qubit(stabilizer_tableau *t, int q, const pauli_image images[4]) {
+    for (int row = 0; row < 2 * t->num_qubits; row++) {
+        uint64_t *x = row_x(t, row), *z = row_z(t, row);
+        int code = get_bit(x, q) | (get_bit(z, q) << 1);
+        if (code != 0) {
+            set_bit(x, q, images[code].x);
+            set_bit(z, q, images[code].z);
+            t->r[row] ^= (uint8_t)images[code].sign;
+        }
+    }
+}
+
+static void tableau_phase(stabilizer_tableau *t, int q, int quarter_turns) {
+    // S: X -> Y, Y -> -X, Z -> Z
+    static const pauli_image s_images[4] = {{0, 0, 0}, {1, 1, 0}, {0, 1, 0}, {1, 0, 1}};
+    for (int k = 0; k < quarter_turns; k++) {
+        tableau_single_qubit(t, q, s_images);
+    }
+}
+
+static void tableau_cnot(stabilizer_tableau *t, int control, int target) {
+    for (int row = 0; row < 2 * t->num_qubits; row++) {
+        uint64_t *x = row_x(t, row), *z = row_z(t, row);
+        int xa = get_bit(x, control), za = get_bit(z, control);
+        int xb = get_bit(x, target), zb = get_bit(z, target);
+        t->r[row] ^= (uint8_t)(xa & zb & (xb ^ za ^ 1));
+        set_bit(x, target, xb ^ xa);
+        set_bit(z, control, za ^ zb);
+    }
+}
+
+static void tableau_cz(stabilizer_tableau *t, int a, int b) {
+    for (int row = 0; row < 2 * t->num_qubits; row++) {
+        uint64_t *x = row_x(t, row), *z = row_z(t, row);
+        int xa = get_bit(x, a), za = get_bit(z, a);
+        int xb = get_bit(x, b), zb = get_bit(z, b);
+        t->r[row] ^= (uint8_t)(xa & xb & (za ^ zb));
+        set_bit(z, a, za ^ xb);
+        set_bit(z, b, zb ^ xa);
+    }
+}
+
+static void tableau_swap(stabilizer_tableau *t, int a, int b) {
+    for (int row = 0; row < 2 * t->num_qubits; row++) {
+        uint64_t *x = row_x(t, row), *z = row_z(t, row);
+        int xa = get_bit(x, a), za = get_bit(z, a);
+        set_bit(x, a, get_bit(x, b));
+        set_bit(z, a, get_bit(z, b));
+        set_bit(x, b, xa);
+        set_bit(z, b, za);
+    }
+}
+
+// Number of quarter turns (0 to 3) of a unit complex number, or -1 if it isn't a power of i
+static int quarter_turns(double re, double im) {
+    static const double unit[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+    for (int k = 0; k < 4; k++) {
+        if (fabs(re - unit[k][0]) < CLIFFORD_TOLERANCE && fabs(im - unit[k][1]) < CLIFFORD_TOLERANCE) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// Images of X, Z & Y under the single qubit matrix u, returns 0 if u is not a Clifford
+static int single_qubit_images(const cnum *u, pauli_image images[4]) {
+    static const cnum paulis[4][4] = {
+        {{0, 0}, {0, 0}, {0, 0}, {0, 0}},
+        {{0, 0}, {1, 0}, {1, 0}, {0, 0}},   // X
+        {{1, 0}, {0, 0}, {0, 0}, {-1, 0}},  // Z
+        {{0, 0}, {0, -1}, {0, 1}, {0, 0}},  // Y
+    };
+    for (int code = 1; code < 4; code++) {
+        const cnum *p = paulis[code];
+        // m = u p u^dagger
+        cnum up[4], m[4];
+        for (int r = 0; r < 2; r++) {
+            for (int c = 0; c < 2; c++) {
+                up[r * 2 + c] = cnum_add(cnum_mul(u[r * 2], p[c]), cnum_mul(u[r * 2 + 1], p[2 + c]));
+            }
+        }
+        for (int r = 0; r < 2; r++) {
+            for (int c = 0; c < 2; c++) {
+                cnum a = cnum_mul(up[r * 2], (cnum){u[c * 2].re, -u[c * 2].im});
+                cnum b = cnum_mul(up[r * 2 + 1], (cnum){u[c * 2 + 1].re, -u[c * 2 + 1].im});
+                m[r * 2 + c] = cnum_add(a, b);
+            }
+        }
+        // m = a X + b Y + c Z, exactly one of them must be +-1
+        double coefficients[3] = {(m[1].re + m[2].re) / 2, (m[2].im - m[1].im) / 2, (m[0].re - m[3].re) / 2};
+        static const int codes[3] = {1, 3, 2};
+        int found = 0;
+        for (int j = 0; j < 3; j++) {
+            double c = coefficients[j];
+            if (fabs(fabs(c) - 1.0) < CLIFFORD_TOLERANCE) {
+                images[code] = (pauli_image){codes[j] & 1, codes[j] >> 1, c < 0};
+                found++;
+            } else if (fabs(c) > CLIFFORD_TOLERANCE) {
+                return 0;
+            }
+        }
+        if (found != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Apply a diagonal over k qubits if its phases are a product of S powers & CZs (up to a global
+// phase), returns 0 otherwise. The phase of key x must be sum_j a_j x_j + 2 sum_{j<l} b_jl x_j x_l
+// quarter turns.
+static int tableau_diagonal(stabilizer_tableau *t, const int *qubits, int k, const cnum *table) {
+    int turns[1 << DIAGONAL_GATE_MAX_QUBITS];
+    cnum reference = table[0];
+    double norm = (double)reference.re * reference.re + (double)reference.im * reference.im;
+    if (norm < CLIFFORD_TOLERANCE) {
+        return 0;
+    }
+    for (int key = 0; key < (1 << k); key++) {
+        // table[key] / table[0]
+        cnum ratio = cnum_mul(table[key], (cnum){reference.re, -reference.im});
+        turns[key] = quarter_turns(ratio.re / norm, ratio.im / norm);
+        if (turns[key] < 0) {
+            return 0;
+        }
+    }
+
+    // qubits[j] is bit k - 1 - j of the key
+    int linear[DIAGONAL_GATE_MAX_QUBITS];
+    int pairs[DIAGONAL_GATE_MAX_QUBITS][DIAGONAL_GATE_MAX_QUBITS] = {{0}};
+    for (int j = 0; j < k; j++) {
+        linear[j] = turns[1 << (k - 1 - j)];
+    }
+    for (int j = 0; j < k; j++) {
+        for (int l = j + 1; l < k; l++) {
+            int both = turns[(1 << (k - 1 - j)) | (1 << (k - 1 - l))];
+            int quadratic = ((both - linear[j] - linear[l]) % 4 + 4) % 4;
+            if (quadratic != 0 && quadratic != 2) {
+                return 0;
+            }
+            pairs[j][l] = quadratic / 2;
+        }
+    }
+    for (int key = 0; key < (1 << k); key++) {
+        int expected = 0;
+        for (int j = 0; j < k; j++) {
+            if ((key >> (k - 1 - j)) & 1) {
+                expected += linear[j];
+                for (int l = j + 1; l < k; l++) {
+                    expected += 2 * (pairs[j][l] & (key >> (k - 1 - l)));
+                }
+            }
+        }
+        if (expected % 4 != turns[key]) {
+            return 0;
+        }
+    }
+
+    for (int j = 0; j < k && t != NULL; j++) {
+        tableau_phase(t, qubits[j], linear[j]);
+        for (int l = j + 1; l < k; l++) {
+            if (pairs[j][l]) {
+                tableau_cz(t, qubits[j], qubits[l]);
+            }
+        }
+    }
+    return 1;
+}
+
+// Apply an instruction to the tableau if it is a Clifford, returns 0 without touching anything otherwise.
+// With a NULL tableau, only tells whether the instruction is a Clifford
+static int tableau_try_instruction(stabilizer_tableau *t, const instruction *ins) {
+    const int *q = ins->qubits;
+    switch (ins->op) {
+        case GATE_OP_CONTROLLED_X:
+            if (ins->num_controls == 0) {
+                static const pauli_image x_images[4] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 1}, {1, 1, 1}};
+                if (t != NULL) {
+                    tableau_single_qubit(t, q[0], x_images);
+                }
+                return 1;
+            }
+            if (ins->num_controls == 1) {
+                if (t != NULL) {
+                    tableau_cnot(t, q[0], q[1]);
+                }
+                return 1;
+            }
+            return 0;
+        case GATE_OP_SWAP:
+            if (t != NULL) {
+                tableau_swap(t, q[0], q[1]);
+            }
+            return 1;
+        case GATE_OP_CONTROLLED_PHASE: {
+            cnum phase = ins->matrix[3];
+            if (quarter_turns(phase.re, phase.im) == 0) {
+                return 1;
+            }
+            if (ins->num_qubits > 2) {
+                return 0;
+            }
+            cnum table[4] = {{1, 0}, {1, 0}, {1, 0}, {1, 0}};
+            table[(1 << ins->num_qubits) - 1] = phase;
+            return tableau_diagonal(t, q, ins->num_qubits, table);
+        }
+        case GATE_OP_DIAGONAL:
+            return tableau_diagonal(t, q, ins->num_qubits, ins->matrix);
+        case GATE_OP_MATRIX: {
+            pauli_image images[4];
+            if (ins->num_qubits != 1 || !single_qubit_images(ins->matrix, images)) {
+                return 0;
+            }
+            if (t != NULL) {
+                tableau_single_qubit(t, q[0], images);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int is_clifford_instruction(const instruction *ins) {
+    return tableau_try_instruction(NULL, ins);
+}
+
+// Drop the gate log: the register can still become a state vector, rebuilt from its generators
+static void drop_log(stabilizer_tableau *t) {
+    free(t->log);
+    free(t->log_qubits);
+    free(t->log_matrices);
+    t->log = NULL;
+    t->log_qubits = NULL;
+    t->log_matrices = NULL;
+    t->log_count = t->log_capacity = 0;
+    t->log_qubit_count = t->log_qubit_capacity = 0;
+    t->log_matrix_count = t->log_matrix_capacity = 0;
+    t->logging = 0;
+}
+
+// Make room for `count` more items in a pool of the log, doubling it as needed. Returns 0 on success
+static int reserve_log_pool(void **pool, uint64_t *capacity, uint64_t needed, size_t item_bytes) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    uint64_t grown = *capacity ? *capacity : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *p = realloc(*pool, grown * item_bytes);
+    if (p == NULL) {
+        return -1;
+    }
+    STATS_ALLOC((grown - *capacity) * item_bytes);
+    *pool = p;
+    *capacity = grown;
+    return 0;
+}
+
+// Append an entry (with room for its qubits & matrix) to the log, or drop the log if that would take
+// it past TABLEAU_LOG_MAX_BYTES. Returns NULL if the log was dropped
+static tableau_log_entry *log_append(stabilizer_tableau *t, int num_qubits, int matrix_entries) {
+    uint64_t bytes = (t->log_count + 1) * sizeof(tableau_log_entry) + (t->log_qubit_count + num_qubits) * sizeof(int) +
+                     (t->log_matrix_count + matrix_entries) * sizeof(cnum);
+    if (bytes > TABLEAU_LOG_MAX_BYTES ||
+        reserve_log_pool((void **)&t->log, &t->log_capacity, t->log_count + 1, sizeof(tableau_log_entry)) != 0 ||
+        reserve_log_pool((void **)&t->log_qubits, &t->log_qubit_capacity, t->log_qubit_count + num_qubits, sizeof(int)) != 0 ||
+        reserve_log_pool((void **)&t->log_matrices, &t->log_matrix_capacity, t->log_matrix_count + matrix_entries, sizeof(cnum)) != 0) {
+        drop_log(t);
+        return NULL;
+    }
+    tableau_log_entry *entry = &t->log[t->log_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->measured_qubit = -1;
+    return entry;
+}
+
+// Keep a copy of an applied instruction for tableau_to_state
+static void log_instruction(stabilizer_tableau *t, const instruction *ins) {
+    int entries = instruction_matrix_entries(ins->op, ins->num_qubits, ins->num_controls);
+    tableau_log_entry *entry = log_append(t, ins->num_qubits, entries);
+    if (entry == NULL) {
+        return;
+    }
+    entry->op = ins->op;
+    entry->num_qubits = ins->num_qubits;
+    entry->num_controls = ins->num_controls;
+    memcpy(t->log_qubits + t->log_qubit_count, ins->qubits, ins->num_qubits * sizeof(int));
+    memcpy(t->log_matrices + t->log_matrix_count, ins->matrix, entries * sizeof(cnum));
+    t->log_qubit_count += ins->num_qubits;
+    t->log_matrix_count += entries;
+}
+
+int apply_tableau_instruction(stabilizer_tableau *t, const instruction *ins) {
+    if (!tableau_try_instruction(t, ins)) {
+        return 0;
+    }
+    if (t->logging) {
+        log_instruction(t, ins);
+    }
+    return 1;
+}
+
+// Measurements
+
+int tableau_measure(stabilizer_tableau *t, int qubit, double draw) {
+    int n = t->num_qubits;
+    int p = -1;
+    for (int row = n; row < 2 * n && p < 0; row++) {
+        if (get_bit(row_x(t, row), qubit)) {
+            p = row;
+        }
+    }
+
+    int result;
+    if (p >= 0) {
+        // Random outcome: every other row anticommuting with Z_qubit is fixed up with row p, whose
+        // stabilizer becomes its destabilizer and is replaced by +-Z_qubit. Same rule as the state
+        // vector registers (result 1 when draw < p1), so the same seed gives the same outcome.
+        for (int row = 0; row < 2 * n; row++) {
+            if (row != p && get_bit(row_x(t, row), qubit)) {
+                rowsum(t, row, p);
+            }
+        }
+        memcpy(row_x(t, p - n), row_x(t, p), t->words * sizeof(uint64_t));
+        memcpy(row_z(t, p - n), row_z(t, p), t->words * sizeof(uint64_t));
+        t->r[p - n] = t->r[p];
+        clear_row(t, p);
+        set_bit(row_z(t, p), qubit, 1);
+        result = draw < 0.5;
+        t->r[p] = (uint8_t)result;
+    } else {
+        // Deterministic outcome: Z_qubit is the product of the stabilizers paired with the
+        // destabilizers that anticommute with it, accumulated in the scratch row
+        clear_row(t, 2 * n);
+        for (int row = 0; row < n; row++) {
+            if (get_bit(row_x(t, row), qubit)) {
+                rowsum(t, 2 * n, row + n);
+            }
+        }
+        result = t->r[2 * n];
+    }
+
+    if (t->logging) {
+        tableau_log_entry *entry = log_append(t, 0, 0);
+        if (entry != NULL) {
+            entry->measured_qubit = qubit;
+            entry->result = result;
+        }
+    }
+    return result;
+}
+
+// Whether two Pauli strings anticommute
+static int anticommute(const stabilizer_tableau *t, const uint64_t *x1, const uint64_t *z1, const uint64_t *x2, const uint64_t *z2) {
+    int parity = 0;
+    for (int w = 0; w < t->words; w++) {
+        parity ^= __builtin_parityll((x1[w] & z2[w]) ^ (z1[w] & x2[w]));
+    }
+    return parity;
+}
+
+qc_status tableau_pauli_expectation(stabilizer_tableau *t, const char *paulis, double *value) {
+    int n = t->num_qubits;
+    uint64_t *px = calloc(3 * t->words, sizeof(uint64_t));
+    if (px == NULL) {
+        return QC_ERR_OUT_OF_MEMORY;
+    }
+    uint64_t *pz = px + t->words;
+    uint64_t *seen = pz + t->words;
+
+    const char *p = paulis;
+    char op;
+    int qubit, ret;
+    while ((ret = next_pauli_factor(paulis, &p, n, &op, &qubit)) > 0) {
+        if (get_bit(seen, qubit)) {
+            fprintf(stderr, "Error: qubit %d appears twice in Pauli string \"%s\"\n", qubit, paulis);
+            ret = -1;
+            break;
+        }
+        set_bit(seen, qubit, 1);
+        set_bit(px, qubit, op == 'X' || op == 'Y');
+        set_bit(pz, qubit, op == 'Z' || op == 'Y');
+    }
+    if (ret < 0) {
+        free(px);
+        return QC_ERR_INVALID_ARGUMENT;
+    }
+
+    // A Pauli anticommuting with a stabilizer averages to 0, otherwise it is +- a product of them
+    *value = 0.0;
+    int in_group = 1;
+    for (int row = n; row < 2 * n && in_group; row++) {
+        in_group = !anticommute(t, px, pz, row_x(t, row), row_z(t, row));
+    }
+    if (in_group) {
+        clear_row(t, 2 * n);
+        for (int row = 0; row < n; row++) {
+            if (anticommute(t, px, pz, row_x(t, row), row_z(t, row))) {
+                rowsum(t, 2 * n, row + n);
+            }
+        }
+        *value = t->r[2 * n] ? -1.0 : 1.0;
+    }
+    free(px);
+    return QC_OK;
+}
+
+void tableau_print(const stabilizer_tableau *t) {
+    static const char letters[4] = {'I', 'X', 'Z', 'Y'};
+    int n = t->num_qubits;
+    printf("Stabilizer state generated by:\n");
+    for (int row = n; row < 2 * n; row++) {
+        putchar(t->r[row] ? '-' : '+');
+        // Qubit 0 right-most, as in view_state_vector
+        for (int q = n - 1; q >= 0; q--) {
+            putchar(letters[get_bit(row_x(t, row), q) | (get_bit(row_z(t, row), q) << 1)]);
+        }
+        putchar('\n');
+    }
+}
+
+// Conversion to a state vector
+
+static void swap_rows(stabilizer_tableau *t, int a, int b) {
+    if (a == b) {
+        return;
+    }
+    uint64_t *xa = row_x(t, a), *za = row_z(t, a), *xb = row_x(t, b), *zb = row_z(t, b);
+    for (int w = 0; w < t->words; w++) {
+        uint64_t x = xa[w], z = za[w];
+        xa[w] = xb[w];
+        za[w] = zb[w];
+        xb[w] = x;
+        zb[w] = z;
+    }
+    uint8_t r = t->r[a];
+    t->r[a] = t->r[b];
+    t->r[b] = r;
+}
+
+// Walk over the 2^k products of the stabilizers with X parts, in Gray code order so that each step
+// multiplies the product (kept in the scratch row) by a single stabilizer
+typedef struct generator_walk {
+    stabilizer_tableau *t;  // In row echelon form, the stabilizers with X parts first
+    uint64_t basis;         // Basis state with a non-zero amplitude
+    uint64_t step;
+    double scale;           // 2^(-k/2)
+} generator_walk;
+
+// Next amplitude P|basis> / 2^(k/2) of the state: with P = (-1)^r i^(x.z) X^x Z^z (Y = iXZ on each qubit),
+// P|b> = (-1)^r i^(x.z) (-1)^(z.b) |b ^ x>
+static void next_generator_amplitude(void *context, uint64_t *index, cnum *value) {
+    generator_walk *walk = context;
+    stabilizer_tableau *t = walk->t;
+    int scratch = 2 * t->num_qubits;
+    if (walk->step > 0) {
+        rowsum(t, scratch, t->num_qubits + __builtin_ctzll(walk->step));
+    }
+    walk->step++;
+    uint64_t x = row_x(t, scratch)[0], z = row_z(t, scratch)[0];
+    int quarter_turns = (2 * t->r[scratch] + __builtin_popcountll(x & z) + 2 * __builtin_popcountll(z & walk->basis)) & 3;
+    static const cnum phases[4] = {{1.0, 0.0}, {0.0, 1.0}, {-1.0, 0.0}, {0.0, -1.0}};
+    *index = walk->basis ^ x;
+    *value = (cnum){(qc_real)(phases[quarter_turns].re * walk->scale), (qc_real)(phases[quarter_turns].im * walk->scale)};
+}
+
+// State vector of a tableau whose gate log was dropped, up to its global phase. The stabilizers are
+// brought to row echelon form, first over their X parts (k rows) then over the Z parts of the others.
+// Each of the Z-only rows, reduced to its pivot qubit, fixes one bit of a basis state |b> that the
+// state overlaps with, and the state is the sum of P|b> / 2^(k/2) over the products P of the k others
+static qreg *state_from_generators(const stabilizer_tableau *tableau) {
+    int n = tableau->num_qubits;
+    stabilizer_tableau *t = tableau_clone(tableau);
+    if (t == NULL) {
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+    int row = n;
+    for (int q = 0; q < n; q++) {
+        for (int pivot = row; pivot < 2 * n; pivot++) {
+            if (get_bit(row_x(t, pivot), q)) {
+                swap_rows(t, row, pivot);
+                for (int other = n; other < 2 * n; other++) {
+                    if (other != row && get_bit(row_x(t, other), q)) {
+                        rowsum(t, other, row);
+                    }
+                }
+                row++;
+                break;
+            }
+        }
+    }
+    int k = row - n;
+    int pivots[SPARSE_QUBIT_LIMIT];
+    for (int q = 0; q < n; q++) {
+        for (int pivot = row; pivot < 2 * n; pivot++) {
+            if (get_bit(row_z(t, pivot), q)) {
+                swap_rows(t, row, pivot);
+                for (int other = n + k; other < 2 * n; other++) {
+                    if (other != row && get_bit(row_z(t, other), q)) {
+                        rowsum(t, other, row);
+                    }
+                }
+                pivots[row - n - k] = q;
+                row++;
+                break;
+            }
+        }
+    }
+    generator_walk walk = {t, 0, 0, pow(2.0, -0.5 * k)};
+    for (int r = n + k; r < 2 * n; r++) {
+        walk.basis |= (uint64_t)t->r[r] << pivots[r - n - k];
+    }
+    clear_row(t, 2 * n);
+
+    qreg *state = sparse_qreg_from_amplitudes(n, 1ULL << k, next_generator_amplitude, &walk);
+    tableau_free(t);
+    return state;
+}
+
+qc_status tableau_to_state(qreg *qr) {
+    stabilizer_tableau *t = qr->tableau;
+    if (qr->size > SPARSE_QUBIT_LIMIT) {
+        fprintf(stderr, "Error: this %d qubit stabilizer register cannot become a state vector (at most %d qubits)\n",
+                qr->size, SPARSE_QUBIT_LIMIT);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return QC_ERR_TOO_MANY_QUBITS;
+    }
+
+    qreg *state;
+    if (!t->logging) {
+        state = state_from_generators(t);
+        if (state == NULL) {
+            return qc_last_status();
+        }
+    } else {
+        state = new_qreg_with_storage(qr->size, QC_STORAGE_SPARSE);
+        if (state == NULL) {
+            return qc_last_status();
+        }
+        const int *qubits = t->log_qubits;
+        const cnum *matrix = t->log_matrices;
+        for (uint64_t e = 0; e < t->log_count; e++) {
+            const tableau_log_entry *entry = &t->log[e];
+            qc_status status;
+            if (entry->measured_qubit >= 0) {
+                status = (project_qubit(state, entry->measured_qubit, entry->result) == 0) ? QC_OK : QC_ERR_OUT_OF_MEMORY;
+            } else {
+                instruction ins = {entry->op, entry->num_qubits, entry->num_controls, qubits, matrix};
+                qubits += entry->num_qubits;
+                matrix += instruction_matrix_entries(entry->op, entry->num_qubits, entry->num_controls);
+                status = apply_instruction(state, &ins);
+            }
+            if (status != QC_OK) {
+                fprintf(stderr, "Error replaying the stabilizer gate log\n");
+                free_qreg(state);
+                set_status(status);
+                return status;
+            }
+        }
+    }
+
+    tableau_free(t);
+    qr->tableau = NULL;
+    qr->amp = state->amp;
+    qr->sparse = state->sparse;
+    free(state);
+    set_status(QC_OK);
+    return QC_OK;
+}
+
+qreg *new_stabilizer_qreg(int size) {
+    if (size > STABILIZER_QUBIT_LIMIT) {
+        fprintf(stderr, "Cannot support more than %d qubits in a stabilizer register, attempted %d\n", STABILIZER_QUBIT_LIMIT, size);
+        set_status(QC_ERR_TOO_MANY_QUBITS);
+        return NULL;
+    }
+
+    qreg *qr = malloc(sizeof(qreg));
+    stabilizer_tableau *t = tableau_alloc(size);
+    if (qr == NULL || t == NULL) {
+        fprintf(stderr, "Error allocating memory for quantum register.\n");
+        free(qr);
+        tableau_free(t);
+        set_status(QC_ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    // |00...0>: destabilizers X_i, stabilizers Z_i
+    for (int q = 0; q < size; q++) {
+        set_bit(row_x(t, q), q, 1);
+        set_bit(row_z(t, size + q), q, 1);
+    }
+    t->logging = (size <= SPARSE_QUBIT_LIMIT);
+
+    qr->size = size;
+    qr->amp = NULL;
+    qr->mapped_bytes = 0;
+    qr->back_buffer = NULL;
+    qr->sparse = NULL;
+    qr->tableau = t;
+    qr->mps = NULL;
+    set_status(QC_OK);
+    return qr;
+}
@@ -0,0 +1,142 @@
+#include "qc_internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Instrumentation
+//
+// With QC_STATS the library hooks record phase timings, allocations, state vector sweeps and parsed
+// gates into one global qc_stats, plus each phase span into a fixed size trace buffer (spans past
+// STATS_MAX_TRACE_EVENTS are only counted). The hooks run on the calling thread, outside the parallel
+// regions; counters are updated atomically so concurrent API calls don't corrupt them. Without
+// QC_STATS only the query functions are compiled, reporting empty statistics.
+
+static const char *phase_names[QC_NUM_PHASES] = {
+    "parse", "lower", "kernels", "dense_expand", "dense_multiply", "dense_apply", "observe", "io",
+};
+
+const char *qc_phase_name(qc_phase phase) {
+    return (phase >= 0 && phase < QC_NUM_PHASES) ? phase_names[phase] : "unknown";
+}
+
+#ifdef QC_STATS
+
+#define STATS_MAX_TRACE_EVENTS (1 << 16)
+
+typedef struct trace_event {
+    qc_phase phase;
+    double start, seconds;
+} trace_event;
+
+static qc_stats stats = {.enabled = 1};
+static trace_event trace[STATS_MAX_TRACE_EVENTS];
+static uint64_t num_trace_events = 0;
+static double trace_origin = -1.0;
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_record_phase(qc_phase phase, double start) {
+    double seconds = stats_now() - start;
+    __atomic_fetch_add(&stats.phase_calls[phase], 1, __ATOMIC_RELAXED);
+    #pragma omp critical(qc_stats)
+    {
+        stats.phase_seconds[phase] += seconds;
+        if (trace_origin < 0.0) {
+            trace_origin = start;
+        }
+    }
+    uint64_t slot = __atomic_fetch_add(&num_trace_events, 1, __ATOMIC_RELAXED);
+    if (slot < STATS_MAX_TRACE_EVENTS) {
+        trace[slot] = (trace_event){phase, start, seconds};
+    }
+}
+
+void stats_add_allocations(uint64_t count, uint64_t bytes) {
+    __atomic_fetch_add(&stats.allocations, count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.bytes_allocated, bytes, __ATOMIC_RELAXED);
+}
+
+void stats_add_sweeps(uint64_t sweeps) {
+    __atomic_fetch_add(&stats.state_sweeps, sweeps, __ATOMIC_RELAXED);
+}
+
+void stats_count_gate(const char *type) {
+    #pragma omp critical(qc_stats)
+    {
+        int t = 0;
+        while (t < stats.num_gate_types && strcmp(stats.gate_types[t], type) != 0) {
+            t++;
+        }
+        if (t == stats.num_gate_types && t < QC_STATS_MAX_GATE_TYPES) {
+            snprintf(stats.gate_types[t], sizeof(stats.gate_types[t]), "%s", type);
+            stats.num_gate_types++;
+        }
+        if (t < stats.num_gate_types) {
+            stats.gate_counts[t]++;
+        }
+    }
+}
+
+void qc_get_stats(qc_stats *out) {
+    if (out != NULL) {
+        #pragma omp critical(qc_stats)
+        *out = stats;
+    }
+}
+
+void qc_reset_stats(void) {
+    #pragma omp critical(qc_stats)
+    {
+        memset(&stats, 0, sizeof(stats));
+        stats.enabled = 1;
+        num_trace_events = 0;
+        trace_origin = -1.0;
+    }
+}
+
+qc_status qc_write_trace(const char *path) {
+    FILE *f = (path != NULL) ? fopen(path, "w") : NULL;
+    if (f == NULL) {
+        fprintf(stderr, "Error opening trace file %s\n", path ? path : "(null)");
+        set_status(QC_ERR_IO);
+        return QC_ERR_IO;
+    }
+
+    // Complete ("X") events, timestamps & durations in microseconds
+    uint64_t count = (num_trace_events < STATS_MAX_TRACE_EVENTS) ? num_trace_events : STATS_MAX_TRACE_EVENTS;
+    fprintf(f, "{\"traceEvents\":[");
+    for (uint64_t e = 0; e < count; e++) {
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"qc\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}", e ? "," : "",
+                phase_names[trace[e].phase], (trace[e].start - trace_origin) * 1e6, trace[e].seconds * 1e6);
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%llu}}\n",
+            (unsigned long long)(num_trace_events - count));
+
+    qc_status status = (fclose(f) == 0) ? QC_OK : QC_ERR_IO;
+    set_status(status);
+    return status;
+}
+
+#else
+
+void qc_get_stats(qc_stats *out) {
+    if (out != NULL) {
+        memset(out, 0, sizeof(*out));
+    }
+}
+
+void qc_reset_stats(void) {
+}
+
+qc_status qc_write_trace(const char *path) {
+    (void)path;
+    fprintf(stderr, "Error: the library was built without QC_STATS, there is no trace to write\n");
+    set_status(QC_ERR_INVALID_ARGUMENT);
+    return QC_ERR_INVALID_ARGUMENT;
+}
+
+#endif // QC_STATS
@@ -0,0 +1,156 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Parametric layers, and the same layers with the angles of one parameter row written out
+static const char *parametric_layers[] = {
+    "H_0|H_1|H_2|RY_3_0.7", "RX_0_$theta0|CNOT_1_3", "RZ_1_$phi1|T_1|P_2_$a2|S_3", "CCNOT_0_1_2",
+    "RY_2_$theta3|SWP_0_3", "MCP_0_2_3_0.4|RZ_0_$phi1", "RX_3_$theta0|CNOT_3_1",
+};
+static const int num_parametric_layers = sizeof(parametric_layers) / sizeof(parametric_layers[0]);
+
+static void bind_layers(const double *row, char bound[][96]) {
+    snprintf(bound[0], 96, "H_0|H_1|H_2|RY_3_0.7");
+    snprintf(bound[1], 96, "RX_0_%.17g|CNOT_1_3", row[0]);
+    snprintf(bound[2], 96, "RZ_1_%.17g|T_1|P_2_%.17g|S_3", row[1], row[2]);
+    snprintf(bound[3], 96, "CCNOT_0_1_2");
+    snprintf(bound[4], 96, "RY_2_%.17g|SWP_0_3", row[3]);
+    snprintf(bound[5], 96, "MCP_0_2_3_0.4|RZ_0_%.17g", row[1]);
+    snprintf(bound[6], 96, "RX_3_%.17g|CNOT_3_1", row[0]);
+}
+
+// Every state of a batch matches a separate run with its angles written into the layers
+void test_batch_matches_single_runs() {
+    qcircuit *circuit = qc_compile(parametric_layers, num_parametric_layers);
+    assert(circuit != NULL && qc_circuit_num_params(circuit) == 4);
+
+    // 5 states: padded to 8 lanes
+    const int batch_size = 5;
+    double params[5 * 4];
+    for (int i = 0; i < batch_size * 4; i++) {
+        params[i] = 0.37 * i - 1.9;
+    }
+    qbatch *qb = new_qbatch(4, batch_size);
+    assert(qb != NULL);
+    assert(qc_run_batch(circuit, qb, params) == QC_OK);
+
+    qreg *copy = new_qreg(4);
+    for (int b = 0; b < batch_size; b++) {
+        char bound[7][96];
+        const char *layers[7];
+        bind_layers(&params[b * 4], bound);
+        qreg *qr = new_qreg(4);
+        for (int l = 0; l < num_parametric_layers; l++) {
+            layers[l] = bound[l];
+            circuit_layer(qr, bound[l]);
+        }
+        assert(qc_batch_get_state(qb, b, copy) == QC_OK);
+        for (uint64_t i = 0; i < 16; i++) {
+            cnum a = qc_batch_get_amplitude(qb, b, i);
+            assert(fabs(a.re - qr->amp[i].re) < 10 * QC_AMPLITUDE_TOLERANCE && fabs(a.im - qr->amp[i].im) < 10 * QC_AMPLITUDE_TOLERANCE);
+            assert(copy->amp[i].re == a.re && copy->amp[i].im == a.im);
+        }
+
+        // Compiled without placeholders, the bound layers run anywhere
+        qcircuit *fixed = qc_compile(layers, num_parametric_layers);
+        assert(qc_circuit_num_params(fixed) == 0);
+        free_qreg(qr);
+        qr = new_qreg(4);
+        assert(qc_run(fixed, qr) == QC_OK);
+        for (uint64_t i = 0; i < 16; i++) {
+            assert(fabs(qr->amp[i].re - copy->amp[i].re) < 10 * QC_AMPLITUDE_TOLERANCE);
+        }
+        qc_free_circuit(fixed);
+        free_qreg(qr);
+    }
+
+    // Out of range reads, & a reset brings back |0...0>
+    assert(qc_batch_get_amplitude(qb, batch_size, 0).re == 0.0 && qc_batch_get_amplitude(qb, 0, 16).re == 0.0);
+    assert(qc_batch_reset(qb) == QC_OK);
+    for (int b = 0; b < batch_size; b++) {
+        assert(qc_batch_get_amplitude(qb, b, 0).re == 1.0 && qc_batch_get_amplitude(qb, b, 5).re == 0.0);
+    }
+    free_qreg(copy);
+    free_qbatch(qb);
+    qc_free_circuit(circuit);
+
+    printf("Batch matches single runs pass\n");
+}
+
+// A batch large enough for the parallel kernels, the expectation values follow cos(theta)
+void test_large_batch() {
+    const int n = 10, batch_size = 64;
+    const char *layers[] = {"RY_0_$theta0|H_5", "CNOT_0_9|CNOT_5_4", "RZ_9_$t1|RX_4_$t1"};
+    qcircuit *circuit = qc_compile(layers, 3);
+    double *params = malloc(batch_size * 2 * sizeof(double));
+    for (int b = 0; b < batch_size; b++) {
+        params[2 * b] = 2 * M_PI * b / batch_size;
+        params[2 * b + 1] = 0.1 * b;
+    }
+    qbatch *qb = new_qbatch(n, batch_size);
+    assert(qb != NULL);
+    assert(qc_run_batch(circuit, qb, params) == QC_OK);
+
+    qreg *qr = new_qreg(n);
+    const char *terms[] = {"Z0", "Z0 Z9", "Z5"};
+    double values[3];
+    for (int b = 0; b < batch_size; b++) {
+        assert(qc_batch_get_state(qb, b, qr) == QC_OK);
+        assert(qc_pauli_expectations(qr, terms, 3, values) == QC_OK);
+        assert(fabs(values[0] - cos(params[2 * b])) < 1e-4);
+        assert(fabs(values[1] - 1.0) < 1e-4 && fabs(values[2]) < 1e-4);
+    }
+    free_qreg(qr);
+    free(params);
+    free_qbatch(qb);
+    qc_free_circuit(circuit);
+
+    printf("Large batch pass\n");
+}
+
+// Placeholders only run on batches, & invalid inputs
+void test_batch_errors() {
+    const char *layers[] = {"H_0|RX_1_$theta0"};
+    qcircuit *circuit = qc_compile(layers, 1);
+    assert(circuit != NULL);
+
+    qreg *qr = new_qreg(2);
+    assert(qc_run(circuit, qr) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_fuse(circuit, 2, NULL) == NULL);
+    assert(qc_run_noisy(circuit, qr, 1) == QC_ERR_INVALID_ARGUMENT);
+    circuit_layer(qr, "X_0|RX_1_$theta0");
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT && qr->amp[0].re == 1.0);
+    free_qreg(qr);
+
+    qbatch *small = new_qbatch(1, 3);
+    assert(qc_run_batch(circuit, small, NULL) == QC_ERR_INVALID_ARGUMENT);
+    double params[3] = {0.1, 0.2, 0.3};
+    assert(qc_run_batch(circuit, small, params) == QC_ERR_INVALID_ARGUMENT);
+    qr = new_qreg(2);
+    assert(qc_batch_get_state(small, 0, qr) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+    free_qbatch(small);
+    qc_free_circuit(circuit);
+
+    const char *malformed[] = {"RX_0_$", "RX_0_$theta", "RX_0_$theta-1", "RX_0_$theta1x", "H_$theta0"};
+    for (int i = 0; i < 5; i++) {
+        assert(qc_compile(&malformed[i], 1) == NULL);
+    }
+    assert(new_qbatch(0, 4) == NULL && qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(new_qbatch(4, 0) == NULL && qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(new_qbatch(QUBIT_REGISTER_LIMIT - 1, 3) == NULL && qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+
+    printf("Batch errors pass\n");
+}
+
+int main() {
+    test_batch_matches_single_runs();
+    test_large_batch();
+    test_batch_errors();
+
+    printf("All batch tests passed successfully.\n");
+    return 0;
+}
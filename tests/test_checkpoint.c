@@ -0,0 +1,103 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+static char path[64];
+
+// A saved state loads back bit for bit, and the loaded register is a normal, independent register
+void test_save_load() {
+    qreg *qr = new_qreg(12);
+    circuit_layer(qr, "H_0|RY_3_0.4|H_11|RX_7_1.2");
+    circuit_layer(qr, "CNOT_0_5|T_11|MCP_3_7_11_0.6");
+    assert(qc_save_state(qr, path) == QC_OK);
+    assert(access(path, F_OK) == 0);
+
+    qreg *loaded = qc_load_state(path);
+    assert(loaded != NULL);
+    assert(qc_last_status() == QC_OK);
+    assert(((uintptr_t)loaded->amp % sysconf(_SC_PAGESIZE)) == 0);
+    assert_same_state(qr, loaded, 0.0);
+
+    // Both registers evolve identically, and changes never reach the file
+    circuit_layer(qr, "H_5|SWP_1_10");
+    circuit_layer(loaded, "H_5|SWP_1_10");
+    assert_same_state(qr, loaded, 0.0);
+
+    qreg *reloaded = qc_load_state(path);
+    assert(reloaded != NULL);
+    assert(memcmp(reloaded->amp, loaded->amp, (1ULL << 12) * sizeof(cnum)) != 0);
+    circuit_layer(reloaded, "H_5|SWP_1_10");
+    assert_same_state(reloaded, loaded, 0.0);
+
+    free_qreg(reloaded);
+    free_qreg(loaded);
+    free_qreg(qr);
+
+    printf("Save & load pass\n");
+}
+
+// The dense engine replaces the state vector, the mapping must be released rather than freed
+void test_load_dense_engine() {
+    qreg *qr = new_qreg(4);
+    circuit_layer(qr, "H_0|RY_2_0.8");
+    assert(qc_save_state(qr, path) == QC_OK);
+    qreg *loaded = qc_load_state(path);
+    assert(loaded != NULL);
+
+    qc_use_dense_engine(1);
+    circuit_layer(qr, "CNOT_0_3|X_1");
+    circuit_layer(loaded, "CNOT_0_3|X_1");
+    qc_use_dense_engine(0);
+    assert(loaded->mapped_bytes == 0);
+    for (int i = 0; i < (1 << 4); i++) {
+        assert(fabs(qr->amp[i].re - loaded->amp[i].re) < QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(qr->amp[i].im - loaded->amp[i].im) < QC_AMPLITUDE_TOLERANCE);
+    }
+
+    free_qreg(loaded);
+    free_qreg(qr);
+    printf("Loaded state with the dense engine pass\n");
+}
+
+void test_load_errors() {
+    // Missing file
+    assert(qc_load_state("/nonexistent/qc_state.bin") == NULL);
+    assert(qc_last_status() == QC_ERR_IO);
+
+    // Not a checkpoint
+    FILE *f = fopen(path, "wb");
+    fputs("definitely not a quantum state", f);
+    fclose(f);
+    assert(qc_load_state(path) == NULL);
+    assert(qc_last_status() == QC_ERR_IO);
+
+    // Truncated checkpoint
+    qreg *qr = new_qreg(10);
+    assert(qc_save_state(qr, path) == QC_OK);
+    assert(truncate(path, qc_qreg_bytes(10)) == 0);
+    assert(qc_load_state(path) == NULL);
+    assert(qc_last_status() == QC_ERR_IO);
+
+    // Unwritable destination
+    assert(qc_save_state(qr, "/nonexistent/qc_state.bin") == QC_ERR_IO);
+    assert(qc_save_state(NULL, path) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+
+    printf("Checkpoint errors pass\n");
+}
+
+int main() {
+    snprintf(path, sizeof(path), "/tmp/qc_checkpoint_test_%d.bin", (int)getpid());
+
+    test_save_load();
+    test_load_dense_engine();
+    test_load_errors();
+    unlink(path);
+
+    printf("All checkpoint tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef TEST_COMMON_H // Include guard
+#define TEST_COMMON_H
+
+// Helpers shared by the test programs
+#include "qc_lib.h"
+#include <assert.h>
+#include <math.h>
+
+// Assert that two registers hold the same state, whatever their storage: every amplitude must match to
+// within `tolerance` (0 for identical amplitudes, e.g. QC_AMPLITUDE_TOLERANCE for states reached through
+// different kernels)
+static inline void assert_same_state(const qreg *a, const qreg *b, double tolerance) {
+    assert(a->size == b->size);
+    for (uint64_t i = 0; i < (1ULL << a->size); i++) {
+        cnum x = qc_get_amplitude(a, i);
+        cnum y = qc_get_amplitude(b, i);
+        assert(fabs(x.re - y.re) <= tolerance);
+        assert(fabs(x.im - y.im) <= tolerance);
+    }
+}
+
+#endif // TEST_COMMON_H
@@ -0,0 +1,107 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+
+// Grover search for |01> on 2 qubits + 1 ancilla, same circuit as examples/grover_search.c
+static const char *grover_layers[] = {
+    "X_2",
+    "H_0|H_1|H_2",
+    "X_1",
+    "CCNOT_0_1_2",
+    "X_1",
+    "H_0|H_1",
+    "X_0|X_1",
+    "H_1",
+    "CNOT_0_1",
+    "H_1",
+    "X_0|X_1",
+    "H_0|H_1|H_2",
+    "X_2",
+};
+#define GROVER_NUM_LAYERS (int)(sizeof(grover_layers) / sizeof(grover_layers[0]))
+
+// A compiled circuit must give the same result as the same layers applied one by one
+void test_compiled_matches_layers() {
+    qcircuit *circuit = qc_compile(grover_layers, GROVER_NUM_LAYERS);
+    assert(circuit != NULL);
+    assert(qc_last_status() == QC_OK);
+    assert(qc_circuit_num_gates(circuit) == 20);
+
+    qreg *expected = new_qreg(3);
+    for (int l = 0; l < GROVER_NUM_LAYERS; l++) {
+        circuit_layer(expected, grover_layers[l]);
+    }
+
+    qreg *qr = new_qreg(3);
+    assert(qc_run(circuit, qr) == QC_OK);
+    assert_same_state(qr, expected, QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(qr->amp[1].re + 1.0) < QC_AMPLITUDE_TOLERANCE); // -|001>
+
+    free_qreg(qr);
+    free_qreg(expected);
+    qc_free_circuit(circuit);
+
+    printf("Compiled circuit matches layer by layer evaluation\n");
+}
+
+// The same circuit can be run many times, and on registers larger than it needs
+void test_compiled_reuse() {
+    const char *layers[] = {"H_0", "CNOT_0_3", "MCP_0_3_1.5|RY_2_0.25", "SWP_1_3"};
+    qcircuit *circuit = qc_compile(layers, 4);
+    assert(circuit != NULL);
+
+    qreg *qr = new_qreg(5);
+    qreg *expected = new_qreg(5);
+    for (int it = 0; it < 10; it++) {
+        assert(qc_run(circuit, qr) == QC_OK);
+        for (int l = 0; l < 4; l++) {
+            circuit_layer(expected, layers[l]);
+        }
+        assert_same_state(qr, expected, QC_AMPLITUDE_TOLERANCE);
+    }
+
+    free_qreg(qr);
+    free_qreg(expected);
+    qc_free_circuit(circuit);
+
+    printf("Compiled circuit reuse pass\n");
+}
+
+void test_compile_errors() {
+    // Unknown gates & malformed qubits fail to compile
+    const char *bad_gate[] = {"H_0", "FOO_1"};
+    assert(qc_compile(bad_gate, 2) == NULL);
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    const char *bad_qubits[] = {"CNOT_1_1"};
+    assert(qc_compile(bad_qubits, 1) == NULL);
+
+    // Registers too small for the circuit are rejected without touching the state
+    const char *layers[] = {"X_0|X_4"};
+    qcircuit *circuit = qc_compile(layers, 1);
+    assert(circuit != NULL);
+    qreg *qr = new_qreg(4);
+    assert(qc_run(circuit, qr) == QC_ERR_INVALID_ARGUMENT);
+    assert(qr->amp[0].re == 1.0);
+    free_qreg(qr);
+    qc_free_circuit(circuit);
+
+    // A NULL layer array is rejected, but an empty circuit is valid
+    qcircuit *empty = qc_compile(NULL, 0);
+    assert(empty == NULL);
+    empty = qc_compile(layers, 0);
+    assert(empty != NULL && qc_circuit_num_gates(empty) == 0);
+    qc_free_circuit(empty);
+
+    printf("Compile errors pass\n");
+}
+
+int main() {
+    test_compiled_matches_layers();
+    test_compiled_reuse();
+    test_compile_errors();
+
+    printf("All compiled circuit tests passed successfully.\n");
+    return 0;
+}
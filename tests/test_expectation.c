@@ -0,0 +1,111 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+void test_bell_expectations() {
+    qreg *qr = new_qreg(2);
+    circuit_layer(qr, "H_0");
+    circuit_layer(qr, "CNOT_0_1");
+
+    const char *paulis[] = {"Z0 Z1", "X0 X1", "Y0 Y1", "Z0", "X1", "", "I0 I1", "X0 Y1"};
+    double expected[] = {1.0, 1.0, -1.0, 0.0, 0.0, 1.0, 1.0, 0.0};
+    double values[8];
+    assert(qc_pauli_expectations(qr, paulis, 8, values) == QC_OK);
+    for (int t = 0; t < 8; t++) {
+        assert(fabs(values[t] - expected[t]) < QC_AMPLITUDE_TOLERANCE);
+    }
+
+    // H = 0.5 ZZ - 2 XX + 0.25 YY
+    double coeffs[] = {0.5, -2.0, 0.25};
+    double energy;
+    assert(qc_hamiltonian_expectation(qr, paulis, coeffs, 3, &energy) == QC_OK);
+    assert(fabs(energy - (0.5 - 2.0 - 0.25)) < QC_AMPLITUDE_TOLERANCE);
+
+    free_qreg(qr);
+    printf("Bell state expectations pass\n");
+}
+
+void test_rotation_expectations() {
+    qreg *qr = new_qreg(3);
+    circuit_layer(qr, "RY_0_0.7|RX_2_1.3");
+    const char *paulis[] = {"Z0", "X0", "Y0", "Z2", "Y2", "X2"};
+    double expected[] = {cos(0.7), sin(0.7), 0.0, cos(1.3), -sin(1.3), 0.0};
+    double values[6];
+    assert(qc_pauli_expectations(qr, paulis, 6, values) == QC_OK);
+    for (int t = 0; t < 6; t++) {
+        assert(fabs(values[t] - expected[t]) < QC_AMPLITUDE_TOLERANCE);
+    }
+    free_qreg(qr);
+
+    // Large enough for the sweeps to be split across threads
+    qr = new_qreg(15);
+    circuit_layer(qr, "RY_14_0.4|H_0");
+    const char *high[] = {"Z14", "X14 X0", "Z0"};
+    assert(qc_pauli_expectations(qr, high, 3, values) == QC_OK);
+    assert(fabs(values[0] - cos(0.4)) < QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(values[1] - sin(0.4)) < QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(values[2]) < QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+
+    printf("Rotation expectations pass\n");
+}
+
+// Compare against applying each Pauli string to a copy of the state and taking the inner product
+void test_against_gate_application() {
+    const int num_qubits = 8;
+    const char *paulis[] = {"X0 Z3 Y5", "Z0 Z1 Z2", "X0 Y5", "Y0 X5 Z7", "Z4", "X1 X2", "Y1 Y2 Z6", "X7", "Y7 Z0", "X0 Z3 X5"};
+    const char *layers[] = {"X_0|Z_3|Y_5", "Z_0|Z_1|Z_2", "X_0|Y_5", "Y_0|X_5|Z_7", "Z_4", "X_1|X_2", "Y_1|Y_2|Z_6", "X_7", "Y_7|Z_0", "X_0|Z_3|X_5"};
+    const int num_terms = 10;
+    char gates_string[64];
+
+    qreg *qr = new_qreg(num_qubits);
+    for (int q = 0; q < num_qubits; q++) {
+        snprintf(gates_string, sizeof(gates_string), "RY_%d_%f|RZ_%d_%f", q, 0.3 + 0.2 * q, q, 1.1 - 0.3 * q);
+        circuit_layer(qr, gates_string);
+    }
+    circuit_layer(qr, "CNOT_0_4|CNOT_7_2");
+
+    double values[10];
+    assert(qc_pauli_expectations(qr, paulis, num_terms, values) == QC_OK);
+    for (int t = 0; t < num_terms; t++) {
+        qreg *copy = new_qreg(num_qubits);
+        memcpy(copy->amp, qr->amp, (1ULL << num_qubits) * sizeof(cnum));
+        circuit_layer(copy, layers[t]);
+        double re = 0.0, im = 0.0;
+        for (int i = 0; i < (1 << num_qubits); i++) {
+            re += qr->amp[i].re * copy->amp[i].re + qr->amp[i].im * copy->amp[i].im;
+            im += qr->amp[i].re * copy->amp[i].im - qr->amp[i].im * copy->amp[i].re;
+        }
+        assert(fabs(values[t] - re) < QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(im) < QC_AMPLITUDE_TOLERANCE);
+        free_qreg(copy);
+    }
+
+    free_qreg(qr);
+    printf("Expectations match gate application pass\n");
+}
+
+void test_expectation_errors() {
+    qreg *qr = new_qreg(3);
+    double value;
+    const char *bad[] = {"X3", "Z0 X0", "Q1", "X", "X-1"};
+    for (int t = 0; t < 5; t++) {
+        assert(qc_pauli_expectations(qr, &bad[t], 1, &value) == QC_ERR_INVALID_ARGUMENT);
+    }
+    assert(qc_pauli_expectations(NULL, bad, 1, &value) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_hamiltonian_expectation(qr, bad, NULL, 1, &value) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+    printf("Expectation errors pass\n");
+}
+
+int main() {
+    test_bell_expectations();
+    test_rotation_expectations();
+    test_against_gate_application();
+    test_expectation_errors();
+
+    printf("All expectation value tests passed successfully.\n");
+    return 0;
+}
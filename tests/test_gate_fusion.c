@@ -0,0 +1,97 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+
+// Mix of single qubit, diagonal, controlled and multi-controlled gates on 9 qubits
+static const char *layers[] = {
+    "H_0|H_1|H_2|H_3|H_4|H_5|H_6|H_7|H_8",
+    "CNOT_0_1|RZ_2_0.3|CNOT_3_4",
+    "RY_1_0.7|T_0|S_5|CNOT_6_8",
+    "CCNOT_0_1_2|RX_7_1.1",
+    "SWP_2_5|Y_4",
+    "MCP_0_1_2_3_0.9|Z_8",
+    "CNOT_8_0|H_3",
+    "MCX_1_3_5_7_6",
+    "RZ_6_-0.4|P_7_0.2|CNOT_2_7",
+    "MCZ_0_4_8|RX_1_2.5",
+};
+#define NUM_LAYERS (int)(sizeof(layers) / sizeof(layers[0]))
+#define NUM_QUBITS 9
+
+// Fused circuits must give the same state as the unfused one, for every block size
+void test_fusion_matches_unfused() {
+    qcircuit *circuit = qc_compile(layers, NUM_LAYERS);
+    assert(circuit != NULL);
+    int num_gates = qc_circuit_num_gates(circuit);
+
+    qreg *expected = new_qreg(NUM_QUBITS);
+    assert(qc_run(circuit, expected) == QC_OK);
+
+    int previous_saved = 0;
+    for (int k = 2; k <= 5; k++) {
+        int saved = -1;
+        qcircuit *fused = qc_fuse(circuit, k, &saved);
+        assert(fused != NULL);
+        assert(qc_last_status() == QC_OK);
+        assert(saved > 0 && saved >= previous_saved);
+        assert(qc_circuit_num_gates(fused) == num_gates - saved);
+        previous_saved = saved;
+
+        // Once with each SIMD level, the fused blocks go through the generic dense kernels
+        for (qc_simd simd = QC_SIMD_SCALAR; simd <= qc_get_simd(); simd++) {
+            qc_simd active = qc_get_simd();
+            if (qc_set_simd(simd) != 0) {
+                continue;
+            }
+            qreg *qr = new_qreg(NUM_QUBITS);
+            assert(qc_run(fused, qr) == QC_OK);
+            assert_same_state(qr, expected, QC_AMPLITUDE_TOLERANCE);
+            free_qreg(qr);
+            qc_set_simd(active);
+        }
+
+        printf("Fusion with %d qubit blocks: %d gates -> %d passes\n", k, num_gates, num_gates - saved);
+        qc_free_circuit(fused);
+    }
+
+    free_qreg(expected);
+    qc_free_circuit(circuit);
+    printf("Fused circuits match the unfused circuit\n");
+}
+
+void test_fusion_edge_cases() {
+    const char *single[] = {"H_0|H_1", "CNOT_0_1", "H_0"};
+    qcircuit *circuit = qc_compile(single, 3);
+    int saved = -1;
+
+    // The whole circuit collapses to one 2 qubit gate
+    qcircuit *fused = qc_fuse(circuit, 2, &saved);
+    assert(fused != NULL && saved == 3 && qc_circuit_num_gates(fused) == 1);
+    qc_free_circuit(fused);
+
+    // Invalid block sizes and NULL circuits are rejected
+    assert(qc_fuse(circuit, 1, NULL) == NULL);
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_fuse(circuit, 6, NULL) == NULL);
+    assert(qc_fuse(NULL, 3, NULL) == NULL);
+    qc_free_circuit(circuit);
+
+    // Empty circuits stay empty
+    qcircuit *empty = qc_compile(single, 0);
+    fused = qc_fuse(empty, 3, &saved);
+    assert(fused != NULL && saved == 0 && qc_circuit_num_gates(fused) == 0);
+    qc_free_circuit(fused);
+    qc_free_circuit(empty);
+
+    printf("Fusion edge cases pass\n");
+}
+
+int main() {
+    test_fusion_matches_unfused();
+    test_fusion_edge_cases();
+
+    printf("All gate fusion tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef QC_SINGLE_PRECISION
+#define STEP 1e-2
+#define GRADIENT_TOLERANCE 2e-3
+#else
+#define STEP 1e-4
+#define GRADIENT_TOLERANCE 1e-6
+#endif
+
+// Single rotations, where the derivatives are known in closed form
+void test_gradient_closed_form() {
+    const char *ry[] = {"RY_0_$theta0"};
+    const char *z[] = {"Z0"};
+    const double one = 1.0;
+    qcircuit *circuit = qc_compile(ry, 1);
+    for (double theta = -3.0; theta < 3.0; theta += 0.7) {
+        double energy, gradient;
+        assert(qc_adjoint_gradient(circuit, 1, &theta, z, &one, 1, &energy, &gradient) == QC_OK);
+        assert(fabs(energy - cos(theta)) < 1e-5 && fabs(gradient + sin(theta)) < 1e-5);
+    }
+    qc_free_circuit(circuit);
+
+    // P rotates |+> around Z, & two gates sharing a parameter add up
+    const char *phase[] = {"H_0", "P_0_$a0", "P_0_$a0"};
+    const char *x[] = {"X0"};
+    circuit = qc_compile(phase, 3);
+    double a = 0.4, energy, gradient;
+    assert(qc_adjoint_gradient(circuit, 1, &a, x, &one, 1, &energy, &gradient) == QC_OK);
+    assert(fabs(energy - cos(2 * a)) < 1e-5 && fabs(gradient + 2 * sin(2 * a)) < 1e-5);
+    qc_free_circuit(circuit);
+
+    printf("Closed form gradients pass\n");
+}
+
+// Every gradient matches central finite differences, evaluated in one batch
+void test_gradient_matches_finite_differences() {
+    const char *layers[] = {
+        "H_0|H_1|H_2|H_3", "RX_0_$t0|RY_1_$t1|RZ_2_$t2|P_3_$t3", "CNOT_0_1|CNOT_2_3", "MCZ_1_2|T_0|S_3",
+        "RY_0_$t4|RX_3_$t0|CCNOT_1_2_0", "SWP_1_3|MCP_0_2_0.3", "RZ_1_$t5|RY_2_$t4|CNOT_3_0",
+    };
+    const char *paulis[] = {"Z0 Z1", "X2", "Y1 Y3", "Z3", "X0 Y2 Z3", ""};
+    const double coeffs[] = {0.7, -1.1, 0.4, 0.9, -0.3, 2.0};
+    const int num_params = 6;
+    qcircuit *circuit = qc_compile(layers, 7);
+    assert(qc_circuit_num_params(circuit) == num_params);
+
+    double params[6] = {0.3, -1.2, 2.1, 0.8, -0.5, 1.7};
+    double energy, gradient[6];
+    assert(qc_adjoint_gradient(circuit, 4, params, paulis, coeffs, 6, &energy, gradient) == QC_OK);
+
+    // Row 0 holds the parameters as they are, rows 2p+1 & 2p+2 shift parameter p by -+STEP
+    double shifted[13 * 6];
+    for (int r = 0; r < 13; r++) {
+        memcpy(&shifted[r * num_params], params, sizeof(params));
+        if (r > 0) {
+            shifted[r * num_params + (r - 1) / 2] += (r % 2) ? -STEP : STEP;
+        }
+    }
+    qbatch *qb = new_qbatch(4, 13);
+    assert(qc_run_batch(circuit, qb, shifted) == QC_OK);
+    qreg *qr = new_qreg(4);
+    double energies[13];
+    for (int r = 0; r < 13; r++) {
+        assert(qc_batch_get_state(qb, r, qr) == QC_OK);
+        assert(qc_hamiltonian_expectation(qr, paulis, coeffs, 6, &energies[r]) == QC_OK);
+    }
+    assert(fabs(energy - energies[0]) < 1e-5);
+    for (int p = 0; p < num_params; p++) {
+        double expected = (energies[2 * p + 2] - energies[2 * p + 1]) / (2 * STEP);
+        assert(fabs(gradient[p] - expected) < GRADIENT_TOLERANCE);
+    }
+    free_qreg(qr);
+    free_qbatch(qb);
+    qc_free_circuit(circuit);
+
+    printf("Gradients match finite differences pass\n");
+}
+
+// Invalid inputs
+void test_gradient_errors() {
+    const char *layers[] = {"H_0|RX_1_$theta0"};
+    const char *paulis[] = {"Z1"};
+    const char *malformed[] = {"Q1"};
+    const double one = 1.0;
+    double param = 0.2, energy, gradient;
+    qcircuit *circuit = qc_compile(layers, 1);
+    assert(qc_adjoint_gradient(circuit, 1, &param, paulis, &one, 1, &energy, &gradient) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_adjoint_gradient(circuit, 2, NULL, paulis, &one, 1, &energy, &gradient) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_adjoint_gradient(circuit, 2, &param, paulis, &one, 1, &energy, NULL) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_adjoint_gradient(circuit, 2, &param, malformed, &one, 1, &energy, &gradient) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_adjoint_gradient(circuit, 2, &param, paulis, &one, 1, NULL, &gradient) == QC_OK);
+    qc_free_circuit(circuit);
+
+    printf("Gradient errors pass\n");
+}
+
+int main() {
+    test_gradient_closed_form();
+    test_gradient_matches_finite_differences();
+    test_gradient_errors();
+
+    printf("All gradient tests passed successfully.\n");
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "qc_lib.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 
 void test_initialization() {
     // Test 1: Initialize a quantum register with 1 qubit
@@ -19,8 +20,38 @@ void test_initialization() {
     printf("Test 3 Passed: Freed quantum registers.\n");
 }
 
+void test_register_limits() {
+    // Test 4: State vector footprint is reported up front, with 64-bit arithmetic
+    assert(qc_qreg_bytes(1) == 2 * sizeof(cnum));
+    assert(qc_qreg_bytes(30) == (1ULL << 30) * sizeof(cnum));
+    assert(qc_qreg_bytes(QUBIT_REGISTER_LIMIT) == (1ULL << QUBIT_REGISTER_LIMIT) * sizeof(cnum));
+    assert(qc_qreg_bytes(0) == 0);
+    assert(qc_qreg_bytes(QUBIT_REGISTER_LIMIT + 1) == 0);
+    printf("Test 4 Passed: State vector footprints.\n");
+
+    // Test 5: Invalid sizes fail cleanly with a status code
+    assert(new_qreg(0) == NULL);
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(new_qreg(QUBIT_REGISTER_LIMIT + 1) == NULL);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+    printf("Test 5 Passed: Invalid register sizes are rejected.\n");
+
+    // Test 6: The state vector is aligned and initialized to |0...0>
+    qreg *qr = new_qreg(10);
+    assert(qr != NULL);
+    assert(qc_last_status() == QC_OK);
+    assert(((uintptr_t)qr->amp % 64) == 0);
+    assert(qr->amp[0].re == 1.0 && qr->amp[0].im == 0.0);
+    for (int i = 1; i < (1 << 10); i++) {
+        assert(qr->amp[i].re == 0.0 && qr->amp[i].im == 0.0);
+    }
+    free_qreg(qr);
+    printf("Test 6 Passed: Aligned and initialized state vector.\n");
+}
+
 int main() {
     test_initialization();
+    test_register_limits();
     printf("All initialization tests passed.\n");
     return 0;
 }
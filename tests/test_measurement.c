@@ -0,0 +1,172 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define SHOTS 20000
+
+// Sampled frequencies must follow |amp|^2, and the state must not change
+void test_measure_all_distribution() {
+    const int num_qubits = 10;
+    const uint64_t dim = 1ULL << num_qubits;
+    qreg *qr = new_qreg(num_qubits);
+    char gates_string[64];
+
+    for (int q = 0; q < num_qubits; q++) {
+        snprintf(gates_string, sizeof(gates_string), "RY_%d_%f", q, 0.2 + 0.25 * q);
+        circuit_layer(qr, gates_string);
+    }
+    circuit_layer(qr, "CNOT_9_0|CNOT_4_7");
+    cnum before = qr->amp[5];
+
+    uint64_t *samples = malloc(SHOTS * sizeof(uint64_t));
+    unsigned *counts = calloc(dim, sizeof(unsigned));
+    assert(qc_measure_all(qr, SHOTS, 42, samples) == QC_OK);
+    for (int s = 0; s < SHOTS; s++) {
+        assert(samples[s] < dim);
+        counts[samples[s]]++;
+    }
+    assert(qr->amp[5].re == before.re && qr->amp[5].im == before.im);
+
+    // Each outcome's frequency within 5 standard deviations (+3 shots for the rare ones) of its probability
+    for (uint64_t i = 0; i < dim; i++) {
+        double p = qr->amp[i].re * qr->amp[i].re + qr->amp[i].im * qr->amp[i].im;
+        double sigma = sqrt(SHOTS * p * (1 - p));
+        assert(fabs(counts[i] - SHOTS * p) <= 5 * sigma + 3);
+    }
+
+    // The same seed gives the same samples
+    uint64_t *again = malloc(SHOTS * sizeof(uint64_t));
+    assert(qc_measure_all(qr, SHOTS, 42, again) == QC_OK);
+    for (int s = 0; s < SHOTS; s++) {
+        assert(again[s] == samples[s]);
+    }
+
+    free(again);
+    free(counts);
+    free(samples);
+    free_qreg(qr);
+
+    printf("Sampling distribution pass\n");
+}
+
+void test_measure_all_basis_and_bell() {
+    uint64_t samples[1000];
+
+    // A basis state always gives the same outcome
+    qreg *qr = new_qreg(5);
+    circuit_layer(qr, "X_1|X_4");
+    assert(qc_measure_all(qr, 1000, 7, samples) == QC_OK);
+    for (int s = 0; s < 1000; s++) {
+        assert(samples[s] == 18);
+    }
+    free_qreg(qr);
+
+    // A Bell pair only gives |00> or |11>, about half of the time each
+    qr = new_qreg(2);
+    circuit_layer(qr, "H_0");
+    circuit_layer(qr, "CNOT_0_1");
+    int ones = 0;
+    assert(qc_measure_all(qr, 1000, 3, samples) == QC_OK);
+    for (int s = 0; s < 1000; s++) {
+        assert(samples[s] == 0 || samples[s] == 3);
+        ones += (samples[s] == 3);
+    }
+    assert(ones > 400 && ones < 600);
+    free_qreg(qr);
+
+    printf("Basis & Bell sampling pass\n");
+}
+
+// Registers with many blocks go through the chunked prefix sum: outcomes spread over several chunks are
+// drawn with their probabilities, and the samples don't depend on the number of threads
+void test_measure_all_chunked_scan() {
+    uint64_t *samples = malloc(SHOTS * sizeof(uint64_t));
+    uint64_t *serial = malloc(SHOTS * sizeof(uint64_t));
+    qreg *qr = new_qreg(20);
+    circuit_layer(qr, "X_7|X_19");
+    assert(qc_measure_all(qr, SHOTS, 11, samples) == QC_OK);
+    for (int s = 0; s < SHOTS; s++) {
+        assert(samples[s] == ((1ULL << 19) | (1ULL << 7)));
+    }
+
+    // Outcomes 0x80080 & co, in four different chunks with probability 1/8 each
+    circuit_layer(qr, "H_0|H_12|H_19");
+    int threads = qc_get_num_threads();
+    qc_set_num_threads(1);
+    assert(qc_measure_all(qr, SHOTS, 5, serial) == QC_OK);
+    qc_set_num_threads(4);
+    assert(qc_measure_all(qr, SHOTS, 5, samples) == QC_OK);
+    qc_set_num_threads(threads);
+    unsigned counts[8] = {0};
+    for (int s = 0; s < SHOTS; s++) {
+        assert(samples[s] == serial[s]);
+        assert((samples[s] & ~((1ULL << 19) | (1ULL << 12) | 1ULL)) == (1ULL << 7));
+        counts[((samples[s] >> 17) & 4) | ((samples[s] >> 11) & 2) | (samples[s] & 1)]++;
+    }
+    for (int k = 0; k < 8; k++) {
+        assert(fabs(counts[k] - SHOTS / 8.0) <= 5 * sqrt(SHOTS * (1.0 / 8) * (7.0 / 8)));
+    }
+
+    free_qreg(qr);
+    free(serial);
+    free(samples);
+
+    printf("Chunked scan sampling pass\n");
+}
+
+// Measuring one qubit of a Bell pair collapses both, and the state stays normalized
+void test_measure_qubit() {
+    int results[2] = {0, 0};
+    for (uint64_t seed = 0; seed < 200; seed++) {
+        qreg *qr = new_qreg(2);
+        circuit_layer(qr, "H_0");
+        circuit_layer(qr, "CNOT_0_1");
+
+        int r = qc_measure_qubit(qr, 0, seed);
+        assert(r == 0 || r == 1);
+        assert(qc_last_status() == QC_OK);
+        results[r]++;
+        int both = r ? 3 : 0;
+        assert(fabs(qr->amp[both].re - 1.0) < QC_AMPLITUDE_TOLERANCE);
+        assert(qr->amp[both ^ 3].re == 0.0 && qr->amp[1].re == 0.0 && qr->amp[2].re == 0.0);
+        assert(qc_measure_qubit(qr, 1, seed + 1000) == r);
+        free_qreg(qr);
+    }
+    assert(results[0] > 60 && results[1] > 60);
+
+    // Renormalization keeps the relative amplitudes
+    qreg *qr = new_qreg(3);
+    circuit_layer(qr, "RY_0_1.0|H_1|X_2");
+    assert(qc_measure_qubit(qr, 2, 11) == 1);
+    assert(fabs(qr->amp[4].re - cos(0.5) / sqrt(2)) < QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(qr->amp[7].re - sin(0.5) / sqrt(2)) < QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+
+    printf("Single qubit measurement pass\n");
+}
+
+void test_measure_errors() {
+    uint64_t sample;
+    qreg *qr = new_qreg(3);
+    assert(qc_measure_all(NULL, 1, 0, &sample) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_measure_all(qr, 1, 0, NULL) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_measure_qubit(qr, 3, 0) == -1);
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_measure_qubit(qr, -1, 0) == -1);
+    free_qreg(qr);
+
+    printf("Measurement errors pass\n");
+}
+
+int main() {
+    test_measure_all_distribution();
+    test_measure_all_basis_and_bell();
+    test_measure_all_chunked_scan();
+    test_measure_qubit();
+    test_measure_errors();
+
+    printf("All measurement tests passed successfully.\n");
+    return 0;
+}
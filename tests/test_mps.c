@@ -0,0 +1,202 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Every kind of gate, neighbours or not, gives the dense state while the bonds are wide enough
+void test_mps_matches_dense() {
+    const char *layers[] = {
+        "H_0|H_3|X_7", "CNOT_0_1", "CNOT_3_9", "CCNOT_9_1_5", "SWP_2_8", "MCX_0_3_6_4",  // Long range & multi-qubit
+        "RZ_0_0.3|T_1|S_5|P_9_1.2|Z_4", "MCP_1_6_8_0.7", "MCZ_5_2|RZ_3_1.1",              // Diagonals
+        "RY_4_0.4|RX_8_1.3", "H_6|Y_2", "CNOT_6_0", "RX_9_0.8|CNOT_2_7",                 // Dense matrices
+    };
+    const int num_layers = sizeof(layers) / sizeof(layers[0]);
+    qreg *mps = new_qreg_with_storage(10, QC_STORAGE_MPS);
+    qreg *dense = new_qreg(10);
+    assert(mps != NULL && qc_get_storage(mps) == QC_STORAGE_MPS);
+    assert(mps->amp == NULL && qc_num_stored_amplitudes(mps) == 20);
+
+    for (int l = 0; l < num_layers; l++) {
+        circuit_layer(mps, layers[l]);
+        circuit_layer(dense, layers[l]);
+        assert_same_state(mps, dense, 10 * QC_AMPLITUDE_TOLERANCE);
+    }
+
+    // Compiled & fused circuits run through the same instructions
+    qcircuit *circuit = qc_compile(layers, num_layers);
+    qcircuit *fused = qc_fuse(circuit, 3, NULL);
+    assert(qc_run(circuit, mps) == QC_OK && qc_run(circuit, dense) == QC_OK);
+    assert(qc_run(fused, mps) == QC_OK && qc_run(fused, dense) == QC_OK);
+    assert_same_state(mps, dense, 10 * QC_AMPLITUDE_TOLERANCE);
+    qc_free_circuit(fused);
+    qc_free_circuit(circuit);
+
+    int bond;
+    double discarded;
+    assert(qc_get_mps_info(mps, &bond, &discarded) == QC_OK);
+    assert(bond > 1 && bond <= 32 && discarded == 0.0);
+
+    // Observables agree too
+    const char *paulis[] = {"Z0 Z5", "X2 Y9", "X7 Z1 Y4", "Y1", ""};
+    double mps_values[5], dense_values[5];
+    assert(qc_pauli_expectations(mps, paulis, 5, mps_values) == QC_OK);
+    assert(qc_pauli_expectations(dense, paulis, 5, dense_values) == QC_OK);
+    for (int t = 0; t < 5; t++) {
+        assert(fabs(mps_values[t] - dense_values[t]) < 1e-4);
+    }
+
+    // Samples only hit non-zero amplitudes, and both sampling calls draw the same ones
+    uint64_t samples[300];
+    uint8_t *bits = malloc(300 * 10);
+    assert(qc_measure_all(mps, 300, 17, samples) == QC_OK);
+    assert(qc_sample_bits(mps, 300, 17, bits) == QC_OK);
+    for (int s = 0; s < 300; s++) {
+        cnum a = dense->amp[samples[s]];
+        assert(a.re * a.re + a.im * a.im > 1e-8);
+        for (int q = 0; q < 10; q++) {
+            assert(bits[s * 10 + q] == ((samples[s] >> q) & 1));
+        }
+    }
+    free(bits);
+
+    assert(qc_measure_qubit(mps, 4, 3) == qc_measure_qubit(dense, 4, 3));
+    assert(qc_measure_qubit(mps, 9, 8) == qc_measure_qubit(dense, 9, 8));
+    assert_same_state(mps, dense, 10 * QC_AMPLITUDE_TOLERANCE);
+
+    // Explicit conversion
+    assert(qc_to_dense(mps) == QC_OK && qc_get_storage(mps) == QC_STORAGE_DENSE);
+    assert_same_state(mps, dense, 10 * QC_AMPLITUDE_TOLERANCE);
+    free_qreg(mps);
+    free_qreg(dense);
+
+    printf("MPS matches dense pass\n");
+}
+
+// Shallow circuits over a hundred qubits, far beyond any state vector
+void test_mps_large_register() {
+    const int n = 100;
+    qreg *qr = new_qreg_with_storage(n, QC_STORAGE_MPS);
+    assert(qr != NULL);
+
+    // GHZ state, including one long range CNOT closing the chain
+    char layer[64];
+    circuit_layer(qr, "H_0");
+    for (int q = 0; q + 1 < n; q++) {
+        snprintf(layer, sizeof(layer), "CNOT_%d_%d", q, q + 1);
+        circuit_layer(qr, layer);
+    }
+    circuit_layer(qr, "CNOT_0_99|CNOT_0_99");
+
+    uint8_t *basis = calloc(n, 1);
+    assert(fabs(qc_get_amplitude_bits(qr, basis).re - M_SQRT1_2) < 1e-4);
+    memset(basis, 1, n);
+    assert(fabs(qc_get_amplitude_bits(qr, basis).re - M_SQRT1_2) < 1e-4);
+    basis[50] = 0;
+    assert(fabs(qc_get_amplitude_bits(qr, basis).re) < 1e-4);
+    free(basis);
+
+    char *all_x = malloc(8 * n);
+    int len = 0;
+    for (int q = 0; q < n; q++) {
+        len += sprintf(all_x + len, "X%d ", q);
+    }
+    const char *terms[] = {all_x, "Z0 Z99", "Z50"};
+    double values[3];
+    assert(qc_pauli_expectations(qr, terms, 3, values) == QC_OK);
+    assert(fabs(values[0] - 1.0) < 1e-4 && fabs(values[1] - 1.0) < 1e-4 && fabs(values[2]) < 1e-4);
+    free(all_x);
+
+    uint8_t *bits = malloc(200 * n);
+    int ones = 0;
+    assert(qc_sample_bits(qr, 200, 3, bits) == QC_OK);
+    for (int s = 0; s < 200; s++) {
+        for (int q = 1; q < n; q++) {
+            assert(bits[s * n + q] == bits[s * n]);
+        }
+        ones += bits[s * n];
+    }
+    assert(ones > 60 && ones < 140);
+    free(bits);
+
+    // A brickwork of entangling layers keeps the bonds small
+    for (int depth = 0; depth < 4; depth++) {
+        for (int q = depth % 2; q + 1 < n; q += 2) {
+            snprintf(layer, sizeof(layer), "RY_%d_0.%d|CNOT_%d_%d|RZ_%d_0.7", q, depth + 3, q, q + 1, q + 1);
+            circuit_layer(qr, layer);
+        }
+    }
+    int bond;
+    double discarded;
+    assert(qc_get_mps_info(qr, &bond, &discarded) == QC_OK);
+    assert(bond <= 32 && discarded == 0.0);
+    const char *norm[] = {""};
+    assert(qc_pauli_expectations(qr, norm, 1, values) == QC_OK && fabs(values[0] - 1.0) < 1e-4);
+
+    // Too large for indices, state vectors or checkpoints
+    uint64_t sample;
+    assert(qc_measure_all(qr, 1, 0, &sample) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_to_dense(qr) == QC_ERR_TOO_MANY_QUBITS);
+    assert(qc_save_state(qr, "/tmp/qc_test_mps.qcs") == QC_ERR_INVALID_ARGUMENT);
+    int result = qc_measure_qubit(qr, 42, 5);
+    assert(result == 0 || result == 1);
+    free_qreg(qr);
+
+    printf("MPS large register pass\n");
+}
+
+// Narrow bonds truncate the state, but keep it normalized
+void test_mps_truncation() {
+    qreg *qr = new_qreg_with_storage(12, QC_STORAGE_MPS);
+    assert(qc_set_mps_limits(qr, 4, 0.0) == QC_OK);
+    char layer[64];
+    unsigned seed = 7;
+    for (int l = 0; l < 40; l++) {
+        int a = rand_r(&seed) % 12;
+        int b = (a + 1 + rand_r(&seed) % 11) % 12;
+        snprintf(layer, sizeof(layer), "RX_%d_%.3f|RY_%d_%.3f", a, (rand_r(&seed) % 1000) / 300.0, b, (rand_r(&seed) % 1000) / 300.0);
+        circuit_layer(qr, layer);
+        snprintf(layer, sizeof(layer), "CNOT_%d_%d", a, b);
+        circuit_layer(qr, layer);
+    }
+    int bond;
+    double discarded;
+    assert(qc_get_mps_info(qr, &bond, &discarded) == QC_OK);
+    assert(bond <= 4 && discarded > 0.0);
+
+    const char *norm[] = {""};
+    double value;
+    assert(qc_pauli_expectations(qr, norm, 1, &value) == QC_OK && fabs(value - 1.0) < 1e-4);
+    assert(qc_to_dense(qr) == QC_OK);
+    double total = 0.0;
+    for (uint64_t i = 0; i < 4096; i++) {
+        total += qr->amp[i].re * qr->amp[i].re + qr->amp[i].im * qr->amp[i].im;
+    }
+    assert(fabs(total - 1.0) < 1e-4);
+    free_qreg(qr);
+
+    // Invalid limits & sizes
+    qreg *dense = new_qreg(3);
+    assert(qc_set_mps_limits(dense, 8, 0.0) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_get_mps_info(dense, &bond, &discarded) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(dense);
+    qr = new_qreg_with_storage(3, QC_STORAGE_MPS);
+    assert(qc_set_mps_limits(qr, 0, 0.0) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_set_mps_limits(qr, 8, 1.5) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+    assert(new_qreg_with_storage(MPS_QUBIT_LIMIT + 1, QC_STORAGE_MPS) == NULL);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+
+    printf("MPS truncation pass\n");
+}
+
+int main() {
+    test_mps_matches_dense();
+    test_mps_large_register();
+    test_mps_truncation();
+
+    printf("All MPS tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TRAJECTORIES 4000
+
+// Fraction of the samples where a qubit was measured as 1
+double fraction_of_ones(const uint64_t *counts, int num_qubits, int qubit, uint64_t total) {
+    uint64_t ones = 0;
+    for (uint64_t i = 0; i < (1ULL << num_qubits); i++) {
+        if ((i >> qubit) & 1) {
+            ones += counts[i];
+        }
+    }
+    return (double)ones / total;
+}
+
+// Noiseless circuits only produce their ideal outcomes
+void test_noiseless_trajectories() {
+    const char *layers[] = {"H_0", "CNOT_0_1"};
+    qcircuit *circuit = qc_compile(layers, 2);
+    uint64_t counts[4];
+    assert(qc_run_trajectories(circuit, 2, 100, 10, 0.0, 1, counts) == QC_OK);
+    assert(counts[1] == 0 && counts[2] == 0 && counts[0] + counts[3] == 1000);
+    assert(counts[0] > 400 && counts[3] > 400);
+    qc_free_circuit(circuit);
+
+    printf("Noiseless trajectories pass\n");
+}
+
+// Outcome frequencies converge to the channels' probabilities
+void test_channel_statistics() {
+    const char *flip[] = {"X_0"};
+    uint64_t counts[4];
+
+    // Depolarizing: X & Y (2/3 of the errors) undo the flip
+    qcircuit *circuit = qc_compile(flip, 1);
+    assert(qc_add_noise(circuit, 0, QC_CHANNEL_DEPOLARIZING, 0.3) == QC_OK);
+    assert(qc_run_trajectories(circuit, 1, TRAJECTORIES, 1, 0.0, 2, counts) == QC_OK);
+    assert(fabs((double)counts[0] / TRAJECTORIES - 0.2) < 0.03);
+    qc_free_circuit(circuit);
+
+    // Amplitude damping of |1> and of |+>
+    circuit = qc_compile(flip, 1);
+    assert(qc_add_noise(circuit, QC_ALL_GATES, QC_CHANNEL_AMPLITUDE_DAMPING, 0.25) == QC_OK);
+    assert(qc_run_trajectories(circuit, 1, TRAJECTORIES, 1, 0.0, 3, counts) == QC_OK);
+    assert(fabs((double)counts[0] / TRAJECTORIES - 0.25) < 0.03);
+    qc_free_circuit(circuit);
+
+    const char *plus[] = {"H_1"};
+    circuit = qc_compile(plus, 1);
+    assert(qc_add_noise(circuit, 0, QC_CHANNEL_AMPLITUDE_DAMPING, 0.4) == QC_OK);
+    assert(qc_run_trajectories(circuit, 2, TRAJECTORIES, 4, 0.0, 4, counts) == QC_OK);
+    assert(fabs(fraction_of_ones(counts, 2, 1, 4 * TRAJECTORIES) - 0.3) < 0.03);
+    assert(fraction_of_ones(counts, 2, 0, 4 * TRAJECTORIES) == 0.0);
+    qc_free_circuit(circuit);
+
+    // Readout errors flip every measured bit, noise on a two qubit gate hits both of its qubits
+    const char *pair[] = {"CNOT_0_1"};
+    circuit = qc_compile(pair, 1);
+    assert(qc_run_trajectories(circuit, 2, TRAJECTORIES, 1, 0.1, 5, counts) == QC_OK);
+    assert(fabs(fraction_of_ones(counts, 2, 0, TRAJECTORIES) - 0.1) < 0.03);
+    assert(fabs(fraction_of_ones(counts, 2, 1, TRAJECTORIES) - 0.1) < 0.03);
+    assert(qc_add_noise(circuit, 0, QC_CHANNEL_DEPOLARIZING, 0.6) == QC_OK);
+    assert(qc_run_trajectories(circuit, 2, TRAJECTORIES, 1, 0.0, 6, counts) == QC_OK);
+    assert(fabs(fraction_of_ones(counts, 2, 0, TRAJECTORIES) - 0.4) < 0.03);
+    assert(fabs(fraction_of_ones(counts, 2, 1, TRAJECTORIES) - 0.4) < 0.03);
+    qc_free_circuit(circuit);
+
+    printf("Channel statistics pass\n");
+}
+
+// The counts only depend on the seed, whatever the number of threads
+void test_trajectories_deterministic() {
+    const char *layers[] = {"H_0|H_1|H_2", "CNOT_0_1|RZ_2_0.4", "CCNOT_0_1_2", "RX_1_0.3|H_0"};
+    qcircuit *circuit = qc_compile(layers, 4);
+    assert(qc_add_noise(circuit, QC_ALL_GATES, QC_CHANNEL_DEPOLARIZING, 0.05) == QC_OK);
+    assert(qc_add_noise(circuit, 2, QC_CHANNEL_AMPLITUDE_DAMPING, 0.2) == QC_OK);
+
+    uint64_t serial[8], parallel[8];
+    int threads = qc_get_num_threads();
+    qc_set_num_threads(1);
+    assert(qc_run_trajectories(circuit, 3, 500, 8, 0.02, 7, serial) == QC_OK);
+    qc_set_num_threads(4);
+    assert(qc_run_trajectories(circuit, 3, 500, 8, 0.02, 7, parallel) == QC_OK);
+    qc_set_num_threads(threads);
+    assert(memcmp(serial, parallel, sizeof(serial)) == 0);
+    uint64_t total = 0;
+    for (int i = 0; i < 8; i++) {
+        total += serial[i];
+    }
+    assert(total == 500 * 8);
+    qc_free_circuit(circuit);
+
+    printf("Deterministic trajectories pass\n");
+}
+
+// Single trajectories on a register, & invalid inputs
+void test_run_noisy() {
+    const char *flip[] = {"X_0|X_2"};
+    qcircuit *circuit = qc_compile(flip, 1);
+    assert(qc_circuit_num_gates(circuit) == 2);
+    assert(qc_add_noise(circuit, QC_ALL_GATES, QC_CHANNEL_AMPLITUDE_DAMPING, 1.0) == QC_OK);
+
+    // Certain decay, while qc_run ignores the channels
+    qreg *qr = new_qreg(3);
+    assert(qc_run_noisy(circuit, qr, 1) == QC_OK);
+    assert(fabs(qr->amp[0].re - 1.0) < QC_AMPLITUDE_TOLERANCE);
+    assert(qc_run(circuit, qr) == QC_OK);
+    assert(fabs(qr->amp[5].re - 1.0) < QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+
+    qreg *sparse = new_qreg_with_storage(40, QC_STORAGE_SPARSE);
+    assert(qc_run_noisy(circuit, sparse, 1) == QC_OK);
+    assert(fabs(qc_get_amplitude(sparse, 0).re - 1.0) < QC_AMPLITUDE_TOLERANCE);
+    free_qreg(sparse);
+
+    qreg *mps = new_qreg_with_storage(3, QC_STORAGE_MPS);
+    assert(qc_run_noisy(circuit, mps, 1) == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(mps);
+
+    uint64_t counts[8];
+    assert(qc_add_noise(circuit, 2, QC_CHANNEL_DEPOLARIZING, 0.1) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_add_noise(circuit, 0, QC_CHANNEL_DEPOLARIZING, 1.5) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_add_noise(circuit, 0, (qc_channel)9, 0.1) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_run_trajectories(circuit, 2, 10, 1, 0.0, 1, counts) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_run_trajectories(circuit, 3, 10, 1, -0.1, 1, counts) == QC_ERR_INVALID_ARGUMENT);
+    qc_free_circuit(circuit);
+
+    printf("Run noisy pass\n");
+}
+
+int main() {
+    test_noiseless_trajectories();
+    test_channel_statistics();
+    test_trajectories_deterministic();
+    test_run_noisy();
+
+    printf("All noise tests passed successfully.\n");
+    return 0;
+}
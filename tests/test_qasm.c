@@ -0,0 +1,237 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HEADER "OPENQASM 2.0;\ninclude \"qelib1.inc\";\n"
+
+static const char *write_qasm(const char *name, const char *source) {
+    static char path[2][256];
+    static int next = 0;
+    char *p = path[next];
+    next ^= 1;
+    snprintf(p, 256, "/tmp/qc_test_qasm_%s.qasm", name);
+    FILE *f = fopen(p, "w");
+    assert(f != NULL);
+    fputs(source, f);
+    fclose(f);
+    return p;
+}
+
+// The Grover search of examples/grover_search.c, written in OpenQASM
+void test_qasm_grover() {
+    const char *path = write_qasm("grover", HEADER
+        "// Search space q[0], q[1] & ancilla q[2]\n"
+        "qreg q[3];\n"
+        "x q[2];\n"
+        "h q;\n"
+        "barrier q;\n"
+        "x q[1];\n"
+        "ccx q[0], q[1], q[2];\n"
+        "x q[1];\n"
+        "h q[0]; h q[1];\n"
+        "x q[0]; x q[1];\n"
+        "h q[1]; cx q[0],q[1]; h q[1];\n"
+        "x q[0]; x q[1];\n"
+        "h q[0]; h q[1];\n");
+    qreg *qr = qc_run_qasm(path, QC_STORAGE_DENSE, 1, NULL, 0);
+    assert(qr != NULL);
+
+    const char *layers[] = {"X_2", "H_0|H_1|H_2", "X_1", "CCNOT_0_1_2", "X_1", "H_0|H_1", "X_0|X_1", "H_1",
+                            "CNOT_0_1", "H_1", "X_0|X_1", "H_0|H_1"};
+    qreg *expected = new_qreg(3);
+    for (int l = 0; l < 12; l++) {
+        circuit_layer(expected, layers[l]);
+    }
+    assert_same_state(qr, expected, 10 * QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+    free_qreg(expected);
+    remove(path);
+
+    printf("QASM Grover search pass\n");
+}
+
+// The gates with a layer equivalent, over two registers & with angle expressions
+void test_qasm_layer_gates() {
+    const char *path = write_qasm("layers", HEADER
+        "qreg a[2];\n"
+        "qreg b[2];\n"
+        "h a; h b;\n"
+        "id a[0]; u0(1) a[1];\n"
+        "y a[0]; z a[1]; s b[0]; t b[1];\n"
+        "rx(pi/2) a[0]; ry(-pi/4) a[1]; rz(2*pi/3) b[0]; p(0.25e1) b[1];\n"
+        "u1(sin(pi/6) + 2^-1) a[0];\n"
+        "cx a, b;\n"
+        "cz a[0], a[1]; cp(-0.3) b[0], b[1]; cu1(pi^2/10) a[1], b[0];\n"
+        "swap a[0], b[1];\n"
+        "ccx a[0], a[1], b[0];\n"
+        "barrier a, b;\n"
+        "x a;\n");
+    qreg *qr = qc_run_qasm(path, QC_STORAGE_DENSE, 1, NULL, 0);
+    assert(qr != NULL && qr->size == 4);
+
+    // a is qubits 0 & 1, b is 2 & 3
+    char layers[10][128];
+    snprintf(layers[0], 128, "H_0|H_1|H_2|H_3");
+    snprintf(layers[1], 128, "Y_0|Z_1|S_2|T_3");
+    snprintf(layers[2], 128, "RX_0_%.17g|RY_1_%.17g|RZ_2_%.17g|P_3_2.5", M_PI / 2, -M_PI / 4, 2 * M_PI / 3);
+    snprintf(layers[3], 128, "P_0_1");
+    snprintf(layers[4], 128, "CNOT_0_2|CNOT_1_3");
+    snprintf(layers[5], 128, "MCZ_0_1|MCP_2_3_-0.3|MCP_1_2_%.17g", M_PI * M_PI / 10);
+    snprintf(layers[6], 128, "SWP_0_3");
+    snprintf(layers[7], 128, "CCNOT_0_1_2");
+    snprintf(layers[8], 128, "X_0|X_1");
+    qreg *expected = new_qreg(4);
+    for (int l = 0; l < 9; l++) {
+        circuit_layer(expected, layers[l]);
+    }
+    assert_same_state(qr, expected, 10 * QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+    free_qreg(expected);
+    remove(path);
+
+    printf("QASM layer gates pass\n");
+}
+
+// The other gates match their definitions in qelib1.inc, exactly (global phase included)
+void test_qasm_decompositions() {
+    // Spread the amplitudes so that every entry of the gates matters
+    const char *prepare = HEADER "qreg q[3];\nh q;\nry(0.3) q[0]; rx(1.2) q[1]; rz(-0.4) q[2]; cx q[0], q[2]; ry(2.1) q[1];\n";
+    const char *pairs[][2] = {
+        {"sdg q[1]; tdg q[2];", "s q[1]; s q[1]; s q[1]; t q[2]; t q[2]; t q[2]; t q[2]; t q[2]; t q[2]; t q[2];"},
+        {"sx q[0]; sx q[0];", "x q[0];"},
+        {"u2(0, pi) q[1];", "h q[1];"},
+        {"u3(0.7, -1.3, 2.2) q[2];", "p(2.2) q[2]; ry(0.7) q[2]; p(-1.3) q[2];"},
+        {"u(0.7, -1.3, 2.2) q[2]; U(0.1, 0.2, 0.3) q[0];", "u3(0.7, -1.3, 2.2) q[2]; u3(0.1, 0.2, 0.3) q[0];"},
+        {"cy q[0], q[2];", "sdg q[2]; cx q[0], q[2]; s q[2];"},
+        {"ch q[2], q[1];", "cu3(pi/2, 0, pi) q[2], q[1];"},
+        {"cu3(0.9, 0.4, -1.7) q[1], q[0];",
+         "u1((-1.7+0.4)/2) q[1]; u1((-1.7-0.4)/2) q[0]; cx q[1], q[0]; u3(-0.9/2, 0, -(0.4+-1.7)/2) q[0]; cx q[1], q[0]; u3(0.9/2, 0.4, 0) q[0];"},
+        {"crx(1.3) q[0], q[1];", "cu3(1.3, -pi/2, pi/2) q[0], q[1];"},
+        {"cry(1.3) q[2], q[0];", "ry(1.3/2) q[0]; cx q[2], q[0]; ry(-1.3/2) q[0]; cx q[2], q[0];"},
+        {"crz(0.8) q[1], q[2];", "rz(0.8/2) q[2]; cx q[1], q[2]; rz(-0.8/2) q[2]; cx q[1], q[2];"},
+        {"rzz(1.1) q[0], q[2];", "cx q[0], q[2]; rz(1.1) q[2]; cx q[0], q[2];"},
+        {"cswap q[1], q[0], q[2];", "cx q[2], q[0]; ccx q[1], q[0], q[2]; cx q[2], q[0];"},
+        // Diagonal gates merged within a layer, split by barriers
+        {"rz(0.3) q[0]; cz q[0], q[1]; t q[2]; crz(0.5) q[2], q[0]; rzz(0.2) q[1], q[2]; h q[1]; s q[1];",
+         "rz(0.3) q[0]; barrier q; cz q[0], q[1]; barrier q; t q[2]; barrier q; crz(0.5) q[2], q[0]; barrier q;"
+         "rzz(0.2) q[1], q[2]; barrier q; h q[1]; barrier q; s q[1];"},
+    };
+    const int num_pairs = sizeof(pairs) / sizeof(pairs[0]);
+    for (int i = 0; i < num_pairs; i++) {
+        char source[1024];
+        snprintf(source, sizeof(source), "%s%s\n", prepare, pairs[i][0]);
+        const char *gate = write_qasm("gate", source);
+        snprintf(source, sizeof(source), "%s%s\n", prepare, pairs[i][1]);
+        const char *definition = write_qasm("definition", source);
+        qreg *a = qc_run_qasm(gate, QC_STORAGE_DENSE, 1, NULL, 0);
+        qreg *b = qc_run_qasm(definition, QC_STORAGE_DENSE, 1, NULL, 0);
+        assert(a != NULL && b != NULL);
+        assert_same_state(a, b, 10 * QC_AMPLITUDE_TOLERANCE);
+        free_qreg(a);
+        free_qreg(b);
+        remove(gate);
+        remove(definition);
+    }
+
+    printf("QASM decompositions pass\n");
+}
+
+// Measurements write the classical registers, and other storages run the same files
+void test_qasm_measure() {
+    const char *path = write_qasm("measure", HEADER
+        "qreg q[4];\n"
+        "creg c[4];\n"
+        "creg flag[1];\n"
+        "x q[1]; x q[3];\n"
+        "measure q -> c;\n"
+        "h q[0];\n"
+        "cx q[0], q[2];\n"
+        "measure q[0] -> flag[0];\n"
+        "measure q[2] -> c[2];\n");
+    for (uint64_t seed = 0; seed < 8; seed++) {
+        uint8_t clbits[5];
+        qreg *qr = qc_run_qasm(path, QC_STORAGE_DENSE, seed, clbits, 5);
+        assert(qr != NULL);
+        assert(clbits[0] == 0 && clbits[1] == 1 && clbits[3] == 1);
+        assert(clbits[2] == clbits[4]);
+        free_qreg(qr);
+
+        // The same file on a stabilizer register
+        uint8_t tableau_bits[5];
+        qr = qc_run_qasm(path, QC_STORAGE_STABILIZER, seed, tableau_bits, 5);
+        assert(qr != NULL);
+        assert(tableau_bits[1] == 1 && tableau_bits[2] == tableau_bits[4]);
+        free_qreg(qr);
+    }
+
+    // Too few classical bits
+    uint8_t clbits[4];
+    assert(qc_run_qasm(path, QC_STORAGE_DENSE, 1, clbits, 4) == NULL && qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    remove(path);
+
+    printf("QASM measure pass\n");
+}
+
+// Invalid files are rejected with a status, without a register
+void test_qasm_errors() {
+    const char *invalid[] = {
+        HEADER "qreg q[2];\nfoo q[0];\n",                      // Unknown gate
+        HEADER "qreg q[2];\nh r[0];\n",                        // Undeclared register
+        HEADER "qreg q[2];\nh q[2];\n",                        // Out of range
+        HEADER "qreg q[2];\ncx q[0], q[0];\n",                 // Same qubit twice
+        HEADER "qreg q[2];\nqreg r[3];\ncx q, r;\n",           // Broadcast over different sizes
+        HEADER "qreg q[2];\nrx q[0];\n",                       // Missing parameter
+        HEADER "qreg q[2];\nrx(1, 2) q[0];\n",                 // Extra parameter
+        HEADER "qreg q[2];\nrx(1 + ) q[0];\n",                 // Bad expression
+        HEADER "qreg q[2];\nu3(1, 2, 3 + ) q[0];\n",          // Bad last expression
+        HEADER "qreg q[2];\nu3(1, 2, 3, 4) q[0];\n",          // More than any gate takes
+        HEADER "qreg q[2];\nrx(theta) q[0];\n",                // Unknown identifier
+        HEADER "qreg q[2];\nh q[0]\n",                         // Missing ';'
+        HEADER "qreg q[2];\nh q[0];\nqreg r[1];\n",            // qreg after a gate
+        HEADER "qreg q[2];\nqreg q[1];\n",                     // Declared twice
+        HEADER "qreg q[2];\ngate g a { h a; }\n",              // Gate definitions aren't supported
+        HEADER "qreg q[2];\ncreg c[2];\nif (c == 1) x q[0];\n",
+        HEADER "qreg q[2];\nreset q[0];\n",
+        "OPENQASM 3.0;\nqreg q[1];\n",
+        "OPENQASM 2.0;\ninclude \"other.inc\";\nqreg q[1];\n",
+        "OPENQASM 2.0;\ninclude \"qelib1.inc;\nqreg q[1];\n",  // Unterminated string
+        "OPENQASM 2.0;\n",                                     // No qreg
+    };
+    const int num_invalid = sizeof(invalid) / sizeof(invalid[0]);
+    for (int i = 0; i < num_invalid; i++) {
+        const char *path = write_qasm("invalid", invalid[i]);
+        assert(qc_run_qasm(path, QC_STORAGE_DENSE, 1, NULL, 0) == NULL);
+        assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+        remove(path);
+    }
+
+    assert(qc_run_qasm("/tmp/qc_test_qasm_missing.qasm", QC_STORAGE_DENSE, 1, NULL, 0) == NULL && qc_last_status() == QC_ERR_IO);
+    const char *empty = write_qasm("empty", "");
+    assert(qc_run_qasm(empty, QC_STORAGE_DENSE, 1, NULL, 0) == NULL && qc_last_status() == QC_ERR_IO);
+    remove(empty);
+    assert(qc_run_qasm(NULL, QC_STORAGE_DENSE, 1, NULL, 0) == NULL && qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+
+    // A file not ending with a newline, with a trailing comment
+    const char *path = write_qasm("comment", HEADER "qreg q[1];\nx q[0]; // done");
+    qreg *qr = qc_run_qasm(path, QC_STORAGE_DENSE, 1, NULL, 0);
+    assert(qr != NULL && qr->amp[1].re == 1.0);
+    free_qreg(qr);
+    remove(path);
+
+    printf("QASM errors pass\n");
+}
+
+int main() {
+    test_qasm_grover();
+    test_qasm_layer_gates();
+    test_qasm_decompositions();
+    test_qasm_measure();
+    test_qasm_errors();
+
+    printf("All QASM tests passed successfully.\n");
+    return 0;
+}
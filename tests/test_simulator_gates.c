@@ -1,6 +1,7 @@
 #include "qc_lib.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 
@@ -16,10 +17,13 @@ int state_to_index(const char *state, int num_qubits) {
     return index;
 }
 
+// Expected amplitudes are written with 6 decimals, so they are only compared up to that (or the build's precision)
+#define EXPECTED_TOLERANCE (QC_AMPLITUDE_TOLERANCE > 1e-6 ? QC_AMPLITUDE_TOLERANCE : 1e-6)
+
 // Helper function to assert amplitude of specific state
 void assert_amplitude_re(qreg *qr, const char *state, double expected_real) {
     int index = state_to_index(state, qr->size);
-    assert(fabs(qr->amp[index].re - expected_real) < 1e-6);
+    assert(fabs(qr->amp[index].re - expected_real) < EXPECTED_TOLERANCE);
 }
 
 
@@ -27,8 +31,8 @@ void assert_amplitude_re(qreg *qr, const char *state, double expected_real) {
 void assert_complex_amplitude(qreg *qr, const char *state, double expected_real, double expected_imag) {
     int index = state_to_index(state, qr->size);
     // printf("Expected re %f im %f, actual re %f, im %f\n", expected_real, expected_imag, qr->amp[index].re, qr->amp[index].im);
-    assert(fabs(qr->amp[index].re - expected_real) < 1e-6);
-    assert(fabs(qr->amp[index].im - expected_imag) < 1e-6);
+    assert(fabs(qr->amp[index].re - expected_real) < EXPECTED_TOLERANCE);
+    assert(fabs(qr->amp[index].im - expected_imag) < EXPECTED_TOLERANCE);
 }
 
 // Single simple qubit gate tests
@@ -170,6 +174,108 @@ void test_three_qubit_gates() {
     printf("Three qubit gates pass\n");
 }
 
+// Controlled gates on qubits that are far apart, acting on a superposition
+void test_long_range_controlled_gates() {
+    qreg *qr = new_qreg(6);
+
+    // (|000000> + |100001>)/sqrt(2)
+    circuit_layer(qr, "H_5");
+    circuit_layer(qr, "CNOT_5_0");
+    assert_amplitude_re(qr, "|000000>", 1/sqrt(2));
+    assert_amplitude_re(qr, "|100001>", 1/sqrt(2));
+
+    // Only the |100001> branch has both controls set
+    circuit_layer(qr, "CCNOT_0_5_3");
+    assert_amplitude_re(qr, "|000000>", 1/sqrt(2));
+    assert_amplitude_re(qr, "|101001>", 1/sqrt(2));
+
+    // Reverse-ordered control and target across the register
+    circuit_layer(qr, "CNOT_3_1");
+    assert_amplitude_re(qr, "|101011>", 1/sqrt(2));
+
+    // Swap the outermost qubits, then swap qubits that hold equal values (no change)
+    circuit_layer(qr, "SWP_0_5|SWP_2_4");
+    assert_amplitude_re(qr, "|000000>", 1/sqrt(2));
+    assert_amplitude_re(qr, "|101011>", 1/sqrt(2));
+    circuit_layer(qr, "SWP_5_2");
+    assert_amplitude_re(qr, "|001111>", 1/sqrt(2));
+
+    free_qreg(qr);
+
+    printf("Long range controlled gates pass\n");
+}
+
+// Multi-controlled gates, from layer strings and from the qubit array API
+void test_multi_controlled_gates() {
+    qreg *qr = new_qreg(6);
+
+    // Controls not all set: nothing happens
+    circuit_layer(qr, "X_0|X_2|X_4");
+    circuit_layer(qr, "MCX_0_1_2_4_5");
+    assert_amplitude_re(qr, "|010101>", 1.0);
+
+    // All four controls set: the target flips
+    circuit_layer(qr, "X_1|MCX_0_1_2_4_5");
+    assert_amplitude_re(qr, "|110111>", 1.0);
+
+    // Same gate through the C API, flipping the target back
+    int controls[4] = {4, 2, 1, 0};
+    qc_mcx(qr, controls, 4, 5);
+    assert_amplitude_re(qr, "|010111>", 1.0);
+
+    // Phase gates only touch the amplitude where every qubit is set
+    circuit_layer(qr, "H_3|H_5");
+    circuit_layer(qr, "MCZ_0_1_2_3_4_5");
+    assert_amplitude_re(qr, "|010111>", 0.5);
+    assert_amplitude_re(qr, "|011111>", 0.5);
+    assert_amplitude_re(qr, "|110111>", 0.5);
+    assert_amplitude_re(qr, "|111111>", -0.5);
+
+    int phase_controls[3] = {0, 1, 3};
+    qc_mcp(qr, phase_controls, 3, 5, M_PI / 2);
+    assert_complex_amplitude(qr, "|101011>", 0.0, 0.0);
+    assert_complex_amplitude(qr, "|110111>", 0.5, 0.0);
+    assert_complex_amplitude(qr, "|111111>", 0.0, -0.5);
+
+    char gates_string[64];
+    snprintf(gates_string, sizeof(gates_string), "MCP_5_3_%f", -M_PI / 2);
+    circuit_layer(qr, gates_string);
+    assert_complex_amplitude(qr, "|011111>", 0.5, 0.0);
+    assert_complex_amplitude(qr, "|111111>", -0.5, 0.0);
+
+    qc_mcz(qr, controls, 4, 3);
+    assert_complex_amplitude(qr, "|010111>", 0.5, 0.0);
+    assert_complex_amplitude(qr, "|011111>", -0.5, 0.0);
+    assert_complex_amplitude(qr, "|111111>", 0.5, 0.0);
+
+    free_qreg(qr);
+
+    // Gates the register's engine cannot apply report an error instead of success
+    int wide_controls[13];
+    for (int j = 0; j < 13; j++) {
+        wide_controls[j] = j;
+    }
+    qr = new_qreg_with_storage(20, QC_STORAGE_MPS);
+    qc_mcx(qr, wide_controls, 13, 19);
+    assert(qc_last_status() != QC_OK);
+    free_qreg(qr);
+
+    qr = new_qreg(16);
+    qc_use_dense_engine(1);
+    qc_mcz(qr, controls, 4, 3);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+    circuit_layer(qr, "H_0");
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+    qc_use_dense_engine(0);
+    circuit_layer(qr, "H_0");
+    assert(qc_last_status() == QC_OK);
+    circuit_layer(qr, "H_16");
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+
+    printf("Multi-controlled gates pass\n");
+}
+
 // Parallel gate tests
 void test_parallel_gates() {
     qreg *qr = new_qreg(3);
@@ -205,12 +311,175 @@ void test_parallel_gates() {
     printf("Parallel qubit gates pass\n");
 }
 
-int main() {
+// Phase oracle layers: the diagonal gates of a layer are merged into one pass, which must give the
+// same state as applying them one layer at a time, also when non-diagonal gates are interleaved
+void test_diagonal_layers() {
+    const int num_qubits = 9;
+    const char *oracle = "Z_0|S_1|T_2|RZ_3_0.4|P_4_0.3|MCZ_0_1_5|H_6|MCP_2_6_7_1.2|RZ_8_-0.9|S_6";
+    const char *gates[] = {"Z_0", "S_1", "T_2", "RZ_3_0.4", "P_4_0.3", "MCZ_0_1_5", "H_6", "MCP_2_6_7_1.2", "RZ_8_-0.9", "S_6"};
+    qreg *qr = new_qreg(num_qubits);
+    qreg *expected = new_qreg(num_qubits);
+
+    circuit_layer(qr, "H_0|H_1|H_2|H_3|H_4|H_5|H_6|H_7|H_8");
+    circuit_layer(expected, "H_0|H_1|H_2|H_3|H_4|H_5|H_6|H_7|H_8");
+    circuit_layer(qr, oracle);
+    for (int g = 0; g < 10; g++) {
+        circuit_layer(expected, gates[g]);
+    }
+    for (int i = 0; i < (1 << num_qubits); i++) {
+        assert(fabs(qr->amp[i].re - expected->amp[i].re) < QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(qr->amp[i].im - expected->amp[i].im) < QC_AMPLITUDE_TOLERANCE);
+    }
+
+    // Compiled, the H runs first since no earlier diagonal gate acts on qubit 6, then a single table
+    qcircuit *circuit = qc_compile(&oracle, 1);
+    assert(qc_circuit_num_gates(circuit) == 2);
+    qc_free_circuit(circuit);
+
+    free_qreg(qr);
+    free_qreg(expected);
+
+    printf("Diagonal layers pass\n");
+}
+
+// Permutation gates only move amplitudes around: check every amplitude lands where the classical
+// reversible function sends its index, on a register large enough for long runs of high qubits
+void test_permutation_gates() {
+    const int num_qubits = 14;
+    const uint64_t dim = 1ULL << num_qubits;
+    qreg *qr = new_qreg(num_qubits);
+    char gates_string[64];
+
+    // Distinct amplitudes on the 4 lowest qubits
+    for (int q = 0; q < 4; q++) {
+        snprintf(gates_string, sizeof(gates_string), "RY_%d_%f|RZ_%d_%f", q, 0.3 + 0.4 * q, q, 0.2 * q);
+        circuit_layer(qr, gates_string);
+    }
+    cnum *before = malloc(dim * sizeof(cnum));
+    for (uint64_t i = 0; i < dim; i++) {
+        before[i] = qr->amp[i];
+    }
+
+    circuit_layer(qr, "X_13|X_1");
+    circuit_layer(qr, "CNOT_13_12|SWP_0_11");
+    circuit_layer(qr, "CCNOT_12_11_13|SWP_12_13");
+
+    for (uint64_t i = 0; i < dim; i++) {
+        uint64_t j = i ^ (1ULL << 13) ^ (1ULL << 1);
+        if ((j >> 13) & 1) {
+            j ^= 1ULL << 12;
+        }
+        uint64_t b0 = j & 1, b11 = (j >> 11) & 1;
+        j = (j & ~((1ULL << 0) | (1ULL << 11))) | (b0 << 11) | b11;
+        if (((j >> 12) & 1) && ((j >> 11) & 1)) {
+            j ^= 1ULL << 13;
+        }
+        uint64_t b12 = (j >> 12) & 1, b13 = (j >> 13) & 1;
+        j = (j & ~((1ULL << 12) | (1ULL << 13))) | (b12 << 13) | (b13 << 12);
+
+        assert(qr->amp[j].re == before[i].re && qr->amp[j].im == before[i].im);
+    }
+
+    free(before);
+    free_qreg(qr);
+
+    printf("Permutation gates pass\n");
+}
+
+// Same circuit with every instruction set: the vectorized kernels must match the portable ones
+void test_simd_kernels_consistency() {
+    const int num_qubits = 10;
+    qc_simd widest = qc_get_simd();
+    qreg *reference = NULL;
+    char gates_string[64];
+
+    for (int simd = QC_SIMD_SCALAR; simd <= widest; simd++) {
+        assert(qc_set_simd(simd) == 0);
+        qreg *qr = new_qreg(num_qubits);
+        for (int q = 0; q < num_qubits; q++) {
+            snprintf(gates_string, sizeof(gates_string), "RY_%d_%f|H_%d", q, 0.3 + 0.1 * q, (q + 3) % num_qubits);
+            circuit_layer(qr, gates_string);
+            snprintf(gates_string, sizeof(gates_string), "RX_%d_%f|T_%d|CNOT_%d_%d", q, 1.1 - 0.2 * q, q, q, (q + 1) % num_qubits);
+            circuit_layer(qr, gates_string);
+            snprintf(gates_string, sizeof(gates_string), "RZ_%d_%f|P_%d_%f|Y_%d", q, 0.7 * q, (q + 5) % num_qubits, 0.4, q);
+            circuit_layer(qr, gates_string);
+        }
+
+        if (reference == NULL) {
+            reference = qr;
+            continue;
+        }
+        for (int i = 0; i < (1 << num_qubits); i++) {
+            assert(fabs(qr->amp[i].re - reference->amp[i].re) < QC_AMPLITUDE_TOLERANCE);
+            assert(fabs(qr->amp[i].im - reference->amp[i].im) < QC_AMPLITUDE_TOLERANCE);
+        }
+        free_qreg(qr);
+    }
+    free_qreg(reference);
+    assert(qc_set_simd(widest) == 0);
+
+    printf("SIMD kernels consistency pass\n");
+}
+
+// Rotation matrices are cached by angle: many distinct angles (evicting each other), the same angle
+// for different rotations, and repeated angles must all give the exact matrices
+void test_rotation_cache() {
+    const char *types[] = {"RX", "RY", "RZ", "P"};
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 300; i++) {
+            double angle = -3.0 + 0.02 * i;
+            qreg *qr = new_qreg(1);
+            char gates_string[64];
+            snprintf(gates_string, sizeof(gates_string), "H_0|%s_0_%.17g", types[(i + pass) % 4], angle);
+            circuit_layer(qr, gates_string);
+
+            // Expected amplitudes of the gate applied to |+>
+            double c = cos(angle / 2), s = sin(angle / 2), h = 1 / sqrt(2.0);
+            cnum expected[2];
+            switch ((i + pass) % 4) {
+                case 0: expected[0] = (cnum){c * h, -s * h}; expected[1] = (cnum){c * h, -s * h}; break;
+                case 1: expected[0] = (cnum){(c - s) * h, 0}; expected[1] = (cnum){(s + c) * h, 0}; break;
+                case 2: expected[0] = (cnum){c * h, -s * h}; expected[1] = (cnum){c * h, s * h}; break;
+                default: expected[0] = (cnum){h, 0}; expected[1] = (cnum){cos(angle) * h, sin(angle) * h}; break;
+            }
+            for (int j = 0; j < 2; j++) {
+                assert(fabs(qr->amp[j].re - expected[j].re) < EXPECTED_TOLERANCE);
+                assert(fabs(qr->amp[j].im - expected[j].im) < EXPECTED_TOLERANCE);
+            }
+            free_qreg(qr);
+        }
+    }
+
+    printf("Rotation cache pass\n");
+}
+
+void run_all_gate_tests() {
     test_simple_single_qubit_gates();
     test_two_qubit_gates();
     test_three_qubit_gates();
+    test_long_range_controlled_gates();
+    test_multi_controlled_gates();
     test_parallel_gates();
     test_rotation_gates();
+    test_diagonal_layers();
+}
+
+int main() {
+    // In-place engine (default), with every instruction set the CPU supports
+    qc_simd widest = qc_get_simd();
+    for (int simd = QC_SIMD_SCALAR; simd <= widest; simd++) {
+        assert(qc_set_simd(simd) == 0);
+        run_all_gate_tests();
+    }
+
+    test_simd_kernels_consistency();
+    test_permutation_gates();
+    test_rotation_cache();
+
+    // Dense operator engine, used as a reference to cross-check the in-place kernels
+    qc_use_dense_engine(1);
+    run_all_gate_tests();
+    qc_use_dense_engine(0);
 
     printf("All simulator gate tests passed successfully.\n");
     return 0;
@@ -0,0 +1,152 @@
+#include "qc_lib.h"
+#include "test_common.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+// Every kind of gate must give the same state as the dense kernels, while only storing what's non-zero
+void test_sparse_matches_dense() {
+    const char *layers[] = {
+        "X_0|X_5", "CNOT_5_11", "CCNOT_0_11_3", "SWP_3_8", "MCX_0_5_8_13",   // Permutations
+        "H_2", "CNOT_2_9", "T_9|RZ_0_0.3|S_13", "MCP_2_9_13_0.7|Z_5",        // Diagonals
+        "RY_4_0.4", "H_2", "H_2", "RX_7_1.1|Y_1", "CNOT_7_12",               // Dense matrices
+    };
+    const int num_layers = sizeof(layers) / sizeof(layers[0]);
+    qreg *sparse = new_qreg_with_storage(14, QC_STORAGE_SPARSE);
+    qreg *dense = new_qreg(14);
+    assert(sparse != NULL && qc_get_storage(sparse) == QC_STORAGE_SPARSE);
+    assert(sparse->amp == NULL && qc_num_stored_amplitudes(sparse) == 1);
+
+    for (int l = 0; l < num_layers; l++) {
+        circuit_layer(sparse, layers[l]);
+        circuit_layer(dense, layers[l]);
+        assert_same_state(sparse, dense, QC_AMPLITUDE_TOLERANCE);
+    }
+    assert(qc_get_storage(sparse) == QC_STORAGE_SPARSE);
+    assert(qc_num_stored_amplitudes(sparse) == 8); // H_2 H_2 cancelled out: GHZ pair x RY_4 x RX_7
+
+    // Compiled & fused circuits run through the same instructions
+    qcircuit *circuit = qc_compile(layers, num_layers);
+    qcircuit *fused = qc_fuse(circuit, 3, NULL);
+    assert(qc_run(circuit, sparse) == QC_OK && qc_run(circuit, dense) == QC_OK);
+    assert(qc_run(fused, sparse) == QC_OK && qc_run(fused, dense) == QC_OK);
+    assert_same_state(sparse, dense, QC_AMPLITUDE_TOLERANCE);
+    qc_free_circuit(fused);
+    qc_free_circuit(circuit);
+
+    // Observables agree too
+    const char *paulis[] = {"Z0 Z5", "X2 Y9", "X7 Z12", "Y1"};
+    double sparse_values[4], dense_values[4];
+    assert(qc_pauli_expectations(sparse, paulis, 4, sparse_values) == QC_OK);
+    assert(qc_pauli_expectations(dense, paulis, 4, dense_values) == QC_OK);
+    for (int t = 0; t < 4; t++) {
+        assert(fabs(sparse_values[t] - dense_values[t]) < 1e-6);
+    }
+    assert(qc_measure_qubit(sparse, 7, 3) == qc_measure_qubit(dense, 7, 3));
+    assert_same_state(sparse, dense, QC_AMPLITUDE_TOLERANCE);
+
+    free_qreg(sparse);
+    free_qreg(dense);
+
+    printf("Sparse matches dense pass\n");
+}
+
+// Reversible logic on far more qubits than a dense state vector could hold
+void test_sparse_large_register() {
+    const int n = 62;
+    qreg *qr = new_qreg_with_storage(n, QC_STORAGE_SPARSE);
+    assert(qr != NULL);
+
+    // GHZ state over all the qubits: two amplitudes out of 2^62
+    char layer[32];
+    circuit_layer(qr, "H_0");
+    for (int q = 0; q + 1 < n; q++) {
+        snprintf(layer, sizeof(layer), "CNOT_%d_%d", q, q + 1);
+        circuit_layer(qr, layer);
+    }
+    uint64_t all_ones = (1ULL << n) - 1;
+    assert(qc_num_stored_amplitudes(qr) == 2);
+    assert(fabs(qc_get_amplitude(qr, 0).re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(qc_get_amplitude(qr, all_ones).re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+
+    const char *paulis[] = {"Z0 Z61", "Z30"};
+    double values[2];
+    assert(qc_pauli_expectations(qr, paulis, 2, values) == QC_OK);
+    assert(fabs(values[0] - 1.0) < 1e-6 && fabs(values[1]) < 1e-6);
+
+    uint64_t samples[1000];
+    int ones = 0;
+    assert(qc_measure_all(qr, 1000, 11, samples) == QC_OK);
+    for (int s = 0; s < 1000; s++) {
+        assert(samples[s] == 0 || samples[s] == all_ones);
+        ones += (samples[s] == all_ones);
+    }
+    assert(ones > 400 && ones < 600);
+
+    // Measuring one qubit collapses all of them
+    int result = qc_measure_qubit(qr, 40, 5);
+    assert(qc_num_stored_amplitudes(qr) == 1);
+    assert(fabs(qc_get_amplitude(qr, result ? all_ones : 0).re - 1.0) < QC_AMPLITUDE_TOLERANCE);
+
+    // Too large to ever become dense or be saved
+    assert(qc_to_dense(qr) == QC_ERR_TOO_MANY_QUBITS);
+    assert(qc_save_state(qr, "/tmp/qc_test_sparse.qcs") == QC_ERR_INVALID_ARGUMENT);
+    free_qreg(qr);
+
+    printf("Sparse large register pass\n");
+}
+
+// Registers switch to dense storage once they fill up, and can be converted explicitly
+void test_sparse_conversion() {
+    qreg *qr = new_qreg_with_storage(8, QC_STORAGE_SPARSE);
+    qreg *expected = new_qreg(8);
+    circuit_layer(qr, "H_0|H_1|H_2");
+    circuit_layer(expected, "H_0|H_1|H_2");
+    assert(qc_get_storage(qr) == QC_STORAGE_SPARSE); // 8 amplitudes out of 256
+    circuit_layer(qr, "H_3|H_4");
+    circuit_layer(expected, "H_3|H_4");
+    assert(qc_get_storage(qr) == QC_STORAGE_DENSE && qr->amp != NULL);
+    assert_same_state(qr, expected, QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+
+    qr = new_qreg_with_storage(8, QC_STORAGE_SPARSE);
+    circuit_layer(qr, "X_6|H_1");
+    assert(qc_to_dense(qr) == QC_OK && qc_get_storage(qr) == QC_STORAGE_DENSE);
+    assert(fabs(qr->amp[64].re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+    assert(fabs(qr->amp[66].re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+    assert(qc_num_stored_amplitudes(qr) == 256);
+    free_qreg(qr);
+    free_qreg(expected);
+
+    // Invalid storages & sizes
+    assert(new_qreg_with_storage(SPARSE_QUBIT_LIMIT + 1, QC_STORAGE_SPARSE) == NULL);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+    assert(new_qreg_with_storage(0, QC_STORAGE_SPARSE) == NULL);
+    assert(qc_last_status() == QC_ERR_INVALID_ARGUMENT);
+    assert(new_qreg_with_storage(4, (qc_storage)7) == NULL);
+
+    // A state vector larger than physical memory is refused before touching any page: the register
+    // stays sparse instead of the process being killed
+    uint64_t physical_bytes = (uint64_t)sysconf(_SC_PHYS_PAGES) * (uint64_t)sysconf(_SC_PAGESIZE);
+    if (qc_qreg_bytes(QUBIT_REGISTER_LIMIT) > physical_bytes) {
+        qr = new_qreg_with_storage(QUBIT_REGISTER_LIMIT, QC_STORAGE_SPARSE);
+        circuit_layer(qr, "H_0");
+        assert(qc_to_dense(qr) == QC_ERR_OUT_OF_MEMORY);
+        assert(qc_get_storage(qr) == QC_STORAGE_SPARSE && qc_num_stored_amplitudes(qr) == 2);
+        assert(fabs(qc_get_amplitude(qr, 1).re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+        free_qreg(qr);
+    }
+
+    printf("Sparse conversion pass\n");
+}
+
+int main() {
+    test_sparse_matches_dense();
+    test_sparse_large_register();
+    test_sparse_conversion();
+
+    printf("All sparse state tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Helper function to assert that a stabilizer register agrees with a dense one on every one & two qubit
+// Pauli expectation value
+void assert_same_paulis(qreg *stabilizer, qreg *dense) {
+    static const char letters[] = "XYZ";
+    char term[32];
+    const char *terms[1] = {term};
+    double expected, value;
+    for (int a = 0; a < dense->size; a++) {
+        for (int b = a; b < dense->size; b++) {
+            for (int pa = 0; pa < 3; pa++) {
+                for (int pb = 0; pb < 3; pb++) {
+                    if (a == b) {
+                        snprintf(term, sizeof(term), "%c%d", letters[pa], a);
+                    } else {
+                        snprintf(term, sizeof(term), "%c%d %c%d", letters[pa], a, letters[pb], b);
+                    }
+                    assert(qc_pauli_expectations(stabilizer, terms, 1, &value) == QC_OK);
+                    assert(qc_pauli_expectations(dense, terms, 1, &expected) == QC_OK);
+                    assert(fabs(value - expected) < 1e-4);
+                }
+            }
+        }
+    }
+}
+
+// Random Clifford layers, including gates that are only Clifford once merged or up to a global phase
+void test_stabilizer_matches_dense() {
+    const int n = 6;
+    qreg *stabilizer = new_qreg_with_storage(n, QC_STORAGE_STABILIZER);
+    qreg *dense = new_qreg(n);
+    assert(stabilizer != NULL && qc_get_storage(stabilizer) == QC_STORAGE_STABILIZER);
+    assert(stabilizer->amp == NULL && qc_num_stored_amplitudes(stabilizer) == 0);
+
+    unsigned seed = 2024;
+    char layer[64];
+    for (int l = 0; l < 60; l++) {
+        int a = rand_r(&seed) % n;
+        int b = (a + 1 + rand_r(&seed) % (n - 1)) % n;
+        switch (rand_r(&seed) % 9) {
+            case 0: snprintf(layer, sizeof(layer), "H_%d", a); break;
+            case 1: snprintf(layer, sizeof(layer), "S_%d|X_%d", a, b); break;
+            case 2: snprintf(layer, sizeof(layer), "Y_%d|Z_%d", a, b); break;
+            case 3: snprintf(layer, sizeof(layer), "CNOT_%d_%d", a, b); break;
+            case 4: snprintf(layer, sizeof(layer), "SWP_%d_%d", a, b); break;
+            case 5: snprintf(layer, sizeof(layer), "MCZ_%d_%d|S_%d", a, b, a); break;
+            case 6: snprintf(layer, sizeof(layer), "RZ_%d_%.17g", a, M_PI / 2); break;
+            case 7: snprintf(layer, sizeof(layer), "RX_%d_%.17g|H_%d", a, M_PI, b); break;
+            default: snprintf(layer, sizeof(layer), "P_%d_%.17g|MCP_%d_%d_%.17g", a, -M_PI / 2, a, b, M_PI); break;
+        }
+        circuit_layer(stabilizer, layer);
+        circuit_layer(dense, layer);
+        assert(qc_get_storage(stabilizer) == QC_STORAGE_STABILIZER);
+        assert_same_paulis(stabilizer, dense);
+    }
+
+    // Measurements agree with the dense register for the same seeds
+    for (int q = 0; q < n; q++) {
+        assert(qc_measure_qubit(stabilizer, q, 100 + q) == qc_measure_qubit(dense, q, 100 + q));
+    }
+    assert_same_paulis(stabilizer, dense);
+
+    free_qreg(stabilizer);
+    free_qreg(dense);
+
+    printf("Stabilizer matches dense pass\n");
+}
+
+// A GHZ state over a thousand qubits, far beyond any state vector
+void test_stabilizer_large_register() {
+    const int n = 1000;
+    qreg *qr = new_qreg_with_storage(n, QC_STORAGE_STABILIZER);
+    assert(qr != NULL);
+
+    char layer[32];
+    circuit_layer(qr, "H_0");
+    for (int q = 0; q + 1 < n; q++) {
+        snprintf(layer, sizeof(layer), "CNOT_%d_%d", q, q + 1);
+        circuit_layer(qr, layer);
+    }
+
+    // Parity of all the X factors & pairs of Zs are stabilizers, single Zs are random
+    char *all_x = malloc(8 * n);
+    int len = 0;
+    for (int q = 0; q < n; q++) {
+        len += sprintf(all_x + len, "X%d ", q);
+    }
+    const char *terms[] = {all_x, "Z0 Z999", "Z500", "Y0 Y1"};
+    double values[4];
+    assert(qc_pauli_expectations(qr, terms, 4, values) == QC_OK);
+    assert(values[0] == 1.0 && values[1] == 1.0 && values[2] == 0.0 && values[3] == 0.0);
+    free(all_x);
+
+    // Once one qubit is measured, all the others follow
+    int result = qc_measure_qubit(qr, 500, 9);
+    assert(result == 0 || result == 1);
+    for (int q = 0; q < n; q += 37) {
+        assert(qc_measure_qubit(qr, q, q) == result);
+    }
+
+    // Non-Clifford gates would need a 2^1000 state vector, whole register samples don't fit either
+    const char *t_layer[] = {"T_3"};
+    qcircuit *circuit = qc_compile(t_layer, 1);
+    assert(qc_run(circuit, qr) == QC_ERR_TOO_MANY_QUBITS);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+    assert(qc_get_storage(qr) == QC_STORAGE_STABILIZER);
+    qc_free_circuit(circuit);
+    uint64_t sample;
+    assert(qc_measure_all(qr, 1, 0, &sample) == QC_ERR_INVALID_ARGUMENT);
+    assert(qc_to_dense(qr) == QC_ERR_TOO_MANY_QUBITS);
+    free_qreg(qr);
+
+    printf("Stabilizer large register pass\n");
+}
+
+// The first non-Clifford gate turns the register into the exact state vector of a dense run
+void test_stabilizer_conversion() {
+    const char *layers[] = {"H_0|H_3", "CNOT_0_1|S_3", "MCZ_1_3|Y_2", "SWP_2_4", "H_5|CNOT_3_6"};
+    qreg *qr = new_qreg_with_storage(7, QC_STORAGE_STABILIZER);
+    qreg *expected = new_qreg(7);
+    for (int l = 0; l < 5; l++) {
+        circuit_layer(qr, layers[l]);
+        circuit_layer(expected, layers[l]);
+    }
+    assert(qc_measure_qubit(qr, 1, 4) == qc_measure_qubit(expected, 1, 4));
+
+    // Samples come from the tableau, only outcomes with non-zero amplitudes appear
+    uint64_t samples[200];
+    assert(qc_measure_all(qr, 200, 5, samples) == QC_OK);
+    for (int s = 0; s < 200; s++) {
+        cnum a = expected->amp[samples[s]];
+        assert(a.re * a.re + a.im * a.im > 1e-6);
+    }
+
+    circuit_layer(qr, "T_0|H_6");
+    circuit_layer(expected, "T_0|H_6");
+    assert(qc_get_storage(qr) != QC_STORAGE_STABILIZER);
+    for (uint64_t i = 0; i < 128; i++) {
+        cnum a = qc_get_amplitude(qr, i);
+        assert(fabs(a.re - expected->amp[i].re) < QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(a.im - expected->amp[i].im) < QC_AMPLITUDE_TOLERANCE);
+    }
+    free_qreg(qr);
+    free_qreg(expected);
+
+    // Explicit conversion
+    qr = new_qreg_with_storage(3, QC_STORAGE_STABILIZER);
+    circuit_layer(qr, "H_0|CNOT_0_2");
+    assert(qc_to_dense(qr) == QC_OK && qc_get_storage(qr) == QC_STORAGE_DENSE);
+    assert(fabs(qr->amp[0].re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE && fabs(qr->amp[5].re - M_SQRT1_2) < QC_AMPLITUDE_TOLERANCE);
+    free_qreg(qr);
+
+    assert(new_qreg_with_storage(STABILIZER_QUBIT_LIMIT + 1, QC_STORAGE_STABILIZER) == NULL);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+
+    printf("Stabilizer conversion pass\n");
+}
+
+// Circuits too long for the gate log are rebuilt from the stabilizer generators: the same state as a
+// dense run, up to a global phase
+void test_stabilizer_long_circuit() {
+    const int n = 8;
+    qreg *qr = new_qreg_with_storage(n, QC_STORAGE_STABILIZER);
+    qreg *expected = new_qreg(n);
+    unsigned seed = 7;
+    char layer[64];
+    for (int l = 0; l < 20000; l++) {
+        int a = rand_r(&seed) % n;
+        int b = (a + 1 + rand_r(&seed) % (n - 1)) % n;
+        switch (rand_r(&seed) % 5) {
+            case 0: snprintf(layer, sizeof(layer), "H_%d", a); break;
+            case 1: snprintf(layer, sizeof(layer), "S_%d|X_%d", a, b); break;
+            case 2: snprintf(layer, sizeof(layer), "CNOT_%d_%d", a, b); break;
+            case 3: snprintf(layer, sizeof(layer), "MCZ_%d_%d|Y_%d", a, b, b); break;
+            default: snprintf(layer, sizeof(layer), "SWP_%d_%d", a, b); break;
+        }
+        circuit_layer(qr, layer);
+        circuit_layer(expected, layer);
+    }
+    assert(qc_get_storage(qr) == QC_STORAGE_STABILIZER);
+    circuit_layer(qr, "T_0|H_1");
+    circuit_layer(expected, "T_0|H_1");
+    assert(qc_get_storage(qr) != QC_STORAGE_STABILIZER);
+
+    // Global phase from the largest amplitude
+    uint64_t largest = 0;
+    for (uint64_t i = 0; i < (1ULL << n); i++) {
+        cnum e = expected->amp[i], m = expected->amp[largest];
+        if (e.re * e.re + e.im * e.im > m.re * m.re + m.im * m.im) {
+            largest = i;
+        }
+    }
+    cnum a = qc_get_amplitude(qr, largest), e = expected->amp[largest];
+    double norm = e.re * e.re + e.im * e.im;
+    cnum phase = {(a.re * e.re + a.im * e.im) / norm, (a.im * e.re - a.re * e.im) / norm};
+    assert(fabs(phase.re * phase.re + phase.im * phase.im - 1.0) < 1e-4);
+    for (uint64_t i = 0; i < (1ULL << n); i++) {
+        a = qc_get_amplitude(qr, i);
+        e = expected->amp[i];
+        assert(fabs(a.re - (phase.re * e.re - phase.im * e.im)) < 10 * QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(a.im - (phase.re * e.im + phase.im * e.re)) < 10 * QC_AMPLITUDE_TOLERANCE);
+    }
+    free_qreg(qr);
+    free_qreg(expected);
+
+    // Same for a register too large for a state vector, with a sparse result
+    qr = new_qreg_with_storage(40, QC_STORAGE_STABILIZER);
+    circuit_layer(qr, "H_0");
+    for (int q = 1; q < 40; q++) {
+        snprintf(layer, sizeof(layer), "CNOT_%d_%d", q - 1, q);
+        circuit_layer(qr, layer);
+    }
+    for (int l = 0; l < 20000; l++) {
+        circuit_layer(qr, (l % 2) ? "S_3|X_7" : "S_3|X_7|S_3");
+    }
+    circuit_layer(qr, "T_0");
+    assert(qc_get_storage(qr) == QC_STORAGE_SPARSE && qc_num_stored_amplitudes(qr) == 2);
+    cnum zero = qc_get_amplitude(qr, 0), ones = qc_get_amplitude(qr, (1ULL << 40) - 1);
+    assert(fabs(zero.re * zero.re + zero.im * zero.im - 0.5) < 1e-4);
+    assert(fabs(ones.re * ones.re + ones.im * ones.im - 0.5) < 1e-4);
+    free_qreg(qr);
+
+    printf("Stabilizer long circuit pass\n");
+}
+
+// Automatic storage: Clifford circuits stay on the tableau, the first other gate switches to a state vector
+void test_stabilizer_auto() {
+    const char *clifford_layers[] = {"H_0", "CNOT_0_1|S_2", "MCZ_1_2|H_3", "SWP_0_3"};
+    const char *t_layers[] = {"H_0", "CNOT_0_1|S_2", "T_1", "SWP_0_3"};
+    qcircuit *clifford = qc_compile(clifford_layers, 4);
+    qcircuit *with_t = qc_compile(t_layers, 4);
+    assert(qc_circuit_is_clifford(clifford) && !qc_circuit_is_clifford(with_t));
+
+    qreg *qr = new_qreg_with_storage(4, QC_STORAGE_AUTO);
+    qreg *expected = new_qreg(4);
+    assert(qr != NULL && qc_get_storage(qr) == QC_STORAGE_STABILIZER);
+    assert(qc_run(clifford, qr) == QC_OK && qc_run(clifford, expected) == QC_OK);
+    assert(qc_get_storage(qr) == QC_STORAGE_STABILIZER);
+    assert_same_paulis(qr, expected);
+    assert(qc_run(with_t, qr) == QC_OK && qc_run(with_t, expected) == QC_OK);
+    assert(qc_get_storage(qr) != QC_STORAGE_STABILIZER);
+    for (uint64_t i = 0; i < 16; i++) {
+        cnum a = qc_get_amplitude(qr, i);
+        assert(fabs(a.re - expected->amp[i].re) < QC_AMPLITUDE_TOLERANCE);
+        assert(fabs(a.im - expected->amp[i].im) < QC_AMPLITUDE_TOLERANCE);
+    }
+    free_qreg(qr);
+    free_qreg(expected);
+    qc_free_circuit(clifford);
+    qc_free_circuit(with_t);
+
+    assert(new_qreg_with_storage(64, QC_STORAGE_AUTO) == NULL);
+    assert(qc_last_status() == QC_ERR_TOO_MANY_QUBITS);
+
+    printf("Stabilizer auto storage pass\n");
+}
+
+int main() {
+    test_stabilizer_matches_dense();
+    test_stabilizer_large_register();
+    test_stabilizer_conversion();
+    test_stabilizer_long_circuit();
+    test_stabilizer_auto();
+
+    printf("All stabilizer tests passed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "qc_lib.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// Works in both builds: with "make STATS=1" the counters must follow the work done, otherwise
+// everything must stay at zero and no trace can be written.
+
+static uint64_t gate_count(const qc_stats *stats, const char *type) {
+    for (int t = 0; t < stats->num_gate_types; t++) {
+        if (strcmp(stats->gate_types[t], type) == 0) {
+            return stats->gate_counts[t];
+        }
+    }
+    return 0;
+}
+
+void test_stats_counters() {
+    qc_reset_stats();
+    const char *layers[] = {"H_0|H_1", "CNOT_0_1", "RZ_2_0.5"};
+    qcircuit *circuit = qc_compile(layers, 3);
+    assert(circuit != NULL);
+    qreg *qr = new_qreg(3);
+    assert(qc_run(circuit, qr) == QC_OK);
+    circuit_layer(qr, "H_2");
+
+    qc_stats stats;
+    qc_get_stats(&stats);
+    if (stats.enabled) {
+        assert(stats.phase_calls[QC_PHASE_PARSE] == 2);  // qc_compile + circuit_layer
+        assert(stats.phase_calls[QC_PHASE_LOWER] == 1);
+        assert(stats.phase_calls[QC_PHASE_KERNELS] == 2); // qc_run + circuit_layer
+        assert(stats.state_sweeps == (uint64_t)qc_circuit_num_gates(circuit) + 1);
+        assert(stats.bytes_allocated >= qc_qreg_bytes(3) && stats.allocations > 0);
+        assert(gate_count(&stats, "H") == 3);
+        assert(gate_count(&stats, "CNOT") == 1);
+        assert(gate_count(&stats, "RZ") == 1);
+        assert(gate_count(&stats, "SWP") == 0);
+        assert(strcmp(qc_phase_name(QC_PHASE_KERNELS), "kernels") == 0);
+
+        const char *path = "/tmp/qc_test_trace.json";
+        assert(qc_write_trace(path) == QC_OK);
+        FILE *file = fopen(path, "r");
+        assert(file != NULL);
+        char head[32] = {0};
+        assert(fread(head, 1, sizeof(head) - 1, file) > 0);
+        assert(strstr(head, "traceEvents") != NULL);
+        fclose(file);
+        remove(path);
+
+        // Gates kept on a tableau or a sparse map don't sweep a state vector
+        qreg *stabilizer = new_qreg_with_storage(3, QC_STORAGE_STABILIZER);
+        qreg *sparse = new_qreg_with_storage(20, QC_STORAGE_SPARSE);
+        qc_reset_stats();
+        assert(qc_run(circuit, sparse) == QC_OK);
+        circuit_layer(stabilizer, "H_0|CNOT_0_1|S_2");
+        qc_get_stats(&stats);
+        assert(stats.state_sweeps == 0);
+        free_qreg(stabilizer);
+        free_qreg(sparse);
+
+        qc_reset_stats();
+        qc_get_stats(&stats);
+        assert(stats.state_sweeps == 0 && stats.num_gate_types == 0);
+        printf("Stats counters pass\n");
+    } else {
+        assert(stats.state_sweeps == 0 && stats.bytes_allocated == 0 && stats.allocations == 0 && stats.num_gate_types == 0);
+        for (int p = 0; p < QC_NUM_PHASES; p++) {
+            assert(stats.phase_calls[p] == 0 && stats.phase_seconds[p] == 0.0);
+        }
+        assert(qc_write_trace("/tmp/qc_test_trace.json") == QC_ERR_INVALID_ARGUMENT);
+        printf("Stats disabled pass\n");
+    }
+
+    free_qreg(qr);
+    qc_free_circuit(circuit);
+}
+
+// Parsed gates come from a static table (rotations from a cache) and gate lists from the per-thread layer
+// arena: once the arena has grown to fit a layer (one block at most), layers don't allocate at all
+void test_layer_allocations() {
+    qc_stats stats;
+    qreg *qr = new_qreg(4);
+    const char *layers[] = {"H_0", "H_0|X_1|Y_2|Z_3", "CNOT_0_1|SWP_2_3|T_0", "CCNOT_0_1_2|S_3",
+                            "RX_0_0.3|RY_1_0.4|RZ_2_0.5|P_3_0.6", "MCX_0_1_2_3", "MCZ_3_0_1|MCP_0_1_2_3_0.7"};
+    for (int repeat = 0; repeat < 3; repeat++) {
+        for (int l = 0; l < 7; l++) {
+            qc_reset_stats();
+            circuit_layer(qr, layers[l]);
+            qc_get_stats(&stats);
+            assert(stats.allocations <= (stats.enabled && repeat == 0 && l == 0 ? 1 : 0));
+        }
+    }
+
+    int controls[2] = {0, 1};
+    qc_reset_stats();
+    qc_mcp(qr, controls, 2, 3, 0.25);
+    qc_get_stats(&stats);
+    assert(stats.allocations == 0);
+
+    // The dense engine reuses the register's back buffer: only its first layer allocates a state vector
+    qc_use_dense_engine(1);
+    uint64_t layer_bytes[3];
+    for (int l = 0; l < 3; l++) {
+        qc_reset_stats();
+        circuit_layer(qr, "H_0|CNOT_1_2");
+        qc_get_stats(&stats);
+        layer_bytes[l] = stats.bytes_allocated;
+    }
+    qc_use_dense_engine(0);
+    if (stats.enabled) {
+        assert(layer_bytes[0] == layer_bytes[1] + qc_qreg_bytes(4));
+        assert(layer_bytes[1] == layer_bytes[2]);
+    }
+    free_qreg(qr);
+
+    printf("Layer allocations pass\n");
+}
+
+int main() {
+    test_stats_counters();
+    test_layer_allocations();
+
+    printf("All stats tests passed successfully.\n");
+    return 0;
+}